@@ -0,0 +1,42 @@
+/*
+ * Counts the heap allocations of a process, for the allocation columns of
+ * the compare benchmark. Built on its own as a shared object and preloaded,
+ * so the program itself never replaces the allocator:
+ *
+ *   g++ -O2 -shared -fPIC -o allocation_counter.so allocation_counter.cpp
+ *   LD_PRELOAD=./allocation_counter.so ./key_code --bench compare
+ *
+ * allocation_counter.h finds key_code_allocation_count at run time.
+ */
+#include <atomic>
+#include <cstddef>
+#include <sys/types.h>
+
+#if __GLIBC__
+static std::atomic<u_int64_t> allocation_counter = {};
+
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *p, std::size_t size);
+
+u_int64_t key_code_allocation_count() {
+  return allocation_counter.load(std::memory_order_relaxed);
+}
+
+void *malloc(std::size_t size) noexcept {
+  allocation_counter.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size) noexcept {
+  allocation_counter.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, std::size_t size) noexcept {
+  allocation_counter.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(p, size);
+}
+}
+#endif
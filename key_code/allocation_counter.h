@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <dlfcn.h>
+#include <sys/types.h>
+
+/**
+ * @brief the number of heap allocations the process made, counted by the
+ * shim of allocation_counter.cpp when it is preloaded. It interposes
+ * malloc, calloc and realloc, so allocations of the shared libraries a
+ * benchmark compares against are counted as well as those of operator new.
+ * Without it nothing is interposed and allocations_counted() is false.
+ * Read allocation_count() before and after the code being measured.
+ */
+inline u_int64_t (*allocation_count_function())() {
+  static u_int64_t (*count)() = reinterpret_cast<u_int64_t (*)()>(
+      dlsym(RTLD_DEFAULT, "key_code_allocation_count"));
+  return count;
+}
+
+inline bool allocations_counted() {
+  return allocation_count_function() != nullptr;
+}
+
+inline u_int64_t allocation_count() {
+  u_int64_t (*count)() = allocation_count_function();
+  return count ? count() : 0;
+}
@@ -0,0 +1,502 @@
+#pragma once
+
+#include "common.h"
+#include "key_decoder.h"
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @struct audit_record_t
+ * @brief a key event as the audit log keeps it, 16 bytes.
+ */
+struct audit_record_t {
+  u_int64_t time_ns = {};
+  u_int32_t session = {};
+  u_int16_t vk = {};
+  char c = {};
+  u_int8_t seq_size = {};
+};
+
+/**
+ * @struct audit_batch_t
+ * @brief heads the records of one commit in the file. hash covers the
+ * header up to it and the records, so a batch cut short by a crash is
+ * found and left out when the log is read. Records carry the steady clock,
+ * steady_ns and wall_ns are the steady clock and the wall clock, in ns
+ * since the epoch, read together when the batch was made, the base that
+ * ties the records to real time, see audit_wall_ns.
+ */
+struct audit_batch_t {
+  static constexpr u_int32_t magic_value = 0x4b414c48;
+
+  u_int32_t magic = magic_value;
+  u_int32_t records = {};
+  u_int64_t sequence = {};
+  u_int64_t steady_ns = {};
+  u_int64_t wall_ns = {};
+  u_int64_t hash = {};
+};
+
+/**
+ * @fn audit_wall_ns
+ * @brief the wall clock time of a record of batch, ns since the epoch.
+ */
+inline u_int64_t audit_wall_ns(const audit_batch_t &batch,
+                               const audit_record_t &r) {
+  return batch.wall_ns + r.time_ns - batch.steady_ns;
+}
+
+/**
+ * @struct audit_policy_t
+ * @brief when records are committed. A worker's buffer is handed over once
+ * it holds flush_bytes, and every buffer at least every max_loss_ns / 2,
+ * so a crash loses the records of the last max_loss_ns, as long as a sync
+ * takes less than half of it. A worker that gets max_buffer_bytes ahead of
+ * the disk waits. Without bsync the batches are written but not synced,
+ * for a log that only needs to survive the process.
+ */
+struct audit_policy_t {
+  std::size_t flush_bytes = 64 << 10;
+  std::size_t max_buffer_bytes = 1 << 20;
+  u_int64_t max_loss_ns = 50000000;
+  bool bsync = true;
+};
+
+/**
+ * @struct audit_counters_t
+ * @brief what the log committed. lost are the records of batches that
+ * failed to commit and of every batch after. truncated are the bytes of a
+ * batch torn by a crash cut off the end of the log when it was opened.
+ * age is how old the oldest record of a commit was when its sync
+ * returned, the loss window as it was.
+ */
+struct audit_counters_t {
+  u_int64_t records = {};
+  u_int64_t lost = {};
+  u_int64_t truncated = {};
+  u_int64_t commits = {};
+  u_int64_t syncs = {};
+  u_int64_t bytes = {};
+  u_int64_t waits = {};
+  latency_histogram_t age = {};
+};
+
+/**
+ * @struct audit_scan_t
+ * @brief what reading a log found. whole_bytes hold whole batches,
+ * torn_bytes follow them, the remains of a commit a crash cut short.
+ * bdamaged is set when what follows is not such remains but a log that
+ * was changed, which is left as it is.
+ */
+struct audit_scan_t {
+  u_int64_t records = {};
+  u_int64_t batches = {};
+  u_int64_t last_sequence = {};
+  u_int64_t whole_bytes = {};
+  u_int64_t torn_bytes = {};
+  bool bdamaged = {};
+};
+
+/** @brief pread of len bytes at at, false when the file ends first. */
+inline bool audit_pread(int fd, void *data, std::size_t len, off_t at) {
+  char *p = static_cast<char *>(data);
+  while (len) {
+    ssize_t n = pread(fd, p, len, at);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    at += n;
+    len -= n;
+  }
+  return true;
+}
+
+/**
+ * @fn audit_scan_fd
+ * @brief reads the log open at fd from the start, calling
+ * on_batch(const audit_batch_t &, const audit_record_t *) for every whole
+ * batch, up to the first that is not.
+ */
+template <typename F>
+inline audit_scan_t audit_scan_fd(int fd, F &&on_batch) {
+  audit_scan_t scan = {};
+  struct stat st = {};
+  if (fstat(fd, &st) != 0) {
+    scan.bdamaged = true;
+    return scan;
+  }
+  u_int64_t size = static_cast<u_int64_t>(st.st_size);
+  std::vector<u_int8_t> batch = {};
+  u_int64_t at = {};
+  bool btorn = {};
+  while (at < size) {
+    audit_batch_t header = {};
+    if (size - at < sizeof(header)) {
+      // a header cut short, when it begins as one.
+      const u_int32_t magic = audit_batch_t::magic_value;
+      std::size_t n = std::min<u_int64_t>(size - at, sizeof(magic));
+      btorn = audit_pread(fd, &header, size - at, at) &&
+              memcmp(&header.magic, &magic, n) == 0;
+      break;
+    }
+    if (!audit_pread(fd, &header, sizeof(header), at))
+      break;
+    u_int64_t len = sizeof(header) +
+                    static_cast<u_int64_t>(header.records) *
+                        sizeof(audit_record_t);
+    if (header.magic != audit_batch_t::magic_value || !header.records)
+      break;
+    if (at + len > size) {
+      btorn = true;
+      break;
+    }
+    batch.resize(len);
+    if (!audit_pread(fd, batch.data(), len, at))
+      break;
+    u_int64_t hash = header.hash;
+    header.hash = {};
+    memcpy(batch.data(), &header, sizeof(header));
+    if (block_hash(batch.data(), batch.size()) != hash) {
+      // the last batch, written in part before the crash.
+      btorn = at + len == size;
+      break;
+    }
+    on_batch(header, reinterpret_cast<const audit_record_t *>(
+                         batch.data() + sizeof(header)));
+    scan.records += header.records;
+    scan.batches++;
+    scan.last_sequence = header.sequence;
+    at += len;
+  }
+  if (at < size && !btorn) {
+    // a file extended with zeros before the data reached it.
+    btorn = true;
+    u_int8_t chunk[4096];
+    for (u_int64_t z = at; btorn && z < size; z += sizeof(chunk)) {
+      std::size_t n = std::min<u_int64_t>(sizeof(chunk), size - z);
+      btorn = audit_pread(fd, chunk, n, z) &&
+              std::all_of(chunk, chunk + n, [](u_int8_t b) { return !b; });
+    }
+  }
+  scan.whole_bytes = at;
+  scan.torn_bytes = size - at;
+  scan.bdamaged = at < size && !btorn;
+  return scan;
+}
+
+/**
+ * @class audit_log_t
+ * @brief appends every key event to a file for an audit trail, without a
+ * write per key. Each worker thread appends to its own buffer, taken with
+ * buffer(), under a lock only the committer shares. A committer thread
+ * gathers what the buffers hold into one batch, writes it and syncs it
+ * with fdatasync, so the workers' records share the sync, a group commit.
+ * A failed write or sync turns ok() false and the records of the batch
+ * and of every one after are counted lost.
+ *
+ * Opening the log cuts off a batch a crash left torn at its end, so the
+ * batches appended from then on can be read. A log that is damaged other
+ * than that is not appended to, ok() is false.
+ */
+class audit_log_t {
+public:
+  /**
+   * @class buffer_t
+   * @brief the records of one worker not yet handed to the committer.
+   */
+  class buffer_t {
+  public:
+    explicit buffer_t(audit_log_t &_log) : log(_log) {}
+
+    void append(u_int32_t session, const key_event_t &e, u_int64_t now_ns) {
+      audit_record_t r = {};
+      r.time_ns = now_ns;
+      r.session = session;
+      r.vk = static_cast<u_int16_t>(e.vk);
+      r.c = e.c;
+      r.seq_size = e.seq_size;
+      std::unique_lock<std::mutex> lock(mutex);
+      if (records.empty())
+        oldest_ns = now_ns;
+      records.push_back(r);
+      std::size_t bytes = records.size() * sizeof(audit_record_t);
+      if (bytes < log.policy.flush_bytes)
+        return;
+      if (bytes < log.policy.flush_bytes + sizeof(audit_record_t)) {
+        lock.unlock();
+        log.kick();
+        return;
+      }
+      if (bytes >= log.policy.max_buffer_bytes) {
+        log.waits++;
+        drained.wait(lock, [&] {
+          return records.size() * sizeof(audit_record_t) <
+                     log.policy.max_buffer_bytes ||
+                 log.bfailed;
+        });
+      }
+    }
+
+  private:
+    friend class audit_log_t;
+
+    audit_log_t &log;
+    std::mutex mutex = {};
+    std::condition_variable drained = {};
+    std::vector<audit_record_t> records = {};
+    u_int64_t oldest_ns = {};
+  };
+
+  audit_policy_t policy = {};
+
+  explicit audit_log_t(const char *path,
+                       const audit_policy_t &_policy = {})
+      : policy(_policy) {
+    fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd >= 0 && !repair()) {
+      close(fd);
+      fd = -1;
+    }
+    if (fd >= 0)
+      committer = std::thread([this] { commit_loop(); });
+    else
+      bfailed = true;
+  }
+
+  ~audit_log_t() {
+    if (committer.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        bstop = true;
+      }
+      wake.notify_one();
+      committer.join();
+    }
+    if (fd >= 0)
+      close(fd);
+  }
+
+  audit_log_t(const audit_log_t &) = delete;
+  audit_log_t &operator=(const audit_log_t &) = delete;
+
+  bool ok() const { return fd >= 0 && !bfailed; }
+
+  /**
+   * @fn buffer
+   * @brief a buffer for the calling worker, to keep and append to. It
+   * lives as long as the log.
+   */
+  buffer_t &buffer() {
+    std::lock_guard<std::mutex> lock(mutex);
+    buffers.push_back(std::make_unique<buffer_t>(*this));
+    return *buffers.back();
+  }
+
+  /**
+   * @fn commit
+   * @brief returns once every record appended before the call is on disk,
+   * for a worker that must not go on before it is. False when the log
+   * failed.
+   */
+  bool commit() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!committer.joinable())
+      return false;
+    u_int64_t ticket = ++requested;
+    wake.notify_one();
+    done.wait(lock, [&] { return committed >= ticket; });
+    return !bfailed;
+  }
+
+  /** @brief counters as of the last commit. */
+  audit_counters_t counters() {
+    std::lock_guard<std::mutex> lock(mutex);
+    audit_counters_t c = counts;
+    c.waits = waits;
+    return c;
+  }
+
+private:
+  /**
+   * @brief truncates a torn batch off the end and goes on from the last
+   * sequence number. False for a damaged log.
+   */
+  bool repair() {
+    audit_scan_t scan =
+        audit_scan_fd(fd, [](const audit_batch_t &, const audit_record_t *) {});
+    if (scan.bdamaged)
+      return false;
+    if (scan.torn_bytes) {
+      if (ftruncate(fd, static_cast<off_t>(scan.whole_bytes)) != 0 ||
+          (policy.bsync && fsync(fd) != 0))
+        return false;
+      counts.truncated = scan.torn_bytes;
+    }
+    sequence = scan.batches ? scan.last_sequence + 1 : 0;
+    return true;
+  }
+
+  void kick() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      bfull = true;
+    }
+    wake.notify_one();
+  }
+
+  void commit_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      wake.wait_for(lock, std::chrono::nanoseconds(policy.max_loss_ns / 2),
+                    [&] { return bstop || bfull || requested > committed; });
+      bool blast = bstop;
+      u_int64_t ticket = requested;
+      bfull = false;
+      gather.clear();
+      for (auto &b : buffers)
+        gather.push_back(b.get());
+      lock.unlock();
+      commit_buffers();
+      lock.lock();
+      committed = ticket;
+      done.notify_all();
+      if (blast)
+        return;
+    }
+  }
+
+  /** @brief takes what the gathered buffers hold and commits it. */
+  void commit_buffers() {
+    batch.resize(sizeof(audit_batch_t));
+    u_int64_t oldest = ~u_int64_t{};
+    for (buffer_t *p : gather) {
+      buffer_t &b = *p;
+      {
+        std::lock_guard<std::mutex> lock(b.mutex);
+        if (!b.records.empty()) {
+          std::size_t at = batch.size();
+          std::size_t len = b.records.size() * sizeof(audit_record_t);
+          batch.resize(at + len);
+          memcpy(batch.data() + at, b.records.data(), len);
+          oldest = std::min(oldest, b.oldest_ns);
+          b.records.clear();
+        }
+      }
+      b.drained.notify_all();
+    }
+    std::size_t records =
+        (batch.size() - sizeof(audit_batch_t)) / sizeof(audit_record_t);
+    if (!records)
+      return;
+    if (bfailed) {
+      std::lock_guard<std::mutex> lock(mutex);
+      counts.lost += records;
+      return;
+    }
+
+    audit_batch_t header = {};
+    header.records = static_cast<u_int32_t>(records);
+    header.sequence = sequence++;
+    header.steady_ns = steady_now_ns();
+    header.wall_ns = static_cast<u_int64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count());
+    memcpy(batch.data(), &header, sizeof(header));
+    header.hash = block_hash(batch.data(), batch.size());
+    memcpy(batch.data(), &header, sizeof(header));
+
+    bool bwritten = true;
+    for (std::size_t at = 0; at < batch.size() && bwritten;) {
+      ssize_t n = write(fd, batch.data() + at, batch.size() - at);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        bwritten = false;
+      else
+        at += n;
+    }
+    bool bsynced = bwritten && (!policy.bsync || fdatasync(fd) == 0);
+    u_int64_t now = steady_now_ns();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!bsynced) {
+      counts.lost += records;
+      bfailed = true;
+      for (auto &b : buffers) {
+        // taken so a worker about to wait sees bfailed or the notify.
+        { std::lock_guard<std::mutex> taken(b->mutex); }
+        b->drained.notify_all();
+      }
+      return;
+    }
+    counts.records += records;
+    counts.commits++;
+    counts.syncs += policy.bsync;
+    counts.bytes += batch.size();
+    counts.age.record(now - std::min(oldest, now));
+  }
+
+  int fd = -1;
+  std::thread committer = {};
+  std::mutex mutex = {};
+  std::condition_variable wake = {};
+  std::condition_variable done = {};
+  std::vector<std::unique_ptr<buffer_t>> buffers = {};
+  std::vector<buffer_t *> gather = {};
+  bool bstop = {};
+  bool bfull = {};
+  std::atomic<bool> bfailed = {};
+  u_int64_t requested = {};
+  u_int64_t committed = {};
+  std::atomic<u_int64_t> waits = {};
+  u_int64_t sequence = {};
+  std::vector<u_int8_t> batch = {};
+  audit_counters_t counts = {};
+};
+
+/**
+ * @fn audit_read
+ * @brief calls on_record(const audit_record_t &) for every record of the
+ * log at path, batch by batch, up to the first batch that is not whole.
+ * on_record may take the record's wall clock time, audit_wall_ns, as a
+ * second argument.
+ */
+template <typename F>
+inline audit_scan_t audit_read(const char *path, F &&on_record) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return {};
+  audit_scan_t scan = audit_scan_fd(
+      fd, [&](const audit_batch_t &header, const audit_record_t *records) {
+        for (std::size_t i = 0; i < header.records; i++) {
+          audit_record_t r = {};
+          memcpy(&r, records + i, sizeof(r));
+          if constexpr (std::is_invocable_v<F, const audit_record_t &,
+                                            u_int64_t>)
+            on_record(r, audit_wall_ns(header, r));
+          else
+            on_record(r);
+        }
+      });
+  close(fd);
+  return scan;
+}
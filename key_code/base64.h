@@ -0,0 +1,325 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <sys/types.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define BASE64_X86_SIMD 1
+#endif
+
+/**
+ * @enum base64_impl_t
+ * @brief the block decoder used by base64_stream_t. The default is chosen
+ * once from the cpu features at start up. The others are there so the
+ * benchmark can compare them against each other.
+ */
+enum class base64_impl_t { scalar, ssse3, avx2 };
+
+/**
+ * @fn base64_sextet_table
+ * @brief the scalar lookup table. Values 0 - 63 are the decoded sextet.
+ * base64_skip marks white space that may appear within wrapped payloads,
+ * base64_pad marks '=' and base64_bad is anything else.
+ */
+constexpr u_int8_t base64_skip = 0x80;
+constexpr u_int8_t base64_pad = 0x81;
+constexpr u_int8_t base64_bad = 0xff;
+
+constexpr std::array<u_int8_t, 256> base64_sextet_table() {
+  std::array<u_int8_t, 256> t = {};
+  for (std::size_t i = 0; i < t.size(); i++)
+    t[i] = base64_bad;
+  for (int i = 0; i < 26; i++) {
+    t['A' + i] = static_cast<u_int8_t>(i);
+    t['a' + i] = static_cast<u_int8_t>(26 + i);
+  }
+  for (int i = 0; i < 10; i++)
+    t['0' + i] = static_cast<u_int8_t>(52 + i);
+  t['+'] = 62;
+  t['/'] = 63;
+  t['='] = base64_pad;
+  t[' '] = t['\t'] = t['\r'] = t['\n'] = base64_skip;
+  return t;
+}
+
+constexpr std::array<u_int8_t, 256> base64_sextets = base64_sextet_table();
+
+#if BASE64_X86_SIMD
+/**
+ * @fn base64_block_ssse3
+ * @brief decodes 16 base64 characters into 12 bytes. The character class is
+ * found by range compares, the sextets are merged with two multiply adds
+ * and a final shuffle packs the three bytes of every lane together. 16 bytes
+ * are stored so the caller must have that much room at out. Returns false
+ * without writing when the block holds anything other than the 64 alphabet
+ * characters, the scalar path then takes that block.
+ */
+__attribute__((target("ssse3"))) inline bool
+base64_block_ssse3(const char *in, u_int8_t *out) {
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+
+  const __m128i upper =
+      _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                    _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+  const __m128i lower =
+      _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+                    _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+  const __m128i digit =
+      _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                    _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+  const __m128i plus = _mm_cmpeq_epi8(v, _mm_set1_epi8('+'));
+  const __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+
+  const __m128i valid =
+      _mm_or_si128(_mm_or_si128(upper, lower),
+                   _mm_or_si128(_mm_or_si128(digit, plus), slash));
+  if (_mm_movemask_epi8(valid) != 0xffff)
+    return false;
+
+  __m128i shift = _mm_and_si128(upper, _mm_set1_epi8(-65));
+  shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(-71)));
+  shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(4)));
+  shift = _mm_or_si128(shift, _mm_and_si128(plus, _mm_set1_epi8(19)));
+  shift = _mm_or_si128(shift, _mm_and_si128(slash, _mm_set1_epi8(16)));
+  const __m128i sextets = _mm_add_epi8(v, shift);
+
+  // aaaaaabb bbbbcccc ccdddddd packed into the low 24 bits of each lane.
+  const __m128i pairs =
+      _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+  const __m128i quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+  const __m128i packed = _mm_shuffle_epi8(
+      quads, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1,
+                           -1));
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(out), packed);
+  return true;
+}
+
+/**
+ * @fn base64_block_avx2
+ * @brief the same as base64_block_ssse3 for 32 characters into 24 bytes. The
+ * two lanes are compacted with a cross lane permute. 32 bytes are stored.
+ */
+__attribute__((target("avx2"))) inline bool
+base64_block_avx2(const char *in, u_int8_t *out) {
+  const __m256i v =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in));
+
+  const __m256i upper =
+      _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+  const __m256i lower =
+      _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+  const __m256i digit =
+      _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+  const __m256i plus = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('+'));
+  const __m256i slash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));
+
+  const __m256i valid =
+      _mm256_or_si256(_mm256_or_si256(upper, lower),
+                      _mm256_or_si256(_mm256_or_si256(digit, plus), slash));
+  if (static_cast<unsigned>(_mm256_movemask_epi8(valid)) != 0xffffffffu)
+    return false;
+
+  __m256i shift = _mm256_and_si256(upper, _mm256_set1_epi8(-65));
+  shift = _mm256_or_si256(shift,
+                          _mm256_and_si256(lower, _mm256_set1_epi8(-71)));
+  shift = _mm256_or_si256(shift,
+                          _mm256_and_si256(digit, _mm256_set1_epi8(4)));
+  shift = _mm256_or_si256(shift,
+                          _mm256_and_si256(plus, _mm256_set1_epi8(19)));
+  shift = _mm256_or_si256(shift,
+                          _mm256_and_si256(slash, _mm256_set1_epi8(16)));
+  const __m256i sextets = _mm256_add_epi8(v, shift);
+
+  const __m256i pairs =
+      _mm256_maddubs_epi16(sextets, _mm256_set1_epi32(0x01400140));
+  const __m256i quads =
+      _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+  const __m256i packed = _mm256_shuffle_epi8(
+      quads, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1,
+                              -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                              -1, -1, -1, -1));
+  const __m256i compact = _mm256_permutevar8x32_epi32(
+      packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), compact);
+  return true;
+}
+#endif
+
+/**
+ * @fn base64_detect_impl
+ * @brief picks the widest block decoder the processor supports.
+ */
+inline base64_impl_t base64_detect_impl() {
+#if BASE64_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return base64_impl_t::avx2;
+  if (__builtin_cpu_supports("ssse3"))
+    return base64_impl_t::ssse3;
+#endif
+  return base64_impl_t::scalar;
+}
+
+/**
+ * @class base64_stream_t
+ * @brief a streaming base64 decoder. Input may be split at any character
+ * boundary across calls, the partial quad is carried within the object.
+ * Decoded bytes are written straight into the caller's buffer. When that
+ * buffer fills, decode returns with the input partly consumed and the caller
+ * drains the buffer and calls again with the remainder. Nothing is
+ * allocated.
+ */
+class base64_stream_t {
+public:
+  /**
+   * @struct result_t
+   * @brief consumed - characters of input used, produced - bytes written.
+   */
+  struct result_t {
+    std::size_t consumed = {};
+    std::size_t produced = {};
+  };
+
+  base64_stream_t() : impl(default_impl()) {}
+  explicit base64_stream_t(base64_impl_t _impl) : impl(_impl) {}
+
+  /**
+   * @fn default_impl
+   * @brief the block decoder selected once for this processor.
+   */
+  static base64_impl_t default_impl() {
+    static const base64_impl_t detected = base64_detect_impl();
+    return detected;
+  }
+
+  /**
+   * @fn reset
+   * @brief prepares the object for a new payload.
+   */
+  void reset() {
+    quad = {};
+    quad_size = {};
+    padded = {};
+    bad_input = {};
+  }
+
+  /**
+   * @fn error
+   * @brief true when characters outside of the alphabet were seen. They are
+   * skipped, the remaining payload still decodes.
+   */
+  bool error() const { return bad_input; }
+
+  /**
+   * @fn decode
+   * @brief decodes as much of in as fits within out_cap bytes of out.
+   */
+  result_t decode(const char *in, std::size_t len, u_int8_t *out,
+                  std::size_t out_cap) {
+    result_t r = {};
+
+    // finish a quad carried over from the last call first so the block
+    // decoders always start on a quad boundary.
+    while (quad_size != 0 && r.consumed < len) {
+      if (!scalar_step(in[r.consumed], out, out_cap, r.produced))
+        return r;
+      r.consumed++;
+    }
+
+    while (r.consumed < len) {
+#if BASE64_X86_SIMD
+      if (!padded && impl == base64_impl_t::avx2) {
+        while (len - r.consumed >= 32 && out_cap - r.produced >= 32 &&
+               base64_block_avx2(in + r.consumed, out + r.produced)) {
+          r.consumed += 32;
+          r.produced += 24;
+        }
+      }
+      if (!padded && impl != base64_impl_t::scalar) {
+        while (len - r.consumed >= 16 && out_cap - r.produced >= 16 &&
+               base64_block_ssse3(in + r.consumed, out + r.produced)) {
+          r.consumed += 16;
+          r.produced += 12;
+        }
+      }
+#endif
+
+      // the tail, or a block holding padding or a stray character. At least
+      // a block worth is taken here, then back to the block decoders once
+      // aligned on a quad again.
+      std::size_t scalar_end = r.consumed + 16;
+      while (r.consumed < len) {
+        if (!scalar_step(in[r.consumed], out, out_cap, r.produced))
+          return r;
+        r.consumed++;
+        if (quad_size == 0 && r.consumed >= scalar_end)
+          break;
+      }
+    }
+    return r;
+  }
+
+private:
+  /**
+   * @fn scalar_step
+   * @brief feeds a single character. Returns false, without consuming it,
+   * when the bytes it completes would not fit within the output.
+   */
+  bool scalar_step(char ch, u_int8_t *out, std::size_t out_cap,
+                   std::size_t &produced) {
+    u_int8_t s = base64_sextets[static_cast<u_int8_t>(ch)];
+
+    if (s < 64) {
+      if (padded) {
+        // data after padding starts a new concatenated payload.
+        padded = false;
+      }
+      if (quad_size == 3 && out_cap - produced < 3)
+        return false;
+      quad = (quad << 6) | s;
+      if (++quad_size == 4) {
+        out[produced++] = static_cast<u_int8_t>(quad >> 16);
+        out[produced++] = static_cast<u_int8_t>(quad >> 8);
+        out[produced++] = static_cast<u_int8_t>(quad);
+        quad = {};
+        quad_size = {};
+      }
+      return true;
+    }
+
+    if (s == base64_pad) {
+      if (padded || quad_size < 2) {
+        padded = true;
+        quad = {};
+        quad_size = {};
+        return true;
+      }
+      std::size_t n = quad_size - 1;
+      if (out_cap - produced < n)
+        return false;
+      u_int32_t v = quad << (6 * (4 - quad_size));
+      out[produced++] = static_cast<u_int8_t>(v >> 16);
+      if (n == 2)
+        out[produced++] = static_cast<u_int8_t>(v >> 8);
+      quad = {};
+      quad_size = {};
+      padded = true;
+      return true;
+    }
+
+    if (s != base64_skip)
+      bad_input = true;
+    return true;
+  }
+
+  base64_impl_t impl = {};
+  u_int32_t quad = {};
+  u_int8_t quad_size = {};
+  bool padded = {};
+  bool bad_input = {};
+};
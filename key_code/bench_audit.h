@@ -0,0 +1,241 @@
+#pragma once
+
+#include "audit_log.h"
+#include "benchmark.h"
+#include "common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @struct audit_run_t
+ * @brief keys logged by the workers and what it cost them.
+ */
+struct audit_run_t {
+  u_int64_t keys = {};
+  double ns_per_key = {};
+  u_int64_t writes = {};
+  u_int64_t syncs = {};
+};
+
+/**
+ * @fn audit_key
+ * @brief the n'th key of a session, letters and now and then a cursor key.
+ */
+inline key_event_t audit_key(u_int64_t n) {
+  key_event_t e = {};
+  if (n % 8 == 7) {
+    e.vk = vkey_t::DOWN_ARROW;
+    e.seq_size = 3;
+  } else {
+    e.c = static_cast<char>('a' + n % 26);
+    e.seq_size = 1;
+  }
+  return e;
+}
+
+/**
+ * @fn run_audit
+ * @brief threads workers each type keys keys round robin over sessions
+ * sessions, logged by log_key(worker, session, event). With per_ms the
+ * keys come at that many a millisecond per worker, else flat out.
+ */
+template <typename F>
+inline audit_run_t run_audit(int threads, int sessions, u_int64_t keys,
+                             u_int64_t per_ms, F &&log_key) {
+  audit_run_t run = {};
+  run.keys = keys * threads;
+  benchmark_timer_t timer;
+  std::vector<std::thread> workers = {};
+  for (int w = 0; w < threads; w++)
+    workers.emplace_back([&, w] {
+      auto tick = std::chrono::steady_clock::now();
+      for (u_int64_t n = 0; n < keys; n++) {
+        if (per_ms && n % per_ms == 0) {
+          tick += std::chrono::milliseconds(1);
+          std::this_thread::sleep_until(tick);
+        }
+        u_int32_t session = static_cast<u_int32_t>(w * sessions +
+                                                   n % sessions);
+        log_key(w, session, audit_key(n / sessions));
+      }
+    });
+  for (auto &w : workers)
+    w.join();
+  run.ns_per_key = timer.elapsed_ns() / run.keys;
+  return run;
+}
+
+/**
+ * @fn bench_audit
+ * @brief an audit log of every key of 4 workers with 1000 sessions each: a
+ * write per key as the demo's printf per event does, a write and
+ * fdatasync per key, and audit_log_t committing batches with a 50 ms and
+ * a 10 ms loss window. Reported are the cost per key to the workers, the
+ * writes and syncs, and how old the oldest record of a commit was once it
+ * was synced, against the window. The log read back must hold every key
+ * of every session in order, and with its last batch cut short as by a
+ * crash, every batch before it. Opened again, the log must cut the torn
+ * batch off, so what is appended after the crash can be read, with wall
+ * clock times of now.
+ */
+inline int bench_audit() {
+  int ret = EXIT_SUCCESS;
+  const int threads = 4;
+  const int sessions = 1000;
+  char path[] = "/tmp/key_code_audit_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    printf("audit cannot create a file in /tmp\n");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+
+  auto record_of = [](u_int32_t session, const key_event_t &e) {
+    audit_record_t r = {};
+    r.time_ns = steady_now_ns();
+    r.session = session;
+    r.vk = static_cast<u_int16_t>(e.vk);
+    r.c = e.c;
+    r.seq_size = e.seq_size;
+    return r;
+  };
+  auto report = [](const std::string &name, const audit_run_t &run) {
+    benchmark_report("audit", name + " per key", run.ns_per_key, "ns");
+    benchmark_report("audit", name + " writes", run.writes, "writes");
+    benchmark_report("audit", name + " syncs", run.syncs, "syncs");
+  };
+
+  // a record written as each key is handled, then also synced.
+  for (bool bsync : {false, true}) {
+    int out = open(path, O_WRONLY | O_TRUNC | O_APPEND | O_CLOEXEC);
+    audit_run_t run =
+        run_audit(threads, sessions, bsync ? 500 : 50000, 0,
+                  [&](int, u_int32_t session, const key_event_t &e) {
+                    audit_record_t r = record_of(session, e);
+                    if (write(out, &r, sizeof(r)) != sizeof(r) ||
+                        (bsync && fdatasync(out) != 0))
+                      ret = EXIT_FAILURE;
+                  });
+    close(out);
+    run.writes = run.keys;
+    run.syncs = bsync ? run.keys : 0;
+    report(bsync ? "write and sync" : "write", run);
+  }
+
+  // flat out, then 20 keys a millisecond per worker for the loss window.
+  struct batched_t {
+    u_int64_t loss_ms;
+    u_int64_t keys;
+    u_int64_t per_ms;
+  } batched[] = {{50, 250000, 0}, {50, 10000, 20}, {10, 10000, 20}};
+  u_int64_t keys = {};
+  for (auto &b : batched) {
+    if (truncate(path, 0) != 0)
+      ret = EXIT_FAILURE;
+    keys = b.keys;
+    audit_policy_t policy = {};
+    policy.max_loss_ns = b.loss_ms * 1000000;
+    audit_counters_t c = {};
+    audit_run_t run = {};
+    {
+      audit_log_t log(path, policy);
+      std::vector<audit_log_t::buffer_t *> buffers = {};
+      for (int w = 0; w < threads; w++)
+        buffers.push_back(&log.buffer());
+      run = run_audit(threads, sessions, keys, b.per_ms,
+                      [&](int w, u_int32_t session, const key_event_t &e) {
+                        buffers[w]->append(session, e, steady_now_ns());
+                      });
+      if (!log.commit() || !log.ok())
+        ret = EXIT_FAILURE;
+      c = log.counters();
+    }
+    run.writes = c.commits;
+    run.syncs = c.syncs;
+    std::string name = "batched " + std::to_string(b.loss_ms) + " ms";
+    if (b.per_ms)
+      name += " paced";
+    else
+      benchmark_report("audit", name + " per key", run.ns_per_key, "ns");
+    benchmark_report("audit", name + " writes", run.writes, "writes");
+    benchmark_report("audit", name + " age p99", c.age.percentile(99) / 1e6,
+                     "ms");
+    benchmark_report("audit", name + " age max", c.age.max() / 1e6, "ms");
+    if (c.records != run.keys ||
+        (b.per_ms && c.age.max() > policy.max_loss_ns)) {
+      printf("audit %s: %lu of %lu keys, oldest %.1f ms\n", name.c_str(),
+             static_cast<unsigned long>(c.records),
+             static_cast<unsigned long>(run.keys), c.age.max() / 1e6);
+      ret = EXIT_FAILURE;
+    }
+  }
+
+  // every key of a session, in the order typed.
+  std::vector<u_int64_t> seen(threads * sessions);
+  bool border = true;
+  audit_scan_t scan = audit_read(path, [&](const audit_record_t &r) {
+    u_int64_t n = seen[r.session]++;
+    key_event_t e = audit_key(n);
+    border = border && r.vk == static_cast<u_int16_t>(e.vk) && r.c == e.c &&
+             r.seq_size == e.seq_size;
+  });
+  if (scan.records != keys * threads || scan.torn_bytes || !border) {
+    printf("audit log read back %lu records, out of order %d\n",
+           static_cast<unsigned long>(scan.records), !border);
+    ret = EXIT_FAILURE;
+  }
+
+  // a crash in the middle of writing the last batch.
+  struct stat st = {};
+  stat(path, &st);
+  if (truncate(path, st.st_size - 7) != 0)
+    ret = EXIT_FAILURE;
+  audit_scan_t torn = audit_read(path, [](const audit_record_t &) {});
+  benchmark_report("audit", "torn batch left out", torn.torn_bytes, "bytes");
+  if (torn.batches + 1 != scan.batches || !torn.torn_bytes) {
+    printf("audit log with a torn batch read %lu of %lu batches\n",
+           static_cast<unsigned long>(torn.batches),
+           static_cast<unsigned long>(scan.batches));
+    ret = EXIT_FAILURE;
+  }
+
+  // the next run after the crash.
+  audit_counters_t c = {};
+  {
+    audit_log_t log(path);
+    audit_log_t::buffer_t &b = log.buffer();
+    for (u_int64_t n = 0; n < 100; n++)
+      b.append(0, audit_key(n), steady_now_ns());
+    if (!log.commit() || !log.ok())
+      ret = EXIT_FAILURE;
+    c = log.counters();
+  }
+  u_int64_t now = static_cast<u_int64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count());
+  u_int64_t off_ns = {};
+  audit_scan_t after =
+      audit_read(path, [&](const audit_record_t &, u_int64_t wall_ns) {
+        off_ns = std::max(off_ns, wall_ns > now ? wall_ns - now
+                                                : now - wall_ns);
+      });
+  benchmark_report("audit", "torn batch cut off", c.truncated, "bytes");
+  if (c.truncated != torn.torn_bytes || after.torn_bytes ||
+      after.records != torn.records + 100 || off_ns > 60000000000ull) {
+    printf("audit log after a crash read %lu of %lu records\n",
+           static_cast<unsigned long>(after.records),
+           static_cast<unsigned long>(torn.records + 100));
+    ret = EXIT_FAILURE;
+  }
+  unlink(path);
+  return ret;
+}
@@ -0,0 +1,467 @@
+#pragma once
+
+#include "allocation_counter.h"
+#include "bench_terminals.h"
+#include "benchmark.h"
+#include "common.h"
+#include "key_decoder.h"
+#include "terminal_corpus.h"
+#include "terminal_policy.h"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+
+/*
+ * The libraries compared against are optional. key_code is built by hand,
+ * without a configure step, so nothing detects them: define HAVE_NCURSES,
+ * HAVE_TERMKEY or HAVE_NOTCURSES on the command line for those installed
+ * on the build machine and link them, for example
+ *
+ *   g++ -O2 -DHAVE_NCURSES -DHAVE_TERMKEY key_code.cpp -lncurses -ltermkey
+ *
+ * or let pkg-config find them, one at a time so a missing one is left out:
+ *
+ *   for p in ncurses:NCURSES termkey:TERMKEY notcurses-core:NOTCURSES; do
+ *     pkg-config --exists ${p%:*} || continue
+ *     defs="$defs -DHAVE_${p#*:}" libs="$libs $(pkg-config --libs ${p%:*})"
+ *   done
+ *   g++ -O2 $defs key_code.cpp $libs
+ *
+ * A library that is not defined is reported as not built. Allocations are
+ * counted when the shim of allocation_counter.cpp is preloaded, otherwise
+ * they are reported as not counted.
+ */
+#if HAVE_NCURSES
+#define NCURSES_NOMACROS
+#include <ncurses.h>
+#endif
+#if HAVE_TERMKEY
+#include <termkey.h>
+#endif
+#if HAVE_NOTCURSES
+#include <notcurses/notcurses.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#endif
+
+/**
+ * @struct compare_result_t
+ * @brief what one decoder measured over the corpus. keys is the number of
+ * key events it produced, which differs from the keystrokes in the corpus
+ * for the sequences it does not know. esc_ms is the time from a lone ESC
+ * reaching the terminal to it being reported, with the decoder's defaults.
+ */
+struct compare_result_t {
+  bool bbuilt = {};
+  double ns = {};
+  std::size_t keys = {};
+  u_int64_t allocations = {};
+  double esc_ms = -1;
+};
+
+/**
+ * @class pty_pair_t
+ * @brief a pseudo terminal, the benchmark writes to master what a terminal
+ * would send and the decoder reads slave.
+ */
+class pty_pair_t {
+public:
+  pty_pair_t() {
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+      return;
+    slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  }
+
+  ~pty_pair_t() {
+    if (slave >= 0)
+      close(slave);
+    if (master >= 0)
+      close(master);
+  }
+
+  pty_pair_t(const pty_pair_t &) = delete;
+  pty_pair_t &operator=(const pty_pair_t &) = delete;
+
+  bool valid() const { return master >= 0 && slave >= 0; }
+
+  int master = -1;
+  int slave = -1;
+};
+
+/**
+ * @fn compare_key_code
+ * @brief this project's decoder, fed 4 KB reads. The ESC wait is the read
+ * loop of key_code.cpp: raw mode with VMIN 1 and VTIME 0, and while a
+ * sequence is pending a poll of a tenth of a second before each read,
+ * flushed when the poll times out.
+ */
+template <typename DECODER>
+inline compare_result_t compare_key_code(const std::string &stream) {
+  const std::size_t read_size = 4096;
+  compare_result_t result = {};
+  result.bbuilt = true;
+
+  DECODER decoder;
+  auto on_key = [&](const key_event_t &e) {
+    result.keys++;
+    benchmark_keep(e);
+  };
+  u_int64_t allocations = allocation_count();
+  benchmark_timer_t timer;
+  for (std::size_t pos = 0; pos < stream.size(); pos += read_size)
+    decoder.feed(stream.data() + pos, std::min(read_size, stream.size() - pos),
+                 on_key);
+  decoder.flush(on_key);
+  result.ns = timer.elapsed_ns();
+  result.allocations = allocation_count() - allocations;
+
+  pty_pair_t pty;
+  if (!pty.valid())
+    return result;
+  struct termios raw = {};
+  tcgetattr(pty.slave, &raw);
+  cfmakeraw(&raw);
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
+  tcsetattr(pty.slave, TCSANOW, &raw);
+
+  bool besc = {};
+  auto on_esc = [&](const key_event_t &e) { besc |= e.vk == vkey_t::ESC; };
+  char buffer[64] = {};
+  u_int64_t start = steady_now_ns();
+  if (write(pty.master, "\x1b", 1) != 1)
+    return result;
+  ssize_t n = read(pty.slave, buffer, sizeof(buffer));
+  if (n > 0)
+    decoder.feed(buffer, n, on_esc);
+  while (!besc && decoder.escape_pending()) {
+    struct pollfd p = {pty.slave, POLLIN, 0};
+    n = poll(&p, 1, 100) > 0 ? read(pty.slave, buffer, sizeof(buffer)) : 0;
+    if (n > 0)
+      decoder.feed(buffer, n, on_esc);
+    else
+      decoder.flush(on_esc);
+  }
+  if (besc)
+    result.esc_ms = (steady_now_ns() - start) / 1e6;
+  return result;
+}
+
+#if HAVE_NCURSES
+/**
+ * @fn compare_ncurses
+ * @brief wgetch with keypad on, reading the corpus from a file. ESCDELAY
+ * is left at its default.
+ */
+inline compare_result_t compare_ncurses(const std::string &stream,
+                                        const char *term) {
+  compare_result_t result = {};
+  FILE *in = tmpfile();
+  FILE *out = fopen("/dev/null", "w");
+  if (!in || !out ||
+      fwrite(stream.data(), 1, stream.size(), in) != stream.size()) {
+    if (in)
+      fclose(in);
+    if (out)
+      fclose(out);
+    return result;
+  }
+  rewind(in);
+
+  SCREEN *screen = newterm(term, out, in);
+  if (screen) {
+    result.bbuilt = true;
+    cbreak();
+    noecho();
+    keypad(stdscr, TRUE);
+    u_int64_t allocations = allocation_count();
+    benchmark_timer_t timer;
+    int ch = {};
+    while ((ch = wgetch(stdscr)) != ERR) {
+      result.keys++;
+      benchmark_keep(ch);
+    }
+    result.ns = timer.elapsed_ns();
+    result.allocations = allocation_count() - allocations;
+    endwin();
+    delscreen(screen);
+  }
+  fclose(in);
+  fclose(out);
+  if (!result.bbuilt)
+    return result;
+
+  pty_pair_t pty;
+  if (!pty.valid())
+    return result;
+  FILE *tty_in = fdopen(dup(pty.slave), "r");
+  FILE *tty_out = fdopen(dup(pty.slave), "w");
+  screen = tty_in && tty_out ? newterm(term, tty_out, tty_in) : nullptr;
+  if (screen) {
+    cbreak();
+    noecho();
+    keypad(stdscr, TRUE);
+    u_int64_t start = steady_now_ns();
+    if (write(pty.master, "\x1b", 1) == 1 && wgetch(stdscr) == 27)
+      result.esc_ms = (steady_now_ns() - start) / 1e6;
+    endwin();
+    delscreen(screen);
+  }
+  if (tty_in)
+    fclose(tty_in);
+  if (tty_out)
+    fclose(tty_out);
+  return result;
+}
+#endif
+
+#if HAVE_TERMKEY
+/**
+ * @fn compare_termkey
+ * @brief an abstract libtermkey instance the corpus is pushed into 4 KB at
+ * a time, and termkey_waitkey on the pty for the ESC wait.
+ */
+inline compare_result_t compare_termkey(const std::string &stream,
+                                        const char *term) {
+  compare_result_t result = {};
+  TermKey *tk = termkey_new_abstract(term, TERMKEY_FLAG_UTF8);
+  if (!tk)
+    return result;
+  result.bbuilt = true;
+  termkey_set_buffer_size(tk, 4096);
+
+  TermKeyKey key = {};
+  u_int64_t allocations = allocation_count();
+  benchmark_timer_t timer;
+  std::size_t pos = {};
+  while (pos < stream.size()) {
+    pos += termkey_push_bytes(tk, stream.data() + pos, stream.size() - pos);
+    while (termkey_getkey(tk, &key) == TERMKEY_RES_KEY)
+      result.keys++;
+  }
+  while (termkey_getkey_force(tk, &key) == TERMKEY_RES_KEY)
+    result.keys++;
+  result.ns = timer.elapsed_ns();
+  result.allocations = allocation_count() - allocations;
+  termkey_destroy(tk);
+
+  pty_pair_t pty;
+  if (!pty.valid())
+    return result;
+  tk = termkey_new(pty.slave, TERMKEY_FLAG_UTF8);
+  if (!tk)
+    return result;
+  u_int64_t start = steady_now_ns();
+  if (write(pty.master, "\x1b", 1) == 1 &&
+      termkey_waitkey(tk, &key) == TERMKEY_RES_KEY)
+    result.esc_ms = (steady_now_ns() - start) / 1e6;
+  termkey_destroy(tk);
+  return result;
+}
+#endif
+
+#if HAVE_NOTCURSES
+/**
+ * @fn compare_notcurses
+ * @brief notcurses input needs its controlling terminal, so it runs in a
+ * child whose terminal is the pty. The parent answers the device
+ * attributes query notcurses waits on at start, then writes the corpus and
+ * the lone ESC. The decode time includes the pty.
+ */
+inline compare_result_t compare_notcurses(const std::string &stream,
+                                          std::size_t expected) {
+  struct report_t {
+    double ns = {};
+    std::size_t keys = {};
+    u_int64_t allocations = {};
+    u_int64_t esc_time = {};
+  };
+  compare_result_t result = {};
+  pty_pair_t pty;
+  int report[2] = {-1, -1};
+  if (!pty.valid() || pipe(report) != 0)
+    return result;
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(report[0]);
+    setsid();
+    ioctl(pty.slave, TIOCSCTTY, 0);
+    dup2(pty.slave, STDIN_FILENO);
+    dup2(pty.slave, STDOUT_FILENO);
+    notcurses_options options = {};
+    options.flags = NCOPTION_SUPPRESS_BANNERS | NCOPTION_NO_ALTERNATE_SCREEN |
+                    NCOPTION_NO_QUIT_SIGHANDLERS | NCOPTION_NO_WINCH_SIGHANDLER;
+    struct notcurses *nc = notcurses_core_init(&options, stdout);
+    report_t r = {};
+    const char ready = {};
+    if (nc) {
+      if (write(report[1], &ready, 1) != 1)
+        _exit(EXIT_FAILURE);
+      ncinput ni = {};
+      struct timespec wait = {0, 200'000'000};
+      u_int64_t allocations = {};
+      benchmark_timer_t timer;
+      while (r.keys < expected) {
+        u_int32_t id = notcurses_get(nc, &wait, &ni);
+        if (id == 0 || id == static_cast<u_int32_t>(-1))
+          break;
+        if (r.keys++ == 0) {
+          allocations = allocation_count();
+          timer.restart();
+        }
+      }
+      r.ns = timer.elapsed_ns();
+      r.allocations = allocation_count() - allocations;
+      if (write(report[1], &ready, 1) != 1)
+        _exit(EXIT_FAILURE);
+      if (notcurses_get_blocking(nc, &ni) == NCKEY_ESC)
+        r.esc_time = steady_now_ns();
+      notcurses_stop(nc);
+    }
+    ssize_t n = write(report[1], &r, sizeof(r));
+    _exit(n == sizeof(r) ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  close(report[1]);
+  if (pid < 0) {
+    close(report[0]);
+    return result;
+  }
+
+  // answer device attributes until the child reports it started.
+  char byte = {};
+  fcntl(pty.master, F_SETFL, O_NONBLOCK);
+  fcntl(report[0], F_SETFL, O_NONBLOCK);
+  std::string queries = {};
+  while (read(report[0], &byte, 1) != 1) {
+    char buffer[256] = {};
+    ssize_t n = read(pty.master, buffer, sizeof(buffer));
+    if (n > 0)
+      queries.append(buffer, n);
+    if (queries.find("\x1b[c") != std::string::npos) {
+      queries.clear();
+      if (write(pty.master, "\x1b[?62;22c", 10) != 10)
+        break;
+    }
+    if (waitpid(pid, nullptr, WNOHANG) == pid) {
+      close(report[0]);
+      return result;
+    }
+    usleep(1000);
+  }
+  result.bbuilt = true;
+  fcntl(pty.master, F_SETFL, 0);
+  fcntl(report[0], F_SETFL, 0);
+
+  std::size_t pos = {};
+  while (pos < stream.size()) {
+    ssize_t n = write(pty.master, stream.data() + pos, stream.size() - pos);
+    if (n <= 0)
+      break;
+    pos += n;
+  }
+  report_t r = {};
+  u_int64_t start = {};
+  if (read(report[0], &byte, 1) == 1) {
+    start = steady_now_ns();
+    if (write(pty.master, "\x1b", 1) != 1)
+      start = 0;
+  }
+  if (read(report[0], &r, sizeof(r)) == sizeof(r)) {
+    result.ns = r.ns;
+    result.keys = r.keys;
+    result.allocations = r.allocations;
+    if (start && r.esc_time > start)
+      result.esc_ms = (r.esc_time - start) / 1e6;
+  }
+  close(report[0]);
+  waitpid(pid, nullptr, 0);
+  return result;
+}
+#endif
+
+/**
+ * @fn report_compare
+ * @brief one decoder's rows. ns/key is per keystroke of the corpus, so
+ * decoders that split unknown sequences into several events are not
+ * credited for the extra events.
+ */
+inline void report_compare(const std::string &name,
+                           const compare_result_t &result,
+                           std::size_t expected) {
+  if (!result.bbuilt) {
+    printf("compare      %-40s not built\n", name.c_str());
+    return;
+  }
+  benchmark_report("compare", name + " decode", result.ns / expected,
+                   "ns/key");
+  benchmark_report("compare", name + " events",
+                   static_cast<double>(result.keys), "keys");
+  if (allocations_counted())
+    benchmark_report("compare", name + " allocations",
+                     static_cast<double>(result.allocations), "allocs");
+  else
+    printf("compare      %-40s not counted\n",
+           (name + " allocations").c_str());
+  if (result.esc_ms >= 0)
+    benchmark_report("compare", name + " ESC latency", result.esc_ms, "ms");
+  else
+    printf("compare      %-40s not measured\n",
+           (name + " ESC latency").c_str());
+}
+
+/**
+ * @fn bench_compare
+ * @brief this decoder against ncurses wgetch, libtermkey and notcurses,
+ * side by side over the same byte stream: the xterm profile of the
+ * terminal corpus with typing between the keys. Reported are the decode
+ * cost per keystroke, the key events produced against the keystrokes in
+ * the stream, the heap allocations while decoding and how long a lone ESC
+ * takes to be reported. Our decoders have to produce every keystroke.
+ */
+inline int bench_compare() {
+  const std::size_t stream_size = 1 << 20;
+  const terminal_profile_t &profile = terminal_corpus().front();
+  std::size_t expected = {};
+  std::string stream = corpus_stream(profile, stream_size, expected);
+  int ret = EXIT_SUCCESS;
+
+  benchmark_report("compare", std::string(profile.name) + " keystrokes",
+                   static_cast<double>(expected), "keys");
+
+  compare_result_t map = compare_key_code<key_decoder_t>(stream);
+  compare_result_t xterm =
+      compare_key_code<basic_key_decoder_t<xterm_policy_t>>(stream);
+  if (map.keys != expected || xterm.keys != expected) {
+    printf("compare: key_code decoded %lu and %lu keys of %lu\n", map.keys,
+           xterm.keys, expected);
+    ret = EXIT_FAILURE;
+  }
+  report_compare("key_code map", map, expected);
+  report_compare("key_code xterm", xterm, expected);
+
+  compare_result_t result = {};
+#if HAVE_NCURSES
+  result = compare_ncurses(stream, profile.term);
+#endif
+  report_compare("ncurses wgetch", result, expected);
+
+  result = {};
+#if HAVE_TERMKEY
+  result = compare_termkey(stream, profile.term);
+#endif
+  report_compare("libtermkey", result, expected);
+
+  result = {};
+#if HAVE_NOTCURSES
+  result = compare_notcurses(stream, expected);
+#endif
+  report_compare("notcurses", result, expected);
+  return ret;
+}
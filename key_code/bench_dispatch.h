@@ -0,0 +1,182 @@
+#pragma once
+
+#include "benchmark.h"
+#include "key_dispatcher.h"
+#include "latency_histogram.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @struct dispatch_run_t
+ * @brief how late the cheap keys were handled, and what the dispatcher
+ * found out about the bindings.
+ */
+struct dispatch_run_t {
+  latency_histogram_t lag = {};
+  std::vector<binding_stats_t> stats = {};
+  u_int64_t stalls_seen = {};
+  u_int64_t stalls_while_running = {};
+  u_int64_t ticks_idle = {};
+};
+
+/**
+ * @fn dispatch_editor_session
+ * @brief an editor's bindings: j and k move the cursor, a microsecond of
+ * work, F5 refreshes from a server, 6 ms of waiting, and x exports the
+ * buffer once, blocking for 15 ms. Keys arrive a millisecond apart, mostly
+ * j and k, F5 every fiftieth, x once half way. A key is handled as soon as
+ * it arrived and the keys before it were, the lag of j and k from their
+ * arrival is what a slow handler costs the keys behind it.
+ */
+inline dispatch_run_t dispatch_editor_session(u_int32_t offload_after) {
+  dispatch_run_t run = {};
+  watchdog_policy_t policy = {};
+  policy.budget_ns = 2000000;
+  policy.offload_after = offload_after;
+  policy.linger_ms = 200;
+  std::atomic<bool> bexporting = {};
+  {
+    key_dispatcher_t dispatcher(policy);
+    dispatcher.on_stall = [&](const std::string &name, u_int64_t) {
+      run.stalls_seen++;
+      if (name == "export" && bexporting)
+        run.stalls_while_running++;
+    };
+    auto move = [](const key_event_t &e) {
+      u_int64_t h = static_cast<u_int8_t>(e.c);
+      for (int i = 0; i < 400; i++)
+        h = h * 0x100000001b3 ^ static_cast<u_int64_t>(i);
+      benchmark_keep(h);
+    };
+    dispatcher.bind("down", 'j', move);
+    dispatcher.bind("up", 'k', move);
+    dispatcher.bind(
+        "refresh", vkey_t::F5,
+        [](const key_event_t &) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(6));
+        },
+        true);
+    dispatcher.bind("export", 'x', [&](const key_event_t &) {
+      bexporting = true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(15));
+      bexporting = false;
+    });
+
+    const int keys = 2000;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < keys; n++) {
+      auto arrival = start + std::chrono::milliseconds(n);
+      std::this_thread::sleep_until(arrival);
+      key_event_t e = {};
+      if (n == keys / 2)
+        e.c = 'x';
+      else if (n % 50 == 49)
+        e.vk = vkey_t::F5;
+      else
+        e.c = n % 3 ? 'j' : 'k';
+      auto begin = std::chrono::steady_clock::now();
+      dispatcher.dispatch(e);
+      if (e.c == 'j' || e.c == 'k')
+        run.lag.record(static_cast<u_int64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(begin -
+                                                                 arrival)
+                .count()));
+    }
+    dispatcher.drain();
+    run.stats = dispatcher.statistics();
+
+    // the watchdog lingers, then must sleep.
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    u_int64_t ticks = dispatcher.watchdog_ticks();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    run.ticks_idle = dispatcher.watchdog_ticks() - ticks;
+  }
+  return run;
+}
+
+/**
+ * @fn bench_dispatch
+ * @brief the cost of timing every handler call, against calling through a
+ * map, and the editor session with the watchdog only flagging and with it
+ * offloading. Reported are the lag of the cheap keys behind the slow ones
+ * and the statistics of the bindings in the dump format. The statistics
+ * must name refresh as the binding most often over budget, export must
+ * have been flagged while it still ran, the watchdog must sleep once keys
+ * stop, and offloading refresh must cut the lag at p95. The p99 takes in
+ * the keys behind export and behind refresh before it was offloaded.
+ */
+inline int bench_dispatch() {
+  int ret = EXIT_SUCCESS;
+
+  {
+    const int calls = 2000000;
+    u_int64_t sink = {};
+    std::unordered_map<int, std::function<void(const key_event_t &)>>
+        plain = {};
+    plain['j'] = [&](const key_event_t &e) { sink += e.c; };
+    key_dispatcher_t dispatcher;
+    dispatcher.bind("down", 'j', [&](const key_event_t &e) { sink += e.c; });
+    key_event_t e = {};
+    e.c = 'j';
+    benchmark_timer_t timer;
+    for (int i = 0; i < calls; i++)
+      plain.find(e.c)->second(e);
+    double plain_ns = timer.elapsed_ns() / calls;
+    timer.restart();
+    for (int i = 0; i < calls; i++)
+      dispatcher.dispatch(e);
+    double timed_ns = timer.elapsed_ns() / calls;
+    benchmark_keep(sink);
+    benchmark_report("dispatch", "plain call", plain_ns, "ns/key");
+    benchmark_report("dispatch", "timed call", timed_ns, "ns/key");
+  }
+
+  const char *names[] = {"flag only", "offload"};
+  double p95[2] = {};
+  for (int m = 0; m < 2; m++) {
+    dispatch_run_t run = dispatch_editor_session(m ? 3 : 0);
+    std::string name = names[m];
+    p95[m] = run.lag.percentile(95) / 1e6;
+    benchmark_report("dispatch", name + " key lag p50",
+                     run.lag.percentile(50) / 1e6, "ms");
+    benchmark_report("dispatch", name + " key lag p95", p95[m], "ms");
+    benchmark_report("dispatch", name + " key lag p99",
+                     run.lag.percentile(99) / 1e6, "ms");
+    benchmark_report("dispatch", name + " key lag max", run.lag.max() / 1e6,
+                     "ms");
+    print_handler_statistics(stdout, run.stats);
+
+    const binding_stats_t *worst = {};
+    for (auto &s : run.stats)
+      if (!worst || s.over_budget > worst->over_budget)
+        worst = &s;
+    if (!worst || worst->name != "refresh" || !run.stats[3].stalls ||
+        !run.stalls_while_running) {
+      printf("dispatch %s: the statistics blame the wrong binding\n",
+             names[m]);
+      ret = EXIT_FAILURE;
+    }
+    if (m == 1 && (!run.stats[2].boffloaded || !run.stats[2].offloaded)) {
+      printf("dispatch %s: refresh was not offloaded\n", names[m]);
+      ret = EXIT_FAILURE;
+    }
+    if (run.ticks_idle) {
+      printf("dispatch %s: the watchdog ticked %lu times while idle\n",
+             names[m], static_cast<unsigned long>(run.ticks_idle));
+      ret = EXIT_FAILURE;
+    }
+  }
+  if (p95[1] >= p95[0]) {
+    printf("dispatch: offloading did not cut the lag\n");
+    ret = EXIT_FAILURE;
+  }
+  return ret;
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "benchmark.h"
+#include "key_decoder.h"
+#include "local_echo.h"
+#include "screen.h"
+
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @class remote_shell_t
+ * @brief the far end of the simulated session, a shell with a line editor
+ * on an 80x24 screen. Characters insert at the cursor, BACKSPACE and the
+ * arrows edit the line and ENTER runs it. A line starting with sudo asks
+ * for a password, which is not echoed.
+ */
+class remote_shell_t {
+public:
+  remote_shell_t() : screen(24, 80) { prompt(prompt_text); }
+
+  void key(const key_event_t &e) {
+    if (e.vk == vkey_t::ENTER) {
+      enter();
+    } else if (e.vk == vkey_t::BACKSPACE) {
+      if (cursor > 0)
+        line.erase(--cursor, 1);
+    } else if (e.vk == vkey_t::LEFT_ARROW) {
+      cursor = std::max(cursor - 1, 0);
+    } else if (e.vk == vkey_t::RIGHT_ARROW) {
+      cursor = std::min(cursor + 1, static_cast<int>(line.size()));
+    } else if (e.vk == vkey_t::none) {
+      line.insert(line.begin() + cursor++, e.c);
+    }
+    draw_line();
+  }
+
+  int cursor_row() const { return row; }
+  int cursor_col() const { return bsecret ? start : start + cursor; }
+
+  screen_grid_t screen;
+
+private:
+  void prompt(const char *text) {
+    start = screen.put_text(row, 0, text);
+    line.clear();
+    cursor = {};
+  }
+
+  void newline() {
+    if (++row == screen.rows()) {
+      screen.scroll_up();
+      row--;
+    }
+  }
+
+  void enter() {
+    std::string command = line;
+    bool bpassword = bsecret;
+    bsecret = false;
+    newline();
+    if (!bpassword && command.compare(0, 5, "sudo ") == 0) {
+      bsecret = true;
+      prompt("[sudo] password for user: ");
+      return;
+    }
+    if (!command.empty() || bpassword) {
+      for (int n = 0; n < 3; n++) {
+        std::string text = "output " + std::to_string(n) + " of " +
+                           (bpassword ? "sudo" : command);
+        screen.put_text(row, 0, text.c_str());
+        newline();
+      }
+    }
+    prompt(prompt_text);
+  }
+
+  void draw_line() {
+    if (bsecret)
+      return;
+    std::string text = line + std::string(screen.columns(), ' ');
+    screen.put_text(row, start, text.c_str());
+  }
+
+  static constexpr const char *prompt_text = "user@host:~$ ";
+  int row = {};
+  int start = {};
+  std::string line = {};
+  int cursor = {};
+  bool bsecret = {};
+};
+
+/**
+ * @struct typed_key_t
+ * @brief a keystroke of the typing script and when it is typed.
+ */
+struct typed_key_t {
+  u_int64_t time = {};
+  key_event_t e = {};
+};
+
+/**
+ * @fn typing_script
+ * @brief someone typing commands at 80 to 200 ms a key. Now and then a
+ * wrong key is corrected with BACKSPACE, or a word is fixed in the middle
+ * of the line with the arrows. One command asks for a password.
+ */
+inline std::vector<typed_key_t> typing_script() {
+  const char *commands[] = {"ls -la",
+                            "cd src/key_code",
+                            "git status",
+                            "grep -rn escape_pending *.h",
+                            "sudo make install",
+                            "./key_code --bench echo",
+                            "vi local_echo.h",
+                            "git commit -am 'wip'",
+                            "history | tail",
+                            "exit"};
+  std::mt19937 rng(80);
+  auto random = [&rng](unsigned range) {
+    return static_cast<unsigned>(rng() % range);
+  };
+  std::vector<typed_key_t> keys = {};
+  u_int64_t now = 1'000'000'000;
+
+  auto type = [&](vkey_t vk, char c) {
+    now += (80 + random(120)) * 1'000'000ull;
+    typed_key_t k = {};
+    k.time = now;
+    k.e.vk = vk;
+    k.e.c = c;
+    keys.push_back(k);
+  };
+
+  for (auto command : commands) {
+    std::string text = command;
+    for (std::size_t i = 0; i < text.size(); i++) {
+      if (random(20) == 0) {
+        type(vkey_t::none, static_cast<char>('a' + random(26)));
+        type(vkey_t::BACKSPACE, 0);
+      }
+      type(vkey_t::none, text[i]);
+      if (i > 4 && random(25) == 0) {
+        type(vkey_t::LEFT_ARROW, 0);
+        type(vkey_t::LEFT_ARROW, 0);
+        type(vkey_t::none, 'x');
+        type(vkey_t::BACKSPACE, 0);
+        type(vkey_t::RIGHT_ARROW, 0);
+        type(vkey_t::RIGHT_ARROW, 0);
+      }
+    }
+    type(vkey_t::ENTER, 0);
+    now += 1'500'000'000;
+    if (text.compare(0, 5, "sudo ") == 0) {
+      for (char c : std::string("hunter2"))
+        type(vkey_t::none, c);
+      type(vkey_t::ENTER, 0);
+      now += 1'500'000'000;
+    }
+  }
+  return keys;
+}
+
+/**
+ * @struct echo_result_t
+ * @brief what one simulated session measured.
+ */
+struct echo_result_t {
+  latency_histogram_t perceived = {};
+  latency_histogram_t round_trip = {};
+  u_int64_t predictions = {};
+  u_int64_t mispredicted = {};
+  u_int64_t rollbacks = {};
+  bool bconsistent = {};
+};
+
+/**
+ * @fn simulate_echo
+ * @brief plays the typing script against remote_shell_t over a link with
+ * the given round trip, plus up to 20% jitter. The shell answers every key
+ * with its screen and the count of keys so far. The client draws a frame
+ * every 16 ms and whenever a key is typed or an update arrives. After the
+ * last update the overlay has to be the server screen exactly.
+ */
+inline echo_result_t simulate_echo(const std::vector<typed_key_t> &keys,
+                                   u_int64_t rtt_ns, bool bpredict) {
+  struct update_t {
+    u_int64_t time = {};
+    screen_grid_t screen = {};
+    int row = {};
+    int col = {};
+    u_int64_t acked = {};
+  };
+  const u_int64_t frame_ns = 16'000'000;
+
+  remote_shell_t shell;
+  local_echo_t echo;
+  if (!bpredict)
+    echo.display_threshold_ns = ~u_int64_t{};
+  std::mt19937 rng(static_cast<unsigned>(rtt_ns));
+  std::deque<update_t> link = {};
+  screen_grid_t display = {};
+  int row = {};
+  int col = {};
+  u_int64_t next_frame = {};
+  u_int64_t arrival = {};
+
+  echo.server_update(shell.screen, shell.cursor_row(), shell.cursor_col(), 0,
+                     0);
+
+  auto advance = [&](u_int64_t until) {
+    for (;;) {
+      bool bupdate = !link.empty() && link.front().time <= next_frame;
+      u_int64_t t = bupdate ? link.front().time : next_frame;
+      if (t > until)
+        return;
+      if (bupdate) {
+        auto &u = link.front();
+        echo.server_update(u.screen, u.row, u.col, u.acked, t);
+        link.pop_front();
+      } else {
+        next_frame += frame_ns;
+      }
+      echo.overlay(display, row, col, t);
+    }
+  };
+
+  u_int64_t acked = {};
+  for (auto &k : keys) {
+    advance(k.time);
+    echo.key(k.e, k.time);
+    echo.overlay(display, row, col, k.time);
+
+    shell.key(k.e);
+    u_int64_t jitter = rtt_ns / 5 * (rng() % 1000) / 1000;
+    arrival = std::max(arrival, k.time + rtt_ns + jitter);
+    link.push_back({arrival, shell.screen, shell.cursor_row(),
+                    shell.cursor_col(), ++acked});
+  }
+  advance(arrival + 10 * rtt_ns);
+
+  echo_result_t result = {};
+  result.perceived = echo.perceived();
+  result.round_trip = echo.round_trip();
+  result.predictions = echo.predictions();
+  result.mispredicted = echo.mispredicted();
+  result.rollbacks = echo.rollbacks();
+  result.bconsistent = echo.outstanding() == 0 && display == shell.screen &&
+                       row == shell.cursor_row() && col == shell.cursor_col();
+  return result;
+}
+
+/**
+ * @fn bench_echo
+ * @brief perceived keystroke latency with and without speculative local
+ * echo, over several round trips. A key is perceived when it is first
+ * drawn, predicted or echoed by the server.
+ */
+inline int bench_echo() {
+  std::vector<typed_key_t> keys = typing_script();
+  int ret = EXIT_SUCCESS;
+
+  for (u_int64_t rtt_ms : {20, 50, 200}) {
+    std::string link = "rtt " + std::to_string(rtt_ms) + "ms";
+    echo_result_t plain = simulate_echo(keys, rtt_ms * 1'000'000, false);
+    echo_result_t predicted = simulate_echo(keys, rtt_ms * 1'000'000, true);
+    if (!plain.bconsistent || !predicted.bconsistent) {
+      printf("echo %s: the display does not end on the server screen\n",
+             link.c_str());
+      ret = EXIT_FAILURE;
+    }
+
+    benchmark_report("echo", link + " echoed p50",
+                     plain.perceived.percentile(50) / 1e6, "ms");
+    benchmark_report("echo", link + " echoed p99",
+                     plain.perceived.percentile(99) / 1e6, "ms");
+    benchmark_report("echo", link + " predicted p50",
+                     predicted.perceived.percentile(50) / 1e6, "ms");
+    benchmark_report("echo", link + " predicted p99",
+                     predicted.perceived.percentile(99) / 1e6, "ms");
+    benchmark_report("echo", link + " confirmed p50",
+                     predicted.round_trip.percentile(50) / 1e6, "ms");
+    benchmark_report("echo", link + " predictions",
+                     static_cast<double>(predicted.predictions), "keys");
+    benchmark_report("echo", link + " mispredicted",
+                     static_cast<double>(predicted.mispredicted), "keys");
+    benchmark_report("echo", link + " rollbacks",
+                     static_cast<double>(predicted.rollbacks), "");
+  }
+  return ret;
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include "benchmark.h"
+#include "common.h"
+#include "latency_histogram.h"
+#include "session.h"
+#include "session_loop.h"
+#include "terminfo.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @struct fairness_run_t
+ * @brief the latency of the keys typed into the interactive sessions, and
+ * the keys of the floods that were decoded meanwhile.
+ */
+struct fairness_run_t {
+  latency_histogram_t latency = {};
+  u_int64_t typed = {};
+  u_int64_t received = {};
+  u_int64_t flood_keys = {};
+  double seconds = {};
+  loop_counters_t loop = {};
+};
+
+/**
+ * @fn fairness_work
+ * @brief what handling a key costs the application, a microsecond or so.
+ */
+inline void fairness_work(const key_event_t &e) {
+  u_int64_t h = static_cast<u_int8_t>(e.c);
+  for (int i = 0; i < 400; i++)
+    h = h * 0x100000001b3 ^ static_cast<u_int64_t>(i);
+  benchmark_keep(h);
+}
+
+/**
+ * @fn fairness_mixed_load
+ * @brief interactive sessions and flooding sessions on one worker's
+ * session_loop_t. A key is typed into an interactive session, the next in
+ * turn, every gap_us, and timed from its write to its on_key. Each flood
+ * writes a held arrow key or mashed function keys as fast as the session
+ * reads them, escape sequences the paste detector leaves to the decoder,
+ * so flood_keys counts decoded events.
+ */
+inline fairness_run_t fairness_mixed_load(int interactive, int floods,
+                                          const input_budget_t &budget,
+                                          unsigned window_ms,
+                                          unsigned gap_us) {
+  fairness_run_t run = {};
+  terminal_caps_t caps = load_terminal_caps("xterm-256color");
+  std::vector<std::unique_ptr<session_t>> all = {};
+  std::vector<int> peers = {};
+  session_loop_t loop;
+  loop.budget = budget;
+  int sessions = interactive + floods;
+  for (int i = 0; i < sessions; i++) {
+    int fds[2] = {-1, -1};
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0,
+                   fds) != 0)
+      break;
+    all.push_back(std::make_unique<session_t>(terminal_policy_t::xterm,
+                                              caps, 24, 80, fds[0]));
+    peers.push_back(fds[1]);
+    loop.add(*all.back());
+  }
+  if (static_cast<int>(all.size()) != sessions) {
+    for (int fd : peers)
+      close(fd);
+    return run;
+  }
+
+  const std::size_t per_session = window_ms * 1000 / gap_us + 1;
+  std::vector<std::atomic<u_int64_t>> sent(interactive * per_session);
+  std::vector<u_int64_t> seen(interactive);
+  std::atomic<bool> bdone = {};
+  u_int64_t typed = {};
+  u_int64_t wrong = {};
+
+  std::thread worker([&] {
+    while (loop.run_once(
+        [&](session_t &s, const key_event_t &e) {
+          fairness_work(e);
+          std::size_t i = {};
+          while (i < all.size() && all[i].get() != &s)
+            i++;
+          if (static_cast<int>(i) >= interactive) {
+            run.flood_keys++;
+            return;
+          }
+          std::size_t n = seen[i]++;
+          u_int64_t at = n < per_session
+                             ? sent[i * per_session + n].load(
+                                   std::memory_order_acquire)
+                             : 0;
+          if (!at || e.c != 'a' + static_cast<char>(n % 26)) {
+            wrong++;
+            return;
+          }
+          run.latency.record(steady_now_ns() - at);
+          run.received++;
+        },
+        [](session_t &, const char *, std::size_t) {},
+        [](session_t &) {})) {
+    }
+  });
+
+  std::thread flooder([&] {
+    // keys the paste detector leaves to the decoder, every one an event.
+    std::string held = {};
+    while (held.size() < 4096)
+      held += "\x1b[B";
+    std::string mashed = {};
+    while (mashed.size() < 4096)
+      mashed += "\x1bOP\x1b[1;5C\x1b[15~\x1b[A\x1b[6~\x1bOQ";
+    bool bwrote = {};
+    while (!bdone.load(std::memory_order_relaxed)) {
+      bwrote = false;
+      for (int f = 0; f < floods; f++) {
+        const std::string &text = f % 2 ? held : mashed;
+        if (write(peers[interactive + f], text.data(), text.size()) > 0)
+          bwrote = true;
+      }
+      if (!bwrote)
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+  });
+
+  benchmark_timer_t timer;
+  auto next = std::chrono::steady_clock::now();
+  auto end = next + std::chrono::milliseconds(window_ms);
+  while ((next += std::chrono::microseconds(gap_us)) < end) {
+    std::this_thread::sleep_until(next);
+    int i = static_cast<int>(typed % interactive);
+    std::size_t n = typed / interactive;
+    if (n >= per_session)
+      break;
+    char c = static_cast<char>('a' + n % 26);
+    sent[i * per_session + n].store(steady_now_ns(), std::memory_order_release);
+    if (write(peers[i], &c, 1) != 1)
+      break;
+    typed++;
+  }
+  // let the keys typed last arrive.
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  run.seconds = timer.elapsed_ns() / 1e9;
+  bdone = true;
+  flooder.join();
+  loop.stop();
+  worker.join();
+  run.typed = typed;
+  run.loop = loop.counters();
+  if (wrong)
+    run.received = 0;
+  for (int fd : peers)
+    close(fd);
+  return run;
+}
+
+/**
+ * @fn bench_fairness
+ * @brief eight interactive sessions typed into, a key every 2 ms among
+ * them, on the worker of eight sessions flooding it with held arrow keys
+ * and mashed function keys. Handling a key costs a microsecond. Reported
+ * are the latency of the typed keys quiet, in the flood without budgets
+ * and in the flood with a budget of 1024 bytes and 512 keys per 10 ms
+ * quantum, and the flood keys decoded and handled a second. Every typed
+ * key must arrive, in order, and with budgets its p99 must stay within
+ * two quanta and under half of that without.
+ */
+inline int bench_fairness() {
+  int ret = EXIT_SUCCESS;
+  const int interactive = 8;
+  const int floods = 8;
+  const unsigned window_ms = 1500;
+  const unsigned gap_us = 2000;
+  input_budget_t budget = {};
+  budget.bytes = 1024;
+  budget.events = 512;
+  budget.quantum_ms = 10;
+
+  struct mode_t {
+    const char *name;
+    int floods;
+    input_budget_t budget;
+  } modes[] = {{"quiet", 0, {}},
+               {"flood", floods, {}},
+               {"flood budgeted", floods, budget}};
+  double p99[3] = {};
+  for (int m = 0; m < 3; m++) {
+    fairness_run_t run = fairness_mixed_load(
+        interactive, modes[m].floods, modes[m].budget, window_ms, gap_us);
+    std::string name = modes[m].name;
+    p99[m] = run.latency.percentile(99) / 1e6;
+    benchmark_report("fairness", name + " key p50",
+                     run.latency.percentile(50) / 1e6, "ms");
+    benchmark_report("fairness", name + " key p99", p99[m], "ms");
+    benchmark_report("fairness", name + " key max", run.latency.max() / 1e6,
+                     "ms");
+    if (modes[m].floods) {
+      benchmark_report("fairness", name + " keys handled",
+                       run.flood_keys / run.seconds, "/s");
+      benchmark_report("fairness", name + " deferrals",
+                       static_cast<double>(run.loop.deferrals), "times");
+    }
+    if (!run.typed || run.received != run.typed) {
+      printf("fairness %s: %lu of %lu typed keys arrived in order\n",
+             modes[m].name, static_cast<unsigned long>(run.received),
+             static_cast<unsigned long>(run.typed));
+      ret = EXIT_FAILURE;
+    }
+  }
+  double quantum = static_cast<double>(budget.quantum_ms);
+  if (p99[2] > 2 * quantum || p99[2] > p99[1] / 2) {
+    printf("fairness: with budgets the p99 of typed keys is %.2f ms, "
+           "%.2f ms without\n",
+           p99[2], p99[1]);
+    ret = EXIT_FAILURE;
+  }
+  return ret;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "benchmark.h"
+#include "shell_highlight.h"
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @struct highlight_key_t
+ * @brief one edit of the line, erase bytes at pos replaced with text.
+ */
+struct highlight_key_t {
+  std::size_t pos = {};
+  std::size_t erase = {};
+  std::string text = {};
+};
+
+/**
+ * @fn long_command_line
+ * @brief a pasted command line of at least size bytes, pipelines of the
+ * usual words, options, quoting and variables.
+ */
+inline std::string long_command_line(std::size_t size) {
+  std::string line = {};
+  for (int i = 0; line.size() < size; i++) {
+    line += "FOO=" + std::to_string(i) + " grep -n --color=auto \"pattern " +
+            std::to_string(i) + "\" file_$i.txt 'a b' ${HOME}/log | sort -u " +
+            "2>&1 && echo $? ; ";
+  }
+  return line;
+}
+
+/**
+ * @fn bench_highlight
+ * @brief the cost of a keystroke to the highlighting of a 100 KB command
+ * line, kept up to date incrementally against lexing the whole line again,
+ * and the bytes each keystroke lexes. Typing at the end, typing and
+ * deleting in the middle, and a quote opened and closed near the start,
+ * the worst case, which changes how the rest of the line reads. Every so
+ * often the incremental tokens are compared with a full lex of the line.
+ */
+inline int bench_highlight() {
+  const std::string initial = long_command_line(100 << 10);
+  std::mt19937 random(85);
+  int ret = EXIT_SUCCESS;
+
+  struct workload_t {
+    std::string name;
+    std::vector<highlight_key_t> keys;
+  };
+  std::vector<workload_t> workloads = {};
+
+  const char typed[] = "cat notes.txt | wc -l; ";
+  workload_t end = {"typing at the end", {}};
+  for (std::size_t i = 0, size = initial.size(); i < 1000; i++, size++)
+    end.keys.push_back({size, 0, std::string(1, typed[i % 23])});
+  workloads.push_back(end);
+
+  workload_t middle = {"typing in the middle", {}};
+  for (std::size_t i = 0, size = initial.size(); i < 1000; i++, size++)
+    middle.keys.push_back(
+        {random() % size, 0, std::string(1, typed[i % 23])});
+  workloads.push_back(middle);
+
+  workload_t erase = {"deleting in the middle", {}};
+  for (std::size_t i = 0, size = initial.size(); i < 1000; i++, size--)
+    erase.keys.push_back({random() % (size - 1), 1, {}});
+  workloads.push_back(erase);
+
+  workload_t quote = {"quote near the start", {}};
+  for (int i = 0; i < 20; i++)
+    quote.keys.push_back(i % 2 ? highlight_key_t{10, 1, {}}
+                               : highlight_key_t{10, 0, "\""});
+  workloads.push_back(quote);
+
+  for (auto &w : workloads) {
+    shell_highlighter_t highlighter;
+    highlighter.assign(initial);
+    std::vector<shell_token_t> full = {};
+    double relexed = {};
+    benchmark_timer_t timer;
+    double ns = {};
+    for (std::size_t k = 0; k < w.keys.size(); k++) {
+      auto &key = w.keys[k];
+      timer.restart();
+      highlighter.edit(key.pos, key.erase, key.text.data(),
+                       key.text.size());
+      ns += timer.elapsed_ns();
+      relexed += highlighter.last_relexed();
+      if (k % 50 == 49 || k + 1 == w.keys.size()) {
+        shell_lexer_t::lex(highlighter.text(), full);
+        if (full != highlighter.token_list()) {
+          printf("highlight %s: the tokens differ from a full lex after "
+                 "key %lu\n",
+                 w.name.c_str(), static_cast<unsigned long>(k));
+          ret = EXIT_FAILURE;
+          break;
+        }
+      }
+    }
+    double keys = static_cast<double>(w.keys.size());
+    benchmark_report("highlight", w.name + " incremental", ns / keys,
+                     "ns/key");
+    benchmark_report("highlight", w.name + " relexed", relexed / keys,
+                     "bytes/key");
+  }
+
+  std::vector<shell_token_t> tokens = {};
+  benchmark_timer_t timer;
+  const int lexes = 50;
+  for (int i = 0; i < lexes; i++)
+    shell_lexer_t::lex(initial, tokens);
+  benchmark_report("highlight", "full lex of 100 KB",
+                   timer.elapsed_ns() / lexes, "ns/key");
+  benchmark_report("highlight", "tokens in 100 KB",
+                   static_cast<double>(tokens.size()), "tokens");
+
+  shell_highlighter_t highlighter;
+  highlighter.assign(initial);
+  std::vector<style_span_t> spans = {};
+  timer.restart();
+  for (int i = 0; i < 1000; i++)
+    highlighter.spans(50000 + i, 50000 + i + 200, spans);
+  benchmark_report("highlight", "spans of a 200 column window",
+                   timer.elapsed_ns() / 1000, "ns");
+  return ret;
+}
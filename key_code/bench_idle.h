@@ -0,0 +1,237 @@
+#pragma once
+
+#include "benchmark.h"
+#include "session.h"
+#include "session_loop.h"
+#include "terminfo.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @fn thread_run_count
+ * @brief how many times the kernel put thread tid on a cpu, the third
+ * field of its schedstat. A thread that sleeps runs once per wakeup. -1
+ * without schedstat.
+ */
+inline long long thread_run_count(pid_t tid) {
+  std::string path = "/proc/self/task/" + std::to_string(tid) + "/schedstat";
+  FILE *f = fopen(path.c_str(), "r");
+  if (!f)
+    return -1;
+  unsigned long long run_ns = {};
+  unsigned long long wait_ns = {};
+  long long count = -1;
+  if (fscanf(f, "%llu %llu %lld", &run_ns, &wait_ns, &count) != 3)
+    count = -1;
+  fclose(f);
+  return count;
+}
+
+inline pid_t idle_thread_id() {
+  return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+/**
+ * @struct idle_run_t
+ * @brief the wakeups of the threads serving sessions during a window.
+ */
+struct idle_run_t {
+  int sessions = {};
+  long long wakeups = {};
+  loop_counters_t loop = {};
+};
+
+/**
+ * @fn idle_timed_reads
+ * @brief terminals read as enable_raw_mode(false) used to set them, VMIN
+ * 0 and VTIME 1, a thread each blocking in read. Nothing is typed.
+ */
+inline idle_run_t idle_timed_reads(int sessions, unsigned window_ms) {
+  idle_run_t run = {};
+  std::vector<int> masters = {};
+  std::vector<int> slaves = {};
+  for (int i = 0; i < sessions; i++) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+      if (master >= 0)
+        close(master);
+      break;
+    }
+    int slave = open(ptsname(master), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (slave < 0) {
+      close(master);
+      break;
+    }
+    struct termios raw = {};
+    tcgetattr(slave, &raw);
+    cfmakeraw(&raw);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 1;
+    tcsetattr(slave, TCSANOW, &raw);
+    masters.push_back(master);
+    slaves.push_back(slave);
+  }
+  run.sessions = static_cast<int>(slaves.size());
+
+  std::atomic<bool> bstop = {};
+  std::vector<std::atomic<pid_t>> tids(slaves.size());
+  std::vector<std::thread> readers = {};
+  for (std::size_t i = 0; i < slaves.size(); i++)
+    readers.emplace_back([&, i] {
+      tids[i] = idle_thread_id();
+      char buffer[64];
+      while (!bstop.load(std::memory_order_relaxed))
+        if (read(slaves[i], buffer, sizeof(buffer)) < 0)
+          break;
+    });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  std::vector<long long> before = {};
+  for (auto &t : tids)
+    before.push_back(thread_run_count(t));
+  std::this_thread::sleep_for(std::chrono::milliseconds(window_ms));
+  for (std::size_t i = 0; i < tids.size(); i++)
+    run.wakeups += thread_run_count(tids[i]) - before[i];
+  bstop = true;
+  for (auto &r : readers)
+    r.join();
+  for (int fd : slaves)
+    close(fd);
+  for (int fd : masters)
+    close(fd);
+  return run;
+}
+
+/**
+ * @fn idle_session_loop
+ * @brief sessions on one session_loop_t. input is typed into the first
+ * session, a piece every gap_ms, once the window starts.
+ */
+inline idle_run_t idle_session_loop(int sessions, unsigned window_ms,
+                                    const std::vector<std::string> &input,
+                                    unsigned gap_ms) {
+  idle_run_t run = {};
+  run.sessions = sessions;
+  terminal_caps_t caps = load_terminal_caps("xterm-256color");
+  std::vector<std::unique_ptr<session_t>> all = {};
+  std::vector<int> peers = {};
+  session_loop_t loop;
+  for (int i = 0; i < sessions; i++) {
+    int fds[2] = {-1, -1};
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+      break;
+    all.push_back(std::make_unique<session_t>(terminal_policy_t::xterm,
+                                              caps, 24, 80, fds[0]));
+    peers.push_back(fds[1]);
+    loop.add(*all.back());
+  }
+  run.sessions = static_cast<int>(all.size());
+
+  std::atomic<pid_t> tid = {};
+  std::atomic<u_int64_t> keys = {};
+  std::thread worker([&] {
+    tid = idle_thread_id();
+    while (loop.run_once([&](session_t &, const key_event_t &) { keys++; },
+                         [&](session_t &, const char *, std::size_t len) {
+                           keys += len;
+                         },
+                         [](session_t &) {})) {
+    }
+  });
+  while (!tid)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  long long before = thread_run_count(tid);
+  loop_counters_t counts = loop.counters();
+  auto start = std::chrono::steady_clock::now();
+  for (auto &piece : input) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(gap_ms));
+    if (!peers.empty() &&
+        write(peers[0], piece.data(), piece.size()) < 0)
+      break;
+  }
+  std::this_thread::sleep_until(start + std::chrono::milliseconds(window_ms));
+  run.wakeups = thread_run_count(tid) - before;
+  run.loop = loop.counters();
+  run.loop.wakeups -= counts.wakeups;
+  run.loop.input -= counts.input;
+  run.loop.timers -= counts.timers;
+  run.loop.spurious -= counts.spurious;
+  loop.stop();
+  worker.join();
+  for (int fd : peers)
+    close(fd);
+  return run;
+}
+
+/**
+ * @fn bench_idle
+ * @brief wakeups of idle sessions, counted from schedstat over a window
+ * and given per session per minute. Terminals read with VTIME 1 wake every
+ * tenth of a second. Sessions on a session_loop_t must not wake at all
+ * while nothing is typed and no timer is armed. A lone ESC arms the escape
+ * timer, which may wake the loop no more than to cascade and expire, and
+ * keys typed a few a second wake it once a key, which shows the count
+ * counts.
+ */
+inline int bench_idle() {
+  int ret = EXIT_SUCCESS;
+  const unsigned window_ms = 1000;
+  const double per_minute = 60000.0 / window_ms;
+  if (thread_run_count(idle_thread_id()) < 0) {
+    printf("idle         no schedstat, skipped\n");
+    return ret;
+  }
+
+  auto report = [&](const char *name, const idle_run_t &run) {
+    std::string n = name;
+    double each = run.sessions ? per_minute / run.sessions : 0;
+    benchmark_report("idle", n + " sessions", run.sessions, "sessions");
+    benchmark_report("idle", n + " wakeups", run.wakeups * per_minute,
+                     "/minute");
+    benchmark_report("idle", n + " per session", run.wakeups * each,
+                     "/minute");
+  };
+
+  idle_run_t timed = idle_timed_reads(32, window_ms);
+  report("VTIME 1", timed);
+
+  idle_run_t idle = idle_session_loop(500, window_ms, {}, 0);
+  report("loop idle", idle);
+  if (idle.wakeups != 0 || idle.loop.wakeups != 0) {
+    printf("idle sessions woke the loop %lld times\n", idle.wakeups);
+    ret = EXIT_FAILURE;
+  }
+
+  idle_run_t escape = idle_session_loop(500, window_ms, {"\x1b"}, 100);
+  report("loop lone ESC", escape);
+  benchmark_report("idle", "loop lone ESC timer wakeups",
+                   escape.loop.timers, "wakeups");
+  if (escape.loop.input != 1 || escape.loop.timers > 2 ||
+      escape.loop.spurious) {
+    printf("idle lone ESC woke the loop %lu times for timers\n",
+           static_cast<unsigned long>(escape.loop.timers));
+    ret = EXIT_FAILURE;
+  }
+
+  std::vector<std::string> keys(8, "j");
+  idle_run_t typing = idle_session_loop(500, window_ms, keys, 100);
+  report("loop 8 keys", typing);
+  if (typing.loop.input != keys.size() || typing.loop.timers) {
+    printf("idle 8 keys woke the loop %lu times\n",
+           static_cast<unsigned long>(typing.loop.wakeups));
+    ret = EXIT_FAILURE;
+  }
+  return ret;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "benchmark.h"
+#include "latency_histogram.h"
+#include "list_view.h"
+#include "terminfo.h"
+#include "widgets.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class list_log_provider_t
+ * @brief rows of a log, made up from their number. Every seventh row is
+ * a stack trace of two or three lines. A fetch costs fetch_us, as reading
+ * a page from disk would.
+ */
+class list_log_provider_t : public row_provider_t {
+public:
+  list_log_provider_t(u_int64_t _rows, unsigned _fetch_us)
+      : rows(_rows), fetch_us(_fetch_us) {}
+
+  u_int64_t size() const override { return rows; }
+
+  void fetch(u_int64_t first, std::size_t count,
+             std::vector<std::string> &out) override {
+    std::this_thread::sleep_for(std::chrono::microseconds(fetch_us));
+    out.clear();
+    for (u_int64_t i = first; i < first + count; i++)
+      out.push_back(text(i));
+  }
+
+  static std::string text(u_int64_t i) {
+    char line[160];
+    snprintf(line, sizeof(line),
+             "%09lu 12:%02lu:%02lu.%03lu INFO worker[%lu] request %06lx "
+             "served in %lu us",
+             static_cast<unsigned long>(i),
+             static_cast<unsigned long>(i / 60000 % 60),
+             static_cast<unsigned long>(i / 1000 % 60),
+             static_cast<unsigned long>(i % 1000),
+             static_cast<unsigned long>(i % 16),
+             static_cast<unsigned long>(i * 2654435761u % 0xffffff),
+             static_cast<unsigned long>(i * 7 % 5000));
+    std::string row = line;
+    if (i % 7 == 3) {
+      row += "\n    at handler (server.cpp:412)";
+      if (i % 2)
+        row += "\n    at dispatch (loop.cpp:88)";
+    }
+    return row;
+  }
+
+private:
+  u_int64_t rows = {};
+  unsigned fetch_us = {};
+};
+
+/**
+ * @fn bench_list
+ * @brief a log viewer of 1,000 to 10 million rows paged through the way a
+ * person does, PAGE_DOWN held for a while, back up, END, HOME and the
+ * cursor keys, a key every few milliseconds, each drawn at once. Fetching
+ * a page costs 3 ms. Reported is the latency of a key to its frame, with
+ * the neighbouring pages prefetched and, for a million rows, without, and
+ * the pages a key had to wait for. The frame after END must show the last
+ * row selected at the bottom, less the room of a row that did not fit,
+ * the one after HOME the first. END must find the last page again after
+ * the view was resized.
+ */
+inline int bench_list() {
+  int ret = EXIT_SUCCESS;
+  const int rows = 50;
+  const int columns = 160;
+  const unsigned gap_us = 4000;
+  terminal_caps_t caps = load_terminal_caps("xterm-256color");
+
+  std::vector<vkey_t> keys = {};
+  keys.insert(keys.end(), 120, vkey_t::PAGE_DOWN);
+  keys.insert(keys.end(), 30, vkey_t::PAGE_UP);
+  keys.push_back(vkey_t::END);
+  keys.insert(keys.end(), 20, vkey_t::PAGE_UP);
+  keys.push_back(vkey_t::HOME);
+  keys.insert(keys.end(), 80, vkey_t::DOWN_ARROW);
+  keys.insert(keys.end(), 20, vkey_t::UP_ARROW);
+
+  struct run_t {
+    u_int64_t rows;
+    bool bprefetch;
+  } runs[] = {{1000, true},
+              {1000000, true},
+              {10000000, true},
+              {1000000, false}};
+
+  for (auto &run : runs) {
+    list_log_provider_t provider(run.rows, 3000);
+    auto view = std::make_unique<list_view_t>(provider, 256, 16,
+                                              run.bprefetch);
+    list_view_t *list = view.get();
+    widget_tree_t tree(std::move(view), rows, columns);
+    tree.set_focus(list);
+    screen_renderer_t renderer(caps, rows, columns);
+    output_writer_t out(-1);
+    tree.render(renderer, out);
+
+    latency_histogram_t latency;
+    for (vkey_t vk : keys) {
+      std::this_thread::sleep_for(std::chrono::microseconds(gap_us));
+      key_event_t e = {};
+      e.vk = vk;
+      benchmark_timer_t timer;
+      tree.dispatch(e);
+      tree.render(renderer, out);
+      latency.record(static_cast<u_int64_t>(timer.elapsed_ns()));
+
+      bool bok = true;
+      const screen_grid_t &grid = tree.grid();
+      if (vk == vkey_t::END) {
+        // the last row reversed, with no more than a row's room below it.
+        u_int64_t last = run.rows - 1;
+        std::string head = list_log_provider_t::text(last).substr(0, 9);
+        int r = rows - 1;
+        while (r > 0 && grid.at(r, 0).style.attrs != style_t::reverse)
+          r--;
+        while (r > 0 && grid.at(r - 1, 0).style.attrs == style_t::reverse)
+          r--;
+        for (int c = 0; c < 9; c++)
+          bok = bok && grid.at(r, c).ch == static_cast<char32_t>(head[c]) &&
+                grid.at(r, c).style.attrs == style_t::reverse;
+        bok = bok && rows - r <= 3 + list->heights().height(last) - 1 &&
+              list->selected_row() == last;
+      } else if (vk == vkey_t::HOME) {
+        bok = grid.at(0, 8).ch == U'0' &&
+              grid.at(0, 0).style.attrs == style_t::reverse &&
+              list->selected_row() == 0;
+      }
+      if (!bok) {
+        printf("list %lu rows: the frame after a key is wrong\n",
+               static_cast<unsigned long>(run.rows));
+        ret = EXIT_FAILURE;
+        break;
+      }
+    }
+
+    list_counters_t c = list->counters();
+    std::string name = std::to_string(run.rows) + " rows";
+    if (!run.bprefetch)
+      name += " no prefetch";
+    benchmark_report("list", name + " key p50",
+                     latency.percentile(50) / 1e3, "us");
+    benchmark_report("list", name + " key p99",
+                     latency.percentile(99) / 1e3, "us");
+    benchmark_report("list", name + " key max", latency.max() / 1e3, "us");
+    benchmark_report("list", name + " waited",
+                     static_cast<double>(c.misses + c.waits), "pages");
+  }
+
+  // END in a short view, then in a tall one: the last row fills each.
+  list_log_provider_t provider(1000, 0);
+  auto view = std::make_unique<list_view_t>(provider, 256, 16, false);
+  list_view_t *list = view.get();
+  widget_tree_t tree(std::move(view), rows, columns);
+  tree.set_focus(list);
+  for (int height : {rows / 3, rows}) {
+    tree.resize(height, columns);
+    screen_renderer_t renderer(caps, height, columns);
+    output_writer_t out(-1);
+    key_event_t e = {};
+    e.vk = vkey_t::HOME;
+    tree.dispatch(e);
+    e.vk = vkey_t::END;
+    tree.dispatch(e);
+    tree.render(renderer, out);
+    const row_height_index_t &h = list->heights();
+    u_int64_t top = list->top_row();
+    u_int64_t lines = h.line_of(h.rows()) - h.line_of(top);
+    if (lines > static_cast<u_int64_t>(height) ||
+        (top && lines + h.height(top - 1) <= static_cast<u_int64_t>(height))) {
+      printf("list END at %d rows shows %lu lines\n", height,
+             static_cast<unsigned long>(lines));
+      ret = EXIT_FAILURE;
+    }
+  }
+  return ret;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "benchmark.h"
+#include "memory_accounting.h"
+#include "session.h"
+#include "terminfo.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @fn exercise_session
+ * @brief puts a session through what a working one does: keystrokes,
+ * a clipboard reply and frames of changed text.
+ */
+inline void exercise_session(session_t &s, std::mt19937 &random) {
+  std::size_t keys = {};
+  auto on_key = [&](const key_event_t &) { keys++; };
+  const char typing[] = "ls -l\r\x1b[A\x1b[B\x1b[1;5C\x1bOP";
+  for (int i = 0; i < 16; i++)
+    s.feed(typing, sizeof(typing) - 1, on_key);
+  const char reply[] = "\x1b]52;c;aGVsbG8gd29ybGQ=\x07";
+  s.feed(reply, sizeof(reply) - 1, on_key);
+  benchmark_keep(keys);
+
+  screen_grid_t &screen = s.screen();
+  for (int frame = 0; frame < 8; frame++) {
+    for (int n = 0; n < screen.rows(); n++) {
+      int r = static_cast<int>(random() % screen.rows());
+      int c = static_cast<int>(random() % screen.columns());
+      screen.put_text(r, c, "the quick brown fox");
+    }
+    s.render(0, 0);
+  }
+}
+
+/**
+ * @fn bench_memory
+ * @brief the per session memory footprint. A session of each size is put
+ * to work and its account dumped, subsystem by subsystem. Then 80x24
+ * sessions are opened until a fixed budget is spent, which is the number a
+ * process serves in that much memory, and compared with the budget divided
+ * by the peak of one session. Every session must give back all it held when
+ * it closes, and sessions past the first chunk of accounts must get
+ * accounts of their own. Fails when memory_accounting.cpp is not in the
+ * program, as nothing would be measured.
+ */
+inline int bench_memory() {
+  const u_int64_t budget = 64 << 20;
+  terminal_caps_t caps = load_terminal_caps("xterm-256color");
+  std::mt19937 random(1);
+  int ret = EXIT_SUCCESS;
+  if (!memory_accounts().benabled()) {
+    printf("memory: memory_accounting.cpp is not linked, nothing charged\n");
+    return EXIT_FAILURE;
+  }
+
+  const struct {
+    int rows;
+    int columns;
+  } sizes[] = {{24, 80}, {50, 132}, {60, 200}};
+  u_int64_t peak_80x24 = {};
+  for (auto &size : sizes) {
+    u_int32_t account = {};
+    std::string name = std::to_string(size.columns) + "x" +
+                       std::to_string(size.rows);
+    {
+      session_t s(terminal_policy_t::generic, caps, size.rows, size.columns);
+      account = s.account();
+      exercise_session(s, random);
+      memory_footprint_t f = s.footprint();
+      print_memory_footprint(stdout, name.c_str(), f);
+      benchmark_report("memory", name + " session peak",
+                       static_cast<double>(f.total.peak) / 1024, "KB");
+      if (size.columns == 80)
+        peak_80x24 = f.total.peak;
+    }
+    if (memory_accounts().footprint(account).total.live) {
+      printf("memory %s: the session kept memory after closing\n",
+             name.c_str());
+      ret = EXIT_FAILURE;
+    }
+  }
+  print_memory_footprint(stdout, "process",
+                         memory_accounts().footprint(0));
+
+  std::vector<std::unique_ptr<session_t>> sessions = {};
+  u_int64_t spent = {};
+  for (;;) {
+    auto s = std::make_unique<session_t>(terminal_policy_t::generic, caps,
+                                         24, 80);
+    exercise_session(*s, random);
+    u_int64_t peak = s->footprint().total.peak;
+    if (spent + peak > budget)
+      break;
+    spent += peak;
+    sessions.push_back(std::move(s));
+  }
+  std::string budget_name = std::to_string(budget >> 20) + " MB budget";
+  benchmark_report("memory", budget_name + " 80x24 sessions",
+                   static_cast<double>(sessions.size()), "sessions");
+  benchmark_report("memory", budget_name + " estimate",
+                   static_cast<double>(budget / peak_80x24), "sessions");
+
+  std::vector<u_int32_t> accounts = {};
+  for (auto &s : sessions)
+    accounts.push_back(s->account());
+  sessions.clear();
+  for (auto account : accounts)
+    if (memory_accounts().footprint(account).total.live) {
+      printf("memory account %u kept memory after closing\n", account);
+      ret = EXIT_FAILURE;
+    }
+
+  // more sessions than a chunk of accounts, none charged to another.
+  const u_int32_t many = memory_accounts_t::chunk_accounts * 3 / 2;
+  accounts.clear();
+  for (u_int32_t n = 0; n < many; n++)
+    accounts.push_back(memory_accounts().acquire());
+  std::vector<u_int32_t> sorted = accounts;
+  std::sort(sorted.begin(), sorted.end());
+  if (!sorted.front() ||
+      std::unique(sorted.begin(), sorted.end()) != sorted.end()) {
+    printf("memory %u sessions did not get accounts of their own\n", many);
+    ret = EXIT_FAILURE;
+  }
+  for (auto account : accounts)
+    memory_accounts().release(account);
+  return ret;
+}
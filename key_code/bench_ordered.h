@@ -0,0 +1,172 @@
+#pragma once
+
+#include "benchmark.h"
+#include "key_dispatcher.h"
+#include "ordered_executor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @struct ordered_run_t
+ * @brief how long the keys took to handle and to dispatch, and whether
+ * each domain saw its keys in order and one at a time.
+ */
+struct ordered_run_t {
+  double seconds = {};
+  double dispatch_max_us = {};
+  u_int64_t handled = {};
+  u_int64_t out_of_order = {};
+  u_int64_t overlaps = {};
+  int most_at_once = {};
+};
+
+/**
+ * @fn ordered_search_keys
+ * @brief keys bound to searches of 0.1 to 3 ms, mostly waiting, as I/O
+ * does. Eight keys, each its own key class. mode 0 runs them inline,
+ * mode 1 async in one ordering domain, mode 2 async in a domain per key
+ * class and mode 3 posts every call to a domain of its own, no ordering
+ * at all. The number of a key travels in its seq bytes, and each class
+ * checks that its calls complete in key order and never overlap.
+ */
+inline ordered_run_t ordered_search_keys(int mode, int keys) {
+  ordered_run_t run = {};
+  const int classes = 8;
+  ordered_executor_t executor(classes);
+  std::vector<std::atomic<u_int32_t>> last(classes);
+  std::vector<std::atomic<int>> running(classes);
+  std::atomic<int> at_once = {};
+  std::atomic<int> most = {};
+  std::atomic<u_int64_t> handled = {};
+  std::atomic<u_int64_t> out_of_order = {};
+  std::atomic<u_int64_t> overlaps = {};
+
+  auto search = [&](const key_event_t &e) {
+    u_int32_t n = {};
+    memcpy(&n, e.seq, sizeof(n));
+    int c = e.c - 'a';
+    if (running[c]++)
+      overlaps++;
+    int now = ++at_once;
+    int seen = most;
+    while (now > seen && !most.compare_exchange_weak(seen, now)) {
+    }
+    std::this_thread::sleep_for(
+        std::chrono::microseconds(100 + (n * 2654435761u >> 16) % 2900));
+    // the previous key of the class completed before this one.
+    if (n <= last[c])
+      out_of_order++;
+    last[c] = std::max(last[c].load(), n);
+    at_once--;
+    running[c]--;
+    handled++;
+  };
+
+  {
+    key_dispatcher_t dispatcher({}, &executor);
+    for (int c = 0; c < classes; c++) {
+      char key = static_cast<char>('a' + c);
+      std::string name = std::string("search ") + key;
+      if (mode == 0)
+        dispatcher.bind(name, key, search);
+      else if (mode == 1)
+        dispatcher.bind_async(name, key, "search", search);
+      else
+        dispatcher.bind_async(name, key, name, search);
+    }
+
+    benchmark_timer_t timer;
+    for (int n = 1; n <= keys; n++) {
+      char seq[sizeof(u_int32_t)];
+      u_int32_t number = static_cast<u_int32_t>(n);
+      memcpy(seq, &number, sizeof(seq));
+      key_event_t e = {};
+      e.c = static_cast<char>('a' + n * 5 % classes);
+      e.seq = seq;
+      e.seq_size = sizeof(seq);
+      benchmark_timer_t call;
+      if (mode == 3) {
+        std::string copy(seq, sizeof(seq));
+        executor.post(executor.domain(), [&, e, copy] {
+          key_event_t k = e;
+          k.seq = copy.data();
+          search(k);
+        });
+      } else {
+        dispatcher.dispatch(e);
+      }
+      run.dispatch_max_us = std::max(run.dispatch_max_us,
+                                     call.elapsed_ns() / 1e3);
+    }
+    dispatcher.drain();
+    run.seconds = timer.elapsed_ns() / 1e9;
+  }
+  run.handled = handled;
+  run.out_of_order = out_of_order;
+  run.overlaps = overlaps;
+  run.most_at_once = most;
+  return run;
+}
+
+/**
+ * @fn bench_ordered
+ * @brief searches bound to eight keys typed flat out, run inline, async
+ * in one ordering domain, async in a domain per key and async without
+ * ordering. Reported are the keys handled a second, the longest a
+ * dispatch held up the input, the calls running at once, and the calls
+ * that completed out of key order. Every async mode must keep dispatch
+ * short, the ordered ones must complete each key's calls in order, one
+ * at a time, and a domain per key must run in parallel and handle keys at
+ * least twice as fast as one domain.
+ */
+inline int bench_ordered() {
+  int ret = EXIT_SUCCESS;
+  const int keys = 800;
+  const char *names[] = {"inline", "one domain", "domain per key",
+                         "no ordering"};
+  double rate[4] = {};
+  for (int mode = 0; mode < 4; mode++) {
+    ordered_run_t run = ordered_search_keys(mode, keys);
+    std::string name = names[mode];
+    rate[mode] = run.handled / run.seconds;
+    benchmark_report("ordered", name + " keys", rate[mode], "/s");
+    benchmark_report("ordered", name + " dispatch max", run.dispatch_max_us,
+                     "us");
+    benchmark_report("ordered", name + " at once",
+                     static_cast<double>(run.most_at_once), "calls");
+    benchmark_report("ordered", name + " overlapped",
+                     static_cast<double>(run.overlaps), "calls");
+    benchmark_report("ordered", name + " out of order",
+                     static_cast<double>(run.out_of_order), "calls");
+
+    bool bok = run.handled == static_cast<u_int64_t>(keys);
+    if (mode > 0)
+      bok = bok && run.dispatch_max_us < 500;
+    if (mode < 3)
+      bok = bok && !run.out_of_order && !run.overlaps;
+    if (mode == 2)
+      bok = bok && run.most_at_once > 1;
+    if (!bok) {
+      printf("ordered %s: %lu of %d keys, %lu out of order, %lu overlapped\n",
+             names[mode], static_cast<unsigned long>(run.handled), keys,
+             static_cast<unsigned long>(run.out_of_order),
+             static_cast<unsigned long>(run.overlaps));
+      ret = EXIT_FAILURE;
+    }
+  }
+  if (rate[2] < 2 * rate[1]) {
+    printf("ordered: a domain per key is not faster than one domain\n");
+    ret = EXIT_FAILURE;
+  }
+  return ret;
+}
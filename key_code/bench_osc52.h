@@ -0,0 +1,187 @@
+#pragma once
+
+#include "base64.h"
+#include "benchmark.h"
+#include "key_decoder.h"
+#include "osc52.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @fn base64_encode
+ * @brief produces the payloads for the benchmark, the library itself only
+ * decodes.
+ */
+inline std::string base64_encode(const std::vector<u_int8_t> &data) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out = {};
+  out.reserve((data.size() + 2) / 3 * 4);
+
+  std::size_t i = {};
+  for (; i + 3 <= data.size(); i += 3) {
+    u_int32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    out.push_back(alphabet[(v >> 18) & 63]);
+    out.push_back(alphabet[(v >> 12) & 63]);
+    out.push_back(alphabet[(v >> 6) & 63]);
+    out.push_back(alphabet[v & 63]);
+  }
+  if (i < data.size()) {
+    u_int32_t v = data[i] << 16;
+    if (i + 1 < data.size())
+      v |= data[i + 1] << 8;
+    out.push_back(alphabet[(v >> 18) & 63]);
+    out.push_back(alphabet[(v >> 12) & 63]);
+    out.push_back(i + 1 < data.size() ? alphabet[(v >> 6) & 63] : '=');
+    out.push_back('=');
+  }
+  return out;
+}
+
+/**
+ * @fn osc52_alt_keys
+ * @brief Alt keys that begin like a control string, sent as ESC ] or ESC P
+ * with meta sending escape. Each case is fed in the pieces listed, the
+ * escape wait expiring after those ending in a flush mark, and must decode
+ * to the keys given, a character or a virtual key in angle brackets.
+ */
+inline bool osc52_alt_keys() {
+  struct alt_case_t {
+    std::vector<std::string> reads;
+    std::string keys;
+  };
+  const std::string flush = "\x01flush";
+  // more than max_string bytes in one read, the string is given up.
+  std::string held = std::string(5000, 'a');
+  const alt_case_t cases[] = {
+      {{"\x1b]", flush, "abc"}, "\x1b]abc"},
+      {{"\x1bP", flush, "x"}, "\x1bPx"},
+      {{"\x1b_", flush, "\x1b^", flush, "q"}, "\x1b_\x1b^q"},
+      {{"\x1b]5", flush, "2"}, "\x1b]52"},
+      {{"\x1b]\x1b[A"}, "\x1b]<up>"},
+      {{"\x1b]", "\x1b", flush}, "\x1b]<esc>"},
+      {{"\x1b]" + held, "z"}, "z"},
+      {{"\x1b]11;rgb:0000/0000/0000\x1b\\", "k"}, "k"}};
+  bool bok = true;
+  int n = {};
+  for (auto &c : cases) {
+    std::string keys = {};
+    auto on_key = [&](const key_event_t &e) {
+      if (e.vk == vkey_t::UP_ARROW)
+        keys += "<up>";
+      else if (e.vk == vkey_t::ESC)
+        keys += "<esc>";
+      else if (e.vk == vkey_t::none)
+        keys += e.c;
+    };
+    key_decoder_t decoder;
+    for (auto &r : c.reads)
+      if (r == flush)
+        decoder.flush(on_key);
+      else
+        decoder.feed(r.data(), r.size(), on_key);
+    if (keys != c.keys || !decoder.ground()) {
+      printf("osc52 alt keys case %d decoded wrong\n", n);
+      bok = false;
+    }
+    n++;
+  }
+  return bok;
+}
+
+/**
+ * @fn bench_osc52
+ * @brief throughput of the base64 block decoders alone and of a complete
+ * OSC 52 reply fed through the key decoder in read() sized pieces. Every
+ * run is checked against the original bytes, and the Alt keys that begin
+ * like a control string must come through as keys.
+ */
+inline int bench_osc52() {
+  const char *impl_names[] = {"scalar", "ssse3", "avx2"};
+  const std::size_t sizes[] = {64 << 10, 1 << 20, 8 << 20};
+  const std::size_t read_size = 4096;
+  const std::size_t drain_capacity = 64 << 10;
+
+  std::mt19937 rng(52);
+  std::vector<u_int8_t> out(drain_capacity);
+  int ret = osc52_alt_keys() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+  for (auto size : sizes) {
+    std::vector<u_int8_t> data(size);
+    for (auto &b : data)
+      b = static_cast<u_int8_t>(rng());
+    std::string encoded = base64_encode(data);
+    int passes = static_cast<int>((64 << 20) / size);
+
+    for (int impl = 0; impl <= static_cast<int>(base64_detect_impl());
+         impl++) {
+      bool bvalid = true;
+      benchmark_timer_t timer;
+      for (int pass = 0; pass < passes; pass++) {
+        base64_stream_t decoder(static_cast<base64_impl_t>(impl));
+        std::size_t in_pos = {};
+        std::size_t out_pos = {};
+        while (in_pos < encoded.size()) {
+          auto r = decoder.decode(encoded.data() + in_pos,
+                                  encoded.size() - in_pos, out.data(),
+                                  out.size());
+          if (pass == 0 &&
+              memcmp(out.data(), data.data() + out_pos, r.produced) != 0)
+            bvalid = false;
+          in_pos += r.consumed;
+          out_pos += r.produced;
+        }
+        if (out_pos != size)
+          bvalid = false;
+        benchmark_keep(out);
+      }
+      double ns = timer.elapsed_ns();
+      benchmark_report("osc52",
+                       std::string("base64 ") + impl_names[impl] + " " +
+                           std::to_string(size >> 10) + "K",
+                       encoded.size() * double(passes) * 1e3 / ns, "MB/s");
+      if (!bvalid) {
+        printf("osc52 base64 %s decoded the wrong bytes\n", impl_names[impl]);
+        ret = EXIT_FAILURE;
+      }
+    }
+
+    std::string reply = "\x1b]52;c;" + encoded + "\x07";
+    std::size_t checked = {};
+    bool bvalid = true;
+    osc52_reader_t reader(
+        out.data(), out.size(),
+        [&](const u_int8_t *p, std::size_t len, bool final) {
+          if (checked + len > size ||
+              memcmp(p, data.data() + checked, len) != 0)
+            bvalid = false;
+          checked += len;
+          if (final && checked != size)
+            bvalid = false;
+        });
+    key_decoder_t decoder;
+    decoder.set_osc_listener(&reader);
+    std::size_t keys = {};
+    auto on_key = [&](const key_event_t &) { keys++; };
+
+    benchmark_timer_t timer;
+    for (int pass = 0; pass < passes; pass++) {
+      checked = {};
+      for (std::size_t pos = 0; pos < reply.size(); pos += read_size)
+        decoder.feed(reply.data() + pos,
+                     std::min(read_size, reply.size() - pos), on_key);
+    }
+    double ns = timer.elapsed_ns();
+    benchmark_report("osc52",
+                     "decoder OSC 52 " + std::to_string(size >> 10) + "K",
+                     reply.size() * double(passes) * 1e3 / ns, "MB/s");
+    if (!bvalid || keys != 0 || reader.error()) {
+      printf("osc52 reply was not delivered intact\n");
+      ret = EXIT_FAILURE;
+    }
+  }
+  return ret;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "benchmark.h"
+#include "output_writer.h"
+#include "pane.h"
+#include "screen_renderer.h"
+#include "terminfo.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @fn panes_build_log
+ * @brief what a build prints in one tick: colored progress lines, now and
+ * then a warning that wraps and a line rewritten in place.
+ */
+inline std::string panes_build_log(int pane, int tick) {
+  std::string out = {};
+  char line[256];
+  for (int i = 0; i < 4; i++) {
+    int n = tick * 4 + i;
+    snprintf(line, sizeof(line),
+             "\x1b[32m[%3d%%]\x1b[0m Building CXX object "
+             "src/module_%d/file_%d.cpp.o\r\n",
+             n % 100, pane, n);
+    out += line;
+  }
+  if (tick % 7 == 0) {
+    snprintf(line, sizeof(line),
+             "\x1b[1;33mwarning:\x1b[0m src/module_%d/file_%d.cpp:%d: "
+             "unused variable 'result' in a function that is long enough "
+             "for the message to wrap [-Wunused-variable]\r\n",
+             pane, tick, tick % 300);
+    out += line;
+  }
+  if (tick % 5 == 0) {
+    snprintf(line, sizeof(line),
+             "\x1b[36mLinking\x1b[0m lib%d.so\r\x1b[K\x1b[1;32mLinked"
+             "\x1b[0m lib%d.so\r\n",
+             tick, tick);
+    out += line;
+  }
+  return out;
+}
+
+/**
+ * @fn panes_top
+ * @brief a process monitor redrawing its table in place.
+ */
+inline std::string panes_top(int tick, int rows) {
+  std::string out = "\x1b[H\x1b[7m  PID USER   %CPU COMMAND\x1b[0m\x1b[K";
+  char line[128];
+  for (int r = 2; r <= rows; r++) {
+    snprintf(line, sizeof(line), "\x1b[%d;1H%5d root  %4.1f worker-%d\x1b[K",
+             r, 1000 + r, ((tick * 31 + r * 17) % 1000) / 10.0,
+             (tick + r) % 50);
+    out += line;
+  }
+  return out;
+}
+
+/**
+ * @fn panes_progress
+ * @brief a download bar that returns to the start of its line.
+ */
+inline std::string panes_progress(int tick) {
+  std::string out = "\r\x1b[1mdownloading\x1b[0m [";
+  int done = tick % 50;
+  out += std::string(done, '#') + std::string(50 - done, ' ');
+  out += "] " + std::to_string(tick % 50 * 2) + "%";
+  if (done == 49)
+    out += "\r\n";
+  return out;
+}
+
+/**
+ * @fn bench_panes
+ * @brief a multiplexer with 64 panes of which 4 are on screen, the others
+ * running builds, two a process monitor and one a progress bar. Each tick
+ * every pane gets its output. Updating and rendering every pane, as if all
+ * were seen, is set against suspended hidden panes that keep only the
+ * output since it last scrolled out. Reported are the time per tick, the
+ * output each hidden pane keeps, and the time to catch a pane up when it
+ * is shown. Every pane must then show the grid and cursor of the pane that
+ * was kept up to date.
+ */
+inline int bench_panes() {
+  int ret = EXIT_SUCCESS;
+  const int panes = 64;
+  const int shown = 4;
+  const int rows = 30;
+  const int columns = 100;
+  const int ticks = 600;
+  terminal_caps_t caps = load_terminal_caps("xterm-256color");
+
+  std::vector<std::vector<std::string>> output(ticks);
+  for (int t = 0; t < ticks; t++)
+    for (int p = 0; p < panes; p++)
+      output[t].push_back(p == 10 || p == 20 ? panes_top(t, rows)
+                          : p == 30          ? panes_progress(t)
+                                             : panes_build_log(p, t));
+
+  struct mux_t {
+    std::vector<std::unique_ptr<pane_t>> panes = {};
+    std::vector<std::unique_ptr<screen_renderer_t>> renderers = {};
+  };
+  auto run = [&](mux_t &mux, bool bsuspend) {
+    output_writer_t out(-1);
+    for (int p = 0; p < panes; p++) {
+      mux.panes.push_back(std::make_unique<pane_t>(rows, columns));
+      mux.renderers.push_back(
+          std::make_unique<screen_renderer_t>(caps, rows, columns));
+      if (bsuspend && p >= shown)
+        mux.panes[p]->hide();
+    }
+    benchmark_timer_t timer;
+    for (int t = 0; t < ticks; t++)
+      for (int p = 0; p < panes; p++) {
+        pane_t &pane = *mux.panes[p];
+        pane.write(output[t][p].data(), output[t][p].size());
+        if (pane.visible())
+          mux.renderers[p]->render(pane.screen(), out, pane.cursor_row(),
+                                   pane.cursor_col());
+      }
+    return timer.elapsed_ns() / ticks;
+  };
+
+  mux_t every = {};
+  mux_t suspended = {};
+  double every_ns = run(every, false);
+  double suspended_ns = run(suspended, true);
+
+  std::size_t held = {};
+  std::size_t compactions = {};
+  for (int p = shown; p < panes; p++) {
+    held += suspended.panes[p]->held_bytes();
+    compactions += suspended.panes[p]->compactions();
+  }
+  benchmark_timer_t timer;
+  for (int p = shown; p < panes; p++)
+    suspended.panes[p]->show();
+  double catch_up_ns = timer.elapsed_ns() / (panes - shown);
+
+  benchmark_report("panes", "every pane per tick", every_ns / 1e3, "us");
+  benchmark_report("panes", "suspended per tick", suspended_ns / 1e3, "us");
+  benchmark_report("panes", "speedup", every_ns / suspended_ns, "x");
+  benchmark_report("panes", "held per hidden pane",
+                   held / 1024.0 / (panes - shown), "KB");
+  benchmark_report("panes", "compactions per hidden pane",
+                   static_cast<double>(compactions) / (panes - shown),
+                   "compactions");
+  benchmark_report("panes", "catch up per pane", catch_up_ns / 1e3, "us");
+
+  for (int p = 0; p < panes; p++) {
+    pane_t &a = *every.panes[p];
+    pane_t &b = *suspended.panes[p];
+    if (!(a.screen() == b.screen()) || a.cursor_row() != b.cursor_row() ||
+        a.cursor_col() != b.cursor_col()) {
+      printf("panes: pane %d differs after it was shown\n", p);
+      ret = EXIT_FAILURE;
+    }
+  }
+  return ret;
+}
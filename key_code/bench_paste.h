@@ -0,0 +1,264 @@
+#pragma once
+
+#include "benchmark.h"
+#include "paste_detector.h"
+#include "session_loop.h"
+#include "terminal_policy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @struct paste_read_t
+ * @brief the bytes one read returns, when, and whether they were pasted.
+ */
+struct paste_read_t {
+  std::string bytes = {};
+  u_int64_t at_us = {};
+  bool bpasted = {};
+};
+
+/**
+ * @fn paste_typing
+ * @brief count keystrokes typed from at_us on: letters a read each at
+ * human speed, some fast, cursor keys, a held key repeating and, now and
+ * then, two keys in one read as a loaded machine returns them.
+ */
+inline void paste_typing(std::vector<paste_read_t> &reads, u_int64_t &at_us,
+                         int count, std::mt19937 &random) {
+  for (int i = 0; i < count; i++) {
+    u_int32_t pick = random() % 100;
+    if (pick < 5) {
+      // a held key, the terminal repeats it 30 times a second.
+      for (int n = 0; n < 40; n++) {
+        at_us += 33000;
+        reads.push_back({"j", at_us, false});
+      }
+      continue;
+    }
+    at_us += pick < 30 ? 25000 + random() % 30000 : 60000 + random() % 250000;
+    if (pick < 15)
+      reads.push_back({"\x1b[B", at_us, false});
+    else if (pick < 20)
+      reads.push_back({"ls", at_us, false});
+    else
+      reads.push_back({std::string(1, static_cast<char>('a' + pick % 26)),
+                       at_us, false});
+  }
+}
+
+/**
+ * @fn paste_source
+ * @brief size bytes of source code as a terminal pastes it, indented
+ * lines ending in CR.
+ */
+inline std::string paste_source(std::size_t size) {
+  const char *lines[] = {"int main(int argc, char **argv) {",
+                         "  for (int i = 0; i < argc; i++) {",
+                         "    if (argv[i][0] == '-')",
+                         "      continue;",
+                         "    printf(\"%s\\n\", argv[i]);", "  }",
+                         "  return 0;", "}"};
+  std::string text = {};
+  for (std::size_t i = 0; text.size() < size; i++)
+    text += std::string(lines[i % 8]) + "\r";
+  text.resize(size);
+  return text;
+}
+
+/**
+ * @fn paste_on_loop
+ * @brief a paste into a session on a session_loop_t. It must come to
+ * on_text whole, and the loop's paste timer must end it once nothing more
+ * arrived, without further input. Returns how long the paste lasted after
+ * it was read, -1 when it went wrong.
+ */
+inline double paste_on_loop(const std::string &source) {
+  int fds[2] = {-1, -1};
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+    return -1;
+  terminal_caps_t caps = load_terminal_caps("xterm-256color");
+  session_t s(terminal_policy_t::xterm, caps, 24, 80, fds[0]);
+  session_loop_t loop;
+  loop.add(s);
+  std::string pasted = source.substr(0, 4096);
+  std::size_t text = {};
+  std::size_t keys = {};
+  auto on_key = [&](session_t &, const key_event_t &) { keys++; };
+  auto on_text = [&](session_t &, const char *, std::size_t n) { text += n; };
+  auto on_closed = [](session_t &) {};
+  double ms = -1;
+  if (write(fds[1], pasted.data(), pasted.size()) ==
+      static_cast<ssize_t>(pasted.size())) {
+    while (text + keys < pasted.size() &&
+           loop.run_once(on_key, on_text, on_closed)) {
+    }
+    auto read = std::chrono::steady_clock::now();
+    // the loop sleeps until the paste timer, at most a few times, and
+    // would sleep for good were none armed.
+    for (int i = 0; i < 8 && s.paste().pasting() && loop.timeout_ms() >= 0;
+         i++)
+      loop.run_once(on_key, on_text, on_closed);
+    if (!s.paste().pasting() && text == pasted.size())
+      ms = std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - read)
+               .count();
+  }
+  loop.remove(s);
+  close(fds[1]);
+  return ms;
+}
+
+/**
+ * @fn bench_paste
+ * @brief paste detection without bracketed paste, on traces of reads with
+ * their arrival times: typing alone, and pastes that arrive in 4 KB reads
+ * back to back, in 64 byte reads a millisecond apart as over a slow link,
+ * and a byte per read as from a serial line, each between typing. No
+ * typing may be taken for a paste, each paste must be found, the typing
+ * after it must be keys again and a paste may go through the keys only
+ * until burst_reads reads made it out. The cost per pasted byte through
+ * the key bindings is set against the text runs. A paste into a session
+ * on an event loop must end on the loop's paste timer.
+ */
+inline int bench_paste() {
+  int ret = EXIT_SUCCESS;
+  std::mt19937 random(3);
+  const std::string source = paste_source(64 << 10);
+
+  struct trace_t {
+    const char *name;
+    std::size_t chunk;
+    u_int64_t gap_us;
+  } traces[] = {{"typing", 0, 0},
+                {"4 KB reads", 4096, 50},
+                {"64 byte reads", 64, 1000},
+                {"byte reads", 1, 100}};
+
+  // the key bindings, looked up for every keystroke on the slow path.
+  std::unordered_map<int, int> bindings = {};
+  for (int k = 0; k < 512; k++)
+    bindings[k] = k * 7;
+
+  for (auto &trace : traces) {
+    std::vector<paste_read_t> reads = {};
+    u_int64_t at_us = 1000000;
+    paste_typing(reads, at_us, 500, random);
+    std::size_t typed_after = {};
+    if (trace.chunk) {
+      at_us += 300000;
+      for (std::size_t i = 0; i < source.size(); i += trace.chunk) {
+        reads.push_back({source.substr(i, trace.chunk), at_us, true});
+        at_us += trace.gap_us;
+      }
+      at_us += 300000;
+      std::size_t before = reads.size();
+      paste_typing(reads, at_us, 200, random);
+      // a cursor key is one keystroke, anything else a key a byte.
+      for (std::size_t i = before; i < reads.size(); i++)
+        typed_after +=
+            reads[i].bytes[0] == '\x1b' ? 1 : reads[i].bytes.size();
+    }
+
+    terminal_decoder_t decoder(terminal_policy_t::xterm);
+    paste_detector_t paste;
+    std::size_t keys = {};
+    std::size_t text = {};
+    std::size_t typed_as_text = {};
+    std::size_t keys_after = {};
+    bool bpasted = {};
+    bool bafter = {};
+    std::string line = {};
+    auto on_key = [&](const key_event_t &e) {
+      auto it = bindings.find(e.vk != vkey_t::none
+                                  ? 256 + static_cast<int>(e.vk)
+                                  : static_cast<u_int8_t>(e.c));
+      keys += it != bindings.end() ? 1 : 0;
+      keys_after += bafter;
+    };
+    auto on_text = [&](const char *p, std::size_t n) {
+      line.append(p, n);
+      text += n;
+    };
+    for (auto &r : reads) {
+      bafter = bpasted && !r.bpasted;
+      std::size_t before = text;
+      paste.feed(decoder, r.bytes.data(), r.bytes.size(), r.at_us, on_key,
+                 on_text);
+      if (!r.bpasted && text != before)
+        typed_as_text += text - before;
+      bpasted = bpasted || r.bpasted;
+    }
+
+    const paste_counters_t &c = paste.counters();
+    std::size_t missed = trace.chunk ? source.size() - c.paste_bytes : 0;
+    std::string name = trace.name;
+    benchmark_report("paste", name + " pastes", c.pastes, "pastes");
+    benchmark_report("paste", name + " typing as paste",
+                     typed_as_text, "bytes");
+    if (trace.chunk)
+      benchmark_report("paste", name + " pasted as keys", missed,
+                       "bytes");
+    bool bpass = typed_as_text == 0;
+    if (trace.chunk)
+      bpass = bpass && c.pastes == 1 && keys_after == typed_after &&
+              missed < trace.chunk * paste.tuning.burst_reads;
+    else
+      bpass = bpass && c.pastes == 0;
+    if (!bpass) {
+      printf("paste %s: the paste was not told from typing\n", trace.name);
+      ret = EXIT_FAILURE;
+    }
+  }
+
+  // the cost of a pasted byte, through the bindings or as text.
+  const int rounds = 20;
+  terminal_decoder_t decoder(terminal_policy_t::xterm);
+  std::size_t found = {};
+  auto on_key = [&](const key_event_t &e) {
+    auto it = bindings.find(e.vk != vkey_t::none
+                                ? 256 + static_cast<int>(e.vk)
+                                : static_cast<u_int8_t>(e.c));
+    found += it != bindings.end();
+  };
+  benchmark_timer_t timer;
+  for (int r = 0; r < rounds; r++)
+    for (std::size_t i = 0; i < source.size(); i += 4096)
+      decoder.feed(source.data() + i,
+                   std::min<std::size_t>(4096, source.size() - i), on_key);
+  double keys_ns = timer.elapsed_ns() / (rounds * source.size());
+  std::string line = {};
+  paste_detector_t paste;
+  timer.restart();
+  for (int r = 0; r < rounds; r++) {
+    line.clear();
+    for (std::size_t i = 0; i < source.size(); i += 4096)
+      paste.feed(decoder, source.data() + i,
+                 std::min<std::size_t>(4096, source.size() - i), 0, on_key,
+                 [&](const char *p, std::size_t n) { line.append(p, n); });
+  }
+  double text_ns = timer.elapsed_ns() / (rounds * source.size());
+  benchmark_keep(found);
+  benchmark_report("paste", "pasted byte as keys", keys_ns, "ns/byte");
+  benchmark_report("paste", "pasted byte as text", text_ns, "ns/byte");
+  benchmark_report("paste", "speedup", keys_ns / text_ns, "x");
+  if (line != source) {
+    printf("paste text runs do not add up to the paste\n");
+    ret = EXIT_FAILURE;
+  }
+
+  double ended_ms = paste_on_loop(source);
+  benchmark_report("paste", "loop paste ended after", ended_ms, "ms");
+  if (ended_ms < 0) {
+    printf("paste on the event loop was not taken whole and ended\n");
+    ret = EXIT_FAILURE;
+  }
+  return ret;
+}
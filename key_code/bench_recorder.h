@@ -0,0 +1,203 @@
+#pragma once
+
+#include "bench_render.h"
+#include "benchmark.h"
+#include "output_recorder.h"
+#include "output_writer.h"
+#include "screen_renderer.h"
+#include "terminfo.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * @class recorder_timed_tee_t
+ * @brief hands batches on to a recorder and adds up the time it took, the
+ * cost recording adds to the output path. With bkeep it keeps a copy of
+ * the batches as well, to check the recording against.
+ */
+class recorder_timed_tee_t : public output_tee_t {
+public:
+  explicit recorder_timed_tee_t(output_tee_t &_to) : to(_to) {}
+
+  void tee(const char *p, std::size_t len) override {
+    benchmark_timer_t timer;
+    to.tee(p, len);
+    ns += timer.elapsed_ns();
+    if (bkeep)
+      kept.append(p, len);
+  }
+
+  output_tee_t &to;
+  bool bkeep = {};
+  double ns = {};
+  std::string kept = {};
+};
+
+/**
+ * @struct recorder_run_t
+ * @brief the frames drawn and what recording them cost.
+ */
+struct recorder_run_t {
+  int frames = {};
+  double frame_ns = {};
+  double tee_ns = {};
+  std::size_t bytes = {};
+  recording_counters_t counters = {};
+  bool bok = true;
+};
+
+/**
+ * @fn recorder_run
+ * @brief draws the frames of rec in full, passes times, to /dev/null, a
+ * frame every gap_us or flat out when 0. With a format the output is
+ * recorded to path, which must then read back as the bytes sent.
+ */
+inline recorder_run_t recorder_run(const frame_recording_t &rec, int passes,
+                                   unsigned gap_us, const char *path,
+                                   const recording_format_t *format) {
+  recorder_run_t run = {};
+  terminal_caps_t caps = load_terminal_caps("xterm-256color");
+  int rows = rec.frames.front().rows();
+  int columns = rec.frames.front().columns();
+  int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  std::string sent = {};
+  {
+    output_writer_t out(null_fd, 256 << 10);
+    screen_renderer_t renderer(caps, rows, columns);
+    std::unique_ptr<output_recorder_t> recorder = {};
+    std::unique_ptr<recorder_timed_tee_t> timed = {};
+    if (format) {
+      recording_policy_t policy = {};
+      policy.format = *format;
+      recorder =
+          std::make_unique<output_recorder_t>(path, rows, columns, policy);
+      timed = std::make_unique<recorder_timed_tee_t>(*recorder);
+      timed->bkeep = gap_us != 0;
+      out.set_tee(timed.get());
+    }
+    auto next = std::chrono::steady_clock::now();
+    double elapsed = {};
+    for (int pass = 0; pass < passes; pass++)
+      for (auto &frame : rec.frames) {
+        if (gap_us) {
+          next += std::chrono::microseconds(gap_us);
+          std::this_thread::sleep_until(next);
+        }
+        benchmark_timer_t timer;
+        renderer.invalidate();
+        renderer.render(frame, out);
+        elapsed += timer.elapsed_ns();
+        run.frames++;
+      }
+    run.frame_ns = elapsed / run.frames;
+    run.bytes = out.bytes_written();
+    if (timed) {
+      run.tee_ns = timed->ns / run.frames;
+      sent = std::move(timed->kept);
+      out.set_tee(nullptr);
+      run.bok = recorder->ok();
+      recorder.reset();
+    }
+  }
+  close(null_fd);
+  if (!format)
+    return run;
+
+  std::string recorded = {};
+  recording_scan_t scan = recording_read(
+      path, [&](u_int64_t, const char *p, std::size_t len) {
+        recorded.append(p, len);
+      });
+  run.counters.batches = scan.batches;
+  run.counters.bytes = scan.bytes;
+  struct stat st = {};
+  stat(path, &st);
+  run.counters.file_bytes = static_cast<u_int64_t>(st.st_size);
+  run.bok = run.bok && scan.torn_bytes == 0 && scan.format == *format &&
+            scan.rows == rows && scan.columns == columns;
+  run.bok = run.bok && recorded.size() <= run.bytes;
+  if (gap_us)
+    run.bok = run.bok && recorded == sent;
+  return run;
+}
+
+/**
+ * @fn bench_recorder
+ * @brief a 400x120 multiplexer redrawn in full every frame, its output
+ * sent to /dev/null and recorded, as asciicast and as binary, against not
+ * recording. Reported are the time per frame and its overhead flat out,
+ * which on a single cpu includes the recorder thread formatting and
+ * writing, the batches the recorder fell behind on and dropped, and at
+ * 120 frames a second what the tee alone adds to the output path and the
+ * size of the recordings. At 120 frames a second, a full redraw rate,
+ * nothing may be dropped and each recording, read back, must hold every
+ * byte that was sent, in order.
+ */
+inline int bench_recorder() {
+  int ret = EXIT_SUCCESS;
+  char path[] = "/tmp/key_code_recording_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    printf("recorder cannot create a file in /tmp\n");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+
+  frame_recording_t rec = record_panes();
+  recorder_run_t none = recorder_run(rec, 5, 0, path, nullptr);
+  benchmark_report("recorder", "not recorded per frame", none.frame_ns / 1e3,
+                   "us");
+  benchmark_report("recorder", "output per frame",
+                   static_cast<double>(none.bytes) / none.frames / 1024,
+                   "KB");
+
+  struct format_t {
+    const char *name;
+    recording_format_t format;
+  } formats[] = {{"asciicast", recording_format_t::asciicast},
+                 {"binary", recording_format_t::binary}};
+  for (auto &f : formats) {
+    std::string name = f.name;
+    recorder_run_t flat = recorder_run(rec, 5, 0, path, &f.format);
+    benchmark_report("recorder", name + " per frame", flat.frame_ns / 1e3,
+                     "us");
+    benchmark_report("recorder", name + " overhead",
+                     100 * (flat.frame_ns - none.frame_ns) / none.frame_ns,
+                     "%");
+    benchmark_report(
+        "recorder", name + " dropped flat out",
+        static_cast<double>(flat.bytes - flat.counters.bytes) / flat.bytes *
+            100,
+        "%");
+    if (!flat.bok) {
+      printf("recorder %s: the recording is not what was sent\n", f.name);
+      ret = EXIT_FAILURE;
+    }
+
+    recorder_run_t paced = recorder_run(rec, 1, 1000000 / 120, path,
+                                        &f.format);
+    benchmark_report("recorder", name + " 120 fps tee per frame",
+                     paced.tee_ns / 1e3, "us");
+    benchmark_report("recorder", name + " 120 fps tee rate",
+                     paced.bytes / paced.tee_ns / paced.frames, "GB/s");
+    benchmark_report("recorder", name + " file per frame",
+                     static_cast<double>(paced.counters.file_bytes) /
+                         paced.frames / 1024,
+                     "KB");
+    if (!paced.bok) {
+      printf("recorder %s at 120 fps: the recording is not what was sent\n",
+             f.name);
+      ret = EXIT_FAILURE;
+    }
+  }
+  unlink(path);
+  return ret;
+}
@@ -0,0 +1,542 @@
+#pragma once
+
+#include "benchmark.h"
+#include "output_writer.h"
+#include "screen.h"
+#include "screen_renderer.h"
+#include "terminfo.h"
+#include "thread_pool.h"
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class naive_renderer_t
+ * @brief the renderer to compare against. It finds the same dirty spans
+ * but addresses every one with cup and sets the style of every span.
+ */
+class naive_renderer_t {
+public:
+  naive_renderer_t(const terminal_caps_t &_caps, int rows, int columns)
+      : caps(_caps), front(rows, columns) {
+    cell_t unknown = {};
+    unknown.ch = ~char32_t{};
+    for (int r = 0; r < rows; r++)
+      std::fill(front.row(r), front.row(r) + columns, unknown);
+  }
+
+  void render(const screen_grid_t &next, output_writer_t &out) {
+    for (int r = 0; r < next.rows(); r++) {
+      const cell_t *want = next.row(r);
+      cell_t *have = front.row(r);
+      int c = {};
+      while (c < next.columns()) {
+        while (c < next.columns() && want[c] == have[c])
+          c++;
+        if (c == next.columns())
+          break;
+        int start = c;
+        while (c < next.columns() && want[c] != have[c])
+          c++;
+
+        char buffer[64] = {};
+        out.write(buffer, terminfo_expand(caps.cup, buffer, r, start));
+        style_t style = want[start].style;
+        out.write(buffer, append_sgr(style, buffer));
+        for (int n = start; n < c; n++) {
+          if (want[n].style != style) {
+            style = want[n].style;
+            out.write(buffer, append_sgr(style, buffer));
+          }
+          out.write(buffer, append_utf8(want[n].ch, buffer));
+        }
+        std::copy(want + start, want + c, have + start);
+      }
+    }
+    out.flush();
+  }
+
+private:
+  terminal_caps_t caps = {};
+  screen_grid_t front = {};
+};
+
+/**
+ * @class render_check_t
+ * @brief a small terminal that applies the output of the renderer so the
+ * benchmark can check the screen ends up as intended. It understands what
+ * the xterm capabilities produce: CSI H A B C D G d m, CR, LF and BS. With
+ * bonlcr LF returns to the first column as well, as a pty does with OPOST
+ * and ONLCR set.
+ */
+class render_check_t {
+public:
+  render_check_t(int rows, int columns, bool _bonlcr = false)
+      : screen(rows, columns), bonlcr(_bonlcr) {}
+
+  void apply(const std::string &bytes) {
+    std::size_t i = {};
+    while (i < bytes.size()) {
+      unsigned char ch = bytes[i++];
+      if (ch == '\r') {
+        col = 0;
+      } else if (ch == '\n') {
+        row = std::min(row + 1, screen.rows() - 1);
+        if (bonlcr)
+          col = 0;
+      } else if (ch == '\b') {
+        col = std::max(col - 1, 0);
+      } else if (ch == '\x1b' && i < bytes.size() && bytes[i] == '[') {
+        i++;
+        int params[8] = {};
+        int count = {};
+        while (i < bytes.size() &&
+               ((bytes[i] >= '0' && bytes[i] <= '9') || bytes[i] == ';')) {
+          if (bytes[i] == ';')
+            count = std::min(count + 1, 7);
+          else
+            params[count] = params[count] * 10 + (bytes[i] - '0');
+          i++;
+        }
+        count++;
+        if (i < bytes.size())
+          control(bytes[i++], params, count);
+      } else {
+        char32_t cp = ch;
+        int extra = ch >= 0xf0 ? 3 : ch >= 0xe0 ? 2 : ch >= 0xc0 ? 1 : 0;
+        if (extra)
+          cp &= 0x3f >> extra;
+        for (; extra && i < bytes.size(); extra--)
+          cp = (cp << 6) | (bytes[i++] & 0x3f);
+        if (col < screen.columns()) {
+          screen.at(row, col).ch = cp;
+          screen.at(row, col).style = style;
+        }
+        col = std::min(col + 1, screen.columns());
+      }
+    }
+  }
+
+  screen_grid_t screen;
+
+private:
+  void control(char final, int *params, int count) {
+    int n = std::max(params[0], 1);
+    switch (final) {
+    case 'H':
+      row = std::max(params[0], 1) - 1;
+      col = std::max(params[1], 1) - 1;
+      break;
+    case 'A':
+      row -= n;
+      break;
+    case 'B':
+      row += n;
+      break;
+    case 'C':
+      col += n;
+      break;
+    case 'D':
+      col -= n;
+      break;
+    case 'G':
+      col = n - 1;
+      break;
+    case 'd':
+      row = n - 1;
+      break;
+    case 'm':
+      style = {};
+      for (int k = 0; k < count; k++) {
+        if (params[k] == 1)
+          style.attrs |= style_t::bold;
+        else if (params[k] == 4)
+          style.attrs |= style_t::underline;
+        else if (params[k] == 7)
+          style.attrs |= style_t::reverse;
+        else if ((params[k] == 38 || params[k] == 48) && k + 2 < count) {
+          (params[k] == 38 ? style.fg : style.bg) = params[k + 2];
+          k += 2;
+        }
+      }
+      break;
+    }
+    row = std::min(std::max(row, 0), screen.rows() - 1);
+    col = std::min(std::max(col, 0), screen.columns() - 1);
+  }
+
+  bool bonlcr = {};
+  int row = {};
+  int col = {};
+  style_t style = {};
+};
+
+/**
+ * @struct frame_recording_t
+ * @brief a sequence of frames and the caret position of each. The frames
+ * are generated, after a shell, top and an editor, not captured from them.
+ * What output_recorder_t records are the bytes sent to the terminal, and
+ * turning those back into frames takes a full terminal emulator, more than
+ * render_check_t understands.
+ */
+struct frame_recording_t {
+  std::string name = {};
+  std::vector<screen_grid_t> frames = {};
+  std::vector<std::pair<int, int>> carets = {};
+};
+
+/**
+ * @fn record_shell_session
+ * @brief an 80x24 shell, a command typed a key per frame, then its output
+ * scrolling the screen.
+ */
+inline frame_recording_t record_shell_session() {
+  frame_recording_t rec = {"shell 80x24"};
+  screen_grid_t grid(24, 80);
+  const char *prompt = "user@host:~/src/key_code$ ";
+  const char *commands[] = {"ls -la /usr/share/doc | grep term",
+                            "git log --oneline | head -20",
+                            "make -j8 && ./key_code --bench terminals",
+                            "vi key_decoder.h"};
+  style_t prompt_style = {};
+  prompt_style.fg = 34;
+  prompt_style.attrs = style_t::bold;
+  int row = {};
+
+  for (auto command : commands) {
+    int col = grid.put_text(row, 0, prompt, prompt_style);
+    rec.frames.push_back(grid);
+    rec.carets.push_back({row, col});
+    for (const char *p = command; *p; p++) {
+      char ch[2] = {*p, 0};
+      col = grid.put_text(row, col, ch);
+      rec.frames.push_back(grid);
+      rec.carets.push_back({row, col});
+    }
+    for (int line = 0; line < 12; line++) {
+      if (++row == grid.rows()) {
+        grid.scroll_up();
+        row--;
+      }
+      std::string text = "-rw-r--r-- 1 user user " +
+                         std::to_string(1000 + line * 37) +
+                         " Oct 18 12:00 file_" + std::to_string(line);
+      grid.put_text(row, 0, text.c_str());
+      rec.frames.push_back(grid);
+      rec.carets.push_back({row, 0});
+    }
+    if (++row == grid.rows()) {
+      grid.scroll_up();
+      row--;
+    }
+  }
+  return rec;
+}
+
+/**
+ * @fn record_process_monitor
+ * @brief a 120x40 top like table where a few fields change every frame.
+ */
+inline frame_recording_t record_process_monitor() {
+  frame_recording_t rec = {"top 120x40"};
+  screen_grid_t grid(40, 120);
+  std::mt19937 rng(79);
+  style_t header = {};
+  header.attrs = style_t::reverse;
+
+  grid.put_text(0, 0,
+                "  PID USER      PR  NI    VIRT    RES  %CPU  %MEM     TIME+ "
+                "COMMAND",
+                header);
+  auto random = [&rng](unsigned range) {
+    return static_cast<unsigned>(rng() % range);
+  };
+
+  for (int frame = 0; frame < 200; frame++) {
+    for (int r = 1; r < grid.rows(); r++) {
+      if (frame && random(4))
+        continue;
+      char line[128] = {};
+      snprintf(line, sizeof(line),
+               "%5d user      20   0 %7u %6u %5.1f %5.1f %3u:%02u.%02u %s",
+               1000 + r * 7, 100000 + random(900000), 1000 + random(90000),
+               random(1000) / 10.0, random(500) / 10.0, random(100),
+               random(60), random(100), r % 3 ? "key_code" : "bash");
+      grid.put_text(r, 0, line);
+    }
+    rec.frames.push_back(grid);
+    rec.carets.push_back({0, 0});
+  }
+  return rec;
+}
+
+/**
+ * @fn record_editor
+ * @brief a 120x40 editor with line numbers, a highlighted cursor line that
+ * moves down a line per frame and a status line.
+ */
+inline frame_recording_t record_editor() {
+  frame_recording_t rec = {"editor 120x40"};
+  screen_grid_t grid(40, 120);
+  style_t number = {};
+  number.fg = 244;
+  style_t status = {};
+  status.attrs = style_t::reverse;
+
+  auto draw = [&](int top, int current) {
+    for (int r = 0; r < grid.rows() - 1; r++) {
+      style_t line_style = {};
+      if (top + r == current)
+        line_style.bg = 236;
+      char text[128] = {};
+      snprintf(text, sizeof(text), "%4d ", top + r + 1);
+      int col = grid.put_text(r, 0, text, number);
+      snprintf(text, sizeof(text), "  auto value_%d = compute(%d, %d);%*s",
+               (top + r) % 17, top + r, (top + r) * 3, 60, "");
+      grid.put_text(r, col, text, line_style);
+    }
+    char text[128] = {};
+    snprintf(text, sizeof(text), " key_decoder.h   Ln %d, Col 5%*s",
+             current + 1, 80, "");
+    grid.put_text(grid.rows() - 1, 0, text, status);
+  };
+
+  int top = {};
+  for (int current = 0; current < 200; current++) {
+    if (current - top >= grid.rows() - 1)
+      top++;
+    draw(top, current);
+    rec.frames.push_back(grid);
+    rec.carets.push_back({current - top, 5});
+  }
+  return rec;
+}
+
+/**
+ * @fn render_reproduces
+ * @brief renders rec with caps through a file, as to a terminal, and
+ * replays the bytes of each frame through render_check_t. True when every
+ * frame comes out exactly. bonlcr is how the terminal treats LF.
+ */
+inline bool render_reproduces(const terminal_caps_t &caps,
+                              const frame_recording_t &rec, bool bonlcr) {
+  int rows = rec.frames[0].rows();
+  int columns = rec.frames[0].columns();
+  FILE *file = tmpfile();
+  if (!file)
+    return false;
+  int fd = fileno(file);
+  std::string bytes = {};
+  bool bok = true;
+  output_writer_t frame_out(fd);
+  screen_renderer_t checked(caps, rows, columns);
+  render_check_t terminal(rows, columns, bonlcr);
+  for (std::size_t f = 0; bok && f < rec.frames.size(); f++) {
+    checked.render(rec.frames[f], frame_out, rec.carets[f].first,
+                   rec.carets[f].second);
+    lseek(fd, 0, SEEK_SET);
+    char chunk[4096] = {};
+    ssize_t n = {};
+    bytes.clear();
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+      bytes.append(chunk, n);
+    lseek(fd, 0, SEEK_SET);
+    if (ftruncate(fd, 0) != 0)
+      bok = false;
+    terminal.apply(bytes);
+    bok = bok && terminal.screen == rec.frames[f];
+  }
+  fclose(file);
+  return bok;
+}
+
+/**
+ * @fn bench_render
+ * @brief bytes per frame of screen_renderer_t against naive_renderer_t over
+ * the frame recordings, and the time to render a frame. The output of
+ * screen_renderer_t is replayed through render_check_t and has to produce
+ * every frame exactly, on a terminal with LF as a line feed only and with
+ * it as CR LF. Caps that do not know onlcr must be right on both, caps
+ * with onlcr set on the latter.
+ */
+inline int bench_render() {
+  terminal_caps_t caps = load_terminal_caps("xterm-256color");
+  int ret = EXIT_SUCCESS;
+
+  for (auto &rec : {record_shell_session(), record_process_monitor(),
+                    record_editor()}) {
+    int rows = rec.frames[0].rows();
+    int columns = rec.frames[0].columns();
+
+    output_writer_t naive_out(-1);
+    naive_renderer_t naive(caps, rows, columns);
+    for (auto &frame : rec.frames)
+      naive.render(frame, naive_out);
+
+    output_writer_t out(-1);
+    screen_renderer_t renderer(caps, rows, columns);
+    benchmark_timer_t timer;
+    for (std::size_t f = 0; f < rec.frames.size(); f++)
+      renderer.render(rec.frames[f], out, rec.carets[f].first,
+                      rec.carets[f].second);
+    double ns = timer.elapsed_ns();
+
+    terminal_caps_t onlcr = caps;
+    onlcr.onlcr = true;
+    const struct {
+      const terminal_caps_t *caps;
+      bool bonlcr;
+      const char *name;
+    } checks[] = {{&caps, false, "LF"},
+                  {&caps, true, "CR LF"},
+                  {&onlcr, true, "CR LF with onlcr"}};
+    for (auto &check : checks)
+      if (!render_reproduces(*check.caps, rec, check.bonlcr)) {
+        printf("render %s: the output does not reproduce the frame, %s\n",
+               rec.name.c_str(), check.name);
+        ret = EXIT_FAILURE;
+      }
+
+    double frames = static_cast<double>(rec.frames.size());
+    double naive_bytes = naive_out.bytes_written() / frames;
+    double planned_bytes = out.bytes_written() / frames;
+    benchmark_report("render", rec.name + " naive", naive_bytes,
+                     "bytes/frame");
+    benchmark_report("render", rec.name + " planned", planned_bytes,
+                     "bytes/frame");
+    benchmark_report("render", rec.name + " saved",
+                     100.0 * (1.0 - planned_bytes / naive_bytes), "%");
+    benchmark_report("render", rec.name + " planned", ns / frames,
+                     "ns/frame");
+  }
+  return ret;
+}
+
+/**
+ * @fn record_panes
+ * @brief a 400x120 multiplexer, eight 100x60 panes in two rows. Each pane
+ * is a top like table with a quarter of its lines changing every frame,
+ * and the log pane in the corner scrolls a line per frame.
+ */
+inline frame_recording_t record_panes() {
+  frame_recording_t rec = {"panes 400x120"};
+  const int pane_rows = 60;
+  const int pane_columns = 100;
+  screen_grid_t grid(2 * pane_rows, 4 * pane_columns);
+  std::mt19937 rng(84);
+  style_t border = {};
+  border.fg = 240;
+  style_t header = {};
+  header.attrs = style_t::reverse;
+  auto random = [&rng](unsigned range) {
+    return static_cast<unsigned>(rng() % range);
+  };
+
+  for (int frame = 0; frame < 100; frame++) {
+    for (int pane = 0; pane < 8; pane++) {
+      int top = pane / 4 * pane_rows;
+      int left = pane % 4 * pane_columns;
+      for (int r = top; r < top + pane_rows; r++)
+        grid.put_text(r, left + pane_columns - 1, "\xe2\x94\x82", border);
+      if (pane == 7) {
+        for (int r = top; r < top + pane_rows - 1; r++)
+          std::copy(grid.row(r + 1) + left,
+                    grid.row(r + 1) + left + pane_columns - 1,
+                    grid.row(r) + left);
+        char line[128] = {};
+        snprintf(line, sizeof(line), "%-99s",
+                 ("[" + std::to_string(frame) + "] request served in " +
+                  std::to_string(random(5000)) + " us")
+                     .c_str());
+        grid.put_text(top + pane_rows - 1, left, line);
+        continue;
+      }
+      grid.put_text(top, left,
+                    "  PID USER      %CPU  %MEM     TIME+ COMMAND"
+                    "                                                   "
+                    "       ",
+                    header);
+      for (int r = top + 1; r < top + pane_rows; r++) {
+        if (frame && random(4))
+          continue;
+        char line[128] = {};
+        snprintf(line, sizeof(line),
+                 "%5d user     %5.1f %5.1f %3u:%02u.%02u %-50s",
+                 1000 + r * 7, random(1000) / 10.0, random(500) / 10.0,
+                 random(100), random(60), random(100),
+                 r % 3 ? "key_code --bench render" : "bash");
+        style_t style = {};
+        style.fg = static_cast<u_int16_t>(r % 5 ? 252 : 160 + pane);
+        grid.put_text(r, left, line, style);
+      }
+    }
+    rec.frames.push_back(grid);
+    rec.carets.push_back({0, 0});
+  }
+  return rec;
+}
+
+/**
+ * @fn bench_render_threads
+ * @brief the time to render a frame of a very large grid with the rows
+ * split over 1 to 16 threads, against rendering on the calling thread
+ * alone, and the bytes the bands add. The output of every thread count is
+ * replayed through render_check_t and has to produce every frame exactly.
+ */
+inline int bench_render_threads() {
+  terminal_caps_t caps = load_terminal_caps("xterm-256color");
+  frame_recording_t rec = record_panes();
+  int rows = rec.frames[0].rows();
+  int columns = rec.frames[0].columns();
+  double frames = static_cast<double>(rec.frames.size());
+  int ret = EXIT_SUCCESS;
+
+  benchmark_report("render", "hardware threads",
+                   std::thread::hardware_concurrency(), "threads");
+  {
+    output_writer_t out(-1);
+    screen_renderer_t renderer(caps, rows, columns);
+    benchmark_timer_t timer;
+    for (auto &frame : rec.frames)
+      renderer.render(frame, out, 0, 0);
+    double ns = timer.elapsed_ns();
+    benchmark_report("render", rec.name + " single", ns / frames,
+                     "ns/frame");
+    benchmark_report("render", rec.name + " single",
+                     out.bytes_written() / frames, "bytes/frame");
+  }
+
+  for (std::size_t threads : {1, 2, 4, 8, 16}) {
+    thread_pool_t pool(threads);
+    std::string name = rec.name + " " + std::to_string(threads) + " threads";
+
+    output_writer_t out(-1);
+    screen_renderer_t renderer(caps, rows, columns);
+    benchmark_timer_t timer;
+    for (auto &frame : rec.frames)
+      renderer.render(frame, out, pool, 0, 0);
+    double ns = timer.elapsed_ns();
+    benchmark_report("render", name, ns / frames, "ns/frame");
+    benchmark_report("render", name, out.bytes_written() / frames,
+                     "bytes/frame");
+
+    output_writer_t captured(output_writer_t::capture);
+    screen_renderer_t checked(caps, rows, columns);
+    render_check_t terminal(rows, columns);
+    for (auto &frame : rec.frames) {
+      checked.render(frame, captured, pool, 0, 0);
+      terminal.apply(std::string(captured.data(), captured.pending()));
+      captured.clear();
+      if (!(terminal.screen == frame)) {
+        printf("render %s: the output does not reproduce the frame\n",
+               name.c_str());
+        ret = EXIT_FAILURE;
+        break;
+      }
+    }
+  }
+  return ret;
+}
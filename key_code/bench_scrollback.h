@@ -0,0 +1,242 @@
+#pragma once
+
+#include "benchmark.h"
+#include "key_decoder.h"
+#include "scrollback.h"
+#include "screen.h"
+#include "text_search.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * @fn scrollback_sample_line
+ * @brief line i of a made up build and service log, the same every time.
+ * Build steps, compiler warnings, log records and directory listings, with
+ * the colors they usually have.
+ */
+inline void scrollback_sample_line(u_int64_t i, screen_grid_t &row) {
+  u_int64_t h = i * 0x9e3779b97f4a7c15ull;
+  h = (h ^ (h >> 31)) * 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 29;
+  auto pick = [&h](unsigned range) {
+    h = h * 6364136223846793005ull + 1442695040888963407ull;
+    return static_cast<unsigned>((h >> 33) % range);
+  };
+
+  row.clear();
+  char text[160] = {};
+  style_t plain = {};
+  switch (pick(4)) {
+  case 0: {
+    style_t green = {};
+    green.fg = 2;
+    snprintf(text, sizeof(text), "[%3u%%] ", pick(101));
+    int col = row.put_text(0, 0, text, green);
+    snprintf(text, sizeof(text),
+             "Building CXX object src/CMakeFiles/app.dir/module_%u.cpp.o",
+             pick(500));
+    row.put_text(0, col, text, plain);
+    break;
+  }
+  case 1: {
+    snprintf(text, sizeof(text), "src/module_%u.cpp:%u:%u: ", pick(500),
+             pick(2000), pick(80));
+    int col = row.put_text(0, 0, text, plain);
+    style_t warning = {};
+    warning.fg = 5;
+    warning.attrs = style_t::bold;
+    col = row.put_text(0, col, "warning: ", warning);
+    snprintf(text, sizeof(text),
+             "unused variable 'x_%u' [-Wunused-variable]", pick(100));
+    row.put_text(0, col, text, plain);
+    break;
+  }
+  case 2:
+    snprintf(text, sizeof(text),
+             "2026-10-18 12:%02u:%02u.%03u INFO  worker[%u] request %06x "
+             "served in %u us",
+             pick(60), pick(60), pick(1000), pick(16), pick(1 << 24),
+             pick(5000));
+    row.put_text(0, 0, text, plain);
+    break;
+  default:
+    snprintf(text, sizeof(text),
+             "-rw-r--r-- 1 user user %7u Oct 18 12:00 file_%u.txt",
+             pick(1000000), pick(10000));
+    row.put_text(0, 0, text, plain);
+    break;
+  }
+}
+
+inline std::string scrollback_utf8(const std::vector<cell_t> &cells) {
+  std::string s = {};
+  for (auto &cell : cells) {
+    char utf8[4] = {};
+    s.append(utf8, append_utf8(cell.ch, utf8));
+  }
+  return s;
+}
+
+/**
+ * @fn bench_scrollback
+ * @brief the memory of 100,000 lines of 120 columns kept as cells against
+ * the compressed scrollback, the cost of pushing a line and of reading one
+ * back, the search speed of each search implementation and of a search
+ * through the whole scrollback, and the latency of the incremental search
+ * per key. Lines read back must be the lines pushed and searches must find
+ * what a plain search of the pushed lines finds.
+ */
+inline int bench_scrollback() {
+  const int columns = 120;
+  const u_int64_t lines = 100000;
+  const int panes = 200;
+  int ret = EXIT_SUCCESS;
+
+  screen_grid_t row(1, columns);
+  scrollback_t scrollback;
+  scrollback.max_lines = lines;
+  benchmark_timer_t timer;
+  double generate_ns = {};
+  for (u_int64_t i = 0; i < lines; i++) {
+    benchmark_timer_t generate;
+    scrollback_sample_line(i, row);
+    generate_ns += generate.elapsed_ns();
+    scrollback.push(row.row(0), columns);
+  }
+  double push_ns = (timer.elapsed_ns() - generate_ns) / lines;
+
+  double raw = static_cast<double>(lines) * columns * sizeof(cell_t);
+  double stored = static_cast<double>(scrollback.stored_bytes());
+  benchmark_report("scrollback", "push", push_ns, "ns/line");
+  benchmark_report("scrollback", "100k lines as cells", raw / (1 << 20),
+                   "MB");
+  benchmark_report("scrollback", "100k lines compressed",
+                   stored / (1 << 20), "MB");
+  benchmark_report("scrollback", "ratio", raw / stored, "x");
+  benchmark_report("scrollback", std::to_string(panes) + " panes as cells",
+                   panes * raw / (1 << 30), "GB");
+  benchmark_report("scrollback",
+                   std::to_string(panes) + " panes compressed",
+                   panes * stored / (1 << 30), "GB");
+
+  std::vector<cell_t> cells = {};
+  std::vector<std::string> texts(lines);
+  for (u_int64_t i = 0; i < lines; i++) {
+    scrollback_sample_line(i, row);
+    std::vector<cell_t> want(row.row(0), row.row(0) + columns);
+    while (!want.empty() && want.back() == cell_t{})
+      want.pop_back();
+    texts[i] = scrollback_utf8(want);
+    if (i % 97 == 0 && (!scrollback.line(i, cells) || cells != want)) {
+      printf("scrollback line %lu does not read back as pushed\n",
+             static_cast<unsigned long>(i));
+      ret = EXIT_FAILURE;
+      break;
+    }
+  }
+  timer.restart();
+  for (u_int64_t i = 0; i < 1000; i++)
+    scrollback.line(lines - 1 - i * 97, cells);
+  benchmark_report("scrollback", "read a line", timer.elapsed_ns() / 1000,
+                   "ns/line");
+
+  // one block of text, searched by every implementation.
+  std::string block = {};
+  for (u_int64_t i = 0; block.size() < (1 << 20); i++)
+    block += texts[i] + "\n";
+  const char *impl_names[] = {"scalar", "sse2", "avx2"};
+  const std::string rare = "no such text";
+  for (int impl = 0; impl <= static_cast<int>(text_search_detect_impl());
+       impl++) {
+    auto search_impl = static_cast<text_search_impl_t>(impl);
+    const int rounds = 20;
+    timer.restart();
+    std::size_t found = {};
+    for (int r = 0; r < rounds; r++)
+      found += text_rfind(block.data(), block.size(), rare.data(),
+                          rare.size(), text_npos, search_impl) != text_npos;
+    double seconds = timer.elapsed_ns() / 1e9;
+    benchmark_report("scrollback",
+                     std::string("search 1 MB ") + impl_names[impl],
+                     rounds * block.size() / seconds / (1 << 20), "MB/s");
+    std::string needle = texts[123];
+    std::size_t at = text_find(block.data(), block.size(), needle.data(),
+                               needle.size(), 0, search_impl);
+    std::size_t back = text_rfind(block.data(), block.size(), needle.data(),
+                                  needle.size(), text_npos, search_impl);
+    if (found || at != block.find(needle) || back != block.rfind(needle)) {
+      printf("scrollback search %s found the wrong position\n",
+             impl_names[impl]);
+      ret = EXIT_FAILURE;
+    }
+  }
+
+  double text_bytes = {};
+  for (auto &t : texts)
+    text_bytes += t.size() + 1;
+  timer.restart();
+  auto miss = scrollback.find_older(rare, ~u_int64_t{}, 0);
+  double ns = timer.elapsed_ns();
+  benchmark_report("scrollback", "search 100k lines, no match", ns / 1e6,
+                   "ms");
+  benchmark_report("scrollback", "search 100k lines, no match",
+                   text_bytes / (ns / 1e9) / (1 << 20), "MB/s");
+  if (miss.bfound)
+    ret = EXIT_FAILURE;
+
+  const std::string query = "unused variable 'x_42'";
+  u_int64_t expected = lines;
+  for (u_int64_t i = lines; i-- > 0;)
+    if (texts[i].find(query) != std::string::npos) {
+      expected = i;
+      break;
+    }
+
+  scrollback_search_t search(scrollback);
+  search.start();
+  timer.restart();
+  for (char c : query) {
+    key_event_t e = {};
+    e.c = c;
+    search.key(e);
+  }
+  ns = timer.elapsed_ns();
+  benchmark_report("scrollback", "incremental search",
+                   ns / query.size() / 1000, "us/key");
+
+  std::size_t steps = {};
+  u_int64_t previous = search.match().line;
+  key_event_t older = {};
+  older.vk = vkey_t::UP_ARROW;
+  timer.restart();
+  for (int n = 0; n < 100; n++) {
+    search.key(older);
+    if (search.match().line == previous)
+      break;
+    previous = search.match().line;
+    steps++;
+  }
+  if (steps)
+    benchmark_report("scrollback", "next older match",
+                     timer.elapsed_ns() / steps / 1000, "us/key");
+
+  const auto &m = search.match();
+  if (!m.bfound || m.line > expected ||
+      (steps == 0 && m.line != expected) ||
+      texts[m.line].compare(m.column, query.size(), query) != 0) {
+    printf("scrollback incremental search did not find the query\n");
+    ret = EXIT_FAILURE;
+  }
+  auto newer = scrollback.find_newer(query, 0, 0);
+  u_int64_t first_expected = {};
+  while (first_expected < lines &&
+         texts[first_expected].find(query) == std::string::npos)
+    first_expected++;
+  if (!newer.bfound || newer.line != first_expected) {
+    printf("scrollback search for newer lines found the wrong line\n");
+    ret = EXIT_FAILURE;
+  }
+  return ret;
+}
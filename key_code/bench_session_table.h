@@ -0,0 +1,204 @@
+#pragma once
+
+#include "benchmark.h"
+#include "session_table.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @struct table_session_t
+ * @brief stands in for a session, it knows its own fd so a lookup that
+ * returned the wrong one, or a freed one, is seen.
+ */
+struct table_session_t {
+  int fd = -1;
+  u_int64_t check = {};
+
+  explicit table_session_t(int _fd)
+      : fd(_fd), check(static_cast<u_int64_t>(_fd) * 0x9e3779b97f4a7c15ull) {}
+  ~table_session_t() { fd = -2; }
+
+  bool valid(int want) const {
+    return fd == want &&
+           check == static_cast<u_int64_t>(want) * 0x9e3779b97f4a7c15ull;
+  }
+};
+
+/**
+ * @struct table_run_t
+ * @brief what the readers and the writer of one run did.
+ */
+struct table_run_t {
+  double lookups_per_s = {};
+  double writes_per_s = {};
+  std::size_t wrong = {};
+};
+
+/**
+ * @fn run_table_lookups
+ * @brief threads look up fds as fast as they can for a while, one more
+ * thread opens and closes sessions meanwhile. lookup(fd) returns whether
+ * the fd was found and, when so, whether the session was the right one,
+ * open(fd) and close(fd) change the table.
+ */
+template <typename L, typename O, typename C>
+table_run_t run_table_lookups(int threads, int stable, int churn,
+                              std::chrono::milliseconds duration,
+                              L &&lookup, O &&open, C &&close) {
+  std::atomic<bool> bstop{false};
+  std::atomic<u_int64_t> lookups{0};
+  std::atomic<u_int64_t> writes{0};
+  std::atomic<std::size_t> wrong{0};
+  std::vector<std::thread> readers = {};
+  for (int t = 0; t < threads; t++)
+    readers.emplace_back([&, t] {
+      u_int64_t n = {};
+      std::size_t bad = {};
+      u_int32_t x = 2463534242u + t;
+      while (!bstop.load(std::memory_order_relaxed)) {
+        for (int i = 0; i < 256; i++) {
+          x ^= x << 13;
+          x ^= x >> 17;
+          x ^= x << 5;
+          int fd = static_cast<int>(x % (stable + churn));
+          // the stable fds must be found, the others may or may not be.
+          int r = lookup(fd);
+          if (r < 0 || (r == 0 && fd < stable))
+            bad++;
+        }
+        n += 256;
+      }
+      lookups += n;
+      wrong += bad;
+    });
+  std::thread writer([&] {
+    u_int64_t n = {};
+    for (int fd = stable; !bstop.load(std::memory_order_relaxed); fd++) {
+      if (fd == stable + churn)
+        fd = stable;
+      close(fd);
+      open(fd);
+      n += 2;
+    }
+    writes = n;
+  });
+
+  benchmark_timer_t timer;
+  std::this_thread::sleep_for(duration);
+  bstop = true;
+  for (auto &r : readers)
+    r.join();
+  writer.join();
+  double seconds = timer.elapsed_ns() / 1e9;
+  return {lookups / seconds, writes / seconds, wrong};
+}
+
+/**
+ * @fn bench_session_table
+ * @brief lookups of 10,000 sessions by 64 threads at once while another
+ * thread keeps closing and opening sessions. The session table is set
+ * against one map behind a mutex and one behind a reader writer lock.
+ * Every lookup must return the session of its fd, and every session closed
+ * must be freed once the readers are gone.
+ */
+inline int bench_session_table() {
+  const int threads = 64;
+  const int stable = 10000;
+  const int churn = 1000;
+  const auto duration = std::chrono::milliseconds(300);
+  int ret = EXIT_SUCCESS;
+
+  {
+    session_table_t<table_session_t> table;
+    for (int fd = 0; fd < stable + churn; fd++)
+      table.insert(fd, std::make_unique<table_session_t>(fd));
+    auto run = run_table_lookups(
+        threads, stable, churn, duration,
+        [&](int fd) {
+          rcu_read_t read;
+          table_session_t *s = table.lookup(fd);
+          return s ? (s->valid(fd) ? 1 : -1) : 0;
+        },
+        [&](int fd) {
+          table.insert(fd, std::make_unique<table_session_t>(fd));
+        },
+        [&](int fd) { table.remove(fd); });
+    benchmark_report("table", "rcu session table lookups",
+                     run.lookups_per_s / 1e6, "M/s");
+    benchmark_report("table", "rcu session table writes",
+                     run.writes_per_s / 1e3, "k/s");
+    rcu_domain().reclaim();
+    if (run.wrong || rcu_domain().pending()) {
+      printf("table rcu lookups wrong %zu, %zu retired left\n", run.wrong,
+             rcu_domain().pending());
+      ret = EXIT_FAILURE;
+    }
+  }
+
+  {
+    std::mutex mutex;
+    std::unordered_map<int, std::unique_ptr<table_session_t>> map;
+    for (int fd = 0; fd < stable + churn; fd++)
+      map[fd] = std::make_unique<table_session_t>(fd);
+    auto run = run_table_lookups(
+        threads, stable, churn, duration,
+        [&](int fd) {
+          std::lock_guard<std::mutex> lock(mutex);
+          auto it = map.find(fd);
+          return it == map.end() ? 0 : it->second->valid(fd) ? 1 : -1;
+        },
+        [&](int fd) {
+          auto s = std::make_unique<table_session_t>(fd);
+          std::lock_guard<std::mutex> lock(mutex);
+          map[fd] = std::move(s);
+        },
+        [&](int fd) {
+          std::lock_guard<std::mutex> lock(mutex);
+          map.erase(fd);
+        });
+    benchmark_report("table", "mutex map lookups", run.lookups_per_s / 1e6,
+                     "M/s");
+    benchmark_report("table", "mutex map writes", run.writes_per_s / 1e3,
+                     "k/s");
+    if (run.wrong)
+      ret = EXIT_FAILURE;
+  }
+
+  {
+    std::shared_mutex mutex;
+    std::unordered_map<int, std::unique_ptr<table_session_t>> map;
+    for (int fd = 0; fd < stable + churn; fd++)
+      map[fd] = std::make_unique<table_session_t>(fd);
+    auto run = run_table_lookups(
+        threads, stable, churn, duration,
+        [&](int fd) {
+          std::shared_lock<std::shared_mutex> lock(mutex);
+          auto it = map.find(fd);
+          return it == map.end() ? 0 : it->second->valid(fd) ? 1 : -1;
+        },
+        [&](int fd) {
+          auto s = std::make_unique<table_session_t>(fd);
+          std::unique_lock<std::shared_mutex> lock(mutex);
+          map[fd] = std::move(s);
+        },
+        [&](int fd) {
+          std::unique_lock<std::shared_mutex> lock(mutex);
+          map.erase(fd);
+        });
+    benchmark_report("table", "shared mutex map lookups",
+                     run.lookups_per_s / 1e6, "M/s");
+    benchmark_report("table", "shared mutex map writes",
+                     run.writes_per_s / 1e3, "k/s");
+    if (run.wrong)
+      ret = EXIT_FAILURE;
+  }
+  return ret;
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "bench_scrollback.h"
+#include "benchmark.h"
+#include "session.h"
+#include "session_snapshot.h"
+#include "terminfo.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @fn snapshot_same_session
+ * @brief whether b has the screen and, at sampled lines, the scrollback
+ * of a.
+ */
+inline bool snapshot_same_session(const session_t &a, const session_t &b) {
+  const screen_grid_t &x = a.screen();
+  const screen_grid_t &y = b.screen();
+  if (x.rows() != y.rows() || x.columns() != y.columns())
+    return false;
+  for (int r = 0; r < x.rows(); r++)
+    for (int c = 0; c < x.columns(); c++)
+      if (x.at(r, c) != y.at(r, c))
+        return false;
+  const scrollback_t &p = a.scrollback();
+  const scrollback_t &q = b.scrollback();
+  if (p.first_line() != q.first_line() || p.end_line() != q.end_line())
+    return false;
+  std::vector<cell_t> u = {};
+  std::vector<cell_t> v = {};
+  for (u_int64_t l = p.first_line(); l < p.end_line(); l += 89)
+    if (!p.line(l, u) || !q.line(l, v) || u != v)
+      return false;
+  return p.line(p.end_line() - 1, u) && q.line(q.end_line() - 1, v) && u == v;
+}
+
+/**
+ * @fn snapshot_collision
+ * @brief two blocks of the same block_hash, written one snapshot after
+ * the other and together, must each read back as written. The hash is a
+ * chain of invertible steps, so the second word can undo a change to the
+ * first.
+ */
+inline bool snapshot_collision(const char *path) {
+  std::vector<u_int8_t> a(snapshot_block_size, 'a');
+  std::vector<u_int8_t> b = a;
+  auto step = [](u_int64_t h, u_int64_t w) {
+    h = (h ^ w) * 0xff51afd7ed558ccdull;
+    return h ^ (h >> 32);
+  };
+  u_int64_t seed = 0x9e3779b97f4a7c15ull ^ snapshot_block_size;
+  u_int64_t w0 = {};
+  u_int64_t w1 = {};
+  memcpy(&w0, a.data(), 8);
+  memcpy(&w1, a.data() + 8, 8);
+  u_int64_t changed = w0 ^ 1;
+  w1 ^= step(seed, w0) ^ step(seed, changed);
+  memcpy(b.data(), &changed, 8);
+  memcpy(b.data() + 8, &w1, 8);
+  if (block_hash(a.data(), a.size()) != block_hash(b.data(), b.size()))
+    return false;
+
+  snapshot_writer_t writer(path);
+  const std::vector<std::vector<u_int8_t>> images[] = {{a}, {b}, {a, b}};
+  for (auto &blocks : images) {
+    snapshot_image_t image;
+    for (auto &block : blocks)
+      image.put(block.data(), block.size());
+    snapshot_reader_t reader;
+    std::vector<u_int8_t> back(snapshot_block_size);
+    if (!writer.write(image) || !reader.open(path))
+      return false;
+    for (std::size_t i = 0; i < blocks.size(); i++)
+      if (!reader.read(i * snapshot_block_size, back.data(), back.size()) ||
+          back != blocks[i])
+        return false;
+  }
+  return true;
+}
+
+/**
+ * @fn bench_snapshot
+ * @brief a 200x60 session with 100,000 lines of scrollback saved to a
+ * snapshot file, then saved again after a few rows changed and a hundred
+ * lines scrolled off, which must write only a small part of the file. The
+ * latest snapshot is mapped and restored into a new session, which must
+ * equal the first. A torn superblock must leave the snapshot before it,
+ * and blocks whose hashes collide must not be taken for each other.
+ */
+inline int bench_snapshot() {
+  const int rows = 60;
+  const int columns = 200;
+  const u_int64_t lines = 100000;
+  terminal_caps_t caps = load_terminal_caps("xterm-256color");
+  int ret = EXIT_SUCCESS;
+
+  char path[] = "/tmp/key_code_snapshot_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    printf("snapshot cannot create a file in /tmp\n");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+
+  session_t s(terminal_policy_t::generic, caps, rows, columns);
+  screen_grid_t row(1, columns);
+  u_int64_t next = {};
+  auto scroll = [&](u_int64_t n) {
+    for (u_int64_t i = 0; i < n; i++, next++) {
+      scrollback_sample_line(next, row);
+      std::copy(row.row(0), row.row(0) + columns,
+                s.screen().row(rows - 1));
+      s.scroll();
+    }
+  };
+  scroll(lines + rows);
+
+  snapshot_image_t image;
+  snapshot_writer_t writer(path);
+  benchmark_timer_t timer;
+  snapshot_session(s, 3, 4, image);
+  double image_ms = timer.elapsed_ns() / 1e6;
+  timer.restart();
+  bool bwritten = writer.write(image);
+  double write_ms = timer.elapsed_ns() / 1e6;
+  benchmark_report("snapshot", "image", image.bytes.size() / 1024.0, "KB");
+  benchmark_report("snapshot", "build image", image_ms, "ms");
+  benchmark_report("snapshot", "first snapshot", write_ms, "ms");
+  benchmark_report("snapshot", "first snapshot blocks",
+                   writer.last_written_blocks(), "blocks");
+
+  s.screen().put_text(10, 0, "edited row");
+  s.screen().put_text(20, 5, "another one");
+  scroll(100);
+  timer.restart();
+  snapshot_session(s, 7, 8, image);
+  bwritten = writer.write(image) && bwritten;
+  write_ms = timer.elapsed_ns() / 1e6;
+  std::size_t incremental = writer.last_written_blocks();
+  std::size_t total = image.bytes.size() / snapshot_block_size;
+  benchmark_report("snapshot", "rolling snapshot", write_ms, "ms");
+  benchmark_report("snapshot", "rolling snapshot blocks", incremental,
+                   "blocks");
+  benchmark_report("snapshot", "rolling snapshot share",
+                   100.0 * incremental / total, "%");
+  benchmark_report("snapshot", "file", writer.file_size() / 1024.0, "KB");
+  if (!bwritten || incremental * 10 > total) {
+    printf("snapshot rolling snapshot wrote %zu of %zu blocks\n",
+           incremental, total);
+    ret = EXIT_FAILURE;
+  }
+
+  timer.restart();
+  snapshot_reader_t reader;
+  snapshot_header_t h = {};
+  int caret_row = {};
+  int caret_col = {};
+  bool bloaded = reader.open(path) && snapshot_read_header(reader, h);
+  session_t restored(static_cast<terminal_policy_t>(h.policy), caps,
+                     bloaded ? h.rows : 1, bloaded ? h.columns : 1);
+  bloaded = bloaded && restore_session(reader, restored, caret_row,
+                                       caret_col);
+  benchmark_report("snapshot", "map and restore", timer.elapsed_ns() / 1e6,
+                   "ms");
+  if (!bloaded || caret_row != 7 || caret_col != 8 ||
+      restored.policy() != s.policy() || !snapshot_same_session(s, restored)) {
+    printf("snapshot restored session is not the saved one\n");
+    ret = EXIT_FAILURE;
+  }
+
+  // a later snapshot whose superblock is torn must not be taken.
+  u_int64_t saved = writer.last_generation();
+  scroll(10);
+  snapshot_session(s, 0, 0, image);
+  writer.write(image);
+  fd = open(path, O_WRONLY);
+  const char torn[] = "torn";
+  if (fd < 0 || pwrite(fd, torn, sizeof(torn),
+                       (writer.last_generation() % 2) * snapshot_block_size +
+                           16) != sizeof(torn)) {
+    ret = EXIT_FAILURE;
+  }
+  if (fd >= 0)
+    close(fd);
+  snapshot_reader_t fallback;
+  if (!fallback.open(path) || fallback.generation() != saved) {
+    printf("snapshot torn superblock did not fall back\n");
+    ret = EXIT_FAILURE;
+  }
+  unlink(path);
+
+  if (!snapshot_collision(path)) {
+    printf("snapshot blocks of the same hash were mixed up\n");
+    ret = EXIT_FAILURE;
+  }
+  unlink(path);
+  return ret;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "benchmark.h"
+#include "syscall_tracer.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * @struct syscall_budget_t
+ * @brief at most limit calls of the named system call per event.
+ */
+struct syscall_budget_t {
+  const char *name = {};
+  double limit = {};
+};
+
+/**
+ * @struct syscall_workload_t
+ * @brief input typed into the demo, how many events it holds, counted in
+ * unit, and the budgets the demo has to keep for it.
+ */
+struct syscall_workload_t {
+  std::string name = {};
+  std::vector<pty_input_t> input = {};
+  double events = {};
+  const char *unit = {};
+  std::vector<syscall_budget_t> budgets = {};
+};
+
+/**
+ * @fn syscall_workloads
+ * @brief typing a key at a time, cursor keys, the lone ESC that waits for
+ * the escape timeout and a 16 KB paste. Each ends with q to quit the demo.
+ * A key or a paste costs the demo a read and no termios calls, the ESC a
+ * poll as well for the wait.
+ */
+inline std::vector<syscall_workload_t> syscall_workloads() {
+  const unsigned key_ms = 5;
+  std::vector<syscall_workload_t> workloads = {};
+
+  syscall_workload_t typing = {"typing", {}, 100, "key"};
+  for (int i = 0; i < 100; i++)
+    typing.input.push_back({std::string(1, "abcdefghijklmnop"[i % 16]),
+                            key_ms});
+  typing.budgets = {{"read", 1}, {"ioctl TCGETS", 0}, {"ioctl TCSETS", 0}};
+  workloads.push_back(typing);
+
+  syscall_workload_t arrows = {"cursor keys", {}, 100, "key"};
+  const char *keys[] = {"\x1b[A", "\x1b[B", "\x1b[C", "\x1b[D"};
+  for (int i = 0; i < 100; i++)
+    arrows.input.push_back({keys[i % 4], key_ms});
+  arrows.budgets = {{"read", 1}, {"ioctl TCGETS", 0}, {"ioctl TCSETS", 0}};
+  workloads.push_back(arrows);
+
+  syscall_workload_t escape = {"lone ESC", {}, 10, "key"};
+  for (int i = 0; i < 10; i++)
+    escape.input.push_back({"\x1b", 150});
+  // the wait for the rest of a sequence is a poll, the settings stay.
+  escape.budgets = {{"read", 1},
+                    {"poll", 1},
+                    {"ioctl TCGETS", 0},
+                    {"ioctl TCSETS", 0}};
+  workloads.push_back(escape);
+
+  syscall_workload_t paste = {"paste 16 KB", {}, 16, "KB"};
+  std::string text = {};
+  while (text.size() < 16 << 10)
+    text += "the quick brown fox jumps over the lazy dog ";
+  text.resize(16 << 10);
+  for (auto &ch : text)
+    if (ch == 'q')
+      ch = 'Q';
+  paste.input.push_back({text, key_ms});
+  paste.budgets = {{"read", 1}, {"ioctl TCGETS", 0}, {"ioctl TCSETS", 0}};
+  workloads.push_back(paste);
+
+  for (auto &w : workloads)
+    w.input.push_back({"q", 50});
+  return workloads;
+}
+
+/**
+ * @fn bench_syscalls
+ * @brief the system call budget harness. The demo is run under ptrace on a
+ * pseudo terminal with each workload, and once with only q to quit, whose
+ * counts are subtracted. The remaining calls are reported per event, by
+ * name, and a workload that goes over one of its budgets fails the run.
+ * Where ptrace is not permitted the harness reports so and skips.
+ */
+inline int bench_syscalls() {
+  char path[] = "/proc/self/exe";
+  char *argv[] = {path, nullptr};
+  const char *term = "xterm-256color";
+  syscall_tracer_t tracer;
+  int ret = EXIT_SUCCESS;
+
+  syscall_tracer_t::counts_t baseline = {};
+  if (!tracer.run(path, argv, term, {{"q", 50}}, baseline)) {
+    printf("syscalls     the demo could not be traced, skipped\n");
+    return ret;
+  }
+
+  for (auto &w : syscall_workloads()) {
+    syscall_tracer_t::counts_t counts = {};
+    if (!tracer.run(path, argv, term, w.input, counts)) {
+      printf("syscalls %s: the demo did not run to the end\n",
+             w.name.c_str());
+      ret = EXIT_FAILURE;
+      continue;
+    }
+
+    auto per_event = [&](const std::string &name) {
+      double n = static_cast<double>(counts[name]) -
+                 static_cast<double>(baseline[name]);
+      return n / w.events;
+    };
+    std::string unit = std::string("calls/") + w.unit;
+    double total = {};
+    for (auto &c : counts) {
+      double n = per_event(c.first);
+      total += n;
+      if (n != 0)
+        benchmark_report("syscalls", w.name + " " + c.first, n,
+                         unit.c_str());
+    }
+    benchmark_report("syscalls", w.name + " total", total, unit.c_str());
+
+    for (auto &budget : w.budgets) {
+      double n = per_event(budget.name);
+      if (n > budget.limit) {
+        printf("syscalls %s: %.2f %s per %s, the budget is %.2f\n",
+               w.name.c_str(), n, budget.name, w.unit, budget.limit);
+        ret = EXIT_FAILURE;
+      }
+    }
+  }
+  return ret;
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "benchmark.h"
+#include "key_decoder.h"
+#include "terminal_corpus.h"
+#include "terminal_policy.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * @fn decode_corpus_key
+ * @brief decodes a single keystroke of the corpus, split into pieces of
+ * piece_size bytes, and checks it comes out as one event of the expected
+ * virtual key. A pending sequence is flushed at the end as if the ESC wait
+ * had expired.
+ */
+template <typename DECODER>
+inline bool decode_corpus_key(DECODER &decoder, const corpus_key_t &key,
+                              std::size_t piece_size) {
+  std::size_t events = {};
+  vkey_t vk = {};
+  auto on_key = [&](const key_event_t &e) {
+    events++;
+    vk = e.vk;
+  };
+
+  std::size_t len = strlen(key.seq);
+  for (std::size_t pos = 0; pos < len; pos += piece_size)
+    decoder.feed(key.seq + pos, std::min(piece_size, len - pos), on_key);
+  decoder.flush(on_key);
+  return events == 1 && vk == key.vk;
+}
+
+/**
+ * @fn corpus_stream
+ * @brief builds a byte stream of about stream_size bytes from the profile's
+ * keys with a short run of typing between each of them. The lone ESC key
+ * is left out as it only decodes after the wait. events counts the
+ * keystrokes within the stream.
+ */
+inline std::string corpus_stream(const terminal_profile_t &profile,
+                                 std::size_t stream_size,
+                                 std::size_t &events) {
+  std::string stream = {};
+  events = {};
+  while (stream.size() < stream_size) {
+    for (auto &key : profile.keys) {
+      if (strcmp(key.seq, "\x1b") == 0)
+        continue;
+      stream += key.seq;
+      stream += "ls -l";
+      events += 6;
+    }
+  }
+  return stream;
+}
+
+/**
+ * @fn bench_terminal_decoder
+ * @brief the coverage and decode cost of one profile with one decoder.
+ */
+template <typename DECODER>
+inline bool bench_terminal_decoder(const terminal_profile_t &profile,
+                                   const char *policy_name,
+                                   const std::string &stream,
+                                   std::size_t expected) {
+  const std::size_t read_size = 4096;
+  bool bvalid = true;
+  std::string name = std::string(profile.name) + " " + policy_name;
+
+  DECODER decoder;
+  std::size_t passed = {};
+  for (auto &key : profile.keys) {
+    bool bwhole = decode_corpus_key(decoder, key, strlen(key.seq));
+    bool bsplit = decode_corpus_key(decoder, key, 1);
+    if (bwhole && bsplit) {
+      passed++;
+    } else {
+      printf("terminals %s: sequence for vk %d not decoded\n", name.c_str(),
+             static_cast<int>(key.vk));
+      bvalid = false;
+    }
+  }
+  benchmark_report("terminals", name + " coverage",
+                   100.0 * passed / profile.keys.size(), "%");
+
+  std::size_t events = {};
+  auto on_key = [&](const key_event_t &e) {
+    events++;
+    benchmark_keep(e);
+  };
+
+  benchmark_timer_t timer;
+  for (std::size_t pos = 0; pos < stream.size(); pos += read_size)
+    decoder.feed(stream.data() + pos, std::min(read_size, stream.size() - pos),
+                 on_key);
+  decoder.flush(on_key);
+  double ns = timer.elapsed_ns();
+
+  benchmark_report("terminals", name + " decode", ns / events, "ns/key");
+  if (events != expected) {
+    printf("terminals %s: %lu keys decoded from a stream of %lu\n",
+           name.c_str(), events, expected);
+    bvalid = false;
+  }
+  return bvalid;
+}
+
+/**
+ * @fn terminal_replies_select
+ * @brief the policy chosen from the replies to the kitty and DA1 queries,
+ * with $TERM as set when they were sent. A bare ESC [ ? 6 c is the linux
+ * console only when nothing else claims the terminal.
+ */
+inline bool terminal_replies_select() {
+  const struct {
+    const char *reply;
+    const char *term;
+    terminal_policy_t policy;
+  } cases[] = {
+      {"\x1b[?6c", nullptr, terminal_policy_t::linux_console},
+      {"\x1b[?6c", "linux", terminal_policy_t::linux_console},
+      {"\x1b[?6c", "vt102", terminal_policy_t::generic},
+      {"\x1b[?0u\x1b[?6c", nullptr, terminal_policy_t::kitty},
+      {"\x1b[?6c\x1b[?0u", nullptr, terminal_policy_t::kitty},
+      {"\x1b[?64;1;2c", nullptr, terminal_policy_t::xterm},
+      {"", nullptr, terminal_policy_t::generic}};
+  bool bok = true;
+  for (auto &c : cases) {
+    terminal_policy_t policy = terminal_policy_from_replies(
+        c.reply, strlen(c.reply), c.term, terminal_policy_t::generic);
+    if (policy != c.policy) {
+      printf("terminals reply %s with TERM %s chose policy %d\n",
+             c.reply + 1, c.term ? c.term : "unset",
+             static_cast<int>(policy));
+      bok = false;
+    }
+  }
+  return bok;
+}
+
+/**
+ * @fn bench_terminals
+ * @brief the terminal conformance and performance matrix. For every profile
+ * of terminal_corpus() it reports the share of keys decoded correctly, both
+ * whole and fed a byte at a time, and the decode cost in ns per key over a
+ * stream of those keys mixed with typing read 4 KB at a time. Each profile
+ * is run with the generic map decoder and with the decoder specialized for
+ * the policy its $TERM selects. Any key that does not decode fails the run,
+ * as does a policy wrongly chosen from the query replies.
+ */
+inline int bench_terminals() {
+  const std::size_t stream_size = 4 << 20;
+  int ret = terminal_replies_select() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+  for (auto &profile : terminal_corpus()) {
+    std::size_t expected = {};
+    std::string stream = corpus_stream(profile, stream_size, expected);
+
+    bool bvalid = bench_terminal_decoder<key_decoder_t>(
+        profile, map_policy_t::name, stream, expected);
+
+    switch (terminal_policy_from_term(profile.term)) {
+    case terminal_policy_t::generic:
+      break;
+    case terminal_policy_t::xterm:
+      bvalid &= bench_terminal_decoder<basic_key_decoder_t<xterm_policy_t>>(
+          profile, xterm_policy_t::name, stream, expected);
+      break;
+    case terminal_policy_t::linux_console:
+      bvalid &= bench_terminal_decoder<
+          basic_key_decoder_t<linux_console_policy_t>>(
+          profile, linux_console_policy_t::name, stream, expected);
+      break;
+    case terminal_policy_t::kitty:
+      bvalid &= bench_terminal_decoder<basic_key_decoder_t<kitty_policy_t>>(
+          profile, kitty_policy_t::name, stream, expected);
+      break;
+    }
+    if (!bvalid)
+      ret = EXIT_FAILURE;
+  }
+  return ret;
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "benchmark.h"
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+/**
+ * @brief the deadlines a session keeps: the wait for the rest of an escape
+ * sequence, the second key of a chord, the next repeat of a held key and
+ * the idle logout.
+ */
+enum session_deadline_t {
+  deadline_escape,
+  deadline_chord,
+  deadline_repeat,
+  deadline_idle,
+  deadline_count
+};
+
+/**
+ * @struct timer_churn_t
+ * @brief what the sessions do at one tick, drawn once so the timer wheel
+ * and the ordered map are given the same work.
+ */
+struct timer_churn_t {
+  u_int32_t timer = {};
+  u_int32_t delay = {};
+};
+
+/**
+ * @fn bench_timers
+ * @brief the deadlines of 10,000 sessions on one worker's timer wheel.
+ * Ten seconds of typing at a millisecond a tick: each tick a thousand
+ * sessions receive input, which sets or cancels their escape timeout, and
+ * some start or cancel a chord or hold a key that repeats from its expiry.
+ * Every session also has an idle timeout up to nine hours away. The cost
+ * of schedule and cancel under that churn is set against the same
+ * operations on an ordered map, and advance is timed per tick and per
+ * expiry. Every timer must fire at the tick it was set for, and next_tick
+ * must never be later than the earliest deadline.
+ */
+inline int bench_timers() {
+  const u_int32_t sessions = 10000;
+  const u_int32_t timers = sessions * deadline_count;
+  const u_int64_t ticks = 10000;
+  const int inputs = 1000;
+  int ret = EXIT_SUCCESS;
+
+  std::mt19937 random(7);
+  std::vector<std::vector<timer_churn_t>> churn(ticks);
+  for (auto &tick : churn) {
+    for (int i = 0; i < inputs; i++) {
+      u_int32_t s = random() % sessions;
+      u_int32_t pick = random() % 100;
+      // 0 cancels, the escape wait is 25 ticks, a chord a second and a
+      // key repeats after half a second.
+      timer_churn_t escape = {s * deadline_count + deadline_escape,
+                              pick < 20 ? 25u : 0u};
+      tick.push_back(escape);
+      if (pick < 5 || pick >= 95)
+        tick.push_back({s * deadline_count + deadline_chord,
+                        pick < 5 ? 1000u : 0u});
+      if (pick == 50)
+        tick.push_back({s * deadline_count + deadline_repeat, 500u});
+    }
+  }
+  std::vector<u_int32_t> idle(sessions);
+  for (auto &i : idle)
+    i = 1 + random() % (9u * 3600 * 1000);
+
+  timer_wheel_t wheel;
+  std::unique_ptr<wheel_timer_t[]> wheel_timers(new wheel_timer_t[timers]);
+  std::vector<u_int64_t> expected(timers);
+  std::size_t fired = {};
+  std::size_t wrong = {};
+  std::size_t ops = {};
+  std::size_t max_batch = {};
+  double schedule_ns = {};
+  double advance_ns = {};
+  auto on_expire = [&](wheel_timer_t &t) {
+    u_int32_t i = static_cast<u_int32_t>(&t - wheel_timers.get());
+    if (expected[i] != wheel.now())
+      wrong++;
+    expected[i] = {};
+    fired++;
+    // a held key repeats 30 times a second until it is let go.
+    if (t.kind == deadline_repeat && fired % 8) {
+      wheel.schedule(t, wheel.now() + 33);
+      expected[i] = wheel.now() + 33;
+    }
+  };
+  for (u_int32_t i = 0; i < timers; i++)
+    wheel_timers[i].kind = static_cast<int>(i % deadline_count);
+
+  benchmark_timer_t timer;
+  for (u_int32_t s = 0; s < sessions; s++)
+    wheel.schedule(wheel_timers[s * deadline_count + deadline_idle], idle[s]);
+  schedule_ns += timer.elapsed_ns();
+  ops += sessions;
+  for (u_int32_t s = 0; s < sessions; s++)
+    expected[s * deadline_count + deadline_idle] = idle[s];
+
+  std::size_t late_next = {};
+  for (u_int64_t t = 0; t < ticks; t++) {
+    if (t % 100 == 0) {
+      u_int64_t earliest = ~u_int64_t{};
+      for (auto e : expected)
+        if (e && e < earliest)
+          earliest = e;
+      if (wheel.next_tick() > earliest)
+        late_next++;
+    }
+    timer.restart();
+    for (auto &c : churn[t]) {
+      if (c.delay)
+        wheel.schedule(wheel_timers[c.timer], wheel.now() + c.delay);
+      else
+        wheel.cancel(wheel_timers[c.timer]);
+    }
+    schedule_ns += timer.elapsed_ns();
+    ops += churn[t].size();
+    for (auto &c : churn[t])
+      expected[c.timer] = c.delay ? wheel.now() + c.delay : 0;
+
+    std::size_t before = fired;
+    timer.restart();
+    wheel.advance(t + 1, on_expire);
+    advance_ns += timer.elapsed_ns();
+    max_batch = std::max(max_batch, fired - before);
+  }
+  std::size_t churn_fired = fired;
+
+  // the same schedule and cancel calls on an ordered map.
+  std::multimap<u_int64_t, u_int32_t> ordered;
+  std::vector<std::multimap<u_int64_t, u_int32_t>::iterator> where(
+      timers, ordered.end());
+  timer.restart();
+  for (u_int32_t s = 0; s < sessions; s++)
+    where[s * deadline_count + deadline_idle] =
+        ordered.emplace(idle[s], s * deadline_count + deadline_idle);
+  for (u_int64_t t = 0; t < ticks; t++) {
+    for (auto &c : churn[t]) {
+      if (where[c.timer] != ordered.end()) {
+        ordered.erase(where[c.timer]);
+        where[c.timer] = ordered.end();
+      }
+      if (c.delay)
+        where[c.timer] = ordered.emplace(t + c.delay, c.timer);
+    }
+    while (!ordered.empty() && ordered.begin()->first <= t + 1) {
+      where[ordered.begin()->second] = ordered.end();
+      ordered.erase(ordered.begin());
+    }
+  }
+  double ordered_ns = timer.elapsed_ns();
+
+  benchmark_report("timers", "timers scheduled", wheel.size(), "timers");
+  benchmark_report("timers", "schedule or cancel", schedule_ns / ops, "ns");
+  benchmark_report("timers", "advance a tick", advance_ns / ticks, "ns");
+  benchmark_report("timers", "advance per expiry",
+                   churn_fired ? advance_ns / churn_fired : 0, "ns");
+  benchmark_report("timers", "largest batch", max_batch, "timers");
+  benchmark_report("timers", "wheel, all churn",
+                   (schedule_ns + advance_ns) / 1e6, "ms");
+  benchmark_report("timers", "ordered map, all churn", ordered_ns / 1e6,
+                   "ms");
+
+  // the idle timeouts, hours away, come down the levels and fire on time.
+  timer.restart();
+  wheel.advance(9u * 3600 * 1000 + 1, on_expire);
+  benchmark_report("timers", "run to the last idle timeout",
+                   timer.elapsed_ns() / 1e6, "ms");
+  for (auto e : expected)
+    if (e)
+      wrong++;
+  if (wrong || late_next || !wheel.empty()) {
+    printf("timers %zu fired at the wrong tick, next tick late %zu times\n",
+           wrong, late_next);
+    ret = EXIT_FAILURE;
+  }
+  return ret;
+}
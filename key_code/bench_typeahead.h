@@ -0,0 +1,295 @@
+#pragma once
+
+#include "bench_scrollback.h"
+#include "benchmark.h"
+#include "common.h"
+#include "session.h"
+#include "session_loop.h"
+#include "terminfo.h"
+#include "typeahead.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @struct typeahead_burst_t
+ * @brief keys the terminal sends in one write, after a pause.
+ */
+struct typeahead_burst_t {
+  u_int32_t pause_us = {};
+  u_int32_t keys = {};
+};
+
+/**
+ * @struct typeahead_run_t
+ * @brief what the event loop did with one workload.
+ */
+struct typeahead_run_t {
+  u_int64_t keys = {};
+  u_int64_t frames = {};
+  u_int64_t skipped = {};
+  u_int64_t stale_frames = {};
+  std::size_t bytes = {};
+  double cpu_ms = {};
+  double last_key_us = {};
+  latency_histogram_t key_to_frame = {};
+  int selected = {};
+};
+
+inline double typeahead_cpu_ms() {
+  struct timespec ts = {};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * @fn run_typeahead
+ * @brief a list browser on a socket pair: a thread types DOWN_ARROW in
+ * bursts, another drains what is drawn. Each key moves the selection and
+ * redraws the list, scrolling it at the bottom. Without btypeahead every
+ * key is drawn as it is handled, with it typeahead_t decides.
+ */
+inline typeahead_run_t
+run_typeahead(const std::vector<typeahead_burst_t> &bursts,
+              const std::vector<std::string> &list, bool btypeahead) {
+  const int rows = 60;
+  const int columns = 200;
+  const char down[] = "\x1b[B";
+  typeahead_run_t run = {};
+  for (auto &b : bursts)
+    run.keys += b.keys;
+
+  int fds[2] = {-1, -1};
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    return run;
+  terminal_caps_t caps = load_terminal_caps("xterm-256color");
+  session_t s(terminal_policy_t::xterm, caps, rows, columns, fds[0]);
+
+  std::vector<std::atomic<u_int64_t>> sent(run.keys);
+  std::thread typist([&] {
+    std::size_t k = {};
+    for (auto &b : bursts) {
+      std::this_thread::sleep_for(std::chrono::microseconds(b.pause_us));
+      std::string keys = {};
+      u_int64_t now = steady_now_ns();
+      for (u_int32_t i = 0; i < b.keys; i++, k++) {
+        keys += down;
+        sent[k].store(now, std::memory_order_relaxed);
+      }
+      for (std::size_t at = 0; at < keys.size();) {
+        ssize_t n = write(fds[1], keys.data() + at, keys.size() - at);
+        if (n <= 0)
+          return;
+        at += n;
+      }
+    }
+  });
+  std::thread terminal([&] {
+    char sink[16 << 10];
+    while (read(fds[1], sink, sizeof(sink)) > 0) {
+    }
+  });
+
+  int top = {};
+  int selected = {};
+  u_int64_t handled = {};
+  u_int64_t drawn_up_to = {};
+  typeahead_t typeahead;
+  auto draw = [&] {
+    screen_grid_t &screen = s.screen();
+    style_t reverse = {};
+    reverse.attrs = style_t::reverse;
+    for (int r = 0; r < rows; r++) {
+      const std::string &text = list[(top + r) % list.size()];
+      std::fill(screen.row(r), screen.row(r) + columns, cell_t{});
+      screen.put_text(r, 0, text.c_str(),
+                      top + r == selected ? reverse : style_t{});
+    }
+    s.render(selected - top, 0);
+    s.writer().flush();
+    u_int64_t now = steady_now_ns();
+    for (; drawn_up_to < handled; drawn_up_to++)
+      run.key_to_frame.record(
+          now - sent[drawn_up_to].load(std::memory_order_relaxed));
+    return now;
+  };
+  auto on_key = [&](const key_event_t &e) {
+    if (e.vk != vkey_t::DOWN_ARROW)
+      return;
+    selected++;
+    if (selected - top >= rows)
+      top++;
+    handled++;
+    if (btypeahead)
+      typeahead.changed(steady_now_ns());
+    else
+      draw();
+  };
+
+  double cpu = typeahead_cpu_ms();
+  std::size_t bytes = s.writer().bytes_written();
+  u_int64_t last_frame = {};
+  while (handled < run.keys) {
+    if (btypeahead && typeahead.dirty()) {
+      // wait for input no longer than the frame may be put off.
+      u_int64_t now = steady_now_ns();
+      u_int64_t due = typeahead.deadline();
+      struct pollfd p = {fds[0], POLLIN, 0};
+      int wait_ms = due > now ? static_cast<int>((due - now) / 1000000) : 0;
+      if (poll(&p, 1, wait_ms) == 0) {
+        last_frame = draw();
+        typeahead.drawn(last_frame);
+        continue;
+      }
+    }
+    if (s.read_input(on_key) <= 0)
+      break;
+    if (btypeahead &&
+        typeahead.ready(s.input_pending(), steady_now_ns())) {
+      last_frame = draw();
+      typeahead.drawn(last_frame);
+    } else if (!btypeahead) {
+      last_frame = steady_now_ns();
+    }
+  }
+  run.cpu_ms = typeahead_cpu_ms() - cpu;
+  run.bytes = s.writer().bytes_written() - bytes;
+  if (run.keys)
+    run.last_key_us =
+        (static_cast<double>(last_frame) -
+         sent[run.keys - 1].load(std::memory_order_relaxed)) / 1e3;
+  run.frames = btypeahead ? typeahead.frames : handled;
+  run.skipped = btypeahead ? typeahead.skipped : 0;
+  run.stale_frames = typeahead.stale_frames;
+  run.selected = selected;
+  if (btypeahead && typeahead.dirty())
+    run.selected = -1;
+
+  shutdown(fds[1], SHUT_WR);
+  typist.join();
+  close(fds[0]);
+  terminal.join();
+  close(fds[1]);
+  return run;
+}
+
+/**
+ * @fn typeahead_on_loop
+ * @brief a macro of DOWN_ARROW keys written at once to a session on a
+ * session_loop_t, which draws it. The loop must draw fewer frames than
+ * keys and leave none owed once the input drained. Returns the frames
+ * drawn, 0 when that failed.
+ */
+inline u_int64_t typeahead_on_loop(u_int32_t keys) {
+  int fds[2] = {-1, -1};
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+    return 0;
+  terminal_caps_t caps = load_terminal_caps("xterm-256color");
+  session_t s(terminal_policy_t::xterm, caps, 24, 80, fds[0]);
+  session_loop_t loop;
+  loop.add(s);
+  std::thread terminal([&] {
+    char sink[16 << 10];
+    while (read(fds[1], sink, sizeof(sink)) > 0) {
+    }
+  });
+
+  std::string macro = {};
+  for (u_int32_t i = 0; i < keys; i++)
+    macro += "\x1b[B";
+  u_int32_t handled = {};
+  auto on_key = [&](session_t &, const key_event_t &e) {
+    if (e.vk != vkey_t::DOWN_ARROW)
+      return;
+    s.screen().put_text(static_cast<int>(handled % 24), 0, "selected");
+    handled++;
+  };
+  auto on_text = [](session_t &, const char *, std::size_t) {};
+  auto on_closed = [](session_t &) {};
+  bool bwrote = write(fds[1], macro.data(), macro.size()) ==
+                static_cast<ssize_t>(macro.size());
+  while (bwrote && handled < keys &&
+         loop.run_once(on_key, on_text, on_closed)) {
+  }
+  u_int64_t frames = s.typeahead().frames;
+  if (handled != keys || s.typeahead().dirty() || !frames ||
+      frames >= keys)
+    frames = 0;
+  loop.remove(s);
+  shutdown(fds[0], SHUT_WR);
+  terminal.join();
+  close(fds[1]);
+  return frames;
+}
+
+/**
+ * @fn bench_typeahead
+ * @brief drawing every key against putting frames off while input is
+ * pending, for a held key at 30 keys a second, bursts of keys as they come
+ * out of a slow link and a macro replayed at once. Reported are the frames
+ * drawn and left out, the bytes and the cpu time spent drawing, and the
+ * latency from a key to the frame that shows it and from the last key to
+ * the final frame. Both must end on the same selection, with the last key
+ * drawn. A macro into a session on the event loop must be drawn in fewer
+ * frames than keys.
+ */
+inline int bench_typeahead() {
+  int ret = EXIT_SUCCESS;
+  std::vector<std::string> list = {};
+  screen_grid_t row(1, 200);
+  for (u_int64_t i = 0; i < 997; i++) {
+    scrollback_sample_line(i, row);
+    list.push_back(scrollback_utf8(
+        std::vector<cell_t>(row.row(0), row.row(0) + row.columns())));
+  }
+
+  struct workload_t {
+    const char *name;
+    std::vector<typeahead_burst_t> bursts;
+  } workloads[] = {
+      {"held key", std::vector<typeahead_burst_t>(30, {33000, 1})},
+      {"slow link", std::vector<typeahead_burst_t>(40, {30000, 25})},
+      {"macro", {{10000, 3000}}}};
+
+  for (auto &w : workloads) {
+    typeahead_run_t every = run_typeahead(w.bursts, list, false);
+    typeahead_run_t ahead = run_typeahead(w.bursts, list, true);
+    for (auto *r : {&every, &ahead}) {
+      std::string name = std::string(w.name) +
+                         (r == &every ? " every key" : " typeahead");
+      benchmark_report("typeahead", name + " frames", r->frames, "frames");
+      benchmark_report("typeahead", name + " skipped", r->skipped, "frames");
+      benchmark_report("typeahead", name + " output", r->bytes / 1024.0,
+                       "KB");
+      benchmark_report("typeahead", name + " cpu", r->cpu_ms, "ms");
+      benchmark_report("typeahead", name + " key to frame p50",
+                       r->key_to_frame.percentile(50) / 1e3, "us");
+      benchmark_report("typeahead", name + " key to frame p99",
+                       r->key_to_frame.percentile(99) / 1e3, "us");
+      benchmark_report("typeahead", name + " last key to frame",
+                       r->last_key_us, "us");
+    }
+    if (every.selected != static_cast<int>(every.keys) ||
+        ahead.selected != every.selected ||
+        ahead.key_to_frame.count() != ahead.keys) {
+      printf("typeahead %s did not draw the last key\n", w.name);
+      ret = EXIT_FAILURE;
+    }
+  }
+
+  u_int64_t frames = typeahead_on_loop(1000);
+  benchmark_report("typeahead", "loop macro frames",
+                   static_cast<double>(frames), "frames");
+  if (!frames) {
+    printf("typeahead the event loop drew every key or not the last\n");
+    ret = EXIT_FAILURE;
+  }
+  return ret;
+}
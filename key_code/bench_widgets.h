@@ -0,0 +1,172 @@
+#pragma once
+
+#include "bench_render.h"
+#include "benchmark.h"
+#include "terminfo.h"
+#include "widgets.h"
+
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @struct widgets_dashboard_t
+ * @brief a dashboard: a title, columns of panels of metrics and a command
+ * field at the bottom.
+ */
+struct widgets_dashboard_t {
+  std::unique_ptr<widget_tree_t> tree = {};
+  std::vector<label_t *> metrics = {};
+  field_t *command = {};
+};
+
+inline widgets_dashboard_t widgets_dashboard(int rows, int columns,
+                                             int panels) {
+  widgets_dashboard_t d = {};
+  auto root = std::make_unique<split_t>(true);
+  style_t title = {};
+  title.attrs = style_t::bold | style_t::reverse;
+  root->add(std::make_unique<label_t>("cluster overview", title), 1);
+  split_t *body = root->add(std::make_unique<split_t>(false));
+  d.command = root->add(std::make_unique<field_t>(), 1);
+  int per_panel = rows - 4;
+  for (int p = 0; p < panels; p++) {
+    style_t edge = {};
+    edge.fg = static_cast<u_int16_t>(1 + p % 6);
+    panel_t *panel = body->add(
+        std::make_unique<panel_t>("node " + std::to_string(p), edge));
+    split_t *lines = panel->add(std::make_unique<split_t>(true));
+    for (int m = 0; m < per_panel; m++)
+      d.metrics.push_back(lines->add(
+          std::make_unique<label_t>("metric " + std::to_string(m)), 1));
+  }
+  d.tree = std::make_unique<widget_tree_t>(std::move(root), rows, columns);
+  d.tree->set_focus(d.command);
+  return d;
+}
+
+/**
+ * @fn widgets_overlap
+ * @brief a label under a popup drawn over it, the popup its later
+ * sibling. Changing the label must leave the popup on top, as drawing
+ * the tree afresh does.
+ */
+inline bool widgets_overlap(const terminal_caps_t &caps) {
+  label_t *under = {};
+  auto tree = [&](const std::string &text) {
+    auto root = std::make_unique<widget_t>();
+    under = root->add(std::make_unique<label_t>(text));
+    root->add(std::make_unique<label_t>("popup"));
+    return std::make_unique<widget_tree_t>(std::move(root), 1, 20);
+  };
+  output_writer_t out(-1);
+  screen_renderer_t renderer(caps, 1, 20);
+  auto fresh = tree("changed under it");
+  fresh->render(renderer, out);
+  auto changed = tree("under the popup");
+  changed->render(renderer, out);
+  under->set("changed under it");
+  changed->render(renderer, out);
+  return changed->grid() == fresh->grid();
+}
+
+/**
+ * @fn bench_widgets
+ * @brief a dashboard driven by events: a metric changing its value, and
+ * keys typed into the command field through the focus. Each event is
+ * drawn at once. Redrawing the whole tree and comparing the whole screen
+ * per event is set against drawing the dirty widgets and rendering their
+ * rectangles, for a small and a large dashboard. Reported are the time
+ * and the widgets drawn per event. Both must end with the same grid, and
+ * the terminal, replaying the output, must show it. A widget drawn over
+ * by a later sibling must stay under it when it changes.
+ */
+inline int bench_widgets() {
+  int ret = EXIT_SUCCESS;
+  terminal_caps_t caps = load_terminal_caps("xterm-256color");
+  if (!widgets_overlap(caps)) {
+    printf("widgets a change under a later sibling drew over it\n");
+    ret = EXIT_FAILURE;
+  }
+  struct layout_t {
+    const char *name;
+    int rows;
+    int columns;
+    int panels;
+  } sizes[] = {{"200x60", 60, 200, 8}, {"400x200", 200, 400, 16}};
+  const int events = 4000;
+  const char *typed = "deploy --canary node-7 ";
+
+  for (auto &size : sizes) {
+    double ns[2] = {};
+    double drawn[2] = {};
+    std::size_t bytes[2] = {};
+    screen_grid_t end[2] = {};
+    for (int mode = 0; mode < 2; mode++) {
+      bool bretained = mode == 1;
+      widgets_dashboard_t d =
+          widgets_dashboard(size.rows, size.columns, size.panels);
+      screen_renderer_t renderer(caps, size.rows, size.columns);
+      output_writer_t out(output_writer_t::capture);
+      render_check_t terminal(size.rows, size.columns);
+      d.tree->render(renderer, out);
+      terminal.apply(std::string(out.data(), out.pending()));
+      out.clear();
+
+      std::mt19937 random(11);
+      std::size_t count = {};
+      double elapsed = {};
+      for (int e = 0; e < events; e++) {
+        benchmark_timer_t timer;
+        if (e % 4 == 3) {
+          key_event_t key = {};
+          key.c = typed[(e / 4) % 23];
+          d.tree->dispatch(key);
+        } else {
+          label_t *m = d.metrics[random() % d.metrics.size()];
+          style_t s = {};
+          u_int32_t value = random() % 1000;
+          s.fg = value > 900 ? 1 : 2;
+          m->set("load " + std::to_string(value / 10) + "." +
+                     std::to_string(value % 10) + "%",
+                 s);
+        }
+        if (!bretained)
+          d.tree->top().invalidate();
+        count += d.tree->render(renderer, out);
+        elapsed += timer.elapsed_ns();
+        bytes[mode] += out.pending();
+        terminal.apply(std::string(out.data(), out.pending()));
+        out.clear();
+      }
+      ns[mode] = elapsed / events;
+      drawn[mode] = static_cast<double>(count) / events;
+      end[mode] = d.tree->grid();
+      if (!(terminal.screen == d.tree->grid())) {
+        printf("widgets %s: the terminal does not show the dashboard\n",
+               size.name);
+        ret = EXIT_FAILURE;
+      }
+    }
+    std::string name = size.name;
+    benchmark_report("widgets", name + " redraw all per event", ns[0] / 1e3,
+                     "us");
+    benchmark_report("widgets", name + " retained per event", ns[1] / 1e3,
+                     "us");
+    benchmark_report("widgets", name + " speedup", ns[0] / ns[1], "x");
+    benchmark_report("widgets", name + " redraw all drawn", drawn[0],
+                     "widgets");
+    benchmark_report("widgets", name + " retained drawn", drawn[1],
+                     "widgets");
+    benchmark_report("widgets", name + " output per event",
+                     static_cast<double>(bytes[1]) / events, "bytes");
+    if (!(end[0] == end[1])) {
+      printf("widgets %s: the retained tree drew something else\n",
+             size.name);
+      ret = EXIT_FAILURE;
+    }
+  }
+  return ret;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @class benchmark_timer_t
+ * @brief wall clock timing of a benchmark section in nanoseconds.
+ */
+class benchmark_timer_t {
+public:
+  benchmark_timer_t() : start(std::chrono::steady_clock::now()) {}
+
+  void restart() { start = std::chrono::steady_clock::now(); }
+
+  double elapsed_ns() const {
+    return std::chrono::duration<double, std::nano>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point start = {};
+};
+
+/**
+ * @fn benchmark_keep
+ * @brief keeps the optimizer from discarding a result that is otherwise
+ * unused.
+ */
+template <typename T> inline void benchmark_keep(const T &value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+ * @fn benchmark_report
+ * @brief prints one measurement as a row, suite name value unit, so the
+ * output of several runs can be compared with diff.
+ */
+inline void benchmark_report(const char *suite, const std::string &name,
+                             double value, const char *unit) {
+  printf("%-12s %-40s %14.2f %s\n", suite, name.c_str(), value, unit);
+}
+
+using benchmark_fn_t = int (*)();
+using benchmark_table_t = std::unordered_map<std::string, benchmark_fn_t>;
+
+/**
+ * @fn run_benchmarks
+ * @brief runs the benchmarks named on the command line, all of them when
+ * none are named. A benchmark returns EXIT_FAILURE when the results it
+ * produced were wrong.
+ */
+inline int run_benchmarks(const benchmark_table_t &table, int argc,
+                          char **argv) {
+  int ret = EXIT_SUCCESS;
+
+  if (argc == 0) {
+    for (auto &n : table)
+      if (n.second() != EXIT_SUCCESS)
+        ret = EXIT_FAILURE;
+    return ret;
+  }
+
+  for (int i = 0; i < argc; i++) {
+    auto it = table.find(argv[i]);
+    if (it == table.end()) {
+      printf("unknown benchmark %s, choose from:", argv[i]);
+      for (auto &n : table)
+        printf(" %s", n.first.c_str());
+      printf("\n");
+      return EXIT_FAILURE;
+    }
+    if (it->second() != EXIT_SUCCESS)
+      ret = EXIT_FAILURE;
+  }
+  return ret;
+}
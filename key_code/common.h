@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <sys/types.h>
+
+/**
+ * @fn steady_now_ns
+ * @brief the steady clock in nanoseconds, for timestamps compared with one
+ * another within the process.
+ */
+inline u_int64_t steady_now_ns() {
+  return static_cast<u_int64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+/**
+ * @fn block_hash
+ * @brief a 64 bit hash of the bytes, a word at a time.
+ */
+inline u_int64_t block_hash(const void *data, std::size_t len) {
+  const u_int8_t *p = static_cast<const u_int8_t *>(data);
+  u_int64_t h = 0x9e3779b97f4a7c15ull ^ len;
+  for (; len >= 8; p += 8, len -= 8) {
+    u_int64_t w = {};
+    memcpy(&w, p, 8);
+    h = (h ^ w) * 0xff51afd7ed558ccdull;
+    h ^= h >> 32;
+  }
+  u_int64_t w = {};
+  memcpy(&w, p, len);
+  h = (h ^ w) * 0xc4ceb9fe1a85ec53ull;
+  return h ^ (h >> 29);
+}
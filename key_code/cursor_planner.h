@@ -0,0 +1,240 @@
+#pragma once
+
+#include "output_writer.h"
+#include "terminfo.h"
+
+#include <algorithm>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * @class cursor_planner_t
+ * @brief moves the cursor with the fewest bytes the terminal allows. Each
+ * way of getting there is costed from the terminfo capabilities and the
+ * cheapest is written:
+ *
+ *  - cup, the absolute address.
+ *  - relative, cuu/cud then cuf/cub, each either as a parameter or as the
+ *    single step (cuu1, cud1, cuf1, cub1) repeated, or hpa/vpa.
+ *  - cr then relative, going left to a column near the start of the line.
+ *  - LF, when output processing turns it into CR LF, see
+ *    terminal_caps_t::onlcr. A cud1 of LF is never used to keep the
+ *    column.
+ *  - home then relative.
+ *  - reprinting the cells in between, which the caller supplies as it knows
+ *    what the terminal shows there.
+ *
+ * The parameterized costs for every distance are computed once for the
+ * window size, so costing a move is table lookups plus one cup expansion.
+ * Moving only reads the tables, threads may share a planner.
+ */
+class cursor_planner_t {
+public:
+  static constexpr std::size_t unavailable = 1 << 20;
+
+  cursor_planner_t(const terminal_caps_t &_caps, int rows, int columns)
+      : caps(_caps) {
+    resize(rows, columns);
+  }
+
+  void resize(int rows, int columns) {
+    int n = std::max(rows, columns) + 1;
+    cuf_len = param_lengths(caps.cuf, n);
+    cub_len = param_lengths(caps.cub, n);
+    cud_len = param_lengths(caps.cud, n);
+    cuu_len = param_lengths(caps.cuu, n);
+    hpa_len = param_lengths(caps.hpa, n);
+    vpa_len = param_lengths(caps.vpa, n);
+
+    // a cud1 of LF keeps the column only when OPOST is off, which caps
+    // cannot tell apart from not knowing, so it is used only as CR LF.
+    lf_returns = caps.onlcr && caps.cud1 == "\n";
+    down_one = caps.cud1 == "\n" ? std::string() : caps.cud1;
+  }
+
+  /**
+   * @fn move
+   * @brief moves from row, col to to_row, to_col and returns the bytes
+   * written. A row or col below 0 means the position is not known, only the
+   * absolute forms are used then. reprint, when given, holds the bytes that
+   * redraw the cells from col up to to_col on the same row.
+   */
+  std::size_t move(output_writer_t &out, int row, int col, int to_row,
+                   int to_col, const char *reprint = nullptr,
+                   std::size_t reprint_len = {}) const {
+    bool bknown = row >= 0 && col >= 0;
+    if (bknown && row == to_row && col == to_col)
+      return 0;
+
+    enum class way_t { cup, relative, cr_relative, newline, home, reprint };
+    way_t way = way_t::cup;
+    std::size_t best = cup_length(to_row, to_col);
+
+    auto consider = [&](way_t w, std::size_t cost) {
+      if (cost < best) {
+        best = cost;
+        way = w;
+      }
+    };
+
+    if (bknown) {
+      if (reprint && row == to_row && to_col > col)
+        consider(way_t::reprint, reprint_len);
+      consider(way_t::relative, vertical(row, to_row, nullptr) +
+                                    horizontal(col, to_col, nullptr));
+      if (!caps.cr.empty() && to_col < col)
+        consider(way_t::cr_relative, caps.cr.size() +
+                                         vertical(row, to_row, nullptr) +
+                                         right(0, to_col, nullptr));
+      if (lf_returns && to_row > row)
+        consider(way_t::newline,
+                 (to_row - row) + right(0, to_col, nullptr));
+    }
+    if (!caps.home.empty())
+      consider(way_t::home, caps.home.size() + vertical(0, to_row, nullptr) +
+                                right(0, to_col, nullptr));
+    if (best >= unavailable)
+      return 0;
+
+    switch (way) {
+    case way_t::cup:
+      emit_param(out, caps.cup, to_row, to_col);
+      break;
+    case way_t::relative:
+      vertical(row, to_row, &out);
+      horizontal(col, to_col, &out);
+      break;
+    case way_t::cr_relative:
+      out.write(caps.cr);
+      vertical(row, to_row, &out);
+      right(0, to_col, &out);
+      break;
+    case way_t::newline:
+      for (int n = row; n < to_row; n++)
+        out.put('\n');
+      right(0, to_col, &out);
+      break;
+    case way_t::home:
+      out.write(caps.home);
+      vertical(0, to_row, &out);
+      right(0, to_col, &out);
+      break;
+    case way_t::reprint:
+      out.write(reprint, reprint_len);
+      break;
+    }
+    return best;
+  }
+
+  /**
+   * @fn cup_length
+   * @brief bytes of the absolute address of row, col.
+   */
+  std::size_t cup_length(int row, int col) const {
+    if (caps.cup.empty())
+      return unavailable;
+    char buffer[64] = {};
+    return terminfo_expand(caps.cup, buffer, row, col);
+  }
+
+private:
+  /**
+   * @brief the length of cap expanded with every parameter below n.
+   */
+  static std::vector<u_int32_t> param_lengths(const std::string &cap, int n) {
+    std::vector<u_int32_t> lengths(n, unavailable);
+    if (cap.empty())
+      return lengths;
+    char buffer[64] = {};
+    for (int i = 0; i < n; i++)
+      lengths[i] = static_cast<u_int32_t>(terminfo_expand(cap, buffer, i));
+    return lengths;
+  }
+
+  void emit_param(output_writer_t &out, const std::string &cap, int p1,
+                  int p2 = 0) const {
+    char buffer[64] = {};
+    out.write(buffer, terminfo_expand(cap, buffer, p1, p2));
+  }
+
+  /**
+   * @brief n steps with either the single step capability repeated or the
+   * parameterized one, whichever is shorter. Written to out when given.
+   */
+  std::size_t steps(const std::string &one, const std::string &param,
+                    const std::vector<u_int32_t> &lengths, int n,
+                    output_writer_t *out) const {
+    std::size_t repeated = one.empty() ? unavailable : one.size() * n;
+    std::size_t parameter = lengths[n];
+    if (out) {
+      if (repeated <= parameter)
+        for (int i = 0; i < n; i++)
+          out->write(one);
+      else
+        emit_param(*out, param, n);
+    }
+    return std::min(repeated, parameter);
+  }
+
+  /**
+   * @brief rightwards from col to to_col, or the hpa to to_col.
+   */
+  std::size_t right(int col, int to_col, output_writer_t *out) const {
+    if (col == to_col)
+      return 0;
+    std::size_t relative = steps(caps.cuf1, caps.cuf, cuf_len, to_col - col,
+                                 nullptr);
+    std::size_t absolute = hpa_len[to_col];
+    if (out) {
+      if (relative <= absolute)
+        steps(caps.cuf1, caps.cuf, cuf_len, to_col - col, out);
+      else
+        emit_param(*out, caps.hpa, to_col);
+    }
+    return std::min(relative, absolute);
+  }
+
+  std::size_t horizontal(int col, int to_col, output_writer_t *out) const {
+    if (to_col >= col)
+      return right(col, to_col, out);
+    std::size_t relative = steps(caps.cub1, caps.cub, cub_len, col - to_col,
+                                 nullptr);
+    std::size_t absolute = hpa_len[to_col];
+    if (out) {
+      if (relative <= absolute)
+        steps(caps.cub1, caps.cub, cub_len, col - to_col, out);
+      else
+        emit_param(*out, caps.hpa, to_col);
+    }
+    return std::min(relative, absolute);
+  }
+
+  std::size_t vertical(int row, int to_row, output_writer_t *out) const {
+    if (row == to_row)
+      return 0;
+    std::size_t relative =
+        to_row > row
+            ? steps(down_one, caps.cud, cud_len, to_row - row, nullptr)
+            : steps(caps.cuu1, caps.cuu, cuu_len, row - to_row, nullptr);
+    std::size_t absolute = vpa_len[to_row];
+    if (out) {
+      if (relative > absolute)
+        emit_param(*out, caps.vpa, to_row);
+      else if (to_row > row)
+        steps(down_one, caps.cud, cud_len, to_row - row, out);
+      else
+        steps(caps.cuu1, caps.cuu, cuu_len, row - to_row, out);
+    }
+    return std::min(relative, absolute);
+  }
+
+  terminal_caps_t caps = {};
+  std::string down_one = {};
+  bool lf_returns = {};
+  std::vector<u_int32_t> cuf_len = {};
+  std::vector<u_int32_t> cub_len = {};
+  std::vector<u_int32_t> cud_len = {};
+  std::vector<u_int32_t> cuu_len = {};
+  std::vector<u_int32_t> hpa_len = {};
+  std::vector<u_int32_t> vpa_len = {};
+};
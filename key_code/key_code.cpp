@@ -1,25 +1,87 @@
 #include <stdlib.h>
+#include <fcntl.h>
 #include <termios.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <unordered_map>
 #include <iostream>
+#include <stdexcept>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "key_decoder.h"
+#include "terminal_policy.h"
+#include "osc52.h"
+#include "benchmark.h"
+#include "bench_osc52.h"
+#include "bench_terminals.h"
+#include "bench_compare.h"
+#include "bench_echo.h"
+#include "bench_render.h"
+#include "bench_syscalls.h"
+#include "bench_memory.h"
+// the operator new that charges the accounts bench_memory reports.
+#include "memory_accounting.cpp"
+#include "bench_highlight.h"
+#include "bench_scrollback.h"
+#include "bench_snapshot.h"
+#include "bench_timers.h"
+#include "bench_session_table.h"
+#include "bench_paste.h"
+#include "bench_typeahead.h"
+#include "bench_panes.h"
+#include "bench_audit.h"
+#include "bench_idle.h"
+#include "bench_widgets.h"
+#include "bench_list.h"
+#include "bench_recorder.h"
+#include "bench_fairness.h"
+#include "bench_dispatch.h"
+#include "bench_ordered.h"
+#include "session_table.h"
+#include "paste_detector.h"
+#include "common.h"
 
 using namespace std;
 
 #if __linux__
 
-struct termios orig_termios = {};
-bool bset_exit = {};
-int keyboard_state = {};
+/**
+ * @struct terminal_state_t
+ * @brief a terminal the process put in raw mode: the settings it had, to
+ * put back at exit, and the raw mode applied last.
+ */
+struct terminal_state_t {
+  int fd = -1;
+  struct termios orig_termios = {};
+  int keyboard_state = {};
+  int applied_raw_mode = -1;
+};
+
+/* @brief the terminals by fd, one for the demo, one per client in the
+ * server. */
+session_table_t<terminal_state_t> terminals;
+
+/* @brief the settings of the terminals put in raw mode, kept apart from
+ * terminals for exit. An atexit handler runs after the main thread's
+ * thread_local RCU state was destroyed, so it must not read the table. */
+std::mutex exit_termios_mutex;
+std::vector<std::pair<int, struct termios>> exit_termios;
 
 /**
  * @fn disable_raw_mode
  * @brief disables raw mode preventing character echo within the terminal when a
- * key is pressed. See:
+ * key is pressed. Every terminal that was put in raw mode is restored. Runs
+ * once, at exit. See:
  * https://viewsourcecode.org/snaptoken/kilo/02.enteringRawMode.html
  */
-void disable_raw_mode() { tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios); }
+void disable_raw_mode() {
+  std::lock_guard<std::mutex> lock(exit_termios_mutex);
+  for (auto &t : exit_termios)
+    tcsetattr(t.first, TCSAFLUSH, &t.second);
+}
 
 /**
  * @enum raw_mode_t
@@ -78,19 +140,34 @@ directory), then /lib/terminfo, and last not least /usr/share/terminfo.
  * See:
  * https://viewsourcecode.org/snaptoken/kilo/02.enteringRawMode.html
  */
-void enable_raw_mode(bool wait_for_input = true,
-                     raw_mode_t mode = raw_mode_t::immediate_no_echo) {
-
-  if (!bset_exit) {
-    atexit(disable_raw_mode);
-    tcgetattr(STDIN_FILENO, &orig_termios);
-    printf("orig_termios(%x %x)\n", (int)orig_termios.c_cc[VMIN],
-           (int)orig_termios.c_cc[VTIME]);
-    bset_exit = true;
+void enable_raw_mode(raw_mode_t mode = raw_mode_t::immediate_no_echo,
+                     int fd = STDIN_FILENO) {
+  static std::once_flag bset_exit;
+
+  rcu_read_t read;
+  terminal_state_t *state = terminals.lookup(fd);
+  if (!state) {
+    auto t = std::make_unique<terminal_state_t>();
+    t->fd = fd;
+    tcgetattr(fd, &t->orig_termios);
+    printf("orig_termios(%x %x)\n", (int)t->orig_termios.c_cc[VMIN],
+           (int)t->orig_termios.c_cc[VTIME]);
+    {
+      std::lock_guard<std::mutex> lock(exit_termios_mutex);
+      exit_termios.emplace_back(fd, t->orig_termios);
+    }
+    state = terminals.insert(fd, std::move(t));
+    std::call_once(bset_exit, [] { atexit(disable_raw_mode); });
   }
 
-  struct termios raw = {};
-  tcgetattr(STDIN_FILENO, &raw);
+  // the terminal keeps its settings between reads, they are only written
+  // when the mode changes.
+  int applied = static_cast<int>(mode);
+  if (applied == state->applied_raw_mode)
+    return;
+  state->applied_raw_mode = applied;
+
+  struct termios raw = state->orig_termios;
 
   switch (mode) {
   case raw_mode_t::immediate_no_echo:
@@ -133,60 +210,17 @@ void enable_raw_mode(bool wait_for_input = true,
     break;
   }
 
-  // amount of characters that must be received.
-  if (wait_for_input) {
-    raw.c_cc[VMIN] = 1;
-    raw.c_cc[VTIME] = 0;
-  } else {
-    raw.c_cc[VMIN] = 0;
-    // tenth of second poll time. or wait exit time.
-    raw.c_cc[VTIME] = 1;
-  }
+  // a read waits for a character, however long. never a timed read, which
+  // wakes the process every tenth of a second while nothing is typed.
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
 
   // TCSANOW is used to keep keys in buffer there for reading.
-  tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+  tcsetattr(fd, TCSANOW, &raw);
 }
 
 #endif
 
-/**
- * @enum vkey_t
- * @brief the virtual keycode. The system translates the input from the
- * STDIN_FILENO low level file to these values. There are two separate events
- * within the event class. A character and a virtual key. Programming the
- * virtual key behavior can be provided as a distinct function within the
- * editing objects.
- */
-enum class vkey_t : u_int8_t {
-  none,
-  F1,
-  F2,
-  F3,
-  F4,
-  F5,
-  F6,
-  F7,
-  F8,
-  F9,
-  F10,
-  F11,
-  F12,
-  HOME,
-  END,
-  UP_ARROW,
-  DOWN_ARROW,
-  LEFT_ARROW,
-  RIGHT_ARROW,
-  PAGE_UP, // 19
-  PAGE_DOWN,
-  INSERT,
-  DELETE,
-  ESC, // 23
-  BACKSPACE,
-  ENTER, // 25
-  TAB
-};
-
 /**
  * @fn get_console_size
  * @brief gets the size of the console text window in text rows
@@ -221,7 +255,7 @@ void get_console_size(u_int16_t &rows, u_int16_t &columns) {
  * editing.
  */
 void get_keyboard_state() {
-  int fd = open("/dev/tty0, O_NOCTTY");
+  int fd = open("/dev/tty0", O_NOCTTY);
   if (fd == -1)
     throw std::runtime_error("Error cannot open /dev/tty0");
 }
@@ -233,14 +267,74 @@ void get_keyboard_state() {
  * If a numeric is supplied within the parameter, the unsigned integer notes the
  * number of
  */
-std::size_t read_raw(char *ptr, bool bwait_for_key = true,
-                     std::size_t ptr_size = 1) {
-  enable_raw_mode(bwait_for_key);
-  std::size_t ret = read(STDIN_FILENO, ptr, ptr_size);
+ssize_t read_raw(char *ptr, bool bwait_for_key = true,
+                 std::size_t ptr_size = 1) {
+  enable_raw_mode();
+  // a wait that is over when input comes or after a tenth of a second.
+  struct pollfd p = {STDIN_FILENO, POLLIN, 0};
+  if (!bwait_for_key && poll(&p, 1, 100) <= 0)
+    return 0;
+  ssize_t ret = read(STDIN_FILENO, ptr, ptr_size);
   return ret;
 }
 
-int main() {
+/**
+ * @fn query_terminal_policy
+ * @brief asks the terminal about itself when $TERM did not identify it. The
+ * kitty keyboard protocol query is sent first and device attributes (DA1)
+ * second. Every terminal answers DA1, so its reply ends the wait.
+ */
+terminal_policy_t query_terminal_policy(terminal_policy_t policy) {
+  // raw before the query goes out, or the replies are echoed and held
+  // back until a newline.
+  enable_raw_mode();
+  const char query[] = "\x1b[?u\x1b[c";
+  if (write(STDOUT_FILENO, query, sizeof(query) - 1) < 0)
+    return policy;
+
+  char reply[128] = {};
+  std::size_t used = {};
+  while (used < sizeof(reply)) {
+    ssize_t rdret = read_raw(reply + used, false, sizeof(reply) - used);
+    if (rdret <= 0)
+      break;
+    used += rdret;
+    if (reply[used - 1] == 'c')
+      break;
+  }
+
+  return terminal_policy_from_replies(reply, used, getenv("TERM"), policy);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && std::string(argv[1]) == "--bench") {
+    benchmark_table_t benchmarks = {{"osc52", bench_osc52},
+                                    {"terminals", bench_terminals},
+                                    {"render", bench_render},
+                                    {"render_threads", bench_render_threads},
+                                    {"echo", bench_echo},
+                                    {"compare", bench_compare},
+                                    {"syscalls", bench_syscalls},
+                                    {"memory", bench_memory},
+                                    {"highlight", bench_highlight},
+                                    {"scrollback", bench_scrollback},
+                                    {"snapshot", bench_snapshot},
+                                    {"timers", bench_timers},
+                                    {"session_table", bench_session_table},
+                                    {"paste", bench_paste},
+                                    {"typeahead", bench_typeahead},
+                                    {"panes", bench_panes},
+                                    {"audit", bench_audit},
+                                    {"idle", bench_idle},
+                                    {"widgets", bench_widgets},
+                                    {"list", bench_list},
+                                    {"recorder", bench_recorder},
+                                    {"fairness", bench_fairness},
+                                    {"dispatch", bench_dispatch},
+                                    {"ordered", bench_ordered}};
+    return run_benchmarks(benchmarks, argc - 2, argv + 2);
+  }
+
   u_int16_t rows = {};
   u_int16_t columns = {};
 
@@ -252,31 +346,6 @@ int main() {
     printf("%c", (i % 10 + '0'));
   printf("*\n");
 
-  std::unordered_map<std::string, vkey_t> virtual_key_map = {
-      {"\x1b", vkey_t::ESC},          {"\x1b[OQ", vkey_t::F2},
-      {"\x1b[OR", vkey_t::F3},        {"\x1b[OS", vkey_t::F4},
-      {"\x1b[15~", vkey_t::F5},       {"\x1b[17~", vkey_t::F6},
-      {"\x1b[18~", vkey_t::F7},       {"\x1b[19~", vkey_t::F8},
-      {"\x1b[20~", vkey_t::F9},       {"\x1b[H", vkey_t::HOME},
-      {"\x1b[F", vkey_t::END},        {"\x1b[A", vkey_t::UP_ARROW},
-      {"\x1b[B", vkey_t::DOWN_ARROW}, {"\x1b[C", vkey_t::RIGHT_ARROW},
-      {"\x1b[D", vkey_t::LEFT_ARROW}, {"\x1b[5~", vkey_t::PAGE_UP},
-      {"\x1b[6~", vkey_t::PAGE_DOWN}, {"\x1b[2~", vkey_t::INSERT},
-      {"\x1b[3~", vkey_t::DELETE},    {"\x7f", vkey_t::BACKSPACE},
-      {"\x0a", vkey_t::ENTER},        {"\x09", vkey_t::TAB}};
-
-#if 0
-
-  char c = {};
-  while (read(STDIN_FILENO, &c, 1) == 1 && c != 'q') {
-    if (iscntrl(c)) {
-      printf("%d - 0x%x\n", c, c);
-    } else {
-      printf("%d - 0x%x ('%c')\n", c, c, c);
-    }
-  }
-#endif
-
   /*
    * @brief  if a control escape sequence has been received, process the rest of
    * the messages from the keyboard. Read the entire buffer. Once it is
@@ -284,15 +353,80 @@ int main() {
    * raw input. If the input is character information it is dispatched.
    *
    */
+  /* @brief the decode loop is specialized for the terminal, chosen once here
+   * from $TERM or, failing that, from what the terminal replies. */
+  terminal_policy_t policy = terminal_policy_from_term(getenv("TERM"));
+  if (policy == terminal_policy_t::generic)
+    policy = query_terminal_policy(policy);
+  terminal_decoder_t decoder(policy);
+  bool bquit = {};
+
+  /* @brief with --audit path every key is appended to an audit log at
+   * path, committed in batches rather than written a key at a time. */
+  std::unique_ptr<audit_log_t> audit = {};
+  if (argc > 2 && std::string(argv[1]) == "--audit") {
+    audit = std::make_unique<audit_log_t>(argv[2]);
+    if (!audit->ok()) {
+      fprintf(stderr, "audit log %s cannot be appended to\n", argv[2]);
+      return EXIT_FAILURE;
+    }
+  }
 
-  char c = {};
-  vkey_t vk = {};
-
+  // ask kitty for unambiguous escape codes, popped again at exit.
+  if (policy == terminal_policy_t::kitty)
+    printf("\x1b[>1u");
+
+  /* @brief clipboard contents requested with OSC 52 come back through the
+   * keyboard input. They are decoded into this buffer, a piece at a time. */
+  u_int8_t clipboard[64 << 10] = {};
+  osc52_reader_t clipboard_reader(
+      clipboard, sizeof(clipboard),
+      [&](const u_int8_t *, std::size_t, bool final) {
+        if (final)
+          printf("clipboard(%s) %lu bytes\n", clipboard_reader.selection(),
+                 clipboard_reader.total());
+      });
+  decoder.set_osc_listener(&clipboard_reader);
+
+  audit_log_t::buffer_t *audit_keys = audit ? &audit->buffer() : nullptr;
+
+  /* @brief here is where the change of in dispatch and other searching may
+   * produce results for listeners. The filter has produced results into two
+   * distinct variables: vk or c. When one is set, the other is turned off. A
+   * type of variant, but really small data. Both are areas of storage for
+   * convenience. A "vk" or the "seq" has the keystroke information.*/
+  auto on_key = [&](const key_event_t &e) {
+    if (audit_keys)
+      audit_keys->append(0, e, steady_now_ns());
+    if (e.vk != vkey_t::none) {
+      printf("key seq - ");
+      for (u_int8_t n = 0; n < e.seq_size; n++) {
+        printf(" 0x%x ", (int)e.seq[n]);
+      }
+      printf("\n");
+      printf("vk        input - %hu\n", static_cast<u_int16_t>(e.vk));
+    } else if (e.c == 'q') {
+      bquit = true;
+    } else {
+      printf("character input - %c\n", e.c);
+    }
+  };
+
+  /* @brief without bracketed paste a paste arrives as typing, the detector
+   * tells it apart and hands over its text in runs instead of keys. */
+  paste_detector_t paste;
+  auto on_text = [&](const char *text, std::size_t n) {
+    printf("text input - %zu bytes\n", n);
+    benchmark_keep(text);
+  };
   // this loop will received control messages another way.
-  while (read_raw(&c) == 1 && c != 'q') {
-    std::string key_sequence = {};
-
-    key_sequence.push_back(c);
+  char buffer[4096] = {};
+  while (!bquit) {
+    ssize_t rdret = read_raw(buffer, true, sizeof(buffer));
+    if (rdret <= 0)
+      break;
+    paste.feed(decoder, buffer, rdret, steady_now_ns() / 1000, on_key,
+               on_text);
 
     /**
      * @brief  if its an escape code, detection of the actual ESC key is
@@ -301,64 +435,24 @@ int main() {
      * character. When it does not have a character at this point, it is a key
      * press from the ESC key. A user input and not an escaped virtual key.
      */
-    if (c == '\x1b') {
-      char immediate_next = {};
-      std::size_t rdret = read_raw(&immediate_next, false);
-      printf("%lu)\n", rdret);
-      if (rdret == 1) {
-        key_sequence.push_back(immediate_next);
-        printf("%lu->", rdret);
-        /** read the rest of the sequence into the remainder of the signature.
-         * the ESC character occupies the first postion. The immediate_next
-         * variable occupies the second. The read is therefore started from the
-         * next insert position. after this completes, a keyboard signature will
-         * most likely be there. This is used as a string to the virtual key map
-         * for identification and then dispatch.*/
-        char buffer[11] = {};
-
-        read_raw(buffer, false, 10); //-1 room for strcat null.
-        key_sequence.append(buffer);
-      }
-    }
-
-    /** @brief filter the key through the keyboard map. If the item is within
-     * the unordered_map then it will produce a vk value from the corresponding
-     * entry. Of note, both  multiple escaped sequence character keystrokes and
-     * single character keystrokes are processed using this filter. There are a
-     * few single character ones that are also labeled as virtual key. ENTER,
-     * TAB, BACKSPACE, etc. for preference of style and handling the filter in
-     * one place. Common for such filters. */
-    auto it = virtual_key_map.find(key_sequence);
-    if (it != virtual_key_map.end()) {
-      vk = it->second;
-      printf("key seq - ");
-      for (auto ch : key_sequence) {
-        printf(" 0x%x ", (int)ch);
-      }
-      printf("\n");
-      key_sequence = {};
-
-    } else {
-      vk = vkey_t::none;
+    while (!bquit && decoder.escape_pending()) {
+      rdret = read_raw(buffer, false, sizeof(buffer));
+      if (rdret > 0)
+        decoder.feed(buffer, rdret, on_key);
+      else
+        decoder.flush(on_key);
     }
-
-    /* @brief here is where the change of in dispatch and other searching may
-     * produce results for listeners. The filter has produced results into two
-     * distinct variables: vk or c. When one is set, the other is turned off. A
-     * type of variant, but really small data. Both are areas of storage for
-     * convenience. A "vk" or the "key_sequence" has the keystroke
-     * information.*/
-    if (vk != vkey_t::none)
-      printf("vk        input - %hu\n", static_cast<u_int16_t>(vk));
-    else
-      for (auto ch : key_sequence) {
-        printf("character input - %c\n", ch);
-      }
   }
 
-  // exiting without disabling raw mod causes no input to show.
-  // so it disables it here.
-  disable_raw_mode();
+  if (policy == terminal_policy_t::kitty)
+    printf("\x1b[<u");
+
+  const paste_counters_t &pasted = paste.counters();
+  if (pasted.pastes)
+    printf("pastes(%lu) %lu bytes as text\n",
+           static_cast<unsigned long>(pasted.pastes),
+           static_cast<unsigned long>(pasted.paste_bytes));
 
+  // raw mode is disabled at exit, by the handler enable_raw_mode set.
   return EXIT_SUCCESS;
 }
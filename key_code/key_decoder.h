@@ -0,0 +1,498 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @enum vkey_t
+ * @brief the virtual keycode. The system translates the input from the
+ * STDIN_FILENO low level file to these values. There are two separate events
+ * within the event class. A character and a virtual key. Programming the
+ * virtual key behavior can be provided as a distinct function within the
+ * editing objects.
+ */
+enum class vkey_t : u_int8_t {
+  none,
+  F1,
+  F2,
+  F3,
+  F4,
+  F5,
+  F6,
+  F7,
+  F8,
+  F9,
+  F10,
+  F11,
+  F12,
+  HOME,
+  END,
+  UP_ARROW,
+  DOWN_ARROW,
+  LEFT_ARROW,
+  RIGHT_ARROW,
+  PAGE_UP, // 19
+  PAGE_DOWN,
+  INSERT,
+  DELETE,
+  ESC, // 23
+  BACKSPACE,
+  ENTER, // 25
+  TAB
+};
+
+using virtual_key_map_t = std::unordered_map<std::string, vkey_t>;
+
+/**
+ * @fn default_virtual_key_map
+ * @brief the keyboard signatures understood by the decoder. Both multiple
+ * escaped sequence character keystrokes and single character keystrokes are
+ * listed. There are a few single character ones that are also labeled as
+ * virtual key. ENTER, TAB, BACKSPACE, etc. for preference of style and
+ * handling the filter in one place.
+ *
+ * The signatures of every terminal within terminal_corpus.h are merged here.
+ * They do not collide, so one map serves them all. Cursor keys are listed in
+ * both the normal and the application (ESC O) form.
+ */
+inline const virtual_key_map_t &default_virtual_key_map() {
+  static const virtual_key_map_t virtual_key_map = {
+      // xterm, alacritty, foot, tmux, screen, Windows Terminal
+      {"\x1bOP", vkey_t::F1},
+      {"\x1bOQ", vkey_t::F2},
+      {"\x1bOR", vkey_t::F3},
+      {"\x1bOS", vkey_t::F4},
+      {"\x1b[15~", vkey_t::F5},
+      {"\x1b[17~", vkey_t::F6},
+      {"\x1b[18~", vkey_t::F7},
+      {"\x1b[19~", vkey_t::F8},
+      {"\x1b[20~", vkey_t::F9},
+      {"\x1b[21~", vkey_t::F10},
+      {"\x1b[23~", vkey_t::F11},
+      {"\x1b[24~", vkey_t::F12},
+      {"\x1b[H", vkey_t::HOME},
+      {"\x1b[F", vkey_t::END},
+      {"\x1bOH", vkey_t::HOME},
+      {"\x1bOF", vkey_t::END},
+      {"\x1b[A", vkey_t::UP_ARROW},
+      {"\x1b[B", vkey_t::DOWN_ARROW},
+      {"\x1b[C", vkey_t::RIGHT_ARROW},
+      {"\x1b[D", vkey_t::LEFT_ARROW},
+      {"\x1bOA", vkey_t::UP_ARROW},
+      {"\x1bOB", vkey_t::DOWN_ARROW},
+      {"\x1bOC", vkey_t::RIGHT_ARROW},
+      {"\x1bOD", vkey_t::LEFT_ARROW},
+      {"\x1b[5~", vkey_t::PAGE_UP},
+      {"\x1b[6~", vkey_t::PAGE_DOWN},
+      {"\x1b[2~", vkey_t::INSERT},
+      {"\x1b[3~", vkey_t::DELETE},
+
+      // linux VT, tmux and screen home and end, rxvt F1 - F4
+      {"\x1b[1~", vkey_t::HOME},
+      {"\x1b[4~", vkey_t::END},
+      {"\x1b[[A", vkey_t::F1},
+      {"\x1b[[B", vkey_t::F2},
+      {"\x1b[[C", vkey_t::F3},
+      {"\x1b[[D", vkey_t::F4},
+      {"\x1b[[E", vkey_t::F5},
+      {"\x1b[11~", vkey_t::F1},
+      {"\x1b[12~", vkey_t::F2},
+      {"\x1b[13~", vkey_t::F3},
+      {"\x1b[14~", vkey_t::F4},
+      {"\x1b[7~", vkey_t::HOME},
+      {"\x1b[8~", vkey_t::END},
+
+      // kitty keyboard protocol, disambiguate escape codes
+      {"\x1b[27u", vkey_t::ESC},
+      {"\x1b[P", vkey_t::F1},
+      {"\x1b[Q", vkey_t::F2},
+      {"\x1b[S", vkey_t::F4},
+
+      {"\x1b", vkey_t::ESC},
+      {"\x7f", vkey_t::BACKSPACE},
+      {"\x0a", vkey_t::ENTER},
+      {"\x0d", vkey_t::ENTER},
+      {"\x09", vkey_t::TAB}};
+  return virtual_key_map;
+}
+
+/**
+ * @struct key_event_t
+ * @brief a decoded keystroke. The filter produces results into two distinct
+ * variables: vk or c. When vk is vkey_t::none, c holds character input.
+ * seq points at the raw bytes of the keystroke and is only valid during the
+ * callback.
+ */
+struct key_event_t {
+  vkey_t vk = {};
+  char c = {};
+  const char *seq = {};
+  u_int8_t seq_size = {};
+};
+
+/**
+ * @class osc_listener_t
+ * @brief receives operating system command strings, ESC ] code ; data
+ * terminated by BEL or ESC \. The data is handed over in pieces as it
+ * arrives, pointing into the caller's read buffer, so strings of any length
+ * pass through without being collected first.
+ */
+class osc_listener_t {
+public:
+  virtual ~osc_listener_t() {}
+  virtual void osc_begin(unsigned /* code */) {}
+  virtual void osc_data(const char * /* data */, std::size_t /* len */) {}
+  /** @brief complete is false when the string was cut off by another
+   * escape sequence rather than a terminator. */
+  virtual void osc_end(bool /* complete */) {}
+};
+
+/**
+ * @fn find_string_terminator
+ * @brief locates the first BEL or ESC within a control string. Clipboard
+ * payloads can be megabytes so this is scanned sixteen bytes at a time.
+ */
+inline std::size_t find_string_terminator(const char *p, std::size_t len) {
+  std::size_t i = {};
+#if defined(__SSE2__)
+  const __m128i bel = _mm_set1_epi8('\x07');
+  const __m128i esc = _mm_set1_epi8('\x1b');
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+    int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, bel), _mm_cmpeq_epi8(v, esc)));
+    if (mask)
+      return i + static_cast<std::size_t>(__builtin_ctz(mask));
+  }
+#endif
+  for (; i < len; i++)
+    if (p[i] == '\x07' || p[i] == '\x1b')
+      break;
+  return i;
+}
+
+/**
+ * @class map_policy_t
+ * @brief the decoder policy that looks keystrokes up within a
+ * virtual_key_map_t. It understands whatever the map lists, so it serves
+ * custom maps and terminals that are not known ahead of time. The
+ * specialized policies are found in terminal_policy.h.
+ */
+class map_policy_t {
+public:
+  static constexpr const char *name = "map";
+
+  /** @brief ESC [ [ A - E may be listed, so the decoder must accept it. */
+  static constexpr bool linux_function_keys = true;
+
+  map_policy_t(const virtual_key_map_t &_map = default_virtual_key_map())
+      : map(&_map) {}
+
+  /**
+   * @fn fill_single_byte
+   * @brief lists the keys that are a single byte such as ENTER and TAB.
+   */
+  void fill_single_byte(vkey_t (&table)[256]) const {
+    for (auto &n : *map)
+      if (n.first.size() == 1)
+        table[static_cast<u_int8_t>(n.first[0])] = n.second;
+  }
+
+  /**
+   * @fn lookup
+   * @brief the virtual key of a complete escape sequence, vkey_t::none when
+   * it is not known.
+   */
+  vkey_t lookup(const char *seq, std::size_t len) const {
+    auto it = map->find(std::string(seq, len));
+    return it != map->end() ? it->second : vkey_t::none;
+  }
+
+private:
+  const virtual_key_map_t *map = {};
+};
+
+/**
+ * @class basic_key_decoder_t
+ * @brief a streaming decoder of the bytes read from the terminal. Input is
+ * fed in whatever pieces read() returns and the sequences may be split at
+ * any point. Recognized keyboard signatures are dispatched as virtual keys,
+ * anything else as character input. Control strings (OSC, DCS, APC, PM, SOS)
+ * are consumed up to their terminator, OSC data is passed on to the listener
+ * and the others are discarded. An OSC 52 clipboard reply may be of any
+ * length, other strings end after max_string bytes. A control string is held
+ * to the escape wait like any sequence, see escape_pending, so Alt+] or
+ * Alt+P sent as ESC ] or ESC P does not swallow the keys typed after it.
+ *
+ * POLICY decides which keyboard signatures exist, see map_policy_t. As it is
+ * a template parameter the decode loop is compiled separately for each
+ * terminal with the lookup inlined.
+ */
+template <typename POLICY> class basic_key_decoder_t {
+public:
+  /** @brief the longest control string other than OSC 52 taken in. */
+  static constexpr std::size_t max_string = 4096;
+
+  basic_key_decoder_t(const POLICY &_policy = POLICY()) : policy(_policy) {
+    policy.fill_single_byte(single_byte);
+  }
+
+  void set_osc_listener(osc_listener_t *_listener) { listener = _listener; }
+
+  /**
+   * @fn escape_pending
+   * @brief true when the input ended part way through an escape sequence.
+   * The caller reads again with a short wait, when nothing arrives it calls
+   * flush. This is how the actual ESC key is told apart from the start of
+   * an escaped virtual key. Control strings are included, a terminal
+   * writes its reply at once, so a string that stops for the wait is ESC
+   * and an introducer typed as a key, or was cut off.
+   */
+  bool escape_pending() const { return state != state_t::ground; }
+
+  /**
+   * @fn ground
+   * @brief true between keystrokes, when the next byte starts a new one.
+   */
+  bool ground() const { return state == state_t::ground; }
+
+  /**
+   * @fn flush
+   * @brief dispatches a partial sequence after the wait expired. A lone ESC
+   * becomes the ESC key. A control string with no data yet is dispatched as
+   * the keys it began with, ESC ] for Alt+], one with data ends cut off.
+   */
+  template <typename F> void flush(F &&on_key) {
+    if (state == state_t::escape || state == state_t::csi ||
+        state == state_t::ss3) {
+      complete(on_key);
+    } else if (state != state_t::ground) {
+      bool bescape = state == state_t::string_escape;
+      if (state == state_t::osc_code)
+        osc_valid = false;
+      end_string(false);
+      if (string_size)
+        seq_size = {};
+      else
+        complete(on_key);
+      if (bescape) {
+        begin_sequence('\x1b');
+        complete(on_key);
+      }
+    }
+    state = state_t::ground;
+  }
+
+  /**
+   * @fn feed
+   * @brief decodes len bytes, calling on_key(const key_event_t &) for every
+   * keystroke recognized.
+   */
+  template <typename F> void feed(const char *p, std::size_t len, F &&on_key) {
+    std::size_t i = {};
+    while (i < len) {
+      char ch = p[i];
+
+      switch (state) {
+      case state_t::ground:
+        if (ch == '\x1b') {
+          begin_sequence(ch);
+          state = state_t::escape;
+        } else {
+          key_event_t e = {};
+          e.vk = single_byte[static_cast<u_int8_t>(ch)];
+          e.c = e.vk == vkey_t::none ? ch : '\0';
+          e.seq = p + i;
+          e.seq_size = 1;
+          on_key(e);
+        }
+        i++;
+        break;
+
+      case state_t::escape:
+        if (ch == '[') {
+          push(ch);
+          state = state_t::csi;
+        } else if (ch == 'O') {
+          push(ch);
+          state = state_t::ss3;
+        } else if (ch == ']') {
+          push(ch);
+          osc_code = {};
+          osc_valid = true;
+          string_size = {};
+          state = state_t::osc_code;
+        } else if (ch == 'P' || ch == '_' || ch == '^' || ch == 'X') {
+          push(ch);
+          osc_valid = false;
+          string_size = {};
+          state = state_t::string;
+        } else if (ch == '\x1b') {
+          // ESC ESC, the first is the key itself.
+          complete(on_key);
+          begin_sequence(ch);
+        } else {
+          push(ch);
+          complete(on_key);
+          state = state_t::ground;
+        }
+        i++;
+        break;
+
+      case state_t::csi:
+        push(ch);
+        i++;
+        if (POLICY::linux_function_keys && ch == '[' && seq_size == 3) {
+          // the linux console F1 - F5, ESC [ [ A - E.
+        } else if (ch >= 0x40 && ch <= 0x7e) {
+          complete(on_key);
+          state = state_t::ground;
+        } else if (ch < 0x20) {
+          // a control character cannot be part of the sequence.
+          complete(on_key);
+          state = state_t::ground;
+        }
+        break;
+
+      case state_t::ss3:
+        push(ch);
+        i++;
+        complete(on_key);
+        state = state_t::ground;
+        break;
+
+      case state_t::osc_code:
+        if (ch >= '0' && ch <= '9') {
+          push(ch);
+          osc_code = osc_code * 10 + static_cast<unsigned>(ch - '0');
+          i++;
+        } else if (ch == ';') {
+          push(ch);
+          begin_string();
+          i++;
+        } else if (ch == '\x07' || ch == '\x1b') {
+          // no data, such as a bare ESC ] 104 BEL.
+          begin_string();
+        } else {
+          osc_valid = false;
+          state = state_t::string;
+        }
+        break;
+
+      case state_t::string: {
+        std::size_t n = find_string_terminator(p + i, len - i);
+        if (n && osc_valid && listener)
+          listener->osc_data(p + i, n);
+        i += n;
+        string_size += n;
+        if (i < len) {
+          state = p[i] == '\x07' ? end_string(true) : state_t::string_escape;
+          i++;
+        } else if (string_size > max_string &&
+                   !(osc_valid && osc_code == 52)) {
+          // no reply is this long, the bytes after it are keys again.
+          state = end_string(false);
+        }
+      } break;
+
+      case state_t::string_escape:
+        if (ch == '\\') {
+          state = end_string(true);
+          i++;
+        } else {
+          // the string was cut short, ESC begins the next sequence. With
+          // no data it was ESC and an introducer typed as a key.
+          end_string(false);
+          if (!string_size)
+            complete(on_key);
+          begin_sequence('\x1b');
+          state = state_t::escape;
+        }
+        break;
+      }
+    }
+  }
+
+private:
+  enum class state_t {
+    ground,
+    escape,
+    csi,
+    ss3,
+    osc_code,
+    string,
+    string_escape
+  };
+
+  void begin_sequence(char ch) {
+    seq_size = {};
+    push(ch);
+  }
+
+  void push(char ch) {
+    if (seq_size < sizeof(seq))
+      seq[seq_size] = ch;
+    seq_size++;
+  }
+
+  void begin_string() {
+    if (osc_valid && listener)
+      listener->osc_begin(osc_code);
+    state = state_t::string;
+  }
+
+  state_t end_string(bool complete) {
+    if (osc_valid && listener)
+      listener->osc_end(complete);
+    osc_valid = false;
+    return state_t::ground;
+  }
+
+  /**
+   * @brief filter the sequence through the policy. Sequences that are
+   * not known are dispatched as character input, over long ones are
+   * dropped.
+   */
+  template <typename F> void complete(F &&on_key) {
+    if (seq_size > sizeof(seq)) {
+      seq_size = {};
+      return;
+    }
+
+    key_event_t e = {};
+    e.seq = seq;
+    e.seq_size = static_cast<u_int8_t>(seq_size);
+
+    e.vk = policy.lookup(seq, seq_size);
+    if (e.vk != vkey_t::none) {
+      on_key(e);
+    } else {
+      for (std::size_t n = 0; n < seq_size; n++) {
+        e.c = seq[n];
+        e.seq = seq + n;
+        e.seq_size = 1;
+        on_key(e);
+      }
+    }
+    seq_size = {};
+  }
+
+  POLICY policy;
+  vkey_t single_byte[256] = {};
+  osc_listener_t *listener = {};
+
+  state_t state = state_t::ground;
+  char seq[32] = {};
+  std::size_t seq_size = {};
+  std::size_t string_size = {};
+  unsigned osc_code = {};
+  bool osc_valid = {};
+};
+
+using key_decoder_t = basic_key_decoder_t<map_policy_t>;
@@ -0,0 +1,427 @@
+#pragma once
+
+#include "common.h"
+#include "key_decoder.h"
+#include "latency_histogram.h"
+#include "ordered_executor.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using key_handler_t = std::function<void(const key_event_t &)>;
+
+/**
+ * @struct watchdog_policy_t
+ * @brief budget_ns is how long a handler may take. A binding that went
+ * past it offload_after times in a row, and allows it, is handed to the
+ * offload thread from then on, 0 never offloads. The watchdog ticks every
+ * half budget while keys come and sleeps once none came for linger_ms.
+ */
+struct watchdog_policy_t {
+  u_int64_t budget_ns = 2000000;
+  u_int32_t offload_after = 3;
+  u_int64_t linger_ms = 1000;
+};
+
+/**
+ * @struct binding_stats_t
+ * @brief what the handler of a binding cost. over_budget are the calls
+ * that went past the budget, stalls the calls the watchdog found still
+ * running past it, offloaded the calls run off the dispatching thread, on
+ * the offload thread or, for an async binding, the executor.
+ */
+struct binding_stats_t {
+  std::string name = {};
+  u_int64_t calls = {};
+  u_int64_t over_budget = {};
+  u_int64_t stalls = {};
+  u_int64_t offloaded = {};
+  bool boffloaded = {};
+  latency_histogram_t latency = {};
+};
+
+/**
+ * @class key_dispatcher_t
+ * @brief calls the handler bound to a key, a virtual key or a character,
+ * and times every call into the binding's histogram, so a binding that
+ * makes input back up can be named. A watchdog thread looks at the call
+ * in flight and flags one that is past the budget while it still runs,
+ * through on_stall, which names a handler that hangs before it returns.
+ * A binding bound with boffloadable, one whose handler needs nothing
+ * from the dispatching thread and may run after keys dispatched later,
+ * is moved to an offload thread once it keeps going past the budget, and
+ * runs there in order, so the keys behind it are not held up.
+ * statistics() is the per binding picture, print_handler_statistics its
+ * dump format.
+ *
+ * A handler that does expensive work, a search or I/O, is bound async to
+ * an ordering domain with bind_async and always runs on the executor the
+ * dispatcher was given. The calls within a domain complete in key order,
+ * the domains proceed in parallel, and dispatch returns once the call is
+ * posted. Handlers whose effects must keep their order share a domain.
+ * The watchdog does not watch async calls, they hold up no input.
+ */
+class key_dispatcher_t {
+public:
+  /** @brief called from the watchdog thread, the binding and how long
+   * its call has run so far. */
+  std::function<void(const std::string &, u_int64_t)> on_stall = {};
+
+  /** @brief async bindings run on executor, which must outlive the
+   * dispatcher. */
+  explicit key_dispatcher_t(const watchdog_policy_t &_policy = {},
+                            ordered_executor_t *_executor = nullptr)
+      : policy(_policy), executor(_executor) {
+    slot.fill(-1);
+    watchdog = std::thread([this] { watch_loop(); });
+  }
+
+  ~key_dispatcher_t() {
+    if (executor)
+      executor->drain();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      bstop = true;
+    }
+    wake.notify_all();
+    queued.notify_all();
+    watchdog.join();
+    if (offloader.joinable())
+      offloader.join();
+  }
+
+  key_dispatcher_t(const key_dispatcher_t &) = delete;
+  key_dispatcher_t &operator=(const key_dispatcher_t &) = delete;
+
+  /**
+   * @fn bind
+   * @brief binds handler to the virtual key vk under name, replacing what
+   * was bound to it. Bind before dispatching.
+   */
+  void bind(const std::string &name, vkey_t vk, key_handler_t handler,
+            bool boffloadable = false) {
+    slot[static_cast<u_int8_t>(vk)] = add(name, handler, boffloadable);
+  }
+
+  /** @brief the same for the character c. */
+  void bind(const std::string &name, char c, key_handler_t handler,
+            bool boffloadable = false) {
+    slot[256 + static_cast<u_int8_t>(c)] = add(name, handler, boffloadable);
+  }
+
+  /**
+   * @fn bind_async
+   * @brief binds handler to vk under name, to run on the executor in the
+   * ordering domain named domain. Throws std::runtime_error without an
+   * executor.
+   */
+  void bind_async(const std::string &name, vkey_t vk,
+                  const std::string &domain, key_handler_t handler) {
+    int d = domain_of(domain);
+    int i = add(name, handler, false);
+    bindings[i]->domain = d;
+    slot[static_cast<u_int8_t>(vk)] = i;
+  }
+
+  /** @brief the same for the character c. */
+  void bind_async(const std::string &name, char c, const std::string &domain,
+                  key_handler_t handler) {
+    int d = domain_of(domain);
+    int i = add(name, handler, false);
+    bindings[i]->domain = d;
+    slot[256 + static_cast<u_int8_t>(c)] = i;
+  }
+
+  /**
+   * @fn dispatch
+   * @brief calls the handler bound to e, or queues it for the offload
+   * thread. False when nothing is bound to e.
+   */
+  bool dispatch(const key_event_t &e) {
+    int i = e.vk != vkey_t::none ? slot[static_cast<u_int8_t>(e.vk)]
+                                 : slot[256 + static_cast<u_int8_t>(e.c)];
+    if (i < 0)
+      return false;
+    binding_t &b = *bindings[i];
+    u_int64_t now = steady_now_ns();
+    last_dispatch_ns.store(now, std::memory_order_seq_cst);
+    if (bwatch_idle.load(std::memory_order_seq_cst) &&
+        bwatch_idle.exchange(false)) {
+      { std::lock_guard<std::mutex> lock(mutex); }
+      wake.notify_all();
+    }
+    if (b.domain >= 0) {
+      post(i, e);
+      return true;
+    }
+    if (b.boffloaded.load(std::memory_order_relaxed)) {
+      offload(i, e);
+      return true;
+    }
+    u_int64_t took = call(inline_call, i, e, now);
+    if (took <= policy.budget_ns) {
+      b.streak = 0;
+    } else if (b.boffloadable && policy.offload_after &&
+               ++b.streak >= policy.offload_after) {
+      b.boffloaded = true;
+    }
+    return true;
+  }
+
+  /**
+   * @fn drain
+   * @brief returns once every offloaded and async call queued before it
+   * ran.
+   */
+  void drain() {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      idle.wait(lock, [&] { return queue.empty() && !brunning; });
+    }
+    if (executor)
+      executor->drain();
+  }
+
+  /** @brief the bindings in the order they were made. */
+  std::vector<binding_stats_t> statistics() const {
+    std::vector<binding_stats_t> all = {};
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    for (auto &b : bindings) {
+      binding_stats_t s = b->stats;
+      s.boffloaded = b->boffloaded;
+      all.push_back(s);
+    }
+    return all;
+  }
+
+  /** @brief the watchdog's ticks, for checking that it sleeps. */
+  u_int64_t watchdog_ticks() const { return ticks; }
+
+private:
+  /**
+   * @struct binding_t
+   * @brief a handler and its statistics, under stats_mutex.
+   */
+  struct binding_t {
+    key_handler_t handler = {};
+    bool boffloadable = {};
+    std::atomic<bool> boffloaded = {};
+    int domain = -1;
+    u_int32_t streak = {};
+    binding_stats_t stats = {};
+  };
+
+  /**
+   * @struct in_flight_t
+   * @brief the call a thread is in, for the watchdog. since_ns is 0
+   * between calls.
+   */
+  struct in_flight_t {
+    std::atomic<int> binding = {-1};
+    std::atomic<u_int64_t> since_ns = {};
+    u_int64_t flagged_ns = {};
+  };
+
+  struct queued_t {
+    int binding = {};
+    key_event_t e = {};
+    std::string seq = {};
+  };
+
+  static constexpr int async_call = -1;
+  static constexpr int inline_call = 0;
+  static constexpr int offload_call = 1;
+
+  int add(const std::string &name, key_handler_t &handler,
+          bool boffloadable) {
+    auto b = std::make_unique<binding_t>();
+    b->handler = std::move(handler);
+    b->boffloadable = boffloadable;
+    b->stats.name = name;
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    bindings.push_back(std::move(b));
+    return static_cast<int>(bindings.size() - 1);
+  }
+
+  int domain_of(const std::string &name) {
+    if (!executor)
+      throw std::runtime_error("key_dispatcher_t async binding needs an "
+                               "executor");
+    auto it = domains.find(name);
+    if (it == domains.end())
+      it = domains.emplace(name, executor->domain()).first;
+    return static_cast<int>(it->second);
+  }
+
+  /**
+   * @fn call
+   * @brief runs the handler of binding i on the thread of flight, which
+   * the watchdog watches unless it is async_call.
+   */
+  u_int64_t call(int flight, int i, const key_event_t &e, u_int64_t start) {
+    binding_t &b = *bindings[i];
+    in_flight_t *f = flight == async_call ? nullptr : &flights[flight];
+    if (f) {
+      f->binding.store(i, std::memory_order_relaxed);
+      f->since_ns.store(start, std::memory_order_release);
+    }
+    b.handler(e);
+    u_int64_t took = steady_now_ns() - start;
+    if (f)
+      f->since_ns.store(0, std::memory_order_release);
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    b.stats.calls++;
+    b.stats.latency.record(took);
+    b.stats.over_budget += took > policy.budget_ns;
+    b.stats.offloaded += flight != inline_call;
+    return took;
+  }
+
+  /** @brief posts the call of binding i to its domain on the executor. */
+  void post(int i, const key_event_t &e) {
+    auto seq = std::make_shared<std::string>(
+        e.seq ? std::string(e.seq, e.seq_size) : std::string());
+    executor->post(static_cast<u_int32_t>(bindings[i]->domain),
+                   [this, i, e, seq] {
+                     key_event_t copy = e;
+                     copy.seq = seq->data();
+                     call(async_call, i, copy, steady_now_ns());
+                   });
+  }
+
+  void offload(int i, const key_event_t &e) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(
+          {i, e, e.seq ? std::string(e.seq, e.seq_size) : std::string()});
+      if (!offloader.joinable())
+        offloader = std::thread([this] { offload_loop(); });
+    }
+    queued.notify_one();
+  }
+
+  void offload_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      queued.wait(lock, [&] { return bstop || !queue.empty(); });
+      if (queue.empty())
+        return;
+      queued_t q = std::move(queue.front());
+      queue.pop_front();
+      brunning = true;
+      lock.unlock();
+      q.e.seq = q.seq.data();
+      call(offload_call, q.binding, q.e, steady_now_ns());
+      lock.lock();
+      brunning = false;
+      if (queue.empty())
+        idle.notify_all();
+    }
+  }
+
+  /**
+   * @fn watch_loop
+   * @brief looks at the calls in flight every half budget, and sleeps
+   * without a timeout once no key came for linger_ms. A call past the
+   * budget is flagged once.
+   */
+  void watch_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    u_int64_t tick_ns = std::max<u_int64_t>(policy.budget_ns / 2, 1000000);
+    while (!bstop) {
+      u_int64_t now = steady_now_ns();
+      u_int64_t last = last_dispatch_ns.load(std::memory_order_relaxed);
+      bool bbusy = false;
+      for (auto &f : flights)
+        bbusy = bbusy || f.since_ns.load(std::memory_order_acquire);
+      if (!bbusy && now - last > policy.linger_ms * 1000000) {
+        bwatch_idle.store(true, std::memory_order_seq_cst);
+        if (last_dispatch_ns.load(std::memory_order_seq_cst) == last)
+          wake.wait(lock, [&] { return bstop || !bwatch_idle; });
+        bwatch_idle = false;
+        continue;
+      }
+      wake.wait_for(lock, std::chrono::nanoseconds(tick_ns),
+                    [&] { return bstop; });
+      ticks++;
+      lock.unlock();
+      check(steady_now_ns());
+      lock.lock();
+    }
+  }
+
+  void check(u_int64_t now) {
+    for (auto &f : flights) {
+      u_int64_t since = f.since_ns.load(std::memory_order_acquire);
+      int i = f.binding.load(std::memory_order_relaxed);
+      if (!since || since == f.flagged_ns || now - since <= policy.budget_ns)
+        continue;
+      f.flagged_ns = since;
+      std::string name = {};
+      {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        bindings[i]->stats.stalls++;
+        name = bindings[i]->stats.name;
+      }
+      if (on_stall)
+        on_stall(name, now - since);
+    }
+  }
+
+  watchdog_policy_t policy = {};
+  ordered_executor_t *executor = {};
+  std::unordered_map<std::string, u_int32_t> domains = {};
+  std::array<int, 512> slot = {};
+  std::vector<std::unique_ptr<binding_t>> bindings = {};
+  mutable std::mutex stats_mutex = {};
+  std::array<in_flight_t, 2> flights = {};
+  std::atomic<u_int64_t> last_dispatch_ns = {};
+  std::atomic<bool> bwatch_idle = {};
+  std::atomic<u_int64_t> ticks = {};
+  std::mutex mutex = {};
+  std::condition_variable wake = {};
+  std::condition_variable queued = {};
+  std::condition_variable idle = {};
+  std::deque<queued_t> queue = {};
+  bool brunning = {};
+  bool bstop = {};
+  std::thread watchdog = {};
+  std::thread offloader = {};
+};
+
+/**
+ * @fn print_handler_statistics
+ * @brief the dump format, one line per binding that was called,
+ *   handler <name> calls <n> p50 <us> p99 <us> max <us> over <n>
+ *   stalls <n> offloaded <n>
+ */
+inline void print_handler_statistics(
+    FILE *file, const std::vector<binding_stats_t> &all) {
+  for (auto &s : all) {
+    if (!s.calls)
+      continue;
+    fprintf(file,
+            "handler %-12s calls %8lu p50 %9.1f p99 %9.1f max %9.1f over "
+            "%lu stalls %lu offloaded %lu%s\n",
+            s.name.c_str(), static_cast<unsigned long>(s.calls),
+            s.latency.percentile(50) / 1e3, s.latency.percentile(99) / 1e3,
+            s.latency.max() / 1e3, static_cast<unsigned long>(s.over_budget),
+            static_cast<unsigned long>(s.stalls),
+            static_cast<unsigned long>(s.offloaded),
+            s.boffloaded ? " (offloaded)" : "");
+  }
+}
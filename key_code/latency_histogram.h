@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <string>
+#include <sys/types.h>
+
+/**
+ * @class latency_histogram_t
+ * @brief a log linear histogram of durations in nanoseconds. Every power of
+ * two is split into 16 linear buckets, so a reported value is within about
+ * 6% of the recorded one, from 1 ns to centuries, in a fixed 8 KB.
+ * Recording is a count increment with no allocation.
+ */
+class latency_histogram_t {
+public:
+  static constexpr int sub_bits = 4;
+  static constexpr int sub_buckets = 1 << sub_bits;
+  static constexpr int bucket_count = (64 - sub_bits + 1) * sub_buckets;
+
+  void record(u_int64_t ns) {
+    counts[index(ns)]++;
+    total++;
+    sum += ns;
+    min_ns = std::min(min_ns, ns);
+    max_ns = std::max(max_ns, ns);
+  }
+
+  void merge(const latency_histogram_t &o) {
+    for (int i = 0; i < bucket_count; i++)
+      counts[i] += o.counts[i];
+    total += o.total;
+    sum += o.sum;
+    min_ns = std::min(min_ns, o.min_ns);
+    max_ns = std::max(max_ns, o.max_ns);
+  }
+
+  void reset() { *this = latency_histogram_t(); }
+
+  u_int64_t count() const { return total; }
+  u_int64_t min() const { return total ? min_ns : 0; }
+  u_int64_t max() const { return max_ns; }
+  double mean() const { return total ? static_cast<double>(sum) / total : 0; }
+
+  /**
+   * @fn percentile
+   * @brief the value below which p percent of the recordings fall, p from 0
+   * to 100. The middle of the bucket is reported, clamped to min and max.
+   */
+  u_int64_t percentile(double p) const {
+    if (!total)
+      return 0;
+    u_int64_t rank = static_cast<u_int64_t>(p / 100.0 * total + 0.5);
+    rank = std::min(std::max<u_int64_t>(rank, 1), total);
+    u_int64_t seen = {};
+    for (int i = 0; i < bucket_count; i++) {
+      seen += counts[i];
+      if (seen >= rank) {
+        u_int64_t low = lower_bound(i);
+        u_int64_t mid = low + (lower_bound(i + 1) - low) / 2;
+        return std::min(std::max(mid, min_ns), max_ns);
+      }
+    }
+    return max_ns;
+  }
+
+  /**
+   * @fn print
+   * @brief one line summary in microseconds.
+   */
+  void print(const std::string &name) const {
+    printf("%-40s n=%llu p50=%.1fus p90=%.1fus p99=%.1fus max=%.1fus\n",
+           name.c_str(), static_cast<unsigned long long>(total),
+           percentile(50) / 1e3, percentile(90) / 1e3, percentile(99) / 1e3,
+           max() / 1e3);
+  }
+
+private:
+  static int index(u_int64_t v) {
+    if (v < sub_buckets)
+      return static_cast<int>(v);
+    int e = 63 - __builtin_clzll(v);
+    int sub = static_cast<int>(v >> (e - sub_bits)) - sub_buckets;
+    return (e - sub_bits + 1) * sub_buckets + sub;
+  }
+
+  static u_int64_t lower_bound(int i) {
+    if (i < sub_buckets)
+      return static_cast<u_int64_t>(i);
+    int b = i / sub_buckets;
+    u_int64_t s = static_cast<u_int64_t>(i % sub_buckets);
+    if (b + sub_bits >= 64)
+      return ~u_int64_t{};
+    return (sub_buckets + s) << (b - 1);
+  }
+
+  std::array<u_int64_t, bucket_count> counts = {};
+  u_int64_t total = {};
+  u_int64_t sum = {};
+  u_int64_t min_ns = ~u_int64_t{};
+  u_int64_t max_ns = {};
+};
@@ -0,0 +1,416 @@
+#pragma once
+
+#include "key_decoder.h"
+#include "screen.h"
+#include "widgets.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @class row_provider_t
+ * @brief the rows a list_view_t shows, fetched a page at a time. A row is
+ * a line of text, or several separated by '\n' for a row that takes more
+ * than one line. fetch may be slow, a file or a query, and is called on
+ * the list's prefetch thread as well as the caller's.
+ */
+class row_provider_t {
+public:
+  virtual ~row_provider_t() {}
+  virtual u_int64_t size() const = 0;
+  virtual void fetch(u_int64_t first, std::size_t count,
+                     std::vector<std::string> &rows) = 0;
+};
+
+/**
+ * @class row_height_index_t
+ * @brief the height in lines of every row, and the line each row starts
+ * on, over a Fenwick tree of the heights beyond one, so finding either is
+ * O(log rows). Rows not yet seen count as one line. Five bytes a row.
+ */
+class row_height_index_t {
+public:
+  void reset(u_int64_t rows) {
+    heights.assign(rows, 0);
+    tree.assign(rows + 1, 0);
+    extra = {};
+  }
+
+  u_int64_t rows() const { return heights.size(); }
+  int height(u_int64_t row) const { return 1 + heights[row]; }
+  /** @brief the lines of every row. */
+  u_int64_t lines() const { return rows() + extra; }
+
+  void set(u_int64_t row, int height) {
+    int delta = std::min(std::max(height, 1), 256) - 1 - heights[row];
+    if (!delta)
+      return;
+    heights[row] = static_cast<u_int8_t>(heights[row] + delta);
+    extra += delta;
+    for (u_int64_t i = row + 1; i < tree.size(); i += i & (~i + 1))
+      tree[i] += delta;
+  }
+
+  /** @brief the lines above row. */
+  u_int64_t line_of(u_int64_t row) const {
+    u_int64_t sum = row;
+    for (u_int64_t i = row; i; i -= i & (~i + 1))
+      sum += tree[i];
+    return sum;
+  }
+
+  /** @brief the row line falls in. */
+  u_int64_t row_at(u_int64_t line) const {
+    u_int64_t row = {};
+    u_int64_t step = 1;
+    while (step * 2 < tree.size())
+      step *= 2;
+    for (; step; step /= 2) {
+      u_int64_t next = row + step;
+      if (next < tree.size() && step + tree[next] <= line) {
+        line -= step + tree[next];
+        row = next;
+      }
+    }
+    return std::min<u_int64_t>(row, rows() ? rows() - 1 : 0);
+  }
+
+private:
+  std::vector<u_int8_t> heights = {};
+  std::vector<u_int32_t> tree = {};
+  u_int64_t extra = {};
+};
+
+/**
+ * @struct list_counters_t
+ * @brief where the pages the list needed came from. A miss is a page
+ * fetched while a key waited.
+ */
+struct list_counters_t {
+  u_int64_t hits = {};
+  u_int64_t misses = {};
+  u_int64_t waits = {};
+  u_int64_t prefetched = {};
+  u_int64_t evicted = {};
+};
+
+/**
+ * @class list_view_t
+ * @brief a list over a row_provider_t of any length that draws only the
+ * rows in view. UP_ARROW and DOWN_ARROW move the selection, PAGE_UP and
+ * PAGE_DOWN a screen, HOME and END to either end. The rows are kept in
+ * pages of page_rows, at most max_pages of them, the least recently used
+ * evicted. After each move the pages either side of the view are fetched
+ * on a thread of the list's own, so the page a key needs next is there.
+ * A move touches the rows in view and the height index, so it costs the
+ * same for a thousand rows as for ten million. The last column is a
+ * scrollbar, placed by line through the height index.
+ */
+class list_view_t : public widget_t {
+public:
+  list_view_t(row_provider_t &_provider, std::size_t _page_rows = 256,
+              std::size_t _max_pages = 16, bool bprefetch = true)
+      : provider(_provider), page_rows(_page_rows), max_pages(_max_pages) {
+    index.reset(provider.size());
+    if (bprefetch)
+      prefetcher = std::thread([this] { prefetch_loop(); });
+  }
+
+  ~list_view_t() {
+    if (!prefetcher.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      bstop = true;
+    }
+    wake.notify_one();
+    prefetcher.join();
+  }
+
+  list_view_t(const list_view_t &) = delete;
+  list_view_t &operator=(const list_view_t &) = delete;
+
+  bool focusable() const override { return true; }
+
+  bool on_key(const key_event_t &e) override {
+    u_int64_t rows = index.rows();
+    if (!rows)
+      return false;
+    u_int64_t was_top = top;
+    u_int64_t was_selected = selected;
+    switch (e.vk) {
+    case vkey_t::UP_ARROW:
+      selected -= selected > 0;
+      break;
+    case vkey_t::DOWN_ARROW:
+      selected += selected + 1 < rows;
+      break;
+    case vkey_t::PAGE_DOWN: {
+      u_int64_t next = std::min(top + std::max<u_int64_t>(shown(), 1),
+                                last_top());
+      selected = std::min(selected + (next - top), rows - 1);
+      top = next;
+      break;
+    }
+    case vkey_t::PAGE_UP: {
+      u_int64_t next = top ? fill_up_to(top - 1) : 0;
+      selected = selected - std::min(selected, top - next);
+      if (!top)
+        selected = 0;
+      top = next;
+      break;
+    }
+    case vkey_t::HOME:
+      top = selected = 0;
+      break;
+    case vkey_t::END:
+      selected = rows - 1;
+      top = last_top();
+      break;
+    default:
+      return false;
+    }
+    keep_selected_in_view();
+    if (top != was_top || selected != was_selected)
+      invalidate();
+    prefetch_around();
+    return true;
+  }
+
+  u_int64_t top_row() const { return top; }
+  u_int64_t selected_row() const { return selected; }
+  const row_height_index_t &heights() const { return index; }
+
+  list_counters_t counters() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counts;
+  }
+
+protected:
+  void draw(screen_grid_t &screen) override {
+    const screen_rect_t &r = rect();
+    screen.fill(r, {});
+    if (r.empty() || !index.rows())
+      return;
+    int width = r.columns - 1;
+    style_t chosen = {};
+    chosen.attrs = style_t::reverse;
+    int line = {};
+    for (u_int64_t row = top; row < index.rows() && line < r.rows; row++) {
+      auto page = fetch_page(row / page_rows);
+      const std::string &text = (*page)[row % page_rows];
+      const style_t &s = row == selected ? chosen : style_t{};
+      std::size_t from = {};
+      for (int h = 0; h < index.height(row) && line < r.rows; h++, line++) {
+        std::size_t end = text.find('\n', from);
+        if (end == std::string::npos)
+          end = text.size();
+        cell_t blank = {};
+        blank.style = s;
+        screen.fill({r.row + line, r.col, 1, width}, blank);
+        put_clipped(screen, r.row + line, r.col, r.col + width,
+                    text.substr(from, end - from), s);
+        from = std::min(end + 1, text.size());
+      }
+    }
+
+    // the scrollbar, a thumb the share of the lines in view.
+    u_int64_t lines = std::max<u_int64_t>(index.lines(), 1);
+    u_int64_t length = std::max<u_int64_t>(
+        std::min<u_int64_t>(r.rows * u_int64_t(r.rows) / lines, r.rows), 1);
+    u_int64_t start = index.line_of(top) * (r.rows - length) /
+                      std::max<u_int64_t>(lines - r.rows, 1);
+    start = std::min<u_int64_t>(start, r.rows - length);
+    cell_t track = {};
+    track.ch = U'│';
+    cell_t thumb = {};
+    thumb.ch = U'█';
+    for (int n = 0; n < r.rows; n++)
+      screen.at(r.row + n, r.col + width) =
+          static_cast<u_int64_t>(n) >= start &&
+                  static_cast<u_int64_t>(n) < start + length
+              ? thumb
+              : track;
+  }
+
+private:
+  struct page_t {
+    std::shared_ptr<const std::vector<std::string>> rows = {};
+    u_int64_t used = {};
+    bool bindexed = {};
+  };
+  using rows_t = std::shared_ptr<const std::vector<std::string>>;
+
+  /** @brief page, from the cache or fetched now, its heights indexed. */
+  rows_t fetch_page(u_int64_t page) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = pages.find(page);
+    if (it == pages.end() && loading.count(page)) {
+      counts.waits++;
+      arrived.wait(lock, [&] {
+        return !loading.count(page) || pages.count(page);
+      });
+      it = pages.find(page);
+    }
+    if (it == pages.end()) {
+      counts.misses++;
+      lock.unlock();
+      rows_t rows = load(page);
+      lock.lock();
+      it = insert(page, rows);
+    } else {
+      counts.hits++;
+    }
+    it->second.used = ++clock;
+    rows_t rows = it->second.rows;
+    if (!it->second.bindexed) {
+      it->second.bindexed = true;
+      for (std::size_t i = 0; i < rows->size(); i++)
+        index.set(page * page_rows + i,
+                  1 + static_cast<int>(std::count((*rows)[i].begin(),
+                                                  (*rows)[i].end(), '\n')));
+    }
+    return rows;
+  }
+
+  int height(u_int64_t row) {
+    fetch_page(row / page_rows);
+    return index.height(row);
+  }
+
+  rows_t load(u_int64_t page) {
+    auto rows = std::make_shared<std::vector<std::string>>();
+    u_int64_t first = page * page_rows;
+    std::size_t count =
+        std::min<u_int64_t>(page_rows, provider.size() - first);
+    provider.fetch(first, count, *rows);
+    rows->resize(count);
+    return rows;
+  }
+
+  std::unordered_map<u_int64_t, page_t>::iterator insert(u_int64_t page,
+                                                         rows_t rows) {
+    auto it = pages.emplace(page, page_t{}).first;
+    if (!it->second.rows)
+      it->second.rows = rows;
+    it->second.used = ++clock;
+    while (pages.size() > max_pages) {
+      auto oldest = pages.end();
+      for (auto p = pages.begin(); p != pages.end(); ++p)
+        if (p->first != page &&
+            (oldest == pages.end() || p->second.used < oldest->second.used))
+          oldest = p;
+      pages.erase(oldest);
+      counts.evicted++;
+    }
+    return pages.find(page);
+  }
+
+  /** @brief the rows from top that fit in view whole, at least one. */
+  u_int64_t shown() {
+    int lines = {};
+    u_int64_t count = {};
+    for (u_int64_t row = top; row < index.rows(); row++, count++) {
+      lines += height(row);
+      if (lines > rect().rows)
+        break;
+    }
+    return std::max<u_int64_t>(count, 1);
+  }
+
+  /** @brief the top that shows last at the bottom with the view full. */
+  u_int64_t fill_up_to(u_int64_t last) {
+    int lines = height(last);
+    u_int64_t first = last;
+    while (first > 0 && lines + height(first - 1) <= rect().rows)
+      lines += height(--first);
+    return first;
+  }
+
+  /** @brief fill_up_to the last row, kept for the height of the view. */
+  u_int64_t last_top() {
+    if (last_top_lines != rect().rows) {
+      last_top_row = fill_up_to(index.rows() - 1);
+      last_top_lines = rect().rows;
+    }
+    return last_top_row;
+  }
+
+  void keep_selected_in_view() {
+    if (selected < top) {
+      top = selected;
+      return;
+    }
+    if (selected - top < shown())
+      return;
+    top = std::max(fill_up_to(selected), top);
+  }
+
+  /** @brief asks for the pages either side of the view. */
+  void prefetch_around() {
+    if (!prefetcher.joinable())
+      return;
+    u_int64_t first = top / page_rows;
+    u_int64_t last = (top + shown()) / page_rows;
+    u_int64_t count = (index.rows() + page_rows - 1) / page_rows;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      wanted.clear();
+      for (u_int64_t p : {last + 1, first - 1, last, first})
+        if (p < count && !pages.count(p) && !loading.count(p))
+          wanted.push_back(p);
+    }
+    wake.notify_one();
+  }
+
+  void prefetch_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      wake.wait(lock, [&] { return bstop || !wanted.empty(); });
+      if (bstop)
+        return;
+      u_int64_t page = wanted.front();
+      wanted.pop_front();
+      if (pages.count(page) || loading.count(page))
+        continue;
+      loading.insert(page);
+      lock.unlock();
+      rows_t rows = load(page);
+      lock.lock();
+      loading.erase(page);
+      insert(page, rows);
+      counts.prefetched++;
+      arrived.notify_all();
+    }
+  }
+
+  row_provider_t &provider;
+  std::size_t page_rows = 256;
+  std::size_t max_pages = 16;
+  row_height_index_t index = {};
+  u_int64_t top = {};
+  u_int64_t selected = {};
+  u_int64_t last_top_row = {};
+  int last_top_lines = -1;
+
+  std::mutex mutex = {};
+  std::condition_variable wake = {};
+  std::condition_variable arrived = {};
+  std::unordered_map<u_int64_t, page_t> pages = {};
+  std::unordered_set<u_int64_t> loading = {};
+  std::deque<u_int64_t> wanted = {};
+  u_int64_t clock = {};
+  list_counters_t counts = {};
+  bool bstop = {};
+  std::thread prefetcher = {};
+};
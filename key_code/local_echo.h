@@ -0,0 +1,307 @@
+#pragma once
+
+#include "key_decoder.h"
+#include "latency_histogram.h"
+#include "screen.h"
+
+#include <algorithm>
+#include <deque>
+#include <sys/types.h>
+
+/**
+ * @class local_echo_t
+ * @brief speculative local echo for sessions with a long round trip. Keys
+ * whose effect on a line editor is certain enough, printable characters,
+ * BACKSPACE at the end of the text and LEFT_ARROW / RIGHT_ARROW, are
+ * predicted the moment they are typed. overlay() draws the predictions over
+ * the last screen the remote side sent.
+ *
+ * Every screen comes with the number of keys the remote side had acted on
+ * when it was taken, for a proxy the keys written to the pty at least an
+ * echo delay before. server_update() checks the predictions of those keys
+ * against it, the cells they changed and the cursor. When the screen shows
+ * them they are confirmed. When it does not, or no screen acknowledges them
+ * within two round trips, every prediction is dropped, so the next overlay
+ * is the server screen again.
+ *
+ * After a misprediction, the following predictions are tentative. They are
+ * still made and checked but not drawn until one of them is confirmed, so
+ * a prompt that does not echo (a password) shows nothing. Other keys, ENTER,
+ * function keys and control characters, stop prediction until the screen
+ * that acknowledges them arrives.
+ *
+ * Predictions are drawn only when the smoothed round trip is at least
+ * display_threshold_ns, below that the real echo is quick enough.
+ * Times are passed in by the caller, in nanoseconds of a monotonic clock.
+ */
+class local_echo_t {
+public:
+  u_int64_t display_threshold_ns = 30'000'000;
+  u_int64_t min_timeout_ns = 50'000'000;
+  u_int64_t initial_timeout_ns = 1'000'000'000;
+  bool bunderline_unconfirmed = true;
+
+  /**
+   * @fn key
+   * @brief notes a keystroke sent to the remote side at now.
+   */
+  void key(const key_event_t &e, u_int64_t now) {
+    u_int64_t seq = sent++;
+    if (bbarrier || server.rows() == 0) {
+      hold(seq, now);
+      return;
+    }
+
+    int row = pending.empty() ? server_row : pending.back().cursor_row;
+    int col = pending.empty() ? server_col : pending.back().cursor_col;
+    unsigned char ch = static_cast<unsigned char>(e.c);
+    prediction_t p = {};
+    p.seq = seq;
+    p.time = now;
+    p.row = p.cursor_row = p.from_row = row;
+    p.col = p.from_col = col;
+    p.btentative = btentative;
+
+    if (e.vk == vkey_t::none && ch >= 0x20 && ch < 0x7f &&
+        col + 1 < server.columns()) {
+      p.bcell = true;
+      p.original = predicted_at(row, col);
+      p.predicted = ch;
+      p.cursor_col = col + 1;
+    } else if (e.vk == vkey_t::BACKSPACE && col > 0 &&
+               blank_from(row, col)) {
+      p.bcell = true;
+      p.col = col - 1;
+      p.original = predicted_at(row, col - 1);
+      p.predicted = U' ';
+      p.cursor_col = col - 1;
+    } else if (e.vk == vkey_t::LEFT_ARROW && col > 0) {
+      p.cursor_col = col - 1;
+    } else if (e.vk == vkey_t::RIGHT_ARROW && !blank_from(row, col)) {
+      p.cursor_col = col + 1;
+    } else {
+      hold(seq, now);
+      return;
+    }
+    pending.push_back(p);
+    total_predictions++;
+  }
+
+  /**
+   * @fn server_update
+   * @brief the remote side's screen and cursor arrived at now, taken after
+   * it acted on the first acked keys.
+   */
+  void server_update(const screen_grid_t &screen, int cursor_row,
+                     int cursor_col, u_int64_t acked, u_int64_t now) {
+    server = screen;
+    server_row = cursor_row;
+    server_col = cursor_col;
+
+    std::size_t k = {};
+    while (k < pending.size() && pending[k].seq < acked)
+      k++;
+    if (!pending.empty() && !shows(k)) {
+      roll_back();
+    } else {
+      for (std::size_t i = 0; i < k; i++) {
+        auto &p = pending[i];
+        u_int64_t rtt = now - p.time;
+        round_trip_ns.record(rtt);
+        if (!p.bshown)
+          perceived_ns.record(rtt);
+        srtt_ns = srtt_ns ? (srtt_ns * 7 + rtt) / 8 : rtt;
+        total_confirmed++;
+      }
+      pending.erase(pending.begin(), pending.begin() + k);
+      if (k) {
+        btentative = false;
+        for (auto &p : pending)
+          p.btentative = false;
+      }
+      expire(now);
+    }
+
+    while (!unpredicted.empty() && unpredicted.front().seq < acked) {
+      perceived_ns.record(now - unpredicted.front().time);
+      unpredicted.pop_front();
+    }
+
+    if (bbarrier && acked > barrier_seq)
+      bbarrier = false;
+  }
+
+  /**
+   * @fn overlay
+   * @brief the screen to draw at now, the server screen with the
+   * predictions applied, and where the cursor goes.
+   */
+  void overlay(screen_grid_t &screen, int &cursor_row, int &cursor_col,
+               u_int64_t now) {
+    expire(now);
+    screen = server;
+    cursor_row = server_row;
+    cursor_col = server_col;
+    if (srtt_ns < display_threshold_ns)
+      return;
+
+    for (auto &p : pending) {
+      if (p.btentative)
+        break;
+      if (p.bcell) {
+        cell_t &cell = screen.at(p.row, p.col);
+        cell.ch = p.predicted;
+        if (bunderline_unconfirmed)
+          cell.style.attrs |= style_t::underline;
+      }
+      if (!p.bshown) {
+        p.bshown = true;
+        perceived_ns.record(now - p.time);
+      }
+      cursor_row = p.cursor_row;
+      cursor_col = p.cursor_col;
+    }
+  }
+
+  std::size_t outstanding() const { return pending.size(); }
+  u_int64_t smoothed_rtt() const { return srtt_ns; }
+  u_int64_t predictions() const { return total_predictions; }
+  u_int64_t confirmed() const { return total_confirmed; }
+  u_int64_t mispredicted() const { return total_mispredicted; }
+  u_int64_t rollbacks() const { return total_rollbacks; }
+
+  /** @brief from a key to when it is first seen, predicted or echoed. */
+  const latency_histogram_t &perceived() const { return perceived_ns; }
+  /** @brief from a predicted key to the server confirming it. */
+  const latency_histogram_t &round_trip() const { return round_trip_ns; }
+
+private:
+  struct prediction_t {
+    u_int64_t seq = {};
+    u_int64_t time = {};
+    int from_row = {};
+    int from_col = {};
+    int row = {};
+    int col = {};
+    int cursor_row = {};
+    int cursor_col = {};
+    char32_t original = {};
+    char32_t predicted = {};
+    bool bcell = {};
+    bool bshown = {};
+    bool btentative = {};
+  };
+
+  struct held_key_t {
+    u_int64_t seq = {};
+    u_int64_t time = {};
+  };
+
+  /**
+   * @brief a key that is not predicted, nothing is until it is acked.
+   */
+  void hold(u_int64_t seq, u_int64_t now) {
+    unpredicted.push_back({seq, now});
+    bbarrier = true;
+    barrier_seq = seq;
+  }
+
+  /**
+   * @brief the server screen is what the first k predictions leave, the
+   * cursor and every predicted cell.
+   */
+  bool shows(std::size_t k) const {
+    const prediction_t &last = k ? pending[k - 1] : pending.front();
+    int row = k ? last.cursor_row : last.from_row;
+    int col = k ? last.cursor_col : last.from_col;
+    if (server_row != row || server_col != col)
+      return false;
+
+    for (auto &p : pending) {
+      if (!p.bcell)
+        continue;
+      char32_t want = {};
+      bool bfirst = true;
+      for (std::size_t j = 0; j < pending.size(); j++) {
+        const prediction_t &q = pending[j];
+        if (!q.bcell || q.row != p.row || q.col != p.col)
+          continue;
+        if (bfirst)
+          want = q.original;
+        if (j < k)
+          want = q.predicted;
+        bfirst = false;
+      }
+      if (server.at(p.row, p.col).ch != want)
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief drops every prediction. Their keys reached the server, what they
+   * did shows once a screen acknowledges them, which is when the ones never
+   * drawn are perceived.
+   */
+  void roll_back() {
+    for (auto &p : pending)
+      if (!p.bshown)
+        unpredicted.push_back({p.seq, p.time});
+    std::sort(unpredicted.begin(), unpredicted.end(),
+              [](const held_key_t &a, const held_key_t &b) {
+                return a.seq < b.seq;
+              });
+    total_mispredicted += pending.size();
+    total_rollbacks++;
+    bbarrier = true;
+    barrier_seq = std::max(barrier_seq, pending.back().seq);
+    pending.clear();
+    btentative = true;
+  }
+
+  void expire(u_int64_t now) {
+    u_int64_t timeout = srtt_ns ? std::max(2 * srtt_ns, min_timeout_ns)
+                                : initial_timeout_ns;
+    if (!pending.empty() && now - pending.front().time > timeout)
+      roll_back();
+  }
+
+  /**
+   * @brief the character at row, col once every prediction is applied.
+   */
+  char32_t predicted_at(int row, int col) const {
+    char32_t ch = server.at(row, col).ch;
+    for (auto &p : pending)
+      if (p.bcell && p.row == row && p.col == col)
+        ch = p.predicted;
+    return ch;
+  }
+
+  /**
+   * @brief the row is blank from col to the end, with the predicted cells.
+   */
+  bool blank_from(int row, int col) const {
+    for (int c = col; c < server.columns(); c++)
+      if (predicted_at(row, c) != U' ')
+        return false;
+    return true;
+  }
+
+  screen_grid_t server = {};
+  int server_row = {};
+  int server_col = {};
+  std::deque<prediction_t> pending = {};
+  std::deque<held_key_t> unpredicted = {};
+  u_int64_t sent = {};
+  bool btentative = {};
+  bool bbarrier = {};
+  u_int64_t barrier_seq = {};
+  u_int64_t srtt_ns = {};
+
+  u_int64_t total_predictions = {};
+  u_int64_t total_confirmed = {};
+  u_int64_t total_mispredicted = {};
+  u_int64_t total_rollbacks = {};
+  latency_histogram_t perceived_ns = {};
+  latency_histogram_t round_trip_ns = {};
+};
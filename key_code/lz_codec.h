@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * @brief a byte oriented LZ77 codec in the manner of LZ4, for blocks of
+ * scrollback. Each sequence is a token byte, the literal count in the high
+ * nibble and the match length less 4 in the low one, 15 meaning more
+ * follows in bytes of up to 255, then the literals, then a two byte offset
+ * back into the output. The last sequence has literals only. Matches are
+ * found through a hash of the next four bytes, one candidate each, which
+ * trades ratio for speed as terminal text repeats a lot anyway.
+ */
+constexpr std::size_t lz_min_match = 4;
+constexpr std::size_t lz_max_offset = 65535;
+
+inline u_int32_t lz_load32(const u_int8_t *p) {
+  u_int32_t v = {};
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline void lz_put_length(std::vector<u_int8_t> &out, std::size_t n) {
+  for (; n >= 255; n -= 255)
+    out.push_back(255);
+  out.push_back(static_cast<u_int8_t>(n));
+}
+
+/**
+ * @fn lz_compress
+ * @brief appends the compressed form of in to out.
+ */
+inline void lz_compress(const u_int8_t *in, std::size_t size,
+                        std::vector<u_int8_t> &out) {
+  const int hash_bits = 12;
+  u_int32_t table[1 << hash_bits] = {};
+  std::size_t anchor = {};
+  std::size_t i = {};
+
+  auto sequence = [&](std::size_t literals, std::size_t offset,
+                      std::size_t match) {
+    std::size_t extra = match ? match - lz_min_match : 0;
+    out.push_back(static_cast<u_int8_t>(
+        (literals < 15 ? literals : 15) << 4 | (extra < 15 ? extra : 15)));
+    if (literals >= 15)
+      lz_put_length(out, literals - 15);
+    out.insert(out.end(), in + anchor, in + anchor + literals);
+    if (!match)
+      return;
+    out.push_back(static_cast<u_int8_t>(offset));
+    out.push_back(static_cast<u_int8_t>(offset >> 8));
+    if (extra >= 15)
+      lz_put_length(out, extra - 15);
+  };
+
+  while (i + lz_min_match <= size) {
+    u_int32_t seq = lz_load32(in + i);
+    u_int32_t h = (seq * 2654435761u) >> (32 - hash_bits);
+    std::size_t candidate = table[h];
+    table[h] = static_cast<u_int32_t>(i + 1);
+    if (!candidate || i - (candidate - 1) > lz_max_offset ||
+        lz_load32(in + candidate - 1) != seq) {
+      i++;
+      continue;
+    }
+    std::size_t from = candidate - 1;
+    std::size_t match = lz_min_match;
+    while (i + match < size && in[from + match] == in[i + match])
+      match++;
+    sequence(i - anchor, i - from, match);
+    i += match;
+    anchor = i;
+  }
+  if (anchor < size)
+    sequence(size - anchor, 0, 0);
+}
+
+/**
+ * @fn lz_decompress
+ * @brief decodes in into out, which is resized to size, the length the
+ * data had. Returns false when in is not what lz_compress made of that
+ * many bytes.
+ */
+inline bool lz_decompress(const u_int8_t *in, std::size_t len,
+                          std::size_t size, std::string &out) {
+  out.resize(size);
+  char *op = &out[0];
+  std::size_t o = {};
+  std::size_t i = {};
+
+  auto get_length = [&](std::size_t n) {
+    if (n != 15)
+      return n;
+    u_int8_t b = 255;
+    while (b == 255 && i < len) {
+      b = in[i++];
+      n += b;
+    }
+    return n;
+  };
+
+  while (i < len) {
+    u_int8_t token = in[i++];
+    std::size_t literals = get_length(token >> 4);
+    if (literals > len - i || literals > size - o)
+      return false;
+    memcpy(op + o, in + i, literals);
+    i += literals;
+    o += literals;
+    if (i == len)
+      break;
+    if (len - i < 2)
+      return false;
+    std::size_t offset = in[i] | in[i + 1] << 8;
+    i += 2;
+    std::size_t match = get_length(token & 15) + lz_min_match;
+    if (!offset || offset > o || match > size - o)
+      return false;
+    const char *from = op + o - offset;
+    if (offset >= match) {
+      memcpy(op + o, from, match);
+    } else {
+      // the match overlaps what it writes, a repeated pattern.
+      for (std::size_t n = 0; n < match; n++)
+        op[o + n] = from[n];
+    }
+    o += match;
+  }
+  return o == size;
+}
@@ -0,0 +1,108 @@
+/*
+ * Charges every allocation made through operator new to the account and
+ * subsystem of the memory_scope_t active on the thread, see
+ * memory_accounts_t. key_code.cpp includes it, so every build has it and
+ * --bench memory measures the footprint without a build of its own. Do
+ * not also link it separately, that defines operator new twice.
+ */
+#include "memory_accounting.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <sys/types.h>
+
+namespace memory_accounting {
+namespace {
+
+const bool benabled = memory_accounts().enable();
+
+/**
+ * @struct header_t
+ * @brief placed before every block operator new returns. offset is from the
+ * start of the malloc block to the memory handed out.
+ */
+struct header_t {
+  u_int32_t tag = {};
+  u_int32_t offset = {};
+  u_int64_t size = {};
+};
+
+void *allocate(std::size_t size, std::size_t align) {
+  std::size_t offset = align > sizeof(header_t) ? align : sizeof(header_t);
+  void *raw = nullptr;
+  if (align > alignof(std::max_align_t)) {
+    if (posix_memalign(&raw, align, size + offset) != 0)
+      return nullptr;
+  } else if (!(raw = malloc(size + offset))) {
+    return nullptr;
+  }
+  char *p = static_cast<char *>(raw) + offset;
+  header_t *h = reinterpret_cast<header_t *>(p) - 1;
+  h->tag = memory_current_tag;
+  h->offset = static_cast<u_int32_t>(offset);
+  h->size = size;
+  memory_accounts().charge(h->tag, size);
+  return p;
+}
+
+void deallocate(void *p) {
+  if (!p)
+    return;
+  header_t *h = static_cast<header_t *>(p) - 1;
+  memory_accounts().discharge(h->tag, h->size);
+  free(static_cast<char *>(p) - h->offset);
+}
+
+void *allocate_or_throw(std::size_t size, std::size_t align) {
+  void *p = allocate(size, align);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+} // namespace
+} // namespace memory_accounting
+
+void *operator new(std::size_t size) {
+  return memory_accounting::allocate_or_throw(
+      size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void *operator new[](std::size_t size) {
+  return memory_accounting::allocate_or_throw(
+      size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return memory_accounting::allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return memory_accounting::allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void *operator new(std::size_t size, std::align_val_t align) {
+  return memory_accounting::allocate_or_throw(
+      size, static_cast<std::size_t>(align));
+}
+void *operator new[](std::size_t size, std::align_val_t align) {
+  return memory_accounting::allocate_or_throw(
+      size, static_cast<std::size_t>(align));
+}
+void operator delete(void *p) noexcept { memory_accounting::deallocate(p); }
+void operator delete[](void *p) noexcept { memory_accounting::deallocate(p); }
+void operator delete(void *p, std::size_t) noexcept {
+  memory_accounting::deallocate(p);
+}
+void operator delete[](void *p, std::size_t) noexcept {
+  memory_accounting::deallocate(p);
+}
+void operator delete(void *p, std::align_val_t) noexcept {
+  memory_accounting::deallocate(p);
+}
+void operator delete[](void *p, std::align_val_t) noexcept {
+  memory_accounting::deallocate(p);
+}
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  memory_accounting::deallocate(p);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+  memory_accounting::deallocate(p);
+}
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <sys/types.h>
+
+/**
+ * @enum memory_subsystem_t
+ * @brief what an allocation is for. Allocations made outside of any
+ * memory_scope_t are other.
+ */
+enum class memory_subsystem_t : u_int8_t {
+  other,
+  session,
+  decoder,
+  keymap,
+  input,
+  clipboard,
+  screen,
+  scrollback,
+  renderer,
+  output,
+  count
+};
+
+inline const char *memory_subsystem_name(memory_subsystem_t subsystem) {
+  static const char *names[] = {"other",    "session",    "decoder",
+                                "keymap",   "input",      "clipboard",
+                                "screen",   "scrollback", "renderer",
+                                "output"};
+  return names[static_cast<std::size_t>(subsystem)];
+}
+
+/**
+ * @struct memory_usage_t
+ * @brief bytes held now, the most ever held at once and the number of
+ * allocations made.
+ */
+struct memory_usage_t {
+  u_int64_t live = {};
+  u_int64_t peak = {};
+  u_int64_t allocations = {};
+};
+
+/**
+ * @struct memory_footprint_t
+ * @brief the usage of one account, per subsystem and in total. The total
+ * peak is the most held at once over all subsystems, not the sum of their
+ * peaks.
+ */
+struct memory_footprint_t {
+  static constexpr std::size_t subsystems =
+      static_cast<std::size_t>(memory_subsystem_t::count);
+
+  u_int32_t account = {};
+  memory_usage_t total = {};
+  memory_usage_t usage[subsystems] = {};
+
+  const memory_usage_t &operator[](memory_subsystem_t subsystem) const {
+    return usage[static_cast<std::size_t>(subsystem)];
+  }
+};
+
+/**
+ * @class memory_accounts_t
+ * @brief the heap usage of every session, by subsystem. An account is a
+ * slot of counters handed to a session while it lives. Account 0 is the
+ * process, which holds what no session owns, the shared keymap among it.
+ *
+ * The replacement operator new of memory_accounting.cpp puts a small
+ * header before every allocation naming the account and subsystem it was
+ * charged to, taken from the memory_scope_t active on the thread, so it
+ * is given back to the same counters wherever it is freed. Counters are
+ * atomics, an allocation takes no lock. Bytes are those asked for, without
+ * the header or malloc's own overhead. Without memory_accounting.cpp in
+ * the program nothing is charged but what is charged by hand, and
+ * benabled() is false.
+ *
+ * Accounts come in chunks of chunk_accounts, the first one static so
+ * allocations made before main are charged, the others allocated as
+ * sessions need them and kept for the life of the process.
+ */
+class memory_accounts_t {
+public:
+  static constexpr u_int32_t chunk_accounts = 1024;
+  static constexpr u_int32_t max_chunks = 4096;
+  static constexpr u_int32_t subsystems =
+      static_cast<u_int32_t>(memory_subsystem_t::count);
+
+  /** @brief called once by memory_accounting.cpp, which does the charging. */
+  bool enable() { return benabled_ = true; }
+
+  bool benabled() const { return benabled_; }
+
+  /**
+   * @fn acquire
+   * @brief a free account with its counters cleared. Throws
+   * std::length_error when max_chunks are taken, rather than charging the
+   * session to another account.
+   */
+  u_int32_t acquire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (u_int32_t c = 0; c < max_chunks; c++) {
+      chunk_t *chunk = chunks[c].load(std::memory_order_relaxed);
+      if (!chunk) {
+        // placement new, the chunk is not itself charged anywhere.
+        void *raw = malloc(sizeof(chunk_t));
+        if (!raw)
+          throw std::bad_alloc();
+        chunk = new (raw) chunk_t();
+        chunks[c].store(chunk, std::memory_order_release);
+      }
+      for (u_int32_t i = c ? 0 : 1; i < chunk_accounts; i++) {
+        if (chunk->bused[i])
+          continue;
+        chunk->bused[i] = true;
+        for (auto &counter : chunk->counters[i])
+          counter.clear();
+        return c * chunk_accounts + i;
+      }
+    }
+    throw std::length_error("memory accounts exhausted");
+  }
+
+  void release(u_int32_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (id)
+      chunks[id / chunk_accounts].load(std::memory_order_relaxed)
+          ->bused[id % chunk_accounts] = false;
+  }
+
+  static u_int32_t tag(u_int32_t account, memory_subsystem_t subsystem) {
+    return account * (subsystems + 1) + static_cast<u_int32_t>(subsystem);
+  }
+
+  void charge(u_int32_t tag, std::size_t bytes) {
+    counter_t *c = counters(tag / (subsystems + 1));
+    c[tag % (subsystems + 1)].add(bytes);
+    c[subsystems].add(bytes);
+  }
+
+  void discharge(u_int32_t tag, std::size_t bytes) {
+    counter_t *c = counters(tag / (subsystems + 1));
+    c[tag % (subsystems + 1)].sub(bytes);
+    c[subsystems].sub(bytes);
+  }
+
+  /**
+   * @fn footprint
+   * @brief a snapshot of the account's counters. Counters of a busy account
+   * are read one at a time, so they may be a few allocations apart.
+   */
+  memory_footprint_t footprint(u_int32_t account) const {
+    memory_footprint_t f = {};
+    f.account = account;
+    const counter_t *c = counters(account);
+    for (u_int32_t s = 0; s < subsystems; s++)
+      f.usage[s] = c[s].usage();
+    f.total = c[subsystems].usage();
+    return f;
+  }
+
+private:
+  struct counter_t {
+    std::atomic<u_int64_t> live = {};
+    std::atomic<u_int64_t> peak = {};
+    std::atomic<u_int64_t> allocations = {};
+
+    void add(std::size_t bytes) {
+      auto relaxed = std::memory_order_relaxed;
+      u_int64_t now = live.fetch_add(bytes, relaxed) + bytes;
+      u_int64_t high = peak.load(relaxed);
+      while (now > high && !peak.compare_exchange_weak(high, now, relaxed))
+        ;
+      allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void sub(std::size_t bytes) {
+      live.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    void clear() {
+      live.store(0, std::memory_order_relaxed);
+      peak.store(0, std::memory_order_relaxed);
+      allocations.store(0, std::memory_order_relaxed);
+    }
+
+    memory_usage_t usage() const {
+      return {live.load(std::memory_order_relaxed),
+              peak.load(std::memory_order_relaxed),
+              allocations.load(std::memory_order_relaxed)};
+    }
+  };
+
+  struct chunk_t {
+    bool bused[chunk_accounts] = {};
+    // one counter per subsystem and the account total last.
+    counter_t counters[chunk_accounts][subsystems + 1] = {};
+  };
+
+  /** @brief the account's counters, its chunk was made by acquire. */
+  counter_t *counters(u_int32_t account) const {
+    chunk_t *chunk =
+        chunks[account / chunk_accounts].load(std::memory_order_acquire);
+    return chunk->counters[account % chunk_accounts];
+  }
+
+  std::mutex mutex = {};
+  bool benabled_ = {};
+  chunk_t first = {};
+  std::atomic<chunk_t *> chunks[max_chunks] = {&first};
+};
+
+/**
+ * @fn memory_accounts
+ * @brief the accounts of the process. Constant initialized, so allocations
+ * made before main are charged as well.
+ */
+inline memory_accounts_t &memory_accounts() {
+  static memory_accounts_t accounts;
+  return accounts;
+}
+
+/** @brief the tag operator new charges on this thread. */
+inline thread_local u_int32_t memory_current_tag = {};
+
+/**
+ * @class memory_scope_t
+ * @brief charges the allocations this thread makes while it lives to the
+ * account and subsystem given. Scopes nest, the previous one is restored.
+ */
+class memory_scope_t {
+public:
+  memory_scope_t(u_int32_t account, memory_subsystem_t subsystem)
+      : previous(memory_current_tag) {
+    memory_current_tag = memory_accounts_t::tag(account, subsystem);
+  }
+  ~memory_scope_t() { memory_current_tag = previous; }
+
+  memory_scope_t(const memory_scope_t &) = delete;
+  memory_scope_t &operator=(const memory_scope_t &) = delete;
+
+private:
+  u_int32_t previous = {};
+};
+
+/**
+ * @fn print_memory_footprint
+ * @brief the dump format, one line for the total and one per subsystem that
+ * was used,
+ *   memory <name> <subsystem> live <bytes> peak <bytes> allocations <n>
+ */
+inline void print_memory_footprint(FILE *file, const char *name,
+                                   const memory_footprint_t &f) {
+  auto line = [&](const char *subsystem, const memory_usage_t &u) {
+    fprintf(file, "memory %s %-10s live %10lu peak %10lu allocations %lu\n",
+            name, subsystem, static_cast<unsigned long>(u.live),
+            static_cast<unsigned long>(u.peak),
+            static_cast<unsigned long>(u.allocations));
+  };
+  line("total", f.total);
+  for (std::size_t s = 0; s < memory_footprint_t::subsystems; s++)
+    if (f.usage[s].allocations)
+      line(memory_subsystem_name(static_cast<memory_subsystem_t>(s)),
+           f.usage[s]);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ordered_executor_t
+ * @brief threads that run tasks posted to ordering domains, for work that
+ * must not hold up the thread posting it. The tasks of one domain run one
+ * at a time, in the order they were posted, so each completes before the
+ * next starts. Different domains run in parallel, as many at once as there
+ * are threads. A domain with tasks waits in a ready queue, a thread takes
+ * it, runs its oldest task and puts it back at the end of the queue while
+ * it has more, so a busy domain does not starve the others. Unlike
+ * thread_pool_t, which runs one job at a time and waits for it, post()
+ * returns at once. Tasks must not throw.
+ */
+class ordered_executor_t {
+public:
+  explicit ordered_executor_t(std::size_t threads) {
+    for (std::size_t i = 0; i < std::max<std::size_t>(threads, 1); i++)
+      workers.emplace_back([this] { work_loop(); });
+  }
+
+  /** @brief runs what was posted, then stops the threads. */
+  ~ordered_executor_t() {
+    drain();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      bstop = true;
+    }
+    work.notify_all();
+    for (auto &w : workers)
+      w.join();
+  }
+
+  ordered_executor_t(const ordered_executor_t &) = delete;
+  ordered_executor_t &operator=(const ordered_executor_t &) = delete;
+
+  std::size_t size() const { return workers.size(); }
+
+  /**
+   * @fn domain
+   * @brief a new ordering domain, for post.
+   */
+  u_int32_t domain() {
+    std::lock_guard<std::mutex> lock(mutex);
+    domains.push_back(std::make_unique<domain_t>());
+    return static_cast<u_int32_t>(domains.size() - 1);
+  }
+
+  /**
+   * @fn post
+   * @brief runs task on a thread after the tasks posted to domain before.
+   */
+  void post(u_int32_t domain, std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      domain_t &d = *domains[domain];
+      d.tasks.push_back(std::move(task));
+      pending++;
+      if (d.brunning || d.bready)
+        return;
+      d.bready = true;
+      ready.push_back(&d);
+    }
+    work.notify_one();
+  }
+
+  /**
+   * @fn drain
+   * @brief returns once every task posted before it ran.
+   */
+  void drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [&] { return pending == 0; });
+  }
+
+private:
+  struct domain_t {
+    std::deque<std::function<void()>> tasks = {};
+    bool bready = {};
+    bool brunning = {};
+  };
+
+  void work_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      work.wait(lock, [&] { return bstop || !ready.empty(); });
+      if (ready.empty())
+        return;
+      domain_t &d = *ready.front();
+      ready.pop_front();
+      d.bready = false;
+      d.brunning = true;
+      std::function<void()> task = std::move(d.tasks.front());
+      d.tasks.pop_front();
+      lock.unlock();
+      task();
+      task = nullptr;
+      lock.lock();
+      d.brunning = false;
+      if (!d.tasks.empty()) {
+        d.bready = true;
+        ready.push_back(&d);
+        work.notify_one();
+      }
+      if (--pending == 0)
+        idle.notify_all();
+    }
+  }
+
+  std::vector<std::thread> workers = {};
+  std::mutex mutex = {};
+  std::condition_variable work = {};
+  std::condition_variable idle = {};
+  std::vector<std::unique_ptr<domain_t>> domains = {};
+  std::deque<domain_t *> ready = {};
+  std::size_t pending = {};
+  bool bstop = {};
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "base64.h"
+#include "key_decoder.h"
+
+#include <functional>
+#include <stdexcept>
+
+/**
+ * @class osc52_reader_t
+ * @brief receives clipboard contents sent back by the terminal in reply to
+ * an OSC 52 query, ESC ] 52 ; selection ; base64 BEL. The payload is decoded
+ * as it streams out of the key decoder straight into the buffer given by the
+ * caller. Every time that buffer fills, and once more at the end of the
+ * string, the drain function is called with the bytes so far. Payloads of
+ * any size therefore pass through a fixed amount of memory.
+ */
+class osc52_reader_t : public osc_listener_t {
+public:
+  /**
+   * @brief drain(data, len, final) - final is set on the last call for a
+   * payload.
+   */
+  using drain_t = std::function<void(const u_int8_t *, std::size_t, bool)>;
+
+  osc52_reader_t(u_int8_t *_buffer, std::size_t _capacity, drain_t _drain)
+      : buffer(_buffer), capacity(_capacity), drain(_drain) {
+    if (capacity < 3)
+      throw std::runtime_error("osc52_reader_t buffer must hold a quad");
+  }
+
+  /**
+   * @fn selection
+   * @brief the selection parameter of the last payload, "c" for the
+   * clipboard, "p" for primary and so on.
+   */
+  const char *selection() const { return selection_name; }
+
+  /**
+   * @fn total
+   * @brief decoded bytes of the current or last payload.
+   */
+  std::size_t total() const { return total_bytes; }
+
+  /**
+   * @fn error
+   * @brief the payload contained characters outside of base64.
+   */
+  bool error() const { return decoder.error(); }
+
+  void osc_begin(unsigned code) override {
+    active = code == 52;
+    in_selection = true;
+    selection_size = {};
+    selection_name[0] = {};
+    used = {};
+    total_bytes = {};
+    decoder.reset();
+  }
+
+  void osc_data(const char *data, std::size_t len) override {
+    if (!active)
+      return;
+
+    if (in_selection) {
+      std::size_t i = {};
+      for (; i < len && data[i] != ';'; i++)
+        if (selection_size < sizeof(selection_name) - 1)
+          selection_name[selection_size++] = data[i];
+      selection_name[selection_size] = {};
+      if (i == len)
+        return;
+      in_selection = false;
+      data += i + 1;
+      len -= i + 1;
+    }
+
+    while (len) {
+      auto r = decoder.decode(data, len, buffer + used, capacity - used);
+      used += r.produced;
+      total_bytes += r.produced;
+      data += r.consumed;
+      len -= r.consumed;
+      if (len) {
+        drain(buffer, used, false);
+        used = {};
+      }
+    }
+  }
+
+  void osc_end(bool /* complete */) override {
+    if (!active)
+      return;
+    drain(buffer, used, true);
+    used = {};
+    active = false;
+  }
+
+private:
+  u_int8_t *buffer = {};
+  std::size_t capacity = {};
+  drain_t drain = {};
+
+  base64_stream_t decoder = {};
+  bool active = {};
+  bool in_selection = {};
+  char selection_name[16] = {};
+  std::size_t selection_size = {};
+  std::size_t used = {};
+  std::size_t total_bytes = {};
+};
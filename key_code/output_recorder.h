@@ -0,0 +1,568 @@
+#pragma once
+
+#include "common.h"
+#include "output_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @enum recording_format_t
+ * @brief how a recording is written. asciicast is asciicast v2, a JSON
+ * header line and an [time, "o", text] line per batch, which players and
+ * asciinema read. binary is a small header and per batch the microseconds
+ * since the last one and the length as varints and the bytes as they
+ * were, with nothing to escape.
+ */
+enum class recording_format_t { asciicast, binary };
+
+/**
+ * @struct recording_policy_t
+ * @brief ring_bytes is the room between the output path and the recorder
+ * thread, rounded up to a power of two. While output flows the thread
+ * takes what the ring holds every interval_ns, or at once when it is half
+ * full. Idle, it sleeps until output comes. A batch that finds no room is
+ * dropped and counted, the output path never waits for the disk.
+ */
+struct recording_policy_t {
+  recording_format_t format = recording_format_t::asciicast;
+  std::size_t ring_bytes = 4 << 20;
+  u_int64_t interval_ns = 20000000;
+};
+
+/**
+ * @struct recording_counters_t
+ * @brief what the recorder took and wrote. kicks are the times the output
+ * path had to wake the recorder thread.
+ */
+struct recording_counters_t {
+  u_int64_t batches = {};
+  u_int64_t bytes = {};
+  u_int64_t dropped_batches = {};
+  u_int64_t dropped_bytes = {};
+  u_int64_t drains = {};
+  u_int64_t file_bytes = {};
+  u_int64_t kicks = {};
+};
+
+/**
+ * @struct recording_header_t
+ * @brief starts a binary recording. start_ms is the wall clock time the
+ * recording began, in milliseconds since the epoch.
+ */
+struct recording_header_t {
+  static constexpr u_int32_t magic_value = 0x4b435243;
+
+  u_int32_t magic = magic_value;
+  u_int16_t version = 1;
+  u_int16_t rows = {};
+  u_int16_t columns = {};
+  u_int16_t reserved = {};
+  u_int32_t reserved2 = {};
+  u_int64_t start_ms = {};
+};
+
+/**
+ * @class output_recorder_t
+ * @brief records what a session displays, set as the tee of its
+ * output_writer_t. tee stamps a flushed batch and copies it into a ring,
+ * nothing more. A recorder thread takes the batches out, formats them and
+ * writes them with a write per drain. There is one producer, the thread
+ * that flushes the writer. A failed open or write turns ok() false and
+ * later batches are dropped.
+ */
+class output_recorder_t : public output_tee_t {
+public:
+  output_recorder_t(const char *path, int rows, int columns,
+                    const recording_policy_t &_policy = {})
+      : policy(_policy) {
+    std::size_t size = 4096;
+    while (size < policy.ring_bytes)
+      size <<= 1;
+    ring.resize(size);
+    start_ns = steady_now_ns();
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+      return;
+    write_header(rows, columns);
+    recorder = std::thread([this] { record_loop(); });
+  }
+
+  ~output_recorder_t() override {
+    if (recorder.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        bstop = true;
+      }
+      wake.notify_one();
+      recorder.join();
+    }
+    if (fd >= 0)
+      close(fd);
+  }
+
+  output_recorder_t(const output_recorder_t &) = delete;
+  output_recorder_t &operator=(const output_recorder_t &) = delete;
+
+  bool ok() const { return fd >= 0 && !bfailed; }
+
+  /**
+   * @fn tee
+   * @brief the batch p, len as flushed now, copied into the ring.
+   */
+  void tee(const char *p, std::size_t len) override {
+    u_int64_t h = head.load(std::memory_order_relaxed);
+    u_int64_t used = h - tail.load(std::memory_order_acquire);
+    batch_t b = {steady_now_ns(), len};
+    std::size_t need = sizeof(b) + len;
+    if (need > ring.size() - used || !recorder.joinable() || bfailed) {
+      dropped_batches.fetch_add(1, std::memory_order_relaxed);
+      dropped_bytes.fetch_add(len, std::memory_order_relaxed);
+      return;
+    }
+    copy_in(h, &b, sizeof(b));
+    copy_in(h + sizeof(b), p, len);
+    head.store(h + need, std::memory_order_seq_cst);
+
+    std::size_t half = ring.size() / 2;
+    bool bhalf = used < half && used + need >= half;
+    bool basleep =
+        bidle.load(std::memory_order_seq_cst) && bidle.exchange(false);
+    if (bhalf || basleep)
+      kick(bhalf);
+  }
+
+  /** @brief counters as of the last drain. */
+  recording_counters_t counters() {
+    std::lock_guard<std::mutex> lock(mutex);
+    recording_counters_t c = counts;
+    c.dropped_batches = dropped_batches;
+    c.dropped_bytes = dropped_bytes;
+    c.kicks = kicks;
+    return c;
+  }
+
+private:
+  struct batch_t {
+    u_int64_t time_ns;
+    u_int64_t len;
+  };
+
+  void copy_in(u_int64_t at, const void *p, std::size_t len) {
+    std::size_t mask = ring.size() - 1;
+    std::size_t from = static_cast<std::size_t>(at) & mask;
+    std::size_t first = std::min(len, ring.size() - from);
+    memcpy(ring.data() + from, p, first);
+    memcpy(ring.data(), static_cast<const char *>(p) + first, len - first);
+  }
+
+  void copy_out(u_int64_t at, void *p, std::size_t len) const {
+    std::size_t mask = ring.size() - 1;
+    std::size_t from = static_cast<std::size_t>(at) & mask;
+    std::size_t first = std::min(len, ring.size() - from);
+    memcpy(p, ring.data() + from, first);
+    memcpy(static_cast<char *>(p) + first, ring.data(), len - first);
+  }
+
+  void kick(bool bhalf) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      bfull = bfull || bhalf;
+      kicks++;
+    }
+    wake.notify_one();
+  }
+
+  /**
+   * @fn record_loop
+   * @brief drains the ring every interval while batches come, and sleeps
+   * without a timeout once a drain found nothing. bidle is set before the
+   * ring is looked at and head is stored before bidle is, so either the
+   * thread sees the batch or tee sees it asleep and wakes it.
+   */
+  void record_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    bool bactive = true;
+    for (;;) {
+      if (bactive) {
+        wake.wait_for(lock, std::chrono::nanoseconds(policy.interval_ns),
+                      [&] { return bstop || bfull; });
+      } else {
+        bidle.store(true, std::memory_order_seq_cst);
+        if (head.load(std::memory_order_seq_cst) ==
+            tail.load(std::memory_order_relaxed))
+          wake.wait(lock, [&] { return bstop || bfull || !bidle; });
+        bidle = false;
+      }
+      bfull = false;
+      bool blast = bstop;
+      lock.unlock();
+      bactive = drain();
+      if (blast)
+        finish();
+      lock.lock();
+      if (blast)
+        return;
+    }
+  }
+
+  /** @brief formats what the ring holds and writes it, true if anything. */
+  bool drain() {
+    u_int64_t t = tail.load(std::memory_order_relaxed);
+    u_int64_t h = head.load(std::memory_order_acquire);
+    if (t == h)
+      return false;
+    out.clear();
+    u_int64_t batches = {};
+    u_int64_t bytes = {};
+    while (t != h) {
+      batch_t b = {};
+      copy_out(t, &b, sizeof(b));
+      data.resize(b.len);
+      copy_out(t + sizeof(b), data.data(), b.len);
+      t += sizeof(b) + b.len;
+      tail.store(t, std::memory_order_release);
+      if (policy.format == recording_format_t::binary)
+        format_binary(b.time_ns, data.data(), data.size());
+      else
+        format_asciicast(b.time_ns, data.data(), data.size());
+      batches++;
+      bytes += b.len;
+    }
+    bool bwritten = write_all(out.data(), out.size());
+    std::lock_guard<std::mutex> lock(mutex);
+    counts.batches += batches;
+    counts.bytes += bytes;
+    counts.drains++;
+    counts.file_bytes += bwritten ? out.size() : 0;
+    return true;
+  }
+
+  /** @brief what is left of a UTF-8 sequence cut by the last batch. */
+  void finish() {
+    if (policy.format != recording_format_t::asciicast || carry.empty())
+      return;
+    out.clear();
+    std::string rest = carry;
+    carry.clear();
+    format_asciicast(last_ns, rest.data(), rest.size());
+    write_all(out.data(), out.size());
+  }
+
+  void write_header(int rows, int columns) {
+    u_int64_t start_ms = static_cast<u_int64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count());
+    if (policy.format == recording_format_t::binary) {
+      recording_header_t header = {};
+      header.rows = static_cast<u_int16_t>(rows);
+      header.columns = static_cast<u_int16_t>(columns);
+      header.start_ms = start_ms;
+      write_all(&header, sizeof(header));
+      return;
+    }
+    char line[160];
+    int n = snprintf(line, sizeof(line),
+                     "{\"version\": 2, \"width\": %d, \"height\": %d, "
+                     "\"timestamp\": %llu}\n",
+                     columns, rows,
+                     static_cast<unsigned long long>(start_ms / 1000));
+    write_all(line, static_cast<std::size_t>(n));
+  }
+
+  bool write_all(const void *p, std::size_t len) {
+    const char *at = static_cast<const char *>(p);
+    while (len && !bfailed) {
+      ssize_t n = ::write(fd, at, len);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        bfailed = true;
+      else {
+        at += n;
+        len -= static_cast<std::size_t>(n);
+      }
+    }
+    return !bfailed;
+  }
+
+  void put_varint(u_int64_t v) {
+    while (v >= 0x80) {
+      out.push_back(static_cast<char>(v | 0x80));
+      v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+  }
+
+  void format_binary(u_int64_t time_ns, const char *p, std::size_t len) {
+    u_int64_t us = (time_ns - start_ns) / 1000;
+    put_varint(us - std::min(us, last_us));
+    last_us = us;
+    put_varint(len);
+    out.append(p, len);
+  }
+
+  /**
+   * @fn format_asciicast
+   * @brief an event line for the batch. The text of an event must be
+   * whole UTF-8, so a sequence cut at the end of a batch is held for the
+   * next one, and bytes that are not UTF-8 become U+FFFD.
+   */
+  void format_asciicast(u_int64_t time_ns, const char *p, std::size_t len) {
+    last_ns = time_ns;
+    text = carry;
+    text.append(p, len);
+    carry.clear();
+    std::size_t end = text.size();
+    for (std::size_t back = 1; back <= 3 && back <= end; back++) {
+      u_int8_t c = static_cast<u_int8_t>(text[end - back]);
+      if ((c & 0xc0) == 0x80)
+        continue;
+      if (c >= 0xc0 && utf8_length(c) > back) {
+        carry.assign(text, end - back, back);
+        end -= back;
+      }
+      break;
+    }
+    if (!end)
+      return;
+
+    char stamp[48];
+    int n = snprintf(stamp, sizeof(stamp), "[%.6f, \"o\", \"",
+                     static_cast<double>(time_ns - start_ns) / 1e9);
+    out.append(stamp, static_cast<std::size_t>(n));
+    static const char hex[] = "0123456789abcdef";
+    for (std::size_t i = 0; i < end;) {
+      u_int8_t c = static_cast<u_int8_t>(text[i]);
+      if (c >= 0x80) {
+        std::size_t l = utf8_length(c);
+        bool bvalid = l > 1 && i + l <= end;
+        for (std::size_t k = 1; bvalid && k < l; k++)
+          bvalid = (static_cast<u_int8_t>(text[i + k]) & 0xc0) == 0x80;
+        if (bvalid)
+          out.append(text, i, l);
+        else
+          out += "\\ufffd";
+        i += bvalid ? l : 1;
+        continue;
+      }
+      if (c == '"' || c == '\\') {
+        out.push_back('\\');
+        out.push_back(static_cast<char>(c));
+      } else if (c == '\n') {
+        out += "\\n";
+      } else if (c == '\r') {
+        out += "\\r";
+      } else if (c < 0x20) {
+        out += "\\u00";
+        out.push_back(hex[c >> 4]);
+        out.push_back(hex[c & 15]);
+      } else {
+        out.push_back(static_cast<char>(c));
+      }
+      i++;
+    }
+    out += "\"]\n";
+  }
+
+  static std::size_t utf8_length(u_int8_t c) {
+    if (c >= 0xf0 && c < 0xf8)
+      return 4;
+    if (c >= 0xe0)
+      return c < 0xf0 ? 3 : 0;
+    return c >= 0xc0 ? 2 : 0;
+  }
+
+  recording_policy_t policy = {};
+  int fd = -1;
+  std::vector<char> ring = {};
+  std::atomic<u_int64_t> head = {};
+  std::atomic<u_int64_t> tail = {};
+  std::atomic<bool> bidle = {};
+  std::atomic<bool> bfailed = {};
+  std::atomic<u_int64_t> dropped_batches = {};
+  std::atomic<u_int64_t> dropped_bytes = {};
+  std::thread recorder = {};
+  std::mutex mutex = {};
+  std::condition_variable wake = {};
+  bool bstop = {};
+  bool bfull = {};
+  u_int64_t kicks = {};
+  recording_counters_t counts = {};
+  u_int64_t start_ns = {};
+  u_int64_t last_ns = {};
+  u_int64_t last_us = {};
+  std::string out = {};
+  std::string data = {};
+  std::string text = {};
+  std::string carry = {};
+};
+
+/**
+ * @struct recording_scan_t
+ * @brief what reading a recording found. torn_bytes follow the last whole
+ * batch, the end of a recording a crash cut short.
+ */
+struct recording_scan_t {
+  recording_format_t format = recording_format_t::asciicast;
+  int rows = {};
+  int columns = {};
+  u_int64_t batches = {};
+  u_int64_t bytes = {};
+  u_int64_t torn_bytes = {};
+};
+
+/**
+ * @fn recording_unescape
+ * @brief the JSON string starting after the quote at p, up to its closing
+ * quote, into text. Returns past the closing quote, nullptr if there is
+ * none before end.
+ */
+inline const char *recording_unescape(const char *p, const char *end,
+                                      std::string &text) {
+  text.clear();
+  while (p < end && *p != '"') {
+    if (*p != '\\') {
+      text.push_back(*p++);
+      continue;
+    }
+    if (++p == end)
+      return nullptr;
+    char c = *p++;
+    if (c == 'n')
+      text.push_back('\n');
+    else if (c == 'r')
+      text.push_back('\r');
+    else if (c == 't')
+      text.push_back('\t');
+    else if (c == 'b')
+      text.push_back('\b');
+    else if (c == 'f')
+      text.push_back('\f');
+    else if (c != 'u')
+      text.push_back(c);
+    else {
+      if (end - p < 4)
+        return nullptr;
+      char digits[5] = {p[0], p[1], p[2], p[3], 0};
+      unsigned cp = static_cast<unsigned>(strtoul(digits, nullptr, 16));
+      p += 4;
+      if (cp < 0x80) {
+        text.push_back(static_cast<char>(cp));
+      } else if (cp < 0x800) {
+        text.push_back(static_cast<char>(0xc0 | cp >> 6));
+        text.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+      } else {
+        text.push_back(static_cast<char>(0xe0 | cp >> 12));
+        text.push_back(static_cast<char>(0x80 | (cp >> 6 & 0x3f)));
+        text.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+      }
+    }
+  }
+  return p < end ? p + 1 : nullptr;
+}
+
+/**
+ * @fn recording_read
+ * @brief calls on_batch(u_int64_t time_us, const char *p, std::size_t len)
+ * for every batch of the recording at path, either format, for a replay.
+ * time_us is since the recording began.
+ */
+template <typename F>
+inline recording_scan_t recording_read(const char *path, F &&on_batch) {
+  recording_scan_t scan = {};
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return scan;
+  std::string bytes = {};
+  char chunk[64 << 10];
+  ssize_t n = {};
+  while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+    bytes.append(chunk, static_cast<std::size_t>(n));
+  close(fd);
+
+  std::size_t at = {};
+  if (bytes.size() >= sizeof(recording_header_t) && bytes[0] != '{') {
+    recording_header_t header = {};
+    memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != recording_header_t::magic_value) {
+      scan.torn_bytes = bytes.size();
+      return scan;
+    }
+    scan.format = recording_format_t::binary;
+    scan.rows = header.rows;
+    scan.columns = header.columns;
+    at = sizeof(header);
+    u_int64_t time_us = {};
+    auto varint = [&](std::size_t &i, u_int64_t &v) {
+      v = {};
+      for (int shift = 0; i < bytes.size() && shift < 64; shift += 7) {
+        u_int8_t c = static_cast<u_int8_t>(bytes[i++]);
+        v |= static_cast<u_int64_t>(c & 0x7f) << shift;
+        if (!(c & 0x80))
+          return true;
+      }
+      return false;
+    };
+    while (at < bytes.size()) {
+      std::size_t i = at;
+      u_int64_t delta = {};
+      u_int64_t len = {};
+      if (!varint(i, delta) || !varint(i, len) || len > bytes.size() - i)
+        break;
+      time_us += delta;
+      on_batch(time_us, bytes.data() + i, static_cast<std::size_t>(len));
+      scan.batches++;
+      scan.bytes += len;
+      at = i + len;
+    }
+    scan.torn_bytes = bytes.size() - at;
+    return scan;
+  }
+
+  std::size_t eol = bytes.find('\n');
+  if (eol == std::string::npos) {
+    scan.torn_bytes = bytes.size();
+    return scan;
+  }
+  const char *width = strstr(bytes.c_str(), "\"width\":");
+  const char *height = strstr(bytes.c_str(), "\"height\":");
+  if (width && width < bytes.data() + eol)
+    scan.columns = atoi(width + 8);
+  if (height && height < bytes.data() + eol)
+    scan.rows = atoi(height + 9);
+  at = eol + 1;
+  std::string text = {};
+  while ((eol = bytes.find('\n', at)) != std::string::npos) {
+    const char *p = bytes.data() + at;
+    const char *end = bytes.data() + eol;
+    char *after = nullptr;
+    double seconds = p < end && *p == '[' ? strtod(p + 1, &after) : 0;
+    const char *quote = after ? strstr(after, ", \"o\", \"") : nullptr;
+    if (!quote || quote >= end ||
+        !recording_unescape(quote + 8, end, text))
+      break;
+    on_batch(static_cast<u_int64_t>(seconds * 1e6 + 0.5), text.data(),
+             text.size());
+    scan.batches++;
+    scan.bytes += text.size();
+    at = eol + 1;
+  }
+  scan.torn_bytes = bytes.size() - at;
+  return scan;
+}
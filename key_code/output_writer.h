@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @class output_tee_t
+ * @brief is handed every batch an output_writer_t flushes, before it is
+ * written, for instance to record what a session showed. tee runs on the
+ * writer's thread, in the output path, and must be cheap.
+ */
+class output_tee_t {
+public:
+  virtual ~output_tee_t() = default;
+  virtual void tee(const char *p, std::size_t len) = 0;
+};
+
+/**
+ * @class output_writer_t
+ * @brief batches terminal output so a frame goes out with one write()
+ * rather than a printf per piece. Output is appended to the buffer and
+ * flush sends all of it. Should a frame be larger than the buffer, the
+ * buffer is sent as it fills. An fd of -1 discards the output but still
+ * counts it, which is how the benchmarks measure bytes on the wire. An fd
+ * of capture keeps the output, the buffer grows to hold it, until it is
+ * taken with data() and pending() and cleared. A tee set with set_tee is
+ * handed what each flush sends.
+ */
+class output_writer_t {
+public:
+  static constexpr int capture = -2;
+
+  explicit output_writer_t(int _fd = STDOUT_FILENO,
+                           std::size_t capacity = 64 << 10)
+      : fd(_fd), buffer(capacity) {}
+
+  void write(const char *p, std::size_t len) {
+    while (len) {
+      if (used == buffer.size())
+        make_room();
+      std::size_t n = std::min(len, buffer.size() - used);
+      memcpy(buffer.data() + used, p, n);
+      used += n;
+      p += n;
+      len -= n;
+    }
+  }
+
+  void write(const std::string &s) { write(s.data(), s.size()); }
+
+  void put(char c) {
+    if (used == buffer.size())
+      make_room();
+    buffer[used++] = c;
+  }
+
+  /**
+   * @fn flush
+   * @brief sends what is buffered, retrying short writes and EINTR.
+   */
+  void flush() {
+    if (fd == capture)
+      return;
+    std::size_t pos = {};
+    if (used)
+      flush_count++;
+    if (tap && used)
+      tap->tee(buffer.data(), used);
+    while (fd >= 0 && pos < used) {
+      ssize_t n = ::write(fd, buffer.data() + pos, used - pos);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      pos += n;
+    }
+    written += used;
+    used = {};
+  }
+
+  /**
+   * @fn pending
+   * @brief bytes buffered and not yet flushed.
+   */
+  std::size_t pending() const { return used; }
+
+  /** @brief the bytes buffered, what a capture writer holds. */
+  const char *data() const { return buffer.data(); }
+
+  /** @brief drops what is buffered without sending it. */
+  void clear() { used = {}; }
+
+  /**
+   * @fn set_tee
+   * @brief t is handed every batch flushed from now on, nullptr stops it.
+   * t must outlive the writer or be unset first.
+   */
+  void set_tee(output_tee_t *t) { tap = t; }
+
+  /**
+   * @fn bytes_written
+   * @brief bytes flushed since the writer was made.
+   */
+  std::size_t bytes_written() const { return written; }
+
+  /**
+   * @fn flushes
+   * @brief the number of flushes that had something to send.
+   */
+  std::size_t flushes() const { return flush_count; }
+
+private:
+  void make_room() {
+    if (fd == capture)
+      buffer.resize(std::max<std::size_t>(buffer.size() * 2, 64));
+    else
+      flush();
+  }
+
+  int fd = {};
+  std::vector<char> buffer = {};
+  std::size_t used = {};
+  std::size_t written = {};
+  std::size_t flush_count = {};
+  output_tee_t *tap = {};
+};
@@ -0,0 +1,497 @@
+#pragma once
+
+#include "screen.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * @class vt_parser_t
+ * @brief splits the output of a program into what a terminal acts on, a
+ * piece at a time so a sequence may be cut between writes. The sink is
+ * given text(p, n) for runs of printable bytes, utf8 included,
+ * control(c, i) for C0 controls at index i of the piece, csi(params,
+ * count, final, bprivate) and escape(intermediate, final). OSC strings
+ * such as window titles are skipped.
+ */
+class vt_parser_t {
+public:
+  static constexpr int max_params = 16;
+
+  template <typename S> void feed(const char *p, std::size_t len, S &sink) {
+    std::size_t i = {};
+    while (i < len) {
+      u_int8_t c = static_cast<u_int8_t>(p[i]);
+      switch (state) {
+      case state_t::ground: {
+        std::size_t start = i;
+        while (i < len && static_cast<u_int8_t>(p[i]) >= 0x20 &&
+               p[i] != 0x7f)
+          i++;
+        if (i > start) {
+          sink.text(p + start, i - start);
+          continue;
+        }
+        if (c == 0x1b) {
+          state = state_t::escape;
+          intermediate = {};
+        } else {
+          sink.control(static_cast<char>(c), i);
+        }
+        break;
+      }
+      case state_t::escape:
+        if (c == '[') {
+          state = state_t::csi;
+          count = {};
+          params[0] = {};
+          bprivate = {};
+        } else if (c == ']') {
+          state = state_t::osc;
+        } else if (c >= 0x20 && c <= 0x2f) {
+          intermediate = static_cast<char>(c);
+        } else {
+          state = state_t::ground;
+          sink.escape(intermediate, static_cast<char>(c));
+        }
+        break;
+      case state_t::csi:
+        if (c >= '0' && c <= '9') {
+          params[count] = params[count] * 10 + (c - '0');
+        } else if (c == ';') {
+          if (count + 1 < max_params)
+            params[++count] = {};
+        } else if (c >= 0x3c && c <= 0x3f) {
+          bprivate = true;
+        } else if (c >= 0x40 && c <= 0x7e) {
+          state = state_t::ground;
+          sink.csi(params, count + 1, static_cast<char>(c), bprivate);
+        }
+        break;
+      case state_t::osc:
+        if (c == 0x07)
+          state = state_t::ground;
+        else if (c == 0x1b)
+          state = state_t::osc_escape;
+        break;
+      case state_t::osc_escape:
+        state = c == '\\' ? state_t::ground : state_t::osc;
+        break;
+      }
+      i++;
+    }
+  }
+
+  bool ground() const { return state == state_t::ground; }
+
+private:
+  enum class state_t { ground, escape, csi, osc, osc_escape };
+
+  state_t state = state_t::ground;
+  int params[max_params] = {};
+  int count = {};
+  bool bprivate = {};
+  char intermediate = {};
+};
+
+/**
+ * @fn apply_sgr
+ * @brief the pen after select graphic rendition with params.
+ */
+inline void apply_sgr(style_t &pen, const int *params, int count) {
+  for (int k = 0; k < count; k++) {
+    int p = params[k];
+    if (p == 0)
+      pen = {};
+    else if (p == 1)
+      pen.attrs |= style_t::bold;
+    else if (p == 4)
+      pen.attrs |= style_t::underline;
+    else if (p == 7)
+      pen.attrs |= style_t::reverse;
+    else if (p == 22)
+      pen.attrs &= ~style_t::bold;
+    else if (p == 24)
+      pen.attrs &= ~style_t::underline;
+    else if (p == 27)
+      pen.attrs &= ~style_t::reverse;
+    else if (p >= 30 && p <= 37)
+      pen.fg = static_cast<u_int16_t>(p - 30);
+    else if (p == 39)
+      pen.fg = style_t::color_default;
+    else if (p >= 40 && p <= 47)
+      pen.bg = static_cast<u_int16_t>(p - 40);
+    else if (p == 49)
+      pen.bg = style_t::color_default;
+    else if (p >= 90 && p <= 97)
+      pen.fg = static_cast<u_int16_t>(p - 90 + 8);
+    else if (p >= 100 && p <= 107)
+      pen.bg = static_cast<u_int16_t>(p - 100 + 8);
+    else if ((p == 38 || p == 48) && k + 2 < count && params[k + 1] == 5) {
+      (p == 38 ? pen.fg : pen.bg) = static_cast<u_int16_t>(params[k + 2]);
+      k += 2;
+    }
+  }
+}
+
+/**
+ * @class pane_t
+ * @brief a pane of the multiplexer: the program's output applied to a
+ * grid that the front end composes and renders.
+ *
+ * A hidden pane does not keep its grid up to date. Its output is kept as
+ * it came, and scanned only for line feeds and the few sequences that
+ * change more than the line being written. No cell is written and no
+ * style resolved. When the output has scrolled everything older off the
+ * screen, the bytes before it are dropped. A line start with twice the
+ * rows of line feeds after it qualifies, since the screen below it must
+ * have scrolled out by then whatever row the cursor was on. From there the
+ * grid is a blank screen with the cursor at the bottom and the pen of that
+ * moment. show() and screen() catch up by applying what was kept. Output
+ * that moves the cursor around, as full screen programs do, is applied as
+ * it comes, still without rendering. So is output kept past max_held
+ * bytes, such as a progress bar that never feeds a line.
+ */
+class pane_t {
+public:
+  /** @brief kept output is compacted once it grows past compact_bytes. */
+  std::size_t compact_bytes = 16 << 10;
+  std::size_t max_held = 1 << 20;
+
+  pane_t(int rows, int columns) : grid(rows, columns) {}
+
+  /**
+   * @fn write
+   * @brief output of the program in the pane.
+   */
+  void write(const char *p, std::size_t len) {
+    if (bvisible || bcomplex) {
+      apply(p, len);
+      return;
+    }
+    std::size_t base = held.size();
+    held.append(p, len);
+    scan_sink_t sink{*this, base};
+    scanner.feed(p, len, sink);
+    if (bcomplex || held.size() > max_held) {
+      catch_up();
+      if (!bcomplex)
+        checkpoint();
+    } else if (held.size() > compact_at) {
+      compact();
+      compact_at = std::max(compact_bytes, held.size() * 2);
+    }
+  }
+
+  bool visible() const { return bvisible; }
+
+  /**
+   * @fn hide
+   * @brief stops keeping the grid up to date.
+   */
+  void hide() {
+    if (!bvisible)
+      return;
+    bvisible = false;
+    bcomplex = false;
+    checkpoint();
+  }
+
+  /**
+   * @fn show
+   * @brief brings the grid up to date and keeps it so.
+   */
+  void show() {
+    catch_up();
+    bvisible = true;
+  }
+
+  /** @brief the grid, brought up to date first when hidden. */
+  const screen_grid_t &screen() {
+    catch_up();
+    return grid;
+  }
+
+  int cursor_row() const { return row; }
+  int cursor_col() const { return col; }
+  /** @brief output kept while hidden, the size of the pane's model. */
+  std::size_t held_bytes() const { return held.size(); }
+  std::size_t catch_ups() const { return catch_up_count; }
+  std::size_t compactions() const { return compaction_count; }
+
+private:
+  /** @brief a line start at offset of the held output. */
+  struct line_start_t {
+    std::size_t offset = {};
+    style_t pen = {};
+  };
+
+  /** @brief writes the output into the grid. */
+  struct apply_sink_t {
+    pane_t &pane;
+
+    void text(const char *p, std::size_t n) {
+      for (std::size_t i = 0; i < n; i++) {
+        u_int8_t b = static_cast<u_int8_t>(p[i]);
+        if (b < 0x80) {
+          pane.put(b);
+        } else if (b >= 0xc0) {
+          pane.need = b >= 0xf0 ? 3 : b >= 0xe0 ? 2 : 1;
+          pane.cp = b & (0x3f >> pane.need);
+        } else if (pane.need) {
+          pane.cp = (pane.cp << 6) | (b & 0x3f);
+          if (--pane.need == 0)
+            pane.put(pane.cp);
+        }
+      }
+    }
+
+    void control(char c, std::size_t) {
+      pane.need = {};
+      if (c == '\r') {
+        pane.col = 0;
+      } else if (c == '\n') {
+        pane.line_feed();
+      } else if (c == '\b') {
+        pane.col = std::max(std::min(pane.col, pane.columns() - 1) - 1, 0);
+      } else if (c == '\t') {
+        pane.col = std::min((pane.col / 8 + 1) * 8, pane.columns() - 1);
+      }
+    }
+
+    void csi(const int *params, int count, char final, bool bprivate) {
+      pane.need = {};
+      if (!bprivate)
+        pane.control_sequence(params, count, final);
+    }
+
+    void escape(char intermediate, char final) {
+      pane.need = {};
+      if (!intermediate)
+        pane.escape(final);
+    }
+  };
+
+  /**
+   * @brief looks only for line feeds after a carriage return, the pen and
+   * what makes the grid depend on more than the lines written.
+   */
+  struct scan_sink_t {
+    pane_t &pane;
+    std::size_t base;
+
+    void text(const char *, std::size_t) { pane.bline_start = false; }
+
+    void control(char c, std::size_t i) {
+      if (c == '\r')
+        pane.bline_start = true;
+      else if (c == '\n' && pane.bline_start)
+        pane.lines.push_back({base + i + 1, pane.scan_pen});
+      else if (c == '\b' || c == '\t')
+        pane.bline_start = false;
+    }
+
+    void csi(const int *params, int count, char final, bool bprivate) {
+      if (bprivate) {
+        // the alternate screen.
+        if ((final == 'h' || final == 'l') &&
+            (params[0] == 47 || params[0] == 1047 || params[0] == 1049))
+          pane.bcomplex = true;
+      } else if (final == 'm') {
+        apply_sgr(pane.scan_pen, params, count);
+      } else if (final != 'K') {
+        pane.bcomplex = true;
+      }
+    }
+
+    void escape(char intermediate, char final) {
+      if (!intermediate && final != '=' && final != '>')
+        pane.bcomplex = true;
+    }
+  };
+
+  int rows() const { return grid.rows(); }
+  int columns() const { return grid.columns(); }
+
+  void apply(const char *p, std::size_t len) {
+    apply_sink_t sink{*this};
+    parser.feed(p, len, sink);
+  }
+
+  /** @brief the hidden pane's output starts from the grid as it is. */
+  void checkpoint() {
+    scanner = parser;
+    scan_pen = pen;
+    bline_start = col == 0 && need == 0;
+    bblank = false;
+    held.clear();
+    lines.clear();
+    compact_at = compact_bytes;
+  }
+
+  void catch_up() {
+    if (held.empty())
+      return;
+    if (bblank) {
+      grid.clear();
+      row = rows() - 1;
+      col = {};
+      pen = blank_pen;
+      parser = vt_parser_t();
+      need = {};
+    }
+    apply(held.data(), held.size());
+    held.clear();
+    lines.clear();
+    bblank = false;
+    catch_up_count++;
+  }
+
+  /** @brief drops the output that has scrolled off in any case. */
+  void compact() {
+    std::size_t keep = static_cast<std::size_t>(rows()) * 2;
+    if (lines.size() <= keep)
+      return;
+    std::size_t k = lines.size() - 1 - keep;
+    std::size_t from = lines[k].offset;
+    held.erase(0, from);
+    blank_pen = lines[k].pen;
+    lines.erase(lines.begin(), lines.begin() + k + 1);
+    for (auto &l : lines)
+      l.offset -= from;
+    bblank = true;
+    compaction_count++;
+  }
+
+  void put(char32_t ch) {
+    if (col >= columns()) {
+      col = 0;
+      line_feed();
+    }
+    cell_t &cell = grid.at(row, col++);
+    cell.ch = ch;
+    cell.style = pen;
+  }
+
+  void line_feed() {
+    if (row == rows() - 1)
+      grid.scroll_up(1);
+    else
+      row++;
+  }
+
+  void erase(int r, int from, int to) {
+    std::fill(grid.row(r) + from, grid.row(r) + to, cell_t{});
+  }
+
+  void control_sequence(const int *params, int count, char final) {
+    int n = std::max(params[0], 1);
+    int c = std::min(col, columns() - 1);
+    switch (final) {
+    case 'm':
+      apply_sgr(pen, params, count);
+      return;
+    case 'H':
+    case 'f':
+      row = n - 1;
+      col = std::max(count > 1 ? params[1] : 0, 1) - 1;
+      break;
+    case 'A':
+      row -= n;
+      break;
+    case 'B':
+      row += n;
+      break;
+    case 'C':
+      col = c + n;
+      break;
+    case 'D':
+      col = c - n;
+      break;
+    case 'G':
+      col = n - 1;
+      break;
+    case 'd':
+      row = n - 1;
+      break;
+    case 'K':
+      if (params[0] == 0)
+        erase(row, c, columns());
+      else if (params[0] == 1)
+        erase(row, 0, c + 1);
+      else
+        erase(row, 0, columns());
+      return;
+    case 'J':
+      if (params[0] == 0) {
+        erase(row, c, columns());
+        for (int r = row + 1; r < rows(); r++)
+          erase(r, 0, columns());
+      } else if (params[0] == 1) {
+        for (int r = 0; r < row; r++)
+          erase(r, 0, columns());
+        erase(row, 0, c + 1);
+      } else {
+        grid.clear();
+      }
+      return;
+    default:
+      return;
+    }
+    row = std::min(std::max(row, 0), rows() - 1);
+    col = std::min(std::max(col, 0), columns() - 1);
+  }
+
+  void escape(char final) {
+    switch (final) {
+    case '7':
+      saved_row = row;
+      saved_col = col;
+      break;
+    case '8':
+      row = saved_row;
+      col = saved_col;
+      break;
+    case 'M':
+      if (row > 0) {
+        row--;
+      } else {
+        std::copy_backward(grid.row(0), grid.row(rows() - 1),
+                           grid.row(rows() - 1) + columns());
+        erase(0, 0, columns());
+      }
+      break;
+    case 'c':
+      grid.clear();
+      row = col = {};
+      pen = {};
+      break;
+    }
+  }
+
+  screen_grid_t grid = {};
+  int row = {};
+  int col = {};
+  int saved_row = {};
+  int saved_col = {};
+  style_t pen = {};
+  vt_parser_t parser = {};
+  char32_t cp = {};
+  int need = {};
+
+  bool bvisible = true;
+  bool bcomplex = {};
+  bool bblank = {};
+  bool bline_start = {};
+  vt_parser_t scanner = {};
+  style_t scan_pen = {};
+  style_t blank_pen = {};
+  std::string held = {};
+  std::vector<line_start_t> lines = {};
+  std::size_t compact_at = compact_bytes;
+  std::size_t catch_up_count = {};
+  std::size_t compaction_count = {};
+};
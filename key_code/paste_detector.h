@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <sys/types.h>
+
+/**
+ * @struct paste_tuning_t
+ * @brief when input is taken for a paste. A read holding a run of at least
+ * burst_bytes text bytes is one, a person types a key or two per read. So
+ * is the burst_reads'th read of text in a row to arrive within burst_gap_us
+ * of the one before, for terminals that hand a paste over in small pieces.
+ * The paste ends when nothing arrives for end_gap_us.
+ */
+struct paste_tuning_t {
+  std::size_t burst_bytes = 16;
+  u_int32_t burst_gap_us = 2000;
+  u_int32_t burst_reads = 6;
+  u_int32_t end_gap_us = 20000;
+};
+
+/**
+ * @struct paste_counters_t
+ * @brief what the detector saw. key_bytes went through the decoder one
+ * keystroke at a time, paste_bytes were handed over as text runs.
+ */
+struct paste_counters_t {
+  u_int64_t pastes = {};
+  u_int64_t paste_bytes = {};
+  u_int64_t key_bytes = {};
+  u_int64_t longest = {};
+};
+
+/**
+ * @class paste_detector_t
+ * @brief tells pastes from typing by the timing and size of the reads, for
+ * terminals without bracketed paste. Typing goes to the decoder as before.
+ * During a paste the runs of text, newlines and tabs included, go to
+ * on_text(const char *, std::size_t) in one piece, without a key binding
+ * looked up or run for each byte, so a pasted line is not indented or
+ * executed as it arrives. Escape sequences within a paste are still
+ * decoded as keys. A paste starts only between keystrokes.
+ */
+class paste_detector_t {
+public:
+  paste_tuning_t tuning = {};
+
+  bool pasting() const { return bpasting; }
+  const paste_counters_t &counters() const { return counts; }
+
+  /**
+   * @fn feed
+   * @brief the bytes of one read that arrived at now_us, given to decoder
+   * and on_key or to on_text.
+   */
+  template <typename D, typename K, typename T>
+  void feed(D &decoder, const char *p, std::size_t len, u_int64_t now_us,
+            K &&on_key, T &&on_text) {
+    u_int64_t gap = bread ? now_us - last_us : ~u_int64_t{};
+    bread = true;
+    last_us = now_us;
+    if (bpasting && gap > tuning.end_gap_us)
+      end_paste();
+
+    if (!bpasting) {
+      std::size_t run = longest_run(p, len);
+      if (!run)
+        fast_reads = {};
+      else if (gap <= tuning.burst_gap_us)
+        fast_reads++;
+      else
+        fast_reads = 1;
+      if (decoder.ground() &&
+          (run >= tuning.burst_bytes || fast_reads >= tuning.burst_reads))
+        begin_paste();
+    }
+    if (!bpasting) {
+      counts.key_bytes += len;
+      decoder.feed(p, len, on_key);
+      return;
+    }
+
+    std::size_t i = {};
+    while (i < len) {
+      std::size_t j = i;
+      if (decoder.ground())
+        while (j < len && text_byte(p[j]))
+          j++;
+      if (j > i) {
+        on_text(p + i, j - i);
+        current += j - i;
+        counts.paste_bytes += j - i;
+        i = j;
+        continue;
+      }
+      // a key or a control string, a byte at a time until it ends.
+      counts.key_bytes++;
+      decoder.feed(p + i, 1, on_key);
+      i++;
+    }
+  }
+
+  /**
+   * @fn idle
+   * @brief ends a paste once end_gap_us passed without input, for the
+   * event loop to call when its wait times out.
+   */
+  void idle(u_int64_t now_us) {
+    if (bpasting && now_us - last_us > tuning.end_gap_us)
+      end_paste();
+  }
+
+private:
+  static bool text_byte(char ch) {
+    u_int8_t c = static_cast<u_int8_t>(ch);
+    return (c >= 0x20 && c != 0x7f) || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  static std::size_t longest_run(const char *p, std::size_t len) {
+    std::size_t longest = {};
+    std::size_t run = {};
+    for (std::size_t i = 0; i < len; i++) {
+      run = text_byte(p[i]) ? run + 1 : 0;
+      if (run > longest)
+        longest = run;
+    }
+    return longest;
+  }
+
+  void begin_paste() {
+    bpasting = true;
+    current = {};
+    counts.pastes++;
+  }
+
+  void end_paste() {
+    bpasting = false;
+    fast_reads = {};
+    if (current > counts.longest)
+      counts.longest = current;
+  }
+
+  bool bpasting = {};
+  bool bread = {};
+  u_int64_t last_us = {};
+  u_int32_t fast_reads = {};
+  u_int64_t current = {};
+  paste_counters_t counts = {};
+};
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * @struct style_t
+ * @brief the rendition of a cell. fg and bg are 256 color palette indexes,
+ * color_default leaves the terminal's own color.
+ */
+struct style_t {
+  static constexpr u_int16_t color_default = 0x100;
+  static constexpr u_int8_t bold = 0x01;
+  static constexpr u_int8_t underline = 0x02;
+  static constexpr u_int8_t reverse = 0x04;
+
+  u_int16_t fg = color_default;
+  u_int16_t bg = color_default;
+  u_int8_t attrs = {};
+
+  bool operator==(const style_t &o) const {
+    return fg == o.fg && bg == o.bg && attrs == o.attrs;
+  }
+  bool operator!=(const style_t &o) const { return !(*this == o); }
+};
+
+/**
+ * @struct cell_t
+ * @brief one character position of the text window. ch is the unicode
+ * code point, every cell is one column wide.
+ */
+struct cell_t {
+  char32_t ch = U' ';
+  style_t style = {};
+
+  bool operator==(const cell_t &o) const {
+    return ch == o.ch && style == o.style;
+  }
+  bool operator!=(const cell_t &o) const { return !(*this == o); }
+};
+
+/**
+ * @struct screen_rect_t
+ * @brief a rectangle of cells, from row, col over rows and columns.
+ */
+struct screen_rect_t {
+  int row = {};
+  int col = {};
+  int rows = {};
+  int columns = {};
+
+  bool empty() const { return rows <= 0 || columns <= 0; }
+
+  screen_rect_t intersect(const screen_rect_t &o) const {
+    int top = std::max(row, o.row);
+    int left = std::max(col, o.col);
+    int bottom = std::min(row + rows, o.row + o.rows);
+    int right = std::min(col + columns, o.col + o.columns);
+    return {top, left, std::max(bottom - top, 0), std::max(right - left, 0)};
+  }
+
+  bool operator==(const screen_rect_t &o) const {
+    return row == o.row && col == o.col && rows == o.rows &&
+           columns == o.columns;
+  }
+  bool operator!=(const screen_rect_t &o) const { return !(*this == o); }
+};
+
+/**
+ * @class screen_grid_t
+ * @brief the cells of the text window, row by row in one block.
+ */
+class screen_grid_t {
+public:
+  screen_grid_t() {}
+  screen_grid_t(int _rows, int _columns) { resize(_rows, _columns); }
+
+  void resize(int _rows, int _columns) {
+    rows_ = _rows;
+    columns_ = _columns;
+    cells.assign(static_cast<std::size_t>(rows_) * columns_, cell_t{});
+  }
+
+  void clear(const style_t &style = {}) {
+    cell_t blank = {};
+    blank.style = style;
+    cells.assign(cells.size(), blank);
+  }
+
+  int rows() const { return rows_; }
+  int columns() const { return columns_; }
+
+  cell_t *row(int r) {
+    return cells.data() + static_cast<std::size_t>(r) * columns_;
+  }
+  const cell_t *row(int r) const {
+    return cells.data() + static_cast<std::size_t>(r) * columns_;
+  }
+
+  cell_t &at(int r, int c) { return row(r)[c]; }
+  const cell_t &at(int r, int c) const { return row(r)[c]; }
+
+  /** @brief sets the cells of area, clipped to the grid, to cell. */
+  void fill(const screen_rect_t &area, const cell_t &cell = {}) {
+    screen_rect_t r = area.intersect({0, 0, rows_, columns_});
+    for (int n = r.row; n < r.row + r.rows; n++)
+      std::fill(row(n) + r.col, row(n) + r.col + r.columns, cell);
+  }
+
+  /**
+   * @fn put_text
+   * @brief writes utf8 text from row r column c, clipped at the end of the
+   * row. Returns the column after the text.
+   */
+  int put_text(int r, int c, const char *utf8, const style_t &style = {}) {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(utf8);
+    while (*p && c < columns_) {
+      char32_t ch = *p++;
+      int extra = ch >= 0xf0 ? 3 : ch >= 0xe0 ? 2 : ch >= 0xc0 ? 1 : 0;
+      if (extra)
+        ch &= 0x3f >> extra;
+      for (; extra && (*p & 0xc0) == 0x80; extra--)
+        ch = (ch << 6) | (*p++ & 0x3f);
+      at(r, c).ch = ch;
+      at(r, c).style = style;
+      c++;
+    }
+    return c;
+  }
+
+  /**
+   * @fn scroll_up
+   * @brief moves every row up by n, the bottom rows become blank.
+   */
+  void scroll_up(int n = 1) {
+    if (n >= rows_) {
+      clear();
+      return;
+    }
+    std::size_t shift = static_cast<std::size_t>(n) * columns_;
+    std::copy(cells.begin() + shift, cells.end(), cells.begin());
+    std::fill(cells.end() - shift, cells.end(), cell_t{});
+  }
+
+  bool operator==(const screen_grid_t &o) const {
+    return rows_ == o.rows_ && columns_ == o.columns_ && cells == o.cells;
+  }
+
+private:
+  int rows_ = {};
+  int columns_ = {};
+  std::vector<cell_t> cells = {};
+};
+
+/**
+ * @fn append_utf8
+ * @brief encodes a code point, returns the number of bytes written to out.
+ */
+inline std::size_t append_utf8(char32_t ch, char *out) {
+  if (ch < 0x80) {
+    out[0] = static_cast<char>(ch);
+    return 1;
+  }
+  if (ch < 0x800) {
+    out[0] = static_cast<char>(0xc0 | (ch >> 6));
+    out[1] = static_cast<char>(0x80 | (ch & 0x3f));
+    return 2;
+  }
+  if (ch < 0x10000) {
+    out[0] = static_cast<char>(0xe0 | (ch >> 12));
+    out[1] = static_cast<char>(0x80 | ((ch >> 6) & 0x3f));
+    out[2] = static_cast<char>(0x80 | (ch & 0x3f));
+    return 3;
+  }
+  out[0] = static_cast<char>(0xf0 | (ch >> 18));
+  out[1] = static_cast<char>(0x80 | ((ch >> 12) & 0x3f));
+  out[2] = static_cast<char>(0x80 | ((ch >> 6) & 0x3f));
+  out[3] = static_cast<char>(0x80 | (ch & 0x3f));
+  return 4;
+}
+
+/**
+ * @fn append_sgr
+ * @brief the select graphic rendition sequence that sets style from a
+ * reset state, returns its length. out must hold 48 bytes. SGR is the same
+ * on every terminal in use so this is not taken from terminfo.
+ */
+inline std::size_t append_sgr(const style_t &style, char *out) {
+  char *p = out;
+  auto put_number = [&p](unsigned n) {
+    char digits[4] = {};
+    int count = {};
+    do {
+      digits[count++] = static_cast<char>('0' + n % 10);
+      n /= 10;
+    } while (n);
+    while (count)
+      *p++ = digits[--count];
+  };
+
+  *p++ = '\x1b';
+  *p++ = '[';
+  *p++ = '0';
+  if (style.attrs & style_t::bold) {
+    *p++ = ';';
+    *p++ = '1';
+  }
+  if (style.attrs & style_t::underline) {
+    *p++ = ';';
+    *p++ = '4';
+  }
+  if (style.attrs & style_t::reverse) {
+    *p++ = ';';
+    *p++ = '7';
+  }
+  if (style.fg != style_t::color_default) {
+    memcpy(p, ";38;5;", 6);
+    p += 6;
+    put_number(style.fg);
+  }
+  if (style.bg != style_t::color_default) {
+    memcpy(p, ";48;5;", 6);
+    p += 6;
+    put_number(style.bg);
+  }
+  *p++ = 'm';
+  return static_cast<std::size_t>(p - out);
+}
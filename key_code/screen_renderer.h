@@ -0,0 +1,238 @@
+#pragma once
+
+#include "cursor_planner.h"
+#include "output_writer.h"
+#include "screen.h"
+#include "terminfo.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @class screen_renderer_t
+ * @brief draws a screen_grid_t by difference. The renderer keeps a copy of
+ * what the terminal shows. Each frame it compares the new grid against it,
+ * row by row, and only the runs of changed cells (dirty spans) are written.
+ * The cursor is taken to each span by cursor_planner_t, which also weighs
+ * reprinting the unchanged cells in between. The frame goes out through the
+ * output writer as one flush.
+ *
+ * Large grids can be rendered on a thread_pool_t. The rows are split into
+ * one band per thread, each band is compared and its escape sequences are
+ * written into a buffer of its own, and the buffers go out in row order as
+ * the one flush. Only the first band knows where the cursor is and what
+ * style is set, the others start with an absolute address and a full SGR,
+ * a few bytes a band.
+ */
+class screen_renderer_t {
+public:
+  /** @brief gaps longer than this are never reprinted, a cursor movement
+   * is always shorter. */
+  static constexpr int reprint_limit = 16;
+
+  screen_renderer_t(const terminal_caps_t &caps, int rows, int columns)
+      : planner(caps, rows, columns) {
+    resize(rows, columns);
+  }
+
+  /**
+   * @fn resize
+   * @brief the window changed size, the next frame is drawn in full.
+   */
+  void resize(int rows, int columns) {
+    front.resize(rows, columns);
+    planner.resize(rows, columns);
+    invalidate();
+  }
+
+  /**
+   * @fn invalidate
+   * @brief forget what the terminal shows, for example after other output
+   * went to it. The next frame is drawn in full.
+   */
+  void invalidate() {
+    cell_t unknown = {};
+    unknown.ch = ~char32_t{};
+    for (int r = 0; r < front.rows(); r++)
+      std::fill(front.row(r), front.row(r) + front.columns(), unknown);
+    pen.row = pen.col = -1;
+    pen.bstyle_known = false;
+  }
+
+  /**
+   * @fn render
+   * @brief writes the difference between next and the terminal and flushes
+   * it. caret_row, caret_col is where the cursor is left, for instance the
+   * insertion point of the line editor. next must be the renderer's size.
+   */
+  void render(const screen_grid_t &next, output_writer_t &out,
+              int caret_row = -1, int caret_col = -1) {
+    for (int r = 0; r < next.rows(); r++)
+      render_row(next, r, pen, out);
+    finish(out, caret_row, caret_col);
+  }
+
+  /**
+   * @fn render
+   * @brief the same, comparing only the cells within regions, for a caller
+   * that knows which parts of next changed. The cost is that of the
+   * regions, not of the grid. Cells outside them are taken to be as shown.
+   */
+  void render(const screen_grid_t &next, output_writer_t &out,
+              const screen_rect_t *regions, std::size_t count,
+              int caret_row = -1, int caret_col = -1) {
+    for (std::size_t i = 0; i < count; i++) {
+      screen_rect_t r =
+          regions[i].intersect({0, 0, next.rows(), next.columns()});
+      for (int n = r.row; n < r.row + r.rows; n++)
+        render_span(next, n, r.col, r.col + r.columns, pen, out);
+    }
+    finish(out, caret_row, caret_col);
+  }
+
+  /**
+   * @fn render
+   * @brief the same frame, with the rows compared and written in bands on
+   * the threads of pool.
+   */
+  void render(const screen_grid_t &next, output_writer_t &out,
+              thread_pool_t &pool, int caret_row = -1, int caret_col = -1) {
+    std::size_t count = std::min<std::size_t>(pool.size(), next.rows());
+    if (count < 2) {
+      render(next, out, caret_row, caret_col);
+      return;
+    }
+    while (bands.size() < count)
+      bands.push_back(std::make_unique<band_t>());
+
+    pool.run(count, [&](std::size_t b) {
+      band_t &band = *bands[b];
+      int first = static_cast<int>(b * next.rows() / count);
+      int last = static_cast<int>((b + 1) * next.rows() / count);
+      band.pen = b ? pen_t{} : pen;
+      for (int r = first; r < last; r++)
+        render_row(next, r, band.pen, band.out);
+    });
+
+    for (std::size_t b = 0; b < count; b++) {
+      band_t &band = *bands[b];
+      if (b == 0 || band.out.pending())
+        std::swap(pen, band.pen);
+      out.write(band.out.data(), band.out.pending());
+      band.out.clear();
+    }
+    finish(out, caret_row, caret_col);
+  }
+
+  /**
+   * @fn shown
+   * @brief what the renderer believes the terminal shows.
+   */
+  const screen_grid_t &shown() const { return front; }
+
+private:
+  /**
+   * @struct pen_t
+   * @brief where the cursor is and the style set, as far as the output
+   * written so far goes. reprint is scratch for move_to.
+   */
+  struct pen_t {
+    int row = -1;
+    int col = -1;
+    style_t style = {};
+    bool bstyle_known = {};
+    std::string reprint = {};
+  };
+
+  struct band_t {
+    output_writer_t out{output_writer_t::capture, 4 << 10};
+    pen_t pen = {};
+  };
+
+  void finish(output_writer_t &out, int caret_row, int caret_col) {
+    if (caret_row >= 0 && caret_col >= 0) {
+      planner.move(out, pen.row, pen.col, caret_row, caret_col);
+      pen.row = caret_row;
+      pen.col = caret_col;
+    }
+    out.flush();
+  }
+
+  void render_row(const screen_grid_t &next, int r, pen_t &p,
+                  output_writer_t &out) {
+    render_span(next, r, 0, next.columns(), p, out);
+  }
+
+  /** @brief the changed cells of row r from column from to before to. */
+  void render_span(const screen_grid_t &next, int r, int from, int to,
+                   pen_t &p, output_writer_t &out) {
+    const cell_t *want = next.row(r);
+    // a band's rows of front are written by its thread alone.
+    cell_t *have = front.row(r);
+    int columns = next.columns();
+
+    int c = from;
+    while (c < to) {
+      while (c < to && want[c] == have[c])
+        c++;
+      if (c == to)
+        break;
+      int start = c;
+      while (c < to && want[c] != have[c])
+        c++;
+
+      move_to(r, start, have, p, out);
+      for (int n = start; n < c; n++)
+        put_cell(want[n], p, out);
+      std::copy(want + start, want + c, have + start);
+
+      p.row = r;
+      p.col = c;
+      // the cursor waits at the last column for the next character, where
+      // it will be depends on the terminal. Treat it as unknown.
+      if (c == columns)
+        p.row = p.col = -1;
+    }
+  }
+
+  /**
+   * @brief moves to r, col. When the cursor is to the left on the same row
+   * and the cells in between are in the current style, their text is
+   * offered to the planner as the reprint option.
+   */
+  void move_to(int r, int col, const cell_t *have, pen_t &p,
+               output_writer_t &out) const {
+    p.reprint.clear();
+    bool breprint = p.bstyle_known && p.row == r && p.col >= 0 &&
+                    p.col < col && col - p.col <= reprint_limit;
+    for (int n = p.col; breprint && n < col; n++) {
+      if (have[n].style != p.style) {
+        breprint = false;
+        break;
+      }
+      char utf8[4] = {};
+      p.reprint.append(utf8, append_utf8(have[n].ch, utf8));
+    }
+    planner.move(out, p.row, p.col, r, col,
+                 breprint ? p.reprint.data() : nullptr, p.reprint.size());
+  }
+
+  static void put_cell(const cell_t &cell, pen_t &p, output_writer_t &out) {
+    if (!p.bstyle_known || cell.style != p.style) {
+      char sgr[48] = {};
+      out.write(sgr, append_sgr(cell.style, sgr));
+      p.style = cell.style;
+      p.bstyle_known = true;
+    }
+    char utf8[4] = {};
+    out.write(utf8, append_utf8(cell.ch, utf8));
+  }
+
+  screen_grid_t front = {};
+  cursor_planner_t planner;
+  pen_t pen = {};
+  std::vector<std::unique_ptr<band_t>> bands = {};
+};
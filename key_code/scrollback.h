@@ -0,0 +1,499 @@
+#pragma once
+
+#include "key_decoder.h"
+#include "lz_codec.h"
+#include "screen.h"
+#include "text_search.h"
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @struct scrollback_match_t
+ * @brief where a search matched, the line number and the byte offset into
+ * the line's utf8 text.
+ */
+struct scrollback_match_t {
+  u_int64_t line = {};
+  u_int32_t column = {};
+  bool bfound = {};
+};
+
+/**
+ * @struct scrollback_block_t
+ * @brief lines packed and compressed. text_size is the length of their
+ * text, size that of the text and the style runs before compression.
+ */
+struct scrollback_block_t {
+  u_int64_t first = {};
+  u_int32_t lines = {};
+  u_int32_t text_size = {};
+  u_int32_t size = {};
+  std::vector<u_int8_t> data = {};
+};
+
+/**
+ * @class scrollback_t
+ * @brief the lines that scrolled off a pane. The newest hot_lines are kept
+ * as cells, ready to draw. Older ones are packed block_lines at a time into
+ * compressed blocks. A block holds the utf8 text of its lines, one per
+ * newline, followed by their style runs, each a cell count and an index
+ * into the scrollback's style dictionary, and the whole is compressed with
+ * lz_compress. Past max_lines the oldest block is dropped.
+ *
+ * Lines are numbered from the first ever pushed. Searches run over the
+ * text of the blocks, decompressed one at a time, with text_find and
+ * text_rfind. The last block decompressed is cached, which makes reading
+ * and searching not thread safe.
+ */
+class scrollback_t {
+public:
+  std::size_t hot_lines = 1024;
+  std::size_t block_lines = 256;
+  std::size_t max_lines = 100000;
+
+  /**
+   * @fn push
+   * @brief appends a line, its trailing blank cells are not kept.
+   */
+  void push(const cell_t *cells, int columns) {
+    int n = columns;
+    while (n > 0 && cells[n - 1] == cell_t{})
+      n--;
+    hot.emplace_back(cells, cells + n);
+    end++;
+    if (hot.size() >= hot_lines + block_lines)
+      pack();
+    while (end - first > max_lines) {
+      if (!blocks.empty()) {
+        first += blocks.front().lines;
+        stored -= blocks.front().data.capacity();
+        blocks.pop_front();
+        cache.first = ~u_int64_t{};
+      } else {
+        hot.pop_front();
+        first++;
+      }
+    }
+  }
+
+  u_int64_t first_line() const { return first; }
+  u_int64_t end_line() const { return end; }
+  std::size_t size() const { return end - first; }
+  std::size_t block_count() const { return blocks.size(); }
+
+  /**
+   * @fn stored_bytes
+   * @brief the memory the lines take, the hot cells, the compressed blocks
+   * and the style dictionary.
+   */
+  std::size_t stored_bytes() const {
+    std::size_t bytes = stored + styles.capacity() * sizeof(style_t);
+    for (auto &line : hot)
+      bytes += line.capacity() * sizeof(cell_t);
+    return bytes;
+  }
+
+  /**
+   * @fn line
+   * @brief the cells of line n, false when it is no longer kept.
+   */
+  bool line(u_int64_t n, std::vector<cell_t> &out) const {
+    out.clear();
+    if (n < first || n >= end)
+      return false;
+    if (n >= hot_first()) {
+      auto &cells = hot[n - hot_first()];
+      out.assign(cells.begin(), cells.end());
+      return true;
+    }
+    const decoded_t &d = decode(block_of(n));
+    std::size_t i = n - d.first;
+    const char *p = d.bytes.data() + d.text_starts[i];
+    const char *text_end = d.bytes.data() + d.text_starts[i + 1] - 1;
+    const u_int8_t *runs =
+        reinterpret_cast<const u_int8_t *>(d.bytes.data()) +
+        d.style_starts[i];
+    std::size_t count = get_varint(runs);
+    for (std::size_t r = 0; r < count; r++) {
+      std::size_t cells = get_varint(runs);
+      style_t style = styles[get_varint(runs)];
+      for (std::size_t c = 0; c < cells && p < text_end; c++) {
+        cell_t cell = {};
+        cell.ch = next_utf8(p, text_end);
+        cell.style = style;
+        out.push_back(cell);
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @fn find_older
+   * @brief the last match of needle before line, column, searching back
+   * towards the oldest line.
+   */
+  scrollback_match_t find_older(const std::string &needle, u_int64_t line,
+                                u_int32_t column) const {
+    if (!searchable(needle) || first == end)
+      return {};
+    if (line >= end) {
+      line = end - 1;
+      column = ~u_int32_t{};
+    }
+    for (u_int64_t l = line + 1; l-- > std::max(hot_first(), first);) {
+      hot_text(l);
+      std::size_t until = l == line ? column : text_npos;
+      std::size_t at = text_rfind(scratch.data(), scratch.size(),
+                                  needle.data(), needle.size(), until);
+      if (at != text_npos)
+        return {l, static_cast<u_int32_t>(at), true};
+    }
+    if (line >= hot_first()) {
+      line = hot_first();
+      column = 0;
+    }
+    for (std::size_t b = blocks.size(); b-- > 0;) {
+      const scrollback_block_t &block = blocks[b];
+      if (block.first > line)
+        continue;
+      const decoded_t &d = decode(b);
+      std::size_t until = d.text_size;
+      if (line < block.first + block.lines)
+        until = std::min<std::size_t>(
+            d.text_starts[line - block.first] + column,
+            d.text_starts[line - block.first + 1]);
+      std::size_t at = text_rfind(d.bytes.data(), d.text_size,
+                                  needle.data(), needle.size(), until);
+      if (at != text_npos)
+        return located(d, at);
+    }
+    return {};
+  }
+
+  /**
+   * @fn find_newer
+   * @brief the first match of needle at or after line, column, searching
+   * on towards the newest line.
+   */
+  scrollback_match_t find_newer(const std::string &needle, u_int64_t line,
+                                u_int32_t column) const {
+    if (!searchable(needle) || line >= end)
+      return {};
+    if (line < first) {
+      line = first;
+      column = 0;
+    }
+    for (std::size_t b = 0; b < blocks.size() && line < hot_first(); b++) {
+      const scrollback_block_t &block = blocks[b];
+      if (block.first + block.lines <= line)
+        continue;
+      const decoded_t &d = decode(b);
+      std::size_t from = {};
+      if (line >= block.first)
+        from = std::min<std::size_t>(
+            d.text_starts[line - block.first] + column, d.text_size);
+      std::size_t at = text_find(d.bytes.data(), d.text_size, needle.data(),
+                                 needle.size(), from);
+      if (at != text_npos)
+        return located(d, at);
+    }
+    for (u_int64_t l = std::max(line, hot_first()); l < end; l++) {
+      hot_text(l);
+      std::size_t from = l == line ? column : 0;
+      if (from > scratch.size())
+        continue;
+      std::size_t at = text_find(scratch.data(), scratch.size(),
+                                 needle.data(), needle.size(), from);
+      if (at != text_npos)
+        return {l, static_cast<u_int32_t>(at), true};
+    }
+    return {};
+  }
+
+  const scrollback_block_t &block(std::size_t i) const { return blocks[i]; }
+  std::size_t hot_count() const { return hot.size(); }
+  const std::vector<cell_t> &hot_line(std::size_t i) const { return hot[i]; }
+  const std::vector<style_t> &style_table() const { return styles; }
+
+  /**
+   * @fn restore
+   * @brief takes over lines saved elsewhere, a snapshot of another
+   * scrollback: the style dictionary the blocks index, the blocks and the
+   * hot lines, the newest last.
+   */
+  void restore(u_int64_t _first, std::vector<style_t> _styles,
+               std::deque<scrollback_block_t> _blocks,
+               std::deque<std::vector<cell_t>> _hot) {
+    styles = std::move(_styles);
+    blocks = std::move(_blocks);
+    hot = std::move(_hot);
+    style_indexes.clear();
+    for (std::size_t i = 0; i < styles.size(); i++)
+      style_indexes[style_key(styles[i])] = static_cast<u_int32_t>(i);
+    first = _first;
+    end = first + hot.size();
+    stored = {};
+    for (auto &block : blocks) {
+      end += block.lines;
+      stored += block.data.capacity();
+    }
+    cache.first = ~u_int64_t{};
+  }
+
+private:
+  /**
+   * @brief a block decompressed, with where each line's text and style
+   * runs start. text_starts has one more entry, the end of the text.
+   */
+  struct decoded_t {
+    u_int64_t first = ~u_int64_t{};
+    std::size_t text_size = {};
+    std::string bytes = {};
+    std::vector<u_int32_t> text_starts = {};
+    std::vector<u_int32_t> style_starts = {};
+  };
+
+  u_int64_t hot_first() const { return end - hot.size(); }
+
+  std::size_t block_of(u_int64_t n) const {
+    return static_cast<std::size_t>((n - blocks.front().first) /
+                                    block_lines);
+  }
+
+  /** @brief needles span no lines, matches never cross one. */
+  static bool searchable(const std::string &needle) {
+    return !needle.empty() && needle.find('\n') == std::string::npos;
+  }
+
+  /**
+   * @brief packs the oldest block_lines hot lines into a block.
+   */
+  void pack() {
+    text.clear();
+    runs.clear();
+    for (std::size_t i = 0; i < block_lines; i++) {
+      auto &cells = hot[i];
+      std::size_t count = {};
+      for (std::size_t c = 0; c < cells.size(); c++)
+        if (c == 0 || cells[c].style != cells[c - 1].style)
+          count++;
+      put_varint(runs, count);
+      std::size_t start = {};
+      for (std::size_t c = 0; c <= cells.size(); c++) {
+        if (c < cells.size()) {
+          char utf8[4] = {};
+          text.append(utf8, append_utf8(cells[c].ch, utf8));
+        }
+        if (c > start &&
+            (c == cells.size() || cells[c].style != cells[start].style)) {
+          put_varint(runs, c - start);
+          put_varint(runs, style_index(cells[start].style));
+          start = c;
+        }
+      }
+      text.push_back('\n');
+    }
+
+    scrollback_block_t block = {};
+    block.first = hot_first();
+    block.lines = static_cast<u_int32_t>(block_lines);
+    block.text_size = static_cast<u_int32_t>(text.size());
+    text.append(runs.begin(), runs.end());
+    block.size = static_cast<u_int32_t>(text.size());
+    lz_compress(reinterpret_cast<const u_int8_t *>(text.data()),
+                text.size(), block.data);
+    block.data.shrink_to_fit();
+    stored += block.data.capacity();
+    blocks.push_back(std::move(block));
+    hot.erase(hot.begin(), hot.begin() + block_lines);
+  }
+
+  static u_int32_t style_key(const style_t &style) {
+    return style.fg | style.bg << 9 | style.attrs << 18;
+  }
+
+  std::size_t style_index(const style_t &style) {
+    u_int32_t key = style_key(style);
+    auto it = style_indexes.find(key);
+    if (it != style_indexes.end())
+      return it->second;
+    styles.push_back(style);
+    style_indexes[key] = static_cast<u_int32_t>(styles.size() - 1);
+    return styles.size() - 1;
+  }
+
+  const decoded_t &decode(std::size_t b) const {
+    const scrollback_block_t &block = blocks[b];
+    if (cache.first == block.first)
+      return cache;
+    cache.first = ~u_int64_t{};
+    if (!lz_decompress(block.data.data(), block.data.size(), block.size,
+                       cache.bytes))
+      cache.bytes.assign(block.size, '\n');
+    cache.text_size = block.text_size;
+    cache.text_starts.clear();
+    cache.text_starts.push_back(0);
+    for (std::size_t i = 0; i < block.text_size; i++)
+      if (cache.bytes[i] == '\n')
+        cache.text_starts.push_back(static_cast<u_int32_t>(i + 1));
+    cache.style_starts.clear();
+    const u_int8_t *base =
+        reinterpret_cast<const u_int8_t *>(cache.bytes.data());
+    const u_int8_t *p = base + block.text_size;
+    for (u_int32_t l = 0; l < block.lines; l++) {
+      cache.style_starts.push_back(static_cast<u_int32_t>(p - base));
+      std::size_t count = get_varint(p);
+      for (std::size_t r = 0; r < 2 * count; r++)
+        get_varint(p);
+    }
+    cache.first = block.first;
+    return cache;
+  }
+
+  scrollback_match_t located(const decoded_t &d, std::size_t at) const {
+    auto it = std::upper_bound(d.text_starts.begin(), d.text_starts.end(),
+                               static_cast<u_int32_t>(at));
+    std::size_t i = static_cast<std::size_t>(it - d.text_starts.begin()) - 1;
+    return {d.first + i, static_cast<u_int32_t>(at - d.text_starts[i]),
+            true};
+  }
+
+  /** @brief the utf8 text of hot line l into scratch. */
+  void hot_text(u_int64_t l) const {
+    scratch.clear();
+    for (auto &cell : hot[l - hot_first()]) {
+      char utf8[4] = {};
+      scratch.append(utf8, append_utf8(cell.ch, utf8));
+    }
+  }
+
+  static void put_varint(std::vector<u_int8_t> &out, std::size_t v) {
+    for (; v >= 0x80; v >>= 7)
+      out.push_back(static_cast<u_int8_t>(v | 0x80));
+    out.push_back(static_cast<u_int8_t>(v));
+  }
+
+  static std::size_t get_varint(const u_int8_t *&p) {
+    std::size_t v = {};
+    for (int shift = 0;; shift += 7) {
+      u_int8_t b = *p++;
+      v |= static_cast<std::size_t>(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        return v;
+    }
+  }
+
+  static char32_t next_utf8(const char *&p, const char *end) {
+    char32_t ch = static_cast<unsigned char>(*p++);
+    int extra = ch >= 0xf0 ? 3 : ch >= 0xe0 ? 2 : ch >= 0xc0 ? 1 : 0;
+    if (extra)
+      ch &= 0x3f >> extra;
+    for (; extra && p < end; extra--)
+      ch = (ch << 6) | (*p++ & 0x3f);
+    return ch;
+  }
+
+  std::deque<std::vector<cell_t>> hot = {};
+  std::deque<scrollback_block_t> blocks = {};
+  std::vector<style_t> styles = {};
+  std::unordered_map<u_int32_t, u_int32_t> style_indexes = {};
+  u_int64_t first = {};
+  u_int64_t end = {};
+  std::size_t stored = {};
+  std::string text = {};
+  std::vector<u_int8_t> runs = {};
+  mutable decoded_t cache = {};
+  mutable std::string scratch = {};
+};
+
+/**
+ * @class scrollback_search_t
+ * @brief the incremental search of a scrollback, driven by decoded keys.
+ * Typed characters extend the query and the match moves back to the
+ * nearest older line that holds it, starting from the current match as a
+ * longer query can only match where the shorter one did or further back.
+ * BACKSPACE returns to the match of the shorter query. UP_ARROW or CTRL R
+ * goes to the next older match, DOWN_ARROW or CTRL S to the next newer one.
+ * ENTER keeps the match and ESC drops it, both end the search.
+ */
+class scrollback_search_t {
+public:
+  explicit scrollback_search_t(const scrollback_t &_scrollback)
+      : scrollback(_scrollback) {}
+
+  /**
+   * @fn start
+   * @brief a new search from the newest line back.
+   */
+  void start() {
+    text.clear();
+    matches.clear();
+    current = {};
+    bactive = true;
+  }
+
+  /**
+   * @fn key
+   * @brief handles a keystroke, returns false when it ended the search.
+   */
+  bool key(const key_event_t &e) {
+    if (!bactive)
+      return false;
+    if (e.vk == vkey_t::ENTER || e.vk == vkey_t::ESC) {
+      if (e.vk == vkey_t::ESC)
+        current = {};
+      bactive = false;
+      return false;
+    }
+    if (e.vk == vkey_t::BACKSPACE) {
+      if (!text.empty()) {
+        text.pop_back();
+        matches.pop_back();
+        current = matches.empty() ? scrollback_match_t{} : matches.back();
+      }
+    } else if (e.vk == vkey_t::UP_ARROW || (e.vk == vkey_t::none &&
+                                            e.c == '\x12')) {
+      if (current.bfound) {
+        auto older = scrollback.find_older(text, current.line,
+                                           current.column);
+        if (older.bfound)
+          current = older;
+      }
+    } else if (e.vk == vkey_t::DOWN_ARROW || (e.vk == vkey_t::none &&
+                                              e.c == '\x13')) {
+      if (current.bfound) {
+        auto newer = scrollback.find_newer(text, current.line,
+                                           current.column + 1);
+        if (newer.bfound)
+          current = newer;
+      }
+    } else if (e.vk == vkey_t::none && static_cast<unsigned char>(e.c) >=
+                                           0x20) {
+      text.push_back(e.c);
+      bool bfirst = matches.empty();
+      if (bfirst)
+        current = scrollback.find_older(text, ~u_int64_t{}, 0);
+      else if (current.bfound)
+        current = scrollback.find_older(text, current.line,
+                                         current.column + 1);
+      matches.push_back(current);
+    }
+    return true;
+  }
+
+  bool active() const { return bactive; }
+  const std::string &query() const { return text; }
+  const scrollback_match_t &match() const { return current; }
+
+private:
+  const scrollback_t &scrollback;
+  std::string text = {};
+  std::vector<scrollback_match_t> matches = {};
+  scrollback_match_t current = {};
+  bool bactive = {};
+};
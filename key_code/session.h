@@ -0,0 +1,325 @@
+#pragma once
+
+#include "key_decoder.h"
+#include "memory_accounting.h"
+#include "osc52.h"
+#include "paste_detector.h"
+#include "output_writer.h"
+#include "screen.h"
+#include "screen_renderer.h"
+#include "scrollback.h"
+#include "terminal_policy.h"
+#include "terminfo.h"
+#include "timer_wheel.h"
+#include "token_bucket.h"
+#include "typeahead.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @class session_t
+ * @brief one terminal served by the process: its key decoder, the buffer
+ * input is read into, the OSC 52 clipboard buffer, the screen the
+ * application draws and the lines that scrolled off it, the renderer with
+ * its copy of what the terminal shows and the output buffer. Each part is
+ * allocated within a memory_scope_t of the session's own account, so
+ * footprint() tells what the session costs, part by part. The decoder's
+ * keymap is shared by every session and charged once to the process. The
+ * wait for the rest of an escape sequence is a timer on the worker's
+ * timer_wheel_t, not a read with a timeout. So is the wait of a session
+ * that spent its input budget, see session_loop_t. Its typeahead_t puts
+ * off frames while more input waits.
+ */
+class session_t {
+public:
+  static constexpr std::size_t input_capacity = 4 << 10;
+  static constexpr std::size_t clipboard_capacity = 64 << 10;
+  static constexpr std::size_t output_capacity = 16 << 10;
+  /** @brief the kind of the escape timer. */
+  static constexpr int escape_timeout = 0;
+  /** @brief the kind of the timer that ends a deferral. */
+  static constexpr int resume_timeout = 1;
+  /** @brief the kind of the timer that ends a paste nothing followed. */
+  static constexpr int paste_timeout = 2;
+
+  session_t(terminal_policy_t policy, const terminal_caps_t &caps, int rows,
+            int columns, int _fd = -1)
+      : fd_(_fd) {
+    memory_accounts().charge(tag(memory_subsystem_t::session),
+                             sizeof(*this));
+    {
+      memory_scope_t scope(0, memory_subsystem_t::keymap);
+      default_virtual_key_map();
+    }
+    {
+      memory_scope_t scope(id.value, memory_subsystem_t::decoder);
+      decoder_ = std::make_unique<terminal_decoder_t>(policy);
+    }
+    {
+      memory_scope_t scope(id.value, memory_subsystem_t::input);
+      input.resize(input_capacity);
+    }
+    {
+      memory_scope_t scope(id.value, memory_subsystem_t::clipboard);
+      clipboard.resize(clipboard_capacity);
+      clipboard_reader = std::make_unique<osc52_reader_t>(
+          clipboard.data(), clipboard.size(),
+          [this](const u_int8_t *, std::size_t, bool final) {
+            if (final)
+              clipboard_payloads++;
+          });
+      decoder_->set_osc_listener(clipboard_reader.get());
+    }
+    {
+      memory_scope_t scope(id.value, memory_subsystem_t::screen);
+      screen_.resize(rows, columns);
+    }
+    {
+      memory_scope_t scope(id.value, memory_subsystem_t::renderer);
+      renderer = std::make_unique<screen_renderer_t>(caps, rows, columns);
+    }
+    {
+      memory_scope_t scope(id.value, memory_subsystem_t::output);
+      output = std::make_unique<output_writer_t>(fd_, output_capacity);
+    }
+  }
+
+  ~session_t() {
+    memory_accounts().discharge(tag(memory_subsystem_t::session),
+                                sizeof(*this));
+  }
+
+  session_t(const session_t &) = delete;
+  session_t &operator=(const session_t &) = delete;
+
+  int fd() const { return fd_; }
+  u_int32_t account() const { return id.value; }
+  terminal_policy_t policy() const { return decoder_->policy(); }
+  terminal_decoder_t &decoder() { return *decoder_; }
+  screen_grid_t &screen() { return screen_; }
+  const screen_grid_t &screen() const { return screen_; }
+  scrollback_t &scrollback() { return scrollback_; }
+  const scrollback_t &scrollback() const { return scrollback_; }
+  output_writer_t &writer() { return *output; }
+  std::size_t clipboard_received() const { return clipboard_payloads; }
+
+  /**
+   * @fn read_input
+   * @brief reads what is waiting on fd, no more than limit bytes, and
+   * decodes it, on_key is called for every keystroke. Returns what read()
+   * returned.
+   */
+  template <typename F>
+  ssize_t read_input(F &&on_key, std::size_t limit = input_capacity) {
+    ssize_t n = {};
+    do {
+      n = ::read(fd_, input.data(), std::min(limit, input.size()));
+    } while (n < 0 && errno == EINTR);
+    if (n > 0)
+      feed(input.data(), static_cast<std::size_t>(n), on_key);
+    return n;
+  }
+
+  /**
+   * @fn read_input
+   * @brief as above, the input read at now_us, a paste detected from the
+   * timing is handed to on_text in runs, see paste_detector_t.
+   */
+  template <typename K, typename T>
+  ssize_t read_input(u_int64_t now_us, K &&on_key, T &&on_text,
+                     std::size_t limit = input_capacity) {
+    ssize_t n = {};
+    do {
+      n = ::read(fd_, input.data(), std::min(limit, input.size()));
+    } while (n < 0 && errno == EINTR);
+    if (n > 0)
+      feed(input.data(), static_cast<std::size_t>(n), now_us, on_key,
+           on_text);
+    return n;
+  }
+
+  /**
+   * @fn input_pending
+   * @brief bytes wait on fd, a frame drawn now would be stale at once.
+   */
+  bool input_pending() const { return ::input_pending(fd_); }
+
+  /**
+   * @fn feed
+   * @brief decodes input that was read elsewhere.
+   */
+  template <typename F> void feed(const char *p, std::size_t len, F &&on_key) {
+    memory_scope_t scope(id.value, memory_subsystem_t::decoder);
+    decoder_->feed(p, len, on_key);
+  }
+
+  /**
+   * @fn feed
+   * @brief decodes input read at now_us, a paste detected from the timing
+   * is handed to on_text in runs, see paste_detector_t.
+   */
+  template <typename K, typename T>
+  void feed(const char *p, std::size_t len, u_int64_t now_us, K &&on_key,
+            T &&on_text) {
+    memory_scope_t scope(id.value, memory_subsystem_t::decoder);
+    paste_.feed(*decoder_, p, len, now_us, on_key, on_text);
+  }
+
+  paste_detector_t &paste() { return paste_; }
+  typeahead_t &typeahead() { return typeahead_; }
+
+  /**
+   * @fn arm_escape_timer
+   * @brief when the input read last ended part way into an escape
+   * sequence, gives the rest wait ticks on wheel, otherwise cancels the
+   * wait. Call it after every read.
+   */
+  void arm_escape_timer(timer_wheel_t &wheel, u_int64_t wait) {
+    if (decoder_->escape_pending())
+      wheel.schedule(escape_timer, wheel.now() + wait);
+    else
+      wheel.cancel(escape_timer);
+  }
+
+  /**
+   * @fn arm_paste_timer
+   * @brief while a paste is in progress, wakes the loop wait ticks on
+   * wheel to end it should nothing more arrive, otherwise cancels the
+   * wait. Call it after every read and when the timer fired.
+   */
+  void arm_paste_timer(timer_wheel_t &wheel, u_int64_t wait) {
+    if (paste_.pasting())
+      wheel.schedule(paste_timer, wheel.now() + wait);
+    else
+      wheel.cancel(paste_timer);
+  }
+
+  /** @brief takes the session's timers off wheel. */
+  void cancel_timers(timer_wheel_t &wheel) {
+    wheel.cancel(escape_timer);
+    wheel.cancel(resume_timer);
+    wheel.cancel(paste_timer);
+  }
+
+  /**
+   * @fn byte_budget
+   * @brief the bytes of input the session may have decoded, refilled
+   * every quantum by the worker's loop. event_budget is the keystrokes.
+   */
+  token_bucket_t &byte_budget() { return bytes_budget; }
+  token_bucket_t &event_budget() { return events_budget; }
+
+  /**
+   * @fn defer
+   * @brief the session spent its budget, its input stays unread until
+   * tick, when the resume timer fires on wheel. The escape timer is
+   * cancelled meanwhile, the rest of a sequence may be among what waits.
+   */
+  void defer(timer_wheel_t &wheel, u_int64_t tick) {
+    wheel.cancel(escape_timer);
+    wheel.schedule(resume_timer, tick);
+  }
+
+  /** @brief input is left unread until the resume timer fires. */
+  bool deferred() const { return resume_timer.scheduled(); }
+
+  /**
+   * @fn escape_expired
+   * @brief the escape timer fired, nothing more came and what is pending
+   * is dispatched, a lone ESC as the ESC key. The timer's context is the
+   * session.
+   */
+  template <typename F> void escape_expired(F &&on_key) {
+    memory_scope_t scope(id.value, memory_subsystem_t::decoder);
+    decoder_->flush(on_key);
+  }
+
+  /**
+   * @fn render
+   * @brief draws the screen to the terminal by difference.
+   */
+  void render(int caret_row = -1, int caret_col = -1) {
+    memory_scope_t scope(id.value, memory_subsystem_t::renderer);
+    renderer->render(screen_, *output, caret_row, caret_col);
+  }
+
+  /**
+   * @fn scroll
+   * @brief scrolls the screen up by n rows, the rows leaving the top go to
+   * the scrollback.
+   */
+  void scroll(int n = 1) {
+    {
+      memory_scope_t scope(id.value, memory_subsystem_t::scrollback);
+      for (int r = 0; r < n && r < screen_.rows(); r++)
+        scrollback_.push(screen_.row(r), screen_.columns());
+    }
+    screen_.scroll_up(n);
+  }
+
+  /**
+   * @fn restore_scrollback
+   * @brief takes over saved lines, see scrollback_t::restore.
+   */
+  void restore_scrollback(u_int64_t first, std::vector<style_t> styles,
+                          std::deque<scrollback_block_t> blocks,
+                          std::deque<std::vector<cell_t>> hot) {
+    memory_scope_t scope(id.value, memory_subsystem_t::scrollback);
+    scrollback_.restore(first, std::move(styles), std::move(blocks),
+                        std::move(hot));
+  }
+
+  void resize(int rows, int columns) {
+    {
+      memory_scope_t scope(id.value, memory_subsystem_t::screen);
+      screen_.resize(rows, columns);
+    }
+    memory_scope_t scope(id.value, memory_subsystem_t::renderer);
+    renderer->resize(rows, columns);
+  }
+
+  /**
+   * @fn footprint
+   * @brief the heap the session holds and the most it ever held.
+   */
+  memory_footprint_t footprint() const {
+    return memory_accounts().footprint(id.value);
+  }
+
+private:
+  /**
+   * @brief the session's account, first among the members so it is
+   * released after everything charged to it was freed.
+   */
+  struct account_t {
+    u_int32_t value = memory_accounts().acquire();
+    ~account_t() { memory_accounts().release(value); }
+  };
+
+  u_int32_t tag(memory_subsystem_t subsystem) const {
+    return memory_accounts_t::tag(id.value, subsystem);
+  }
+
+  account_t id = {};
+  int fd_ = -1;
+  std::unique_ptr<terminal_decoder_t> decoder_ = {};
+  std::vector<char> input = {};
+  std::vector<u_int8_t> clipboard = {};
+  std::unique_ptr<osc52_reader_t> clipboard_reader = {};
+  std::size_t clipboard_payloads = {};
+  screen_grid_t screen_ = {};
+  scrollback_t scrollback_ = {};
+  std::unique_ptr<screen_renderer_t> renderer = {};
+  std::unique_ptr<output_writer_t> output = {};
+  wheel_timer_t escape_timer{this, escape_timeout};
+  wheel_timer_t resume_timer{this, resume_timeout};
+  wheel_timer_t paste_timer{this, paste_timeout};
+  token_bucket_t bytes_budget = {};
+  token_bucket_t events_budget = {};
+  paste_detector_t paste_ = {};
+  typeahead_t typeahead_ = {};
+};
@@ -0,0 +1,321 @@
+#pragma once
+
+#include "common.h"
+#include "session.h"
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @struct loop_counters_t
+ * @brief why the loop woke: input, an armed timer, or neither, a signal
+ * for instance. deferrals are the times a session spent its input budget
+ * and was set aside, resumes the times it was taken back.
+ */
+struct loop_counters_t {
+  u_int64_t wakeups = {};
+  u_int64_t input = {};
+  u_int64_t timers = {};
+  u_int64_t spurious = {};
+  u_int64_t deferrals = {};
+  u_int64_t resumes = {};
+};
+
+/**
+ * @struct input_budget_t
+ * @brief how much input a session may have decoded per quantum_ms, in
+ * bytes and in keystrokes, each a token bucket that holds one quantum's
+ * budget. 0 is no limit.
+ */
+struct input_budget_t {
+  u_int64_t bytes = {};
+  u_int64_t events = {};
+  u_int64_t quantum_ms = 10;
+};
+
+/**
+ * @class session_loop_t
+ * @brief the event loop of a worker: the sessions' fds in an epoll set and
+ * the worker's timer wheel, ticking in milliseconds. Nothing is polled.
+ * The loop sleeps until input arrives or the earliest armed timer is due,
+ * and with no timer armed it sleeps until input arrives, however long, so
+ * an idle session costs no wakeups. The terminals are read with VMIN 1 and
+ * VTIME 0, never with a timed read, and the wait for the rest of an escape
+ * sequence is the session's escape timer. Reads go through the session's
+ * paste detector, and a paste that nothing followed is ended by its paste
+ * timer. Each key or pasted run handled is a change to the session's
+ * screen, drawn with render() once its typeahead_t is ready, that is once
+ * no more input waits or the oldest change is max_stale_ns old. The wait
+ * ends no later than that, for a session whose input waits while it is
+ * deferred.
+ *
+ * A session that pastes or floods keys would take the worker's decode
+ * time from the others. With an input budget each session reads no more
+ * than its buckets hold, and one that spent them is taken out of the epoll
+ * set until they are full again, when its resume timer puts it back. Its
+ * input waits in the kernel meanwhile, and the keys of the other sessions
+ * wait for no more than a quantum's budget of each flood.
+ */
+class session_loop_t {
+public:
+  /** @brief how long the rest of an escape sequence is waited for. */
+  u_int64_t escape_wait_ms = 100;
+  /** @brief the input budget of sessions added from now on. */
+  input_budget_t budget = {};
+
+  session_loop_t() : start_ns(steady_now_ns()) {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    stopfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, stopfd, &ev);
+  }
+
+  ~session_loop_t() {
+    close(stopfd);
+    close(epfd);
+  }
+
+  session_loop_t(const session_loop_t &) = delete;
+  session_loop_t &operator=(const session_loop_t &) = delete;
+
+  bool add(session_t &s) {
+    set_budget(s, budget);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &s;
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, s.fd(), &ev) == 0;
+  }
+
+  void remove(session_t &s) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, s.fd(), nullptr);
+    s.cancel_timers(wheel);
+    undrawn.erase(std::remove(undrawn.begin(), undrawn.end(), &s),
+                  undrawn.end());
+  }
+
+  /**
+   * @fn set_budget
+   * @brief gives s its own input budget, full.
+   */
+  void set_budget(session_t &s, const input_budget_t &b) {
+    u_int64_t now = now_ns();
+    u_int64_t quantum = b.quantum_ms * 1000000;
+    s.byte_budget() = b.bytes ? token_bucket_t(b.bytes, quantum, now)
+                              : token_bucket_t();
+    s.event_budget() = b.events ? token_bucket_t(b.events, quantum, now)
+                                : token_bucket_t();
+  }
+
+  /**
+   * @fn stop
+   * @brief makes run_once return false, from any thread.
+   */
+  void stop() {
+    u_int64_t one = 1;
+    if (write(stopfd, &one, sizeof(one)) < 0)
+      return;
+  }
+
+  /**
+   * @fn timeout_ms
+   * @brief how long the next wait may sleep, until the earliest armed
+   * timer or frame deadline, -1 for as long as it takes when there is
+   * neither.
+   */
+  int timeout_ms() const {
+    u_int64_t due = ~u_int64_t{};
+    for (session_t *s : undrawn)
+      due = std::min(due, s->typeahead().deadline());
+    if (wheel.empty() && due == ~u_int64_t{})
+      return -1;
+    u_int64_t now = now_ns();
+    u_int64_t wait = ~u_int64_t{};
+    if (due != ~u_int64_t{})
+      wait = due > now ? (due - now + 999999) / 1000000 : 0;
+    if (!wheel.empty()) {
+      u_int64_t next = wheel.next_tick();
+      u_int64_t ms = now / 1000000;
+      wait = std::min(wait, next > ms ? next - ms : 0);
+    }
+    return static_cast<int>(wait);
+  }
+
+  /**
+   * @fn run_once
+   * @brief waits once and handles what woke the loop. on_key(session_t &,
+   * const key_event_t &) is called for every keystroke, on_text(session_t
+   * &, const char *, std::size_t) for the runs of a paste, on_closed(
+   * session_t &) for a session whose fd reached its end, after it was
+   * removed. Returns false once stop() was called.
+   */
+  template <typename K, typename T, typename C>
+  bool run_once(K &&on_key, T &&on_text, C &&on_closed) {
+    struct epoll_event events[max_events];
+    int timeout = timeout_ms();
+    int n = epoll_wait(epfd, events, max_events, timeout);
+    if (n < 0 && errno != EINTR)
+      return false;
+    counts.wakeups++;
+    if (n > 0)
+      counts.input++;
+    else if (n == 0 && timeout >= 0)
+      counts.timers++;
+    else
+      counts.spurious++;
+
+    session_t *current = {};
+    auto key = [&](const key_event_t &e) {
+      on_key(*current, e);
+      changed(*current);
+    };
+    auto text = [&](const char *p, std::size_t len) {
+      on_text(*current, p, len);
+      changed(*current);
+    };
+    wheel.advance(now_ms(), [&](wheel_timer_t &timer) {
+      current = static_cast<session_t *>(timer.context);
+      if (timer.kind == session_t::escape_timeout) {
+        current->escape_expired(key);
+      } else if (timer.kind == session_t::resume_timeout) {
+        resume(*current);
+      } else if (timer.kind == session_t::paste_timeout) {
+        current->paste().idle(now_ns() / 1000);
+        current->arm_paste_timer(wheel, paste_wait_ms(*current));
+      }
+    });
+
+    bool bstop = {};
+    for (int i = 0; i < n; i++) {
+      current = static_cast<session_t *>(events[i].data.ptr);
+      if (!current) {
+        bstop = true;
+        continue;
+      }
+      // a deferred session is only reported when its fd hung up, what is
+      // left is read without a budget so it closes.
+      bool bhangup = current->deferred();
+      if (bhangup)
+        resume(*current);
+      u_int64_t now = now_ns();
+      token_bucket_t &bytes = current->byte_budget();
+      token_bucket_t &keys = current->event_budget();
+      std::size_t limit = session_t::input_capacity;
+      if (!bhangup)
+        limit = static_cast<std::size_t>(std::min<u_int64_t>(
+            {limit, bytes.available(now), keys.available(now)}));
+      if (!limit) {
+        defer(*current, now);
+        continue;
+      }
+      u_int64_t decoded = {};
+      ssize_t got = current->read_input(
+          now / 1000,
+          [&](const key_event_t &e) {
+            decoded++;
+            key(e);
+          },
+          text, limit);
+      if (got > 0) {
+        current->arm_escape_timer(wheel, escape_wait_ms);
+        current->arm_paste_timer(wheel, paste_wait_ms(*current));
+        bytes.take(static_cast<u_int64_t>(got));
+        keys.take(decoded);
+        if (!bhangup && (!bytes.available(now) || !keys.available(now)))
+          defer(*current, now);
+      } else if (got == 0 || errno != EAGAIN) {
+        remove(*current);
+        on_closed(*current);
+      }
+    }
+    draw_ready();
+    return !bstop;
+  }
+
+  timer_wheel_t &timers() { return wheel; }
+  const loop_counters_t &counters() const { return counts; }
+
+private:
+  static constexpr int max_events = 64;
+
+  /** @brief what s shows changed, a frame is owed. */
+  void changed(session_t &s) {
+    if (!s.typeahead().dirty())
+      undrawn.push_back(&s);
+    s.typeahead().changed(now_ns());
+  }
+
+  /**
+   * @fn draw_ready
+   * @brief draws the sessions owing a frame that no input waits for, or
+   * whose frame was put off for long enough.
+   */
+  void draw_ready() {
+    std::size_t kept = {};
+    for (session_t *s : undrawn) {
+      typeahead_t &t = s->typeahead();
+      if (t.ready(s->input_pending(), now_ns())) {
+        s->render();
+        s->writer().flush();
+        t.drawn(now_ns());
+      } else {
+        undrawn[kept++] = s;
+      }
+    }
+    undrawn.resize(kept);
+  }
+
+  /**
+   * @fn defer
+   * @brief takes s out of the epoll set until its budgets are full.
+   */
+  void defer(session_t &s, u_int64_t now) {
+    u_int64_t wait = std::max(s.byte_budget().full_in_ns(now),
+                              s.event_budget().full_in_ns(now));
+    u_int64_t ticks = std::max<u_int64_t>((wait + 999999) / 1000000, 1);
+    struct epoll_event ev = {};
+    ev.events = 0;
+    ev.data.ptr = &s;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, s.fd(), &ev);
+    s.defer(wheel, wheel.now() + ticks);
+    counts.deferrals++;
+  }
+
+  /**
+   * @fn resume
+   * @brief puts s back in the epoll set, and the wait for the rest of an
+   * escape sequence that was cut off when it was deferred.
+   */
+  void resume(session_t &s) {
+    s.cancel_timers(wheel);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &s;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, s.fd(), &ev);
+    s.arm_escape_timer(wheel, escape_wait_ms);
+    s.arm_paste_timer(wheel, paste_wait_ms(s));
+    counts.resumes++;
+  }
+
+  /** @brief the ticks after which a paste nothing followed has ended. */
+  static u_int64_t paste_wait_ms(session_t &s) {
+    return s.paste().tuning.end_gap_us / 1000 + 1;
+  }
+
+  u_int64_t now_ns() const { return steady_now_ns() - start_ns; }
+  u_int64_t now_ms() const { return now_ns() / 1000000; }
+
+  u_int64_t start_ns = {};
+  int epfd = -1;
+  int stopfd = -1;
+  timer_wheel_t wheel;
+  std::vector<session_t *> undrawn = {};
+  loop_counters_t counts = {};
+};
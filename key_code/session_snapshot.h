@@ -0,0 +1,685 @@
+#pragma once
+
+#include "common.h"
+#include "memory_accounting.h"
+#include "screen.h"
+#include "scrollback.h"
+#include "session.h"
+#include "terminal_policy.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief a session snapshot file is made of 4 KB blocks. Blocks 0 and 1
+ * hold two superblocks, the newest valid one names the snapshot. The
+ * snapshot is an image of the session, read through a table that maps each
+ * of its blocks to a block of the file. A new snapshot writes the image
+ * blocks that are not in the file already, by content hash, then its table,
+ * syncs, and only then writes its superblock into the slot of the older
+ * one and syncs again. Blocks of the snapshot in use are never written
+ * over, so a crash at any point leaves the last complete snapshot.
+ *
+ * The image holds offsets from its own start, never pointers, so it reads
+ * the same wherever the file is mapped. Sections start on a block of their
+ * own, and the screen rows, the groups of hot scrollback lines and each
+ * compressed scrollback block are laid out so that what did not change
+ * hashes the same as before even when it moved. A rolling snapshot then
+ * writes about what changed since the last one.
+ */
+constexpr std::size_t snapshot_block_size = 4096;
+constexpr u_int64_t snapshot_magic = 0x544e534559454b31ull;
+constexpr u_int32_t snapshot_version = 1;
+/** @brief hot scrollback lines are grouped by line number, so a group
+ * stays as it was until a line is added to it or it is packed. */
+constexpr u_int64_t snapshot_hot_group = 64;
+
+/**
+ * @struct snapshot_cell_t
+ * @brief a cell as stored, fixed layout and no padding left undefined.
+ */
+struct snapshot_cell_t {
+  u_int32_t ch = {};
+  u_int16_t fg = {};
+  u_int16_t bg = {};
+  u_int8_t attrs = {};
+  u_int8_t reserved[3] = {};
+};
+
+/**
+ * @struct snapshot_header_t
+ * @brief the start of the image. Offsets are from the start of the image.
+ */
+struct snapshot_header_t {
+  u_int64_t magic = snapshot_magic;
+  u_int32_t version = snapshot_version;
+  u_int32_t policy = {};
+  int32_t rows = {};
+  int32_t columns = {};
+  int32_t caret_row = {};
+  int32_t caret_col = {};
+  u_int64_t screen_offset = {};
+  u_int64_t scrollback_first = {};
+  u_int64_t style_offset = {};
+  u_int32_t style_count = {};
+  u_int32_t block_count = {};
+  u_int64_t block_offset = {};
+  u_int32_t group_count = {};
+  u_int32_t hot_count = {};
+  u_int64_t group_offset = {};
+};
+
+/**
+ * @struct snapshot_block_entry_t
+ * @brief a compressed scrollback block, its data at data_offset.
+ */
+struct snapshot_block_entry_t {
+  u_int64_t first = {};
+  u_int32_t lines = {};
+  u_int32_t text_size = {};
+  u_int32_t size = {};
+  u_int32_t data_size = {};
+  u_int64_t data_offset = {};
+};
+
+/**
+ * @struct snapshot_group_entry_t
+ * @brief hot lines, each a cell count and that many cells, at offset.
+ */
+struct snapshot_group_entry_t {
+  u_int32_t lines = {};
+  u_int32_t reserved = {};
+  u_int64_t offset = {};
+};
+
+/**
+ * @struct snapshot_super_t
+ * @brief names the image, its size, and where its block table is. hash
+ * covers the fields before it.
+ */
+struct snapshot_super_t {
+  u_int64_t magic = snapshot_magic;
+  u_int64_t generation = {};
+  u_int64_t image_size = {};
+  u_int32_t table_block = {};
+  u_int32_t table_blocks = {};
+  u_int64_t table_hash = {};
+  u_int64_t hash = {};
+
+  u_int64_t compute_hash() const {
+    return block_hash(this, offsetof(snapshot_super_t, hash));
+  }
+};
+
+/**
+ * @struct snapshot_entry_t
+ * @brief where an image block is in the file and the hash of its bytes.
+ */
+struct snapshot_entry_t {
+  u_int32_t block = {};
+  u_int32_t reserved = {};
+  u_int64_t hash = {};
+};
+
+/**
+ * @class snapshot_image_t
+ * @brief the image being built, bytes appended and sections aligned to
+ * blocks.
+ */
+class snapshot_image_t {
+public:
+  std::vector<u_int8_t> bytes = {};
+
+  std::size_t offset() const { return bytes.size(); }
+
+  void align() {
+    bytes.resize((bytes.size() + snapshot_block_size - 1) /
+                 snapshot_block_size * snapshot_block_size);
+  }
+
+  std::size_t put(const void *data, std::size_t len) {
+    std::size_t at = bytes.size();
+    const u_int8_t *p = static_cast<const u_int8_t *>(data);
+    bytes.insert(bytes.end(), p, p + len);
+    return at;
+  }
+
+  template <typename T> std::size_t put(const T &value) {
+    return put(&value, sizeof(value));
+  }
+
+  template <typename T> T *at(std::size_t offset) {
+    return reinterpret_cast<T *>(bytes.data() + offset);
+  }
+};
+
+inline snapshot_cell_t snapshot_cell(const cell_t &cell) {
+  snapshot_cell_t c = {};
+  c.ch = cell.ch;
+  c.fg = cell.style.fg;
+  c.bg = cell.style.bg;
+  c.attrs = cell.style.attrs;
+  return c;
+}
+
+inline cell_t snapshot_cell(const snapshot_cell_t &c) {
+  cell_t cell = {};
+  cell.ch = c.ch;
+  cell.style.fg = c.fg;
+  cell.style.bg = c.bg;
+  cell.style.attrs = c.attrs;
+  return cell;
+}
+
+/**
+ * @fn snapshot_session
+ * @brief the image of a session: the decoder's policy, the screen and the
+ * caret, and the scrollback. A decoder that is part way into an escape
+ * sequence is saved without it, take snapshots between reads.
+ */
+inline void snapshot_session(const session_t &s, int caret_row,
+                             int caret_col, snapshot_image_t &image) {
+  const screen_grid_t &screen = s.screen();
+  const scrollback_t &scrollback = s.scrollback();
+  image.bytes.clear();
+  image.put(snapshot_header_t{});
+  image.align();
+
+  snapshot_header_t h = {};
+  h.policy = static_cast<u_int32_t>(s.policy());
+  h.rows = screen.rows();
+  h.columns = screen.columns();
+  h.caret_row = caret_row;
+  h.caret_col = caret_col;
+
+  h.screen_offset = image.offset();
+  for (int r = 0; r < screen.rows(); r++)
+    for (int c = 0; c < screen.columns(); c++)
+      image.put(snapshot_cell(screen.at(r, c)));
+  image.align();
+
+  // the directory, filled in once the data is placed.
+  h.scrollback_first = scrollback.first_line();
+  h.style_count = static_cast<u_int32_t>(scrollback.style_table().size());
+  h.style_offset = image.offset();
+  for (auto &style : scrollback.style_table())
+    image.put(snapshot_cell(cell_t{U' ', style}));
+  h.block_count = static_cast<u_int32_t>(scrollback.block_count());
+  h.block_offset = image.offset();
+  image.bytes.resize(image.offset() +
+                     h.block_count * sizeof(snapshot_block_entry_t));
+  u_int64_t hot_first = scrollback.end_line() - scrollback.hot_count();
+  h.hot_count = static_cast<u_int32_t>(scrollback.hot_count());
+  u_int64_t group_first = hot_first / snapshot_hot_group;
+  u_int64_t group_end =
+      (scrollback.end_line() + snapshot_hot_group - 1) / snapshot_hot_group;
+  h.group_count = static_cast<u_int32_t>(group_end - group_first);
+  h.group_offset = image.offset();
+  image.bytes.resize(image.offset() +
+                     h.group_count * sizeof(snapshot_group_entry_t));
+  image.align();
+
+  for (u_int32_t b = 0; b < h.block_count; b++) {
+    const scrollback_block_t &block = scrollback.block(b);
+    snapshot_block_entry_t e = {};
+    e.first = block.first;
+    e.lines = block.lines;
+    e.text_size = block.text_size;
+    e.size = block.size;
+    e.data_size = static_cast<u_int32_t>(block.data.size());
+    e.data_offset = image.put(block.data.data(), block.data.size());
+    image.align();
+    *image.at<snapshot_block_entry_t>(
+        h.block_offset + b * sizeof(snapshot_block_entry_t)) = e;
+  }
+
+  for (u_int32_t g = 0; g < h.group_count; g++) {
+    u_int64_t from = std::max((group_first + g) * snapshot_hot_group,
+                              hot_first);
+    u_int64_t to = std::min((group_first + g + 1) * snapshot_hot_group,
+                            scrollback.end_line());
+    snapshot_group_entry_t e = {};
+    e.lines = static_cast<u_int32_t>(to - from);
+    e.offset = image.offset();
+    for (u_int64_t l = from; l < to; l++) {
+      const std::vector<cell_t> &cells = scrollback.hot_line(l - hot_first);
+      image.put(static_cast<u_int32_t>(cells.size()));
+      for (auto &cell : cells)
+        image.put(snapshot_cell(cell));
+    }
+    image.align();
+    *image.at<snapshot_group_entry_t>(
+        h.group_offset + g * sizeof(snapshot_group_entry_t)) = e;
+  }
+
+  *image.at<snapshot_header_t>(0) = h;
+}
+
+/**
+ * @class snapshot_writer_t
+ * @brief writes rolling snapshots into a file. Opening a file that holds
+ * a snapshot carries on from it, its blocks are reused where the next
+ * image has the same ones. A block is found by its hash and read back to
+ * compare before it is reused, so a collision costs a block, not the
+ * snapshot.
+ */
+class snapshot_writer_t {
+public:
+  explicit snapshot_writer_t(const char *path) {
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+      return;
+    snapshot_super_t super = {};
+    if (!newest_super(super))
+      return;
+    generation = super.generation;
+    std::vector<snapshot_entry_t> table(super.image_size /
+                                        snapshot_block_size);
+    std::size_t len = table.size() * sizeof(snapshot_entry_t);
+    if (pread(fd, table.data(), len,
+              static_cast<off_t>(super.table_block) * snapshot_block_size) !=
+            static_cast<ssize_t>(len) ||
+        block_hash(table.data(), len) != super.table_hash)
+      return;
+    struct stat st = {};
+    fstat(fd, &st);
+    file_blocks = static_cast<u_int32_t>(
+        std::max<off_t>(st.st_size / snapshot_block_size, 2));
+    committed(table, super);
+  }
+
+  ~snapshot_writer_t() {
+    if (fd >= 0)
+      close(fd);
+  }
+
+  snapshot_writer_t(const snapshot_writer_t &) = delete;
+  snapshot_writer_t &operator=(const snapshot_writer_t &) = delete;
+
+  bool ok() const { return fd >= 0; }
+
+  /**
+   * @fn write
+   * @brief commits image as the next snapshot. Returns false when the
+   * file could not be written, the previous snapshot then stands.
+   */
+  bool write(const snapshot_image_t &image) {
+    if (fd < 0)
+      return false;
+    written_blocks = {};
+    std::size_t count = (image.bytes.size() + snapshot_block_size - 1) /
+                        snapshot_block_size;
+    std::vector<snapshot_entry_t> table(count);
+    std::unordered_map<u_int64_t, u_int32_t> fresh = {};
+    taken.assign(file_blocks, false);
+    for (auto &e : entries)
+      taken[e.second] = true;
+    for (u_int32_t b : table_blocks)
+      taken[b] = true;
+    cursor = 2;
+
+    std::vector<u_int8_t> block(snapshot_block_size);
+    for (std::size_t i = 0; i < count; i++) {
+      std::size_t at = i * snapshot_block_size;
+      std::size_t len = std::min(snapshot_block_size, image.bytes.size() - at);
+      memcpy(block.data(), image.bytes.data() + at, len);
+      memset(block.data() + len, 0, snapshot_block_size - len);
+      u_int64_t h = block_hash(block.data(), block.size());
+      table[i].hash = h;
+      auto old = entries.find(h);
+      auto now = fresh.find(h);
+      if (old != entries.end() && same(old->second, block)) {
+        table[i].block = old->second;
+      } else if (now != fresh.end() && same(now->second, block)) {
+        table[i].block = now->second;
+      } else {
+        table[i].block = allocate();
+        if (!put(table[i].block, block.data(), block.size()))
+          return false;
+        fresh.emplace(h, table[i].block);
+      }
+    }
+
+    std::size_t table_len = table.size() * sizeof(snapshot_entry_t);
+    u_int32_t table_count = static_cast<u_int32_t>(
+        (table_len + snapshot_block_size - 1) / snapshot_block_size);
+    // the table is written in one piece, into blocks that follow on.
+    u_int32_t table_at = file_blocks;
+    for (u_int32_t b = cursor; b + table_count <= file_blocks; b++) {
+      bool bfree = true;
+      for (u_int32_t k = 0; k < table_count && bfree; k++)
+        bfree = !taken[b + k];
+      if (bfree) {
+        table_at = b;
+        break;
+      }
+    }
+    std::vector<u_int8_t> table_bytes(table_count * snapshot_block_size);
+    memcpy(table_bytes.data(), table.data(), table_len);
+    if (!put(table_at, table_bytes.data(), table_bytes.size()))
+      return false;
+    file_blocks = std::max(file_blocks, table_at + table_count);
+    if (fdatasync(fd) != 0)
+      return false;
+
+    snapshot_super_t super = {};
+    super.generation = generation + 1;
+    super.image_size = count * snapshot_block_size;
+    super.table_block = table_at;
+    super.table_blocks = table_count;
+    super.table_hash = block_hash(table.data(), table_len);
+    super.hash = super.compute_hash();
+    std::vector<u_int8_t> super_block(snapshot_block_size);
+    memcpy(super_block.data(), &super, sizeof(super));
+    if (!put(super.generation % 2, super_block.data(), super_block.size()) ||
+        fdatasync(fd) != 0)
+      return false;
+    written_blocks--;
+
+    generation = super.generation;
+    committed(table, super);
+    return true;
+  }
+
+  u_int64_t last_generation() const { return generation; }
+  /** @brief image and table blocks the last write() put in the file. */
+  std::size_t last_written_blocks() const { return written_blocks; }
+  std::size_t file_size() const {
+    return static_cast<std::size_t>(file_blocks) * snapshot_block_size;
+  }
+
+private:
+  bool newest_super(snapshot_super_t &newest) {
+    bool bfound = {};
+    for (int slot = 0; slot < 2; slot++) {
+      snapshot_super_t super = {};
+      if (pread(fd, &super, sizeof(super),
+                static_cast<off_t>(slot) * snapshot_block_size) !=
+              sizeof(super) ||
+          super.magic != snapshot_magic || super.hash != super.compute_hash())
+        continue;
+      if (!bfound || super.generation > newest.generation)
+        newest = super;
+      bfound = true;
+    }
+    return bfound;
+  }
+
+  void committed(const std::vector<snapshot_entry_t> &table,
+                 const snapshot_super_t &super) {
+    entries.clear();
+    for (auto &e : table)
+      entries[e.hash] = e.block;
+    table_blocks.clear();
+    for (u_int32_t k = 0; k < super.table_blocks; k++)
+      table_blocks.push_back(super.table_block + k);
+  }
+
+  /** @brief a block neither the committed snapshot nor this one uses. */
+  u_int32_t allocate() {
+    while (cursor < file_blocks && taken[cursor])
+      cursor++;
+    if (cursor == file_blocks) {
+      file_blocks++;
+      taken.push_back(false);
+    }
+    taken[cursor] = true;
+    return cursor++;
+  }
+
+  /** @brief whether block of the file holds data, a block's worth. */
+  bool same(u_int32_t block, const std::vector<u_int8_t> &data) {
+    stored.resize(snapshot_block_size);
+    off_t at = static_cast<off_t>(block) * snapshot_block_size;
+    std::size_t got = {};
+    while (got < stored.size()) {
+      ssize_t n = pread(fd, stored.data() + got, stored.size() - got,
+                        at + static_cast<off_t>(got));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      got += n;
+    }
+    return memcmp(stored.data(), data.data(), stored.size()) == 0;
+  }
+
+  bool put(u_int32_t block, const void *data, std::size_t len) {
+    off_t at = static_cast<off_t>(block) * snapshot_block_size;
+    const char *p = static_cast<const char *>(data);
+    while (len) {
+      ssize_t n = pwrite(fd, p, len, at);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      p += n;
+      at += n;
+      len -= n;
+    }
+    written_blocks += (static_cast<std::size_t>(p - static_cast<const char *>(
+                                                        data)) +
+                       snapshot_block_size - 1) /
+                      snapshot_block_size;
+    return true;
+  }
+
+  int fd = -1;
+  u_int64_t generation = {};
+  u_int32_t file_blocks = 2;
+  std::unordered_map<u_int64_t, u_int32_t> entries = {};
+  std::vector<u_int32_t> table_blocks = {};
+  std::vector<bool> taken = {};
+  u_int32_t cursor = {};
+  std::size_t written_blocks = {};
+  std::vector<u_int8_t> stored = {};
+};
+
+/**
+ * @class snapshot_reader_t
+ * @brief maps a snapshot file and reads the newest complete snapshot in
+ * it. With bverify every image block is checked against its hash.
+ */
+class snapshot_reader_t {
+public:
+  bool open(const char *path, bool bverify = true) {
+    close_map();
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return false;
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 ||
+        st.st_size < static_cast<off_t>(2 * snapshot_block_size)) {
+      close(fd);
+      return false;
+    }
+    map_size = static_cast<std::size_t>(st.st_size);
+    void *p = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+      map_size = {};
+      return false;
+    }
+    map = static_cast<const u_int8_t *>(p);
+
+    bool bfound = {};
+    for (int slot = 0; slot < 2; slot++) {
+      snapshot_super_t s = {};
+      memcpy(&s, map + slot * snapshot_block_size, sizeof(s));
+      if (s.magic != snapshot_magic || s.hash != s.compute_hash())
+        continue;
+      std::size_t table_end =
+          (static_cast<std::size_t>(s.table_block) + s.table_blocks) *
+          snapshot_block_size;
+      std::size_t len =
+          s.image_size / snapshot_block_size * sizeof(snapshot_entry_t);
+      if (table_end > map_size ||
+          len > s.table_blocks * snapshot_block_size ||
+          block_hash(map + s.table_block * snapshot_block_size, len) !=
+              s.table_hash)
+        continue;
+      if (!bfound || s.generation > super.generation)
+        super = s;
+      bfound = true;
+    }
+    if (!bfound)
+      return close_map();
+
+    table.resize(super.image_size / snapshot_block_size);
+    memcpy(table.data(), map + super.table_block * snapshot_block_size,
+           table.size() * sizeof(snapshot_entry_t));
+    for (auto &e : table) {
+      if ((static_cast<std::size_t>(e.block) + 1) * snapshot_block_size >
+          map_size)
+        return close_map();
+      if (bverify && block_hash(map + e.block * snapshot_block_size,
+                               snapshot_block_size) != e.hash)
+        return close_map();
+    }
+    return true;
+  }
+
+  ~snapshot_reader_t() { close_map(); }
+
+  u_int64_t generation() const { return super.generation; }
+  std::size_t size() const { return super.image_size; }
+
+  /**
+   * @fn read
+   * @brief copies len bytes of the image from offset, gathered across the
+   * blocks they are in.
+   */
+  bool read(std::size_t offset, void *out, std::size_t len) const {
+    if (offset > size() || len > size() - offset)
+      return false;
+    u_int8_t *o = static_cast<u_int8_t *>(out);
+    while (len) {
+      std::size_t in = offset % snapshot_block_size;
+      std::size_t n = std::min(len, snapshot_block_size - in);
+      memcpy(o, map + table[offset / snapshot_block_size].block *
+                          snapshot_block_size + in, n);
+      o += n;
+      offset += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  template <typename T> bool get(std::size_t offset, T &value) const {
+    return read(offset, &value, sizeof(value));
+  }
+
+private:
+  bool close_map() {
+    if (map)
+      munmap(const_cast<u_int8_t *>(map), map_size);
+    map = {};
+    map_size = {};
+    table.clear();
+    return false;
+  }
+
+  const u_int8_t *map = {};
+  std::size_t map_size = {};
+  snapshot_super_t super = {};
+  std::vector<snapshot_entry_t> table = {};
+};
+
+/**
+ * @fn snapshot_read_header
+ * @brief the header, to make a session of the policy and size it had.
+ */
+inline bool snapshot_read_header(const snapshot_reader_t &reader,
+                                 snapshot_header_t &h) {
+  return reader.get(0, h) && h.magic == snapshot_magic &&
+         h.version == snapshot_version && h.rows > 0 && h.columns > 0;
+}
+
+/**
+ * @fn restore_session
+ * @brief puts the screen, the caret and the scrollback of the snapshot
+ * into s, which was made with the policy and size the header gives.
+ * Nothing is replayed, the scrollback blocks are taken as compressed.
+ */
+inline bool restore_session(const snapshot_reader_t &reader, session_t &s,
+                            int &caret_row, int &caret_col) {
+  snapshot_header_t h = {};
+  screen_grid_t &screen = s.screen();
+  if (!snapshot_read_header(reader, h) || h.rows != screen.rows() ||
+      h.columns != screen.columns())
+    return false;
+
+  std::vector<snapshot_cell_t> cells(static_cast<std::size_t>(h.rows) *
+                                     h.columns);
+  if (!reader.read(h.screen_offset, cells.data(),
+                   cells.size() * sizeof(snapshot_cell_t)))
+    return false;
+  for (int r = 0; r < h.rows; r++)
+    for (int c = 0; c < h.columns; c++)
+      screen.at(r, c) = snapshot_cell(cells[r * h.columns + c]);
+  caret_row = h.caret_row;
+  caret_col = h.caret_col;
+
+  memory_scope_t scope(s.account(), memory_subsystem_t::scrollback);
+  std::vector<style_t> styles(h.style_count);
+  for (u_int32_t i = 0; i < h.style_count; i++) {
+    snapshot_cell_t c = {};
+    if (!reader.get(h.style_offset + i * sizeof(c), c))
+      return false;
+    styles[i] = snapshot_cell(c).style;
+  }
+
+  std::deque<scrollback_block_t> blocks = {};
+  for (u_int32_t b = 0; b < h.block_count; b++) {
+    snapshot_block_entry_t e = {};
+    if (!reader.get(h.block_offset + b * sizeof(e), e))
+      return false;
+    scrollback_block_t block = {};
+    block.first = e.first;
+    block.lines = e.lines;
+    block.text_size = e.text_size;
+    block.size = e.size;
+    block.data.resize(e.data_size);
+    if (!reader.read(e.data_offset, block.data.data(), e.data_size))
+      return false;
+    blocks.push_back(std::move(block));
+  }
+
+  std::deque<std::vector<cell_t>> hot = {};
+  for (u_int32_t g = 0; g < h.group_count; g++) {
+    snapshot_group_entry_t e = {};
+    if (!reader.get(h.group_offset + g * sizeof(e), e))
+      return false;
+    std::size_t at = e.offset;
+    for (u_int32_t l = 0; l < e.lines; l++) {
+      u_int32_t count = {};
+      if (!reader.get(at, count) || count > (1u << 20))
+        return false;
+      at += sizeof(count);
+      cells.resize(count);
+      if (!reader.read(at, cells.data(), count * sizeof(snapshot_cell_t)))
+        return false;
+      at += count * sizeof(snapshot_cell_t);
+      std::vector<cell_t> line(count);
+      for (u_int32_t c = 0; c < count; c++)
+        line[c] = snapshot_cell(cells[c]);
+      hot.push_back(std::move(line));
+    }
+  }
+  if (hot.size() != h.hot_count)
+    return false;
+  s.restore_scrollback(h.scrollback_first, std::move(styles),
+                       std::move(blocks), std::move(hot));
+  return true;
+}
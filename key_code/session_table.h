@@ -0,0 +1,337 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * @class rcu_domain_t
+ * @brief epochs for lock free reading. A reader publishes the epoch it
+ * started in, in a slot of its thread, for as long as it reads. A writer
+ * takes an object out of reach, then retires it with the epoch of that
+ * moment. The object is freed once no reader is left that started at or
+ * before that epoch. Writers never wait for readers, what cannot be freed
+ * yet waits in the retired list for a later writer.
+ */
+class rcu_domain_t {
+public:
+  static constexpr std::size_t max_threads = 256;
+  static constexpr u_int64_t idle = ~u_int64_t{};
+
+  /** @brief a reader thread's slot, on a cache line of its own. */
+  struct alignas(64) slot_t {
+    std::atomic<u_int64_t> epoch{idle};
+    std::atomic<bool> bused{false};
+  };
+
+  /**
+   * @fn enter
+   * @brief begins a read section of the calling thread. Sections nest.
+   */
+  void enter() {
+    thread_t &t = self();
+    if (t.depth++ == 0)
+      slots[t.slot].epoch.store(global.load(), std::memory_order_seq_cst);
+  }
+
+  void leave() {
+    thread_t &t = self();
+    if (--t.depth == 0)
+      slots[t.slot].epoch.store(idle, std::memory_order_release);
+  }
+
+  /**
+   * @fn retire
+   * @brief frees p with deleter once the readers that may see it are gone.
+   * p must be out of reach of new readers already.
+   */
+  void retire(void *p, void (*deleter)(void *)) {
+    std::lock_guard<std::mutex> lock(mutex);
+    retired.push_back({global.fetch_add(1), p, deleter});
+    reclaim_locked();
+  }
+
+  /** @brief frees what no reader can see any more. */
+  void reclaim() {
+    std::lock_guard<std::mutex> lock(mutex);
+    reclaim_locked();
+  }
+
+  std::size_t pending() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return retired.size();
+  }
+
+private:
+  struct retired_t {
+    u_int64_t epoch;
+    void *p;
+    void (*deleter)(void *);
+  };
+
+  /** @brief the calling thread's slot, taken on its first read. */
+  struct thread_t {
+    rcu_domain_t *domain = {};
+    std::size_t slot = {};
+    int depth = {};
+
+    ~thread_t() {
+      if (domain)
+        domain->slots[slot].bused.store(false, std::memory_order_release);
+    }
+  };
+
+  thread_t &self() {
+    thread_local thread_t t;
+    if (!t.domain) {
+      for (std::size_t i = 0; i < max_threads; i++) {
+        bool bfree = false;
+        if (slots[i].bused.compare_exchange_strong(bfree, true)) {
+          t.domain = this;
+          t.slot = i;
+          return t;
+        }
+      }
+      throw std::runtime_error("Error more reader threads than rcu slots");
+    }
+    return t;
+  }
+
+  void reclaim_locked() {
+    u_int64_t oldest = idle;
+    for (auto &s : slots) {
+      u_int64_t e = s.epoch.load(std::memory_order_seq_cst);
+      if (e < oldest)
+        oldest = e;
+    }
+    std::size_t kept = {};
+    for (auto &r : retired) {
+      if (r.epoch < oldest)
+        r.deleter(r.p);
+      else
+        retired[kept++] = r;
+    }
+    retired.resize(kept);
+  }
+
+  slot_t slots[max_threads] = {};
+  std::atomic<u_int64_t> global{1};
+  mutable std::mutex mutex = {};
+  std::vector<retired_t> retired = {};
+};
+
+/**
+ * @fn rcu_domain
+ * @brief the process wide domain. A thread holds one slot in it however
+ * many tables it reads.
+ */
+inline rcu_domain_t &rcu_domain() {
+  static rcu_domain_t domain;
+  return domain;
+}
+
+/**
+ * @class rcu_read_t
+ * @brief a read section for the lifetime of the object. What a lookup
+ * returned stays valid until it ends.
+ */
+class rcu_read_t {
+public:
+  rcu_read_t() { rcu_domain().enter(); }
+  ~rcu_read_t() { rcu_domain().leave(); }
+  rcu_read_t(const rcu_read_t &) = delete;
+  rcu_read_t &operator=(const rcu_read_t &) = delete;
+};
+
+/**
+ * @class session_table_t
+ * @brief the sessions of a server by fd, for I/O workers to find the
+ * session of a descriptor that became ready. The fds are spread over
+ * shards, each an immutable open addressed array behind an atomic pointer.
+ * lookup() reads it without a lock or a write to shared memory, inside an
+ * rcu_read_t. insert() and remove() lock only their shard against other
+ * writers, copy the array with the change, publish the copy and retire the
+ * old array and a removed session to rcu_domain(), so a worker that is
+ * still using them is never held up nor left with freed memory.
+ */
+template <typename T> class session_table_t {
+public:
+  static constexpr std::size_t shard_count = 64;
+
+  session_table_t() = default;
+
+  ~session_table_t() {
+    for (auto &s : shards) {
+      array_t *a = s.array.load(std::memory_order_relaxed);
+      if (!a)
+        continue;
+      for (std::size_t i = 0; i < a->capacity; i++)
+        if (a->entries[i].fd >= 0)
+          delete a->entries[i].value;
+      delete a;
+    }
+  }
+
+  session_table_t(const session_table_t &) = delete;
+  session_table_t &operator=(const session_table_t &) = delete;
+
+  /**
+   * @fn lookup
+   * @brief the session of fd, nullptr when there is none. Call it within
+   * an rcu_read_t and use the session only within it.
+   */
+  T *lookup(int fd) const {
+    const array_t *a = shard(fd).array.load(std::memory_order_seq_cst);
+    if (!a)
+      return nullptr;
+    std::size_t mask = a->capacity - 1;
+    for (std::size_t i = hash(fd) & mask;; i = (i + 1) & mask) {
+      const entry_t &e = a->entries[i];
+      if (e.fd == fd)
+        return e.value;
+      if (e.fd < 0)
+        return nullptr;
+    }
+  }
+
+  /**
+   * @fn insert
+   * @brief adds the session of fd, replacing and retiring the one there
+   * was. Returns the session as stored.
+   */
+  T *insert(int fd, std::unique_ptr<T> value) {
+    shard_t &s = shard(fd);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const array_t *old = s.array.load(std::memory_order_relaxed);
+    T *replaced = {};
+    std::size_t count = old ? old->count + 1 : 1;
+    array_t *a = array_t::make(count);
+    if (old)
+      for (std::size_t i = 0; i < old->capacity; i++) {
+        const entry_t &e = old->entries[i];
+        if (e.fd == fd)
+          replaced = e.value;
+        else if (e.fd >= 0)
+          a->add(e.fd, e.value);
+      }
+    T *stored = value.release();
+    a->add(fd, stored);
+    publish(s, a, old, replaced);
+    size_.fetch_add(replaced ? 0 : 1, std::memory_order_relaxed);
+    return stored;
+  }
+
+  /**
+   * @fn remove
+   * @brief takes the session of fd out, it is freed when no worker can be
+   * using it. Returns false when there was none.
+   */
+  bool remove(int fd) {
+    shard_t &s = shard(fd);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const array_t *old = s.array.load(std::memory_order_relaxed);
+    if (!old)
+      return false;
+    T *removed = {};
+    array_t *a = array_t::make(old->count);
+    for (std::size_t i = 0; i < old->capacity; i++) {
+      const entry_t &e = old->entries[i];
+      if (e.fd == fd)
+        removed = e.value;
+      else if (e.fd >= 0)
+        a->add(e.fd, e.value);
+    }
+    if (!removed) {
+      delete a;
+      return false;
+    }
+    publish(s, a, old, removed);
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * @fn for_each
+   * @brief calls fn(fd, T &) for every session, within a read section.
+   */
+  template <typename F> void for_each(F &&fn) const {
+    rcu_read_t read;
+    for (auto &s : shards) {
+      const array_t *a = s.array.load(std::memory_order_seq_cst);
+      for (std::size_t i = 0; a && i < a->capacity; i++)
+        if (a->entries[i].fd >= 0)
+          fn(a->entries[i].fd, *a->entries[i].value);
+    }
+  }
+
+  std::size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+private:
+  struct entry_t {
+    int fd = -1;
+    T *value = {};
+  };
+
+  /** @brief a shard's sessions, never changed once published. */
+  struct array_t {
+    std::size_t capacity = {};
+    std::size_t count = {};
+    std::unique_ptr<entry_t[]> entries = {};
+
+    /** @brief room for count sessions at most half full. */
+    static array_t *make(std::size_t count) {
+      auto *a = new array_t;
+      a->capacity = 4;
+      while (a->capacity < count * 2)
+        a->capacity *= 2;
+      a->entries.reset(new entry_t[a->capacity]);
+      return a;
+    }
+
+    void add(int fd, T *value) {
+      std::size_t mask = capacity - 1;
+      std::size_t i = hash(fd) & mask;
+      while (entries[i].fd >= 0)
+        i = (i + 1) & mask;
+      entries[i] = {fd, value};
+      count++;
+    }
+  };
+
+  struct alignas(64) shard_t {
+    std::atomic<array_t *> array{nullptr};
+    std::mutex mutex = {};
+  };
+
+  /**
+   * @brief fds are small and dense, their low bits pick the shard and the
+   * rest are the slot, so the fds of a shard rarely collide.
+   */
+  static std::size_t hash(int fd) {
+    return static_cast<std::size_t>(fd) / shard_count;
+  }
+
+  shard_t &shard(int fd) {
+    return shards[static_cast<std::size_t>(fd) % shard_count];
+  }
+  const shard_t &shard(int fd) const {
+    return shards[static_cast<std::size_t>(fd) % shard_count];
+  }
+
+  void publish(shard_t &s, array_t *a, const array_t *old, T *gone) {
+    s.array.store(a, std::memory_order_seq_cst);
+    rcu_domain_t &domain = rcu_domain();
+    if (old)
+      domain.retire(const_cast<array_t *>(old),
+                    [](void *p) { delete static_cast<array_t *>(p); });
+    if (gone)
+      domain.retire(gone, [](void *p) { delete static_cast<T *>(p); });
+  }
+
+  shard_t shards[shard_count] = {};
+  std::atomic<std::size_t> size_{0};
+};
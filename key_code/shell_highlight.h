@@ -0,0 +1,334 @@
+#pragma once
+
+#include "screen.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * @enum shell_token_kind_t
+ * @brief what a piece of a shell command line is, for highlighting.
+ */
+enum class shell_token_kind_t : u_int8_t {
+  space,
+  command,
+  assignment,
+  argument,
+  option,
+  single_quoted,
+  double_quoted,
+  variable,
+  operator_,
+  comment
+};
+
+/**
+ * @struct shell_token_t
+ * @brief a token of the line. state is the lexer state where it starts,
+ * whether the next word is in command position.
+ */
+struct shell_token_t {
+  u_int32_t start = {};
+  u_int32_t length = {};
+  shell_token_kind_t kind = {};
+  u_int8_t state = {};
+
+  u_int32_t end() const { return start + length; }
+
+  bool operator==(const shell_token_t &o) const {
+    return start == o.start && length == o.length && kind == o.kind &&
+           state == o.state;
+  }
+};
+
+/**
+ * @struct style_span_t
+ * @brief length characters from start drawn in style.
+ */
+struct style_span_t {
+  u_int32_t start = {};
+  u_int32_t length = {};
+  style_t style = {};
+};
+
+/**
+ * @fn shell_token_style
+ * @brief the highlighting theme, 256 color palette indexes.
+ */
+inline style_t shell_token_style(shell_token_kind_t kind) {
+  style_t style = {};
+  switch (kind) {
+  case shell_token_kind_t::command:
+    style.fg = 33;
+    style.attrs = style_t::bold;
+    break;
+  case shell_token_kind_t::assignment:
+    style.fg = 81;
+    break;
+  case shell_token_kind_t::option:
+    style.fg = 179;
+    break;
+  case shell_token_kind_t::single_quoted:
+  case shell_token_kind_t::double_quoted:
+    style.fg = 114;
+    break;
+  case shell_token_kind_t::variable:
+    style.fg = 176;
+    break;
+  case shell_token_kind_t::operator_:
+    style.fg = 203;
+    break;
+  case shell_token_kind_t::comment:
+    style.fg = 244;
+    break;
+  default:
+    break;
+  }
+  return style;
+}
+
+/**
+ * @class shell_lexer_t
+ * @brief splits a shell command line into tokens. The only state carried
+ * from one token to the next is whether a command word is expected, so
+ * lexing can resume at any token start given the state recorded there.
+ * Quoted strings and comments that are not closed run to the end of the
+ * line.
+ */
+class shell_lexer_t {
+public:
+  static constexpr u_int8_t command_position = 1;
+
+  /**
+   * @fn next
+   * @brief the token at pos, which must be a token start, lexed with state.
+   * state is left as it is after the token.
+   */
+  static shell_token_t next(const char *line, std::size_t size,
+                            std::size_t pos, u_int8_t &state) {
+    shell_token_t t = {};
+    t.start = static_cast<u_int32_t>(pos);
+    t.state = state;
+    std::size_t i = pos;
+    char ch = line[i];
+
+    if (ch == ' ' || ch == '\t') {
+      while (i < size && (line[i] == ' ' || line[i] == '\t'))
+        i++;
+      t.kind = shell_token_kind_t::space;
+    } else if (ch == '#') {
+      i = size;
+      t.kind = shell_token_kind_t::comment;
+    } else if (is_operator(ch)) {
+      i++;
+      if (i < size && pairs(ch, line[i]))
+        i++;
+      t.kind = shell_token_kind_t::operator_;
+      // a redirection is followed by a file name, anything else by a
+      // command.
+      if (ch != '<' && ch != '>' && !(i - pos == 2 && line[i - 1] == '>'))
+        state = command_position;
+    } else if (ch == '\'') {
+      const char *close =
+          static_cast<const char *>(memchr(line + i + 1, '\'', size - i - 1));
+      i = close ? static_cast<std::size_t>(close - line) + 1 : size;
+      t.kind = shell_token_kind_t::single_quoted;
+      state = {};
+    } else if (ch == '"') {
+      for (i++; i < size && line[i] != '"'; i++)
+        if (line[i] == '\\' && i + 1 < size)
+          i++;
+      i = std::min(i + 1, size);
+      t.kind = shell_token_kind_t::double_quoted;
+      state = {};
+    } else if (ch == '$') {
+      i++;
+      if (i < size && line[i] == '{') {
+        while (i < size && line[i] != '}')
+          i++;
+        i = std::min(i + 1, size);
+      } else if (i < size && !is_name(line[i])) {
+        if (!is_delimiter(line[i]))
+          i++;
+      } else {
+        while (i < size && is_name(line[i]))
+          i++;
+      }
+      t.kind = shell_token_kind_t::variable;
+      state = {};
+    } else {
+      bool bassignment = {};
+      for (; i < size && !is_delimiter(line[i]); i++) {
+        if (line[i] == '\\' && i + 1 < size)
+          i++;
+        else if (line[i] == '=' && i > pos && !bassignment)
+          bassignment = true;
+      }
+      if (state & command_position) {
+        t.kind = bassignment ? shell_token_kind_t::assignment
+                             : shell_token_kind_t::command;
+        if (!bassignment)
+          state = {};
+      } else {
+        t.kind = ch == '-' ? shell_token_kind_t::option
+                           : shell_token_kind_t::argument;
+      }
+    }
+    t.length = static_cast<u_int32_t>(i - pos);
+    return t;
+  }
+
+  /**
+   * @fn lex
+   * @brief every token of the line, from the start.
+   */
+  static void lex(const std::string &line, std::vector<shell_token_t> &out) {
+    out.clear();
+    u_int8_t state = command_position;
+    for (std::size_t pos = 0; pos < line.size();) {
+      out.push_back(next(line.data(), line.size(), pos, state));
+      pos = out.back().end();
+    }
+  }
+
+private:
+  static bool is_operator(char ch) {
+    return ch == '|' || ch == '&' || ch == ';' || ch == '(' || ch == ')' ||
+           ch == '<' || ch == '>';
+  }
+
+  static bool pairs(char a, char b) {
+    return (a == b && a != '(' && a != ')') || (a == '>' && b == '&') ||
+           (a == '<' && b == '&') || (a == '&' && b == '>');
+  }
+
+  static bool is_delimiter(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\'' || ch == '"' || ch == '$' ||
+           is_operator(ch);
+  }
+
+  static bool is_name(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+           (ch >= '0' && ch <= '9') || ch == '_';
+  }
+};
+
+/**
+ * @class shell_highlighter_t
+ * @brief keeps the tokens of the line being edited up to date as it
+ * changes. An edit re-lexes from the start of the token before it and
+ * stops at the first token start past the edit where the lexer state is
+ * the one the previous run had there, the tokens from then on are the old
+ * ones moved by the length difference. A keystroke in a long line costs a
+ * few tokens of lexing rather than the line, unless it changes how the
+ * rest of the line reads, as an opening quote does.
+ */
+class shell_highlighter_t {
+public:
+  void assign(const std::string &_line) {
+    line = _line;
+    shell_lexer_t::lex(line, tokens);
+    relexed = line.size();
+  }
+
+  /**
+   * @fn edit
+   * @brief replaces erase bytes at pos with the len bytes of text.
+   */
+  void edit(std::size_t pos, std::size_t erase, const char *text,
+            std::size_t len) {
+    line.replace(pos, erase, text, len);
+    std::ptrdiff_t delta = static_cast<std::ptrdiff_t>(len) -
+                           static_cast<std::ptrdiff_t>(erase);
+
+    // the token holding the byte before the edit may grow into it.
+    std::size_t first = token_at(pos ? pos - 1 : 0);
+    std::size_t restart = first < tokens.size() ? tokens[first].start : 0;
+    u_int8_t state = first < tokens.size() ? tokens[first].state
+                                           : shell_lexer_t::command_position;
+
+    std::size_t old = first;
+    std::size_t edit_end = pos + erase;
+    relex.clear();
+    std::size_t at = restart;
+    while (at < line.size()) {
+      // where the old tokens are past the edit, a start that agrees on the
+      // state is where the two runs meet again.
+      while (old < tokens.size() &&
+             (tokens[old].start < edit_end ||
+              static_cast<std::ptrdiff_t>(tokens[old].start) + delta <
+                  static_cast<std::ptrdiff_t>(at)))
+        old++;
+      if (old < tokens.size() &&
+          static_cast<std::ptrdiff_t>(tokens[old].start) + delta ==
+              static_cast<std::ptrdiff_t>(at) &&
+          tokens[old].state == state)
+        break;
+      relex.push_back(shell_lexer_t::next(line.data(), line.size(), at,
+                                          state));
+      at = relex.back().end();
+    }
+    if (at >= line.size())
+      old = tokens.size();
+    relexed = at - restart;
+
+    for (std::size_t i = old; i < tokens.size(); i++)
+      tokens[i].start = static_cast<u_int32_t>(tokens[i].start + delta);
+    std::size_t keep = relex.size();
+    if (keep <= old - first) {
+      std::copy(relex.begin(), relex.end(), tokens.begin() + first);
+      tokens.erase(tokens.begin() + first + keep, tokens.begin() + old);
+    } else {
+      std::copy(relex.begin(), relex.begin() + (old - first),
+                tokens.begin() + first);
+      tokens.insert(tokens.begin() + old, relex.begin() + (old - first),
+                    relex.end());
+    }
+  }
+
+  const std::string &text() const { return line; }
+  const std::vector<shell_token_t> &token_list() const { return tokens; }
+
+  /** @brief bytes the last edit lexed again. */
+  std::size_t last_relexed() const { return relexed; }
+
+  /**
+   * @fn spans
+   * @brief the style spans of the bytes from..to, what the renderer needs
+   * for the part of the line that is on screen. Spans in the default style
+   * are left out.
+   */
+  void spans(std::size_t from, std::size_t to,
+             std::vector<style_span_t> &out) const {
+    out.clear();
+    for (std::size_t i = token_at(from);
+         i < tokens.size() && tokens[i].start < to; i++) {
+      const shell_token_t &t = tokens[i];
+      style_t style = shell_token_style(t.kind);
+      if (style == style_t{})
+        continue;
+      u_int32_t start = std::max<u_int32_t>(t.start, from);
+      u_int32_t end = std::min<u_int32_t>(t.end(), to);
+      out.push_back({start, end - start, style});
+    }
+  }
+
+private:
+  /** @brief the index of the token holding pos. */
+  std::size_t token_at(std::size_t pos) const {
+    auto it = std::upper_bound(
+        tokens.begin(), tokens.end(), pos,
+        [](std::size_t p, const shell_token_t &t) { return p < t.start; });
+    return it == tokens.begin() ? 0
+                                : static_cast<std::size_t>(
+                                      it - tokens.begin() - 1);
+  }
+
+  std::string line = {};
+  std::vector<shell_token_t> tokens = {};
+  std::vector<shell_token_t> relex = {};
+  std::size_t relexed = {};
+};
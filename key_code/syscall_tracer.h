@@ -0,0 +1,231 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <map>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @struct pty_input_t
+ * @brief bytes the driver types into the terminal after waiting delay_ms.
+ */
+struct pty_input_t {
+  std::string bytes = {};
+  unsigned delay_ms = {};
+};
+
+/**
+ * @class syscall_tracer_t
+ * @brief runs a program on a pseudo terminal under ptrace and counts the
+ * system calls it makes, by name. The terminal ioctls are named by request,
+ * TCGETS for reading the termios settings and TCSETS for writing them,
+ * which glibc's tcsetattr follows with TCGETS of its own. A driver thread
+ * types the input into the terminal and reads everything the program
+ * writes back, so the program sees a terminal like any other.
+ *
+ * Counting starts at the exec of the program. Subtract the counts of a run
+ * with no input to leave those of the input alone.
+ */
+class syscall_tracer_t {
+public:
+  using counts_t = std::map<std::string, u_int64_t>;
+
+  /** @brief a run that has not ended by then is killed and fails. */
+  unsigned timeout_ms = 20000;
+
+  /**
+   * @fn run
+   * @brief runs path with argv and TERM set to term, typing input, and
+   * counts its system calls into counts. Returns false when the program
+   * could not be traced or did not end by itself.
+   */
+  bool run(const char *path, char *const argv[], const char *term,
+           const std::vector<pty_input_t> &input, counts_t &counts) {
+    counts.clear();
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+      if (master >= 0)
+        close(master);
+      return false;
+    }
+    struct winsize size = {};
+    size.ws_row = 24;
+    size.ws_col = 80;
+    ioctl(master, TIOCSWINSZ, &size);
+    const char *slave_name = ptsname(master);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+      setsid();
+      int slave = open(slave_name, O_RDWR);
+      if (slave < 0)
+        _exit(127);
+      ioctl(slave, TIOCSCTTY, 0);
+      dup2(slave, STDIN_FILENO);
+      dup2(slave, STDOUT_FILENO);
+      dup2(slave, STDERR_FILENO);
+      if (slave > STDERR_FILENO)
+        close(slave);
+      close(master);
+      setenv("TERM", term, 1);
+      if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) != 0)
+        _exit(126);
+      raise(SIGSTOP);
+      execv(path, argv);
+      _exit(127);
+    }
+    if (pid < 0) {
+      close(master);
+      return false;
+    }
+
+    int status = {};
+    if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) {
+      close(master);
+      return false;
+    }
+    ptrace(PTRACE_SETOPTIONS, pid, nullptr,
+           PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL);
+
+    std::atomic<bool> bdone = {};
+    std::atomic<bool> btimeout = {};
+    std::thread driver([&] { drive(master, pid, input, bdone, btimeout); });
+
+    bool bcounting = {};
+    bool bexited = {};
+    ptrace(PTRACE_SYSCALL, pid, nullptr, nullptr);
+    while (waitpid(pid, &status, 0) == pid) {
+      if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        bexited = WIFEXITED(status);
+        break;
+      }
+      int signal = {};
+      if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+        struct __ptrace_syscall_info info = {};
+        if (bcounting &&
+            ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) > 0 &&
+            info.op == PTRACE_SYSCALL_INFO_ENTRY)
+          counts[name(info.entry.nr, info.entry.args[1])]++;
+      } else if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_EXEC << 8))) {
+        bcounting = true;
+      } else if (WSTOPSIG(status) != SIGTRAP) {
+        signal = WSTOPSIG(status);
+      }
+      ptrace(PTRACE_SYSCALL, pid, nullptr, signal);
+    }
+
+    bdone = true;
+    driver.join();
+    close(master);
+    return bcounting && bexited && !btimeout;
+  }
+
+private:
+  /**
+   * @brief types the input and drains the output until the program ends.
+   */
+  void drive(int master, pid_t pid, const std::vector<pty_input_t> &input,
+             std::atomic<bool> &bdone, std::atomic<bool> &btimeout) {
+    using steady_t = std::chrono::steady_clock;
+    // a blocking write would stop the draining the program may wait on.
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    auto start = steady_t::now();
+    auto step_start = start;
+    std::size_t step = {};
+    std::size_t pos = {};
+    while (!bdone) {
+      auto now = steady_t::now();
+      bool bwriting = step < input.size() &&
+                      now - step_start >=
+                          std::chrono::milliseconds(input[step].delay_ms);
+      struct pollfd fd = {master, POLLIN, 0};
+      if (bwriting)
+        fd.events |= POLLOUT;
+      poll(&fd, 1, 1);
+      if (fd.revents & POLLIN) {
+        char buffer[4096];
+        if (read(master, buffer, sizeof(buffer)) <= 0)
+          usleep(1000);
+      }
+      if (bwriting && (fd.revents & POLLOUT)) {
+        const std::string &bytes = input[step].bytes;
+        ssize_t n = write(master, bytes.data() + pos, bytes.size() - pos);
+        if (n > 0)
+          pos += n;
+        if (pos == bytes.size()) {
+          step++;
+          pos = {};
+          step_start = steady_t::now();
+        }
+      }
+      if (!btimeout &&
+          now - start > std::chrono::milliseconds(timeout_ms)) {
+        btimeout = true;
+        kill(pid, SIGKILL);
+      }
+    }
+  }
+
+  static std::string name(u_int64_t nr, u_int64_t arg1) {
+    switch (nr) {
+    case SYS_read:
+      return "read";
+    case SYS_write:
+      return "write";
+    case SYS_ioctl:
+      if (arg1 == TCGETS)
+        return "ioctl TCGETS";
+      if (arg1 == TCSETS || arg1 == TCSETSW || arg1 == TCSETSF)
+        return "ioctl TCSETS";
+      if (arg1 == TIOCGWINSZ)
+        return "ioctl TIOCGWINSZ";
+      return "ioctl";
+#ifdef SYS_poll
+    case SYS_poll:
+      return "poll";
+#endif
+    case SYS_ppoll:
+      return "ppoll";
+#ifdef SYS_select
+    case SYS_select:
+      return "select";
+#endif
+    case SYS_pselect6:
+      return "pselect6";
+    case SYS_epoll_pwait:
+      return "epoll_pwait";
+    case SYS_nanosleep:
+      return "nanosleep";
+    case SYS_clock_nanosleep:
+      return "clock_nanosleep";
+    case SYS_futex:
+      return "futex";
+    case SYS_openat:
+      return "openat";
+    case SYS_close:
+      return "close";
+    case SYS_mmap:
+      return "mmap";
+    case SYS_munmap:
+      return "munmap";
+    case SYS_brk:
+      return "brk";
+    case SYS_exit_group:
+      return "exit_group";
+    }
+    return "syscall " + std::to_string(nr);
+  }
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "key_decoder.h"
+
+#include <vector>
+
+/**
+ * @struct corpus_key_t
+ * @brief one keystroke as a terminal sends it and the virtual key it should
+ * decode to.
+ */
+struct corpus_key_t {
+  vkey_t vk = {};
+  const char *seq = {};
+};
+
+/**
+ * @struct terminal_profile_t
+ * @brief the keys of a terminal in its default state. That is cursor keys in
+ * normal mode, keypad off and no modifiers, which is how the demo runs. term
+ * is the usual $TERM value.
+ */
+struct terminal_profile_t {
+  const char *name = {};
+  const char *term = {};
+  std::vector<corpus_key_t> keys = {};
+};
+
+/**
+ * @fn terminal_corpus
+ * @brief the key sequences of the terminals found within the fleet. This
+ * is a reconstructed corpus, not bytes captured from the terminals: the
+ * sequences come from each terminal's terminfo entry (infocmp kf1 - kf12,
+ * khome, kend, kcuu1 ...), taken in normal cursor mode, and the terminal's
+ * own documentation where it differs from terminfo, as for the kitty
+ * keyboard protocol. Terminals that share a key table keep a profile only
+ * when their $TERM differs, as that picks the policy. Add a profile here
+ * when a new terminal shows up so the conformance matrix covers it.
+ */
+inline const std::vector<terminal_profile_t> &terminal_corpus() {
+  // the keys most terminals agree upon.
+  auto common = [](std::vector<corpus_key_t> keys) {
+    std::vector<corpus_key_t> all = {
+        {vkey_t::F6, "\x1b[17~"},        {vkey_t::F7, "\x1b[18~"},
+        {vkey_t::F8, "\x1b[19~"},        {vkey_t::F9, "\x1b[20~"},
+        {vkey_t::F10, "\x1b[21~"},       {vkey_t::F11, "\x1b[23~"},
+        {vkey_t::F12, "\x1b[24~"},       {vkey_t::UP_ARROW, "\x1b[A"},
+        {vkey_t::DOWN_ARROW, "\x1b[B"},  {vkey_t::RIGHT_ARROW, "\x1b[C"},
+        {vkey_t::LEFT_ARROW, "\x1b[D"},  {vkey_t::PAGE_UP, "\x1b[5~"},
+        {vkey_t::PAGE_DOWN, "\x1b[6~"},  {vkey_t::INSERT, "\x1b[2~"},
+        {vkey_t::DELETE, "\x1b[3~"},     {vkey_t::BACKSPACE, "\x7f"},
+        {vkey_t::ENTER, "\r"},           {vkey_t::TAB, "\t"}};
+    all.insert(all.end(), keys.begin(), keys.end());
+    return all;
+  };
+
+  // F1 - F4 as SS3 with home and end as CSI H / F, the xterm way.
+  std::vector<corpus_key_t> xterm_keys = {
+      {vkey_t::F1, "\x1bOP"},   {vkey_t::F2, "\x1bOQ"},
+      {vkey_t::F3, "\x1bOR"},   {vkey_t::F4, "\x1bOS"},
+      {vkey_t::F5, "\x1b[15~"}, {vkey_t::HOME, "\x1b[H"},
+      {vkey_t::END, "\x1b[F"},  {vkey_t::ESC, "\x1b"}};
+
+  // F1 - F4 as SS3 with home and end as CSI 1 ~ / 4 ~, the vt220 way.
+  std::vector<corpus_key_t> vt220_keys = {
+      {vkey_t::F1, "\x1bOP"},    {vkey_t::F2, "\x1bOQ"},
+      {vkey_t::F3, "\x1bOR"},    {vkey_t::F4, "\x1bOS"},
+      {vkey_t::F5, "\x1b[15~"},  {vkey_t::HOME, "\x1b[1~"},
+      {vkey_t::END, "\x1b[4~"},  {vkey_t::ESC, "\x1b"}};
+
+  static const std::vector<terminal_profile_t> corpus = {
+      {"xterm", "xterm-256color", common(xterm_keys)},
+      {"linux VT", "linux",
+       common({{vkey_t::F1, "\x1b[[A"},
+               {vkey_t::F2, "\x1b[[B"},
+               {vkey_t::F3, "\x1b[[C"},
+               {vkey_t::F4, "\x1b[[D"},
+               {vkey_t::F5, "\x1b[[E"},
+               {vkey_t::HOME, "\x1b[1~"},
+               {vkey_t::END, "\x1b[4~"},
+               {vkey_t::ESC, "\x1b"}})},
+      {"rxvt", "rxvt-unicode-256color",
+       common({{vkey_t::F1, "\x1b[11~"},
+               {vkey_t::F2, "\x1b[12~"},
+               {vkey_t::F3, "\x1b[13~"},
+               {vkey_t::F4, "\x1b[14~"},
+               {vkey_t::F5, "\x1b[15~"},
+               {vkey_t::HOME, "\x1b[7~"},
+               {vkey_t::END, "\x1b[8~"},
+               {vkey_t::ESC, "\x1b"}})},
+      // with the keyboard protocol flag "disambiguate escape codes" set.
+      {"kitty", "xterm-kitty",
+       common({{vkey_t::F1, "\x1b[P"},
+               {vkey_t::F2, "\x1b[Q"},
+               {vkey_t::F3, "\x1b[13~"},
+               {vkey_t::F4, "\x1b[S"},
+               {vkey_t::F5, "\x1b[15~"},
+               {vkey_t::HOME, "\x1b[H"},
+               {vkey_t::END, "\x1b[F"},
+               {vkey_t::ESC, "\x1b[27u"}})},
+      {"alacritty", "alacritty", common(xterm_keys)},
+      {"foot", "foot", common(xterm_keys)},
+      {"tmux", "tmux-256color", common(vt220_keys)},
+      {"screen", "screen-256color", common(vt220_keys)}};
+  return corpus;
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include "key_decoder.h"
+
+#include <cstring>
+#include <variant>
+
+/**
+ * @class escape_policy_t
+ * @brief decodes the escape sequences with a switch on the final byte and
+ * the numeric parameter rather than a map lookup. LINUX adds the linux
+ * console ESC [ [ A - E function keys, KITTY the forms of the kitty keyboard
+ * protocol (ESC [ 27 u, ESC [ P ...). The terminal policies below are this
+ * class with the flags their terminal needs, so the branches for the other
+ * terminals are not compiled into their decode loop.
+ */
+template <bool LINUX, bool KITTY> class escape_policy_t {
+public:
+  static constexpr bool linux_function_keys = LINUX;
+
+  void fill_single_byte(vkey_t (&table)[256]) const {
+    table[0x7f] = vkey_t::BACKSPACE;
+    table['\n'] = vkey_t::ENTER;
+    table['\r'] = vkey_t::ENTER;
+    table['\t'] = vkey_t::TAB;
+  }
+
+  vkey_t lookup(const char *seq, std::size_t len) const {
+    if (len == 1)
+      return vkey_t::ESC;
+    if (len < 3)
+      return vkey_t::none;
+
+    char final = seq[len - 1];
+
+    // SS3, ESC O final.
+    if (seq[1] == 'O') {
+      if (len != 3)
+        return vkey_t::none;
+      switch (final) {
+      case 'P':
+      case 'Q':
+      case 'R':
+      case 'S':
+        return function_key(final - 'P');
+      case 'H':
+        return vkey_t::HOME;
+      case 'F':
+        return vkey_t::END;
+      default:
+        return cursor_key(final);
+      }
+    }
+
+    if (seq[1] != '[')
+      return vkey_t::none;
+
+    if (LINUX && len == 4 && seq[2] == '[')
+      return final >= 'A' && final <= 'E' ? function_key(final - 'A')
+                                           : vkey_t::none;
+
+    // CSI final without parameters.
+    if (len == 3) {
+      switch (final) {
+      case 'H':
+        return vkey_t::HOME;
+      case 'F':
+        return vkey_t::END;
+      case 'P':
+        return KITTY ? vkey_t::F1 : vkey_t::none;
+      case 'Q':
+        return KITTY ? vkey_t::F2 : vkey_t::none;
+      case 'S':
+        return KITTY ? vkey_t::F4 : vkey_t::none;
+      default:
+        return cursor_key(final);
+      }
+    }
+
+    // CSI number final.
+    unsigned number = {};
+    for (std::size_t i = 2; i < len - 1; i++) {
+      if (seq[i] < '0' || seq[i] > '9' || number > 99)
+        return vkey_t::none;
+      number = number * 10 + static_cast<unsigned>(seq[i] - '0');
+    }
+
+    if (KITTY && final == 'u')
+      return number == 27 ? vkey_t::ESC : vkey_t::none;
+    if (final != '~')
+      return vkey_t::none;
+
+    switch (number) {
+    case 1:
+    case 7:
+      return vkey_t::HOME;
+    case 2:
+      return vkey_t::INSERT;
+    case 3:
+      return vkey_t::DELETE;
+    case 4:
+    case 8:
+      return vkey_t::END;
+    case 5:
+      return vkey_t::PAGE_UP;
+    case 6:
+      return vkey_t::PAGE_DOWN;
+    case 11:
+    case 12:
+    case 13:
+    case 14:
+    case 15:
+      return function_key(number - 11);
+    case 17:
+    case 18:
+    case 19:
+    case 20:
+    case 21:
+      return function_key(number - 12);
+    case 23:
+    case 24:
+      return function_key(number - 13);
+    default:
+      return vkey_t::none;
+    }
+  }
+
+private:
+  static vkey_t function_key(unsigned n) {
+    return static_cast<vkey_t>(static_cast<unsigned>(vkey_t::F1) + n);
+  }
+
+  static vkey_t cursor_key(char final) {
+    switch (final) {
+    case 'A':
+      return vkey_t::UP_ARROW;
+    case 'B':
+      return vkey_t::DOWN_ARROW;
+    case 'C':
+      return vkey_t::RIGHT_ARROW;
+    case 'D':
+      return vkey_t::LEFT_ARROW;
+    default:
+      return vkey_t::none;
+    }
+  }
+};
+
+/**
+ * @brief the policies. xterm covers the terminals that follow it, which is
+ * also alacritty, foot, tmux, screen, rxvt and Windows Terminal.
+ */
+struct xterm_policy_t : escape_policy_t<false, false> {
+  static constexpr const char *name = "xterm";
+};
+
+struct linux_console_policy_t : escape_policy_t<true, false> {
+  static constexpr const char *name = "linux console";
+};
+
+struct kitty_policy_t : escape_policy_t<false, true> {
+  static constexpr const char *name = "kitty";
+};
+
+/**
+ * @enum terminal_policy_t
+ * @brief the policy set fixed at compile time. generic is the map policy
+ * used when the terminal could not be identified.
+ */
+enum class terminal_policy_t { generic, xterm, linux_console, kitty };
+
+/**
+ * @fn terminal_policy_from_term
+ * @brief picks the policy from the $TERM value.
+ */
+inline terminal_policy_t terminal_policy_from_term(const char *term) {
+  if (!term)
+    return terminal_policy_t::generic;
+
+  auto starts_with = [term](const char *prefix) {
+    return strncmp(term, prefix, strlen(prefix)) == 0;
+  };
+
+  if (strcmp(term, "xterm-kitty") == 0)
+    return terminal_policy_t::kitty;
+  if (strcmp(term, "linux") == 0)
+    return terminal_policy_t::linux_console;
+  if (starts_with("xterm") || starts_with("screen") || starts_with("tmux") ||
+      starts_with("rxvt") || starts_with("alacritty") ||
+      starts_with("foot") || starts_with("vt220"))
+    return terminal_policy_t::xterm;
+  return terminal_policy_t::generic;
+}
+
+/**
+ * @fn terminal_policy_from_reply
+ * @brief refines the policy from a reply to the queries the terminal was
+ * sent. A reply to the kitty keyboard protocol query, ESC [ ? flags u, means
+ * the protocol is there. The linux console answers device attributes (DA1)
+ * with ESC [ ? 6 c, where xterm like terminals report a higher level of
+ * ESC [ ? 6x ; ... c. Anything else leaves current as it is.
+ */
+inline terminal_policy_t terminal_policy_from_reply(const char *reply,
+                                                    std::size_t len,
+                                                    terminal_policy_t current) {
+  if (len < 4 || reply[0] != '\x1b' || reply[1] != '[' || reply[2] != '?')
+    return current;
+
+  char final = reply[len - 1];
+  if (final == 'u')
+    return terminal_policy_t::kitty;
+  if (final != 'c' || current == terminal_policy_t::kitty)
+    return current;
+  if (len == 5 && reply[3] == '6')
+    return terminal_policy_t::linux_console;
+  if (reply[3] == '6' && current == terminal_policy_t::generic)
+    return terminal_policy_t::xterm;
+  return current;
+}
+
+/**
+ * @fn terminal_policy_from_replies
+ * @brief the policy from everything read back after the queries, the
+ * replies one after the other, each starting with ESC. Any VT102 emulation
+ * answers ESC [ ? 6 c, so the linux console is only taken when no kitty
+ * reply came and $TERM, if set, is linux.
+ */
+inline terminal_policy_t
+terminal_policy_from_replies(const char *reply, std::size_t len,
+                             const char *term, terminal_policy_t current) {
+  terminal_policy_t policy = current;
+  bool bkitty = {};
+  std::size_t start = {};
+  for (std::size_t i = 1; i <= len; i++) {
+    if (i == len || reply[i] == '\x1b') {
+      policy = terminal_policy_from_reply(reply + start, i - start, policy);
+      bkitty |= policy == terminal_policy_t::kitty;
+      start = i;
+    }
+  }
+  if (policy == terminal_policy_t::linux_console &&
+      (bkitty || (term && *term && strcmp(term, "linux") != 0)))
+    return current;
+  return policy;
+}
+
+/**
+ * @class terminal_decoder_t
+ * @brief holds the decoder specialized for the policy chosen when the
+ * session starts. The choice is visited once for every block of input read,
+ * never per byte, so each session runs its own inlined decode loop.
+ */
+class terminal_decoder_t {
+public:
+  terminal_decoder_t(terminal_policy_t _policy = terminal_policy_t::generic)
+      : selected(_policy) {
+    switch (selected) {
+    case terminal_policy_t::generic:
+      break;
+    case terminal_policy_t::xterm:
+      decoder.emplace<basic_key_decoder_t<xterm_policy_t>>();
+      break;
+    case terminal_policy_t::linux_console:
+      decoder.emplace<basic_key_decoder_t<linux_console_policy_t>>();
+      break;
+    case terminal_policy_t::kitty:
+      decoder.emplace<basic_key_decoder_t<kitty_policy_t>>();
+      break;
+    }
+  }
+
+  terminal_policy_t policy() const { return selected; }
+
+  void set_osc_listener(osc_listener_t *listener) {
+    std::visit([&](auto &d) { d.set_osc_listener(listener); }, decoder);
+  }
+
+  bool escape_pending() const {
+    return std::visit([](auto &d) { return d.escape_pending(); }, decoder);
+  }
+
+  bool ground() const {
+    return std::visit([](auto &d) { return d.ground(); }, decoder);
+  }
+
+  template <typename F> void flush(F &&on_key) {
+    std::visit([&](auto &d) { d.flush(on_key); }, decoder);
+  }
+
+  template <typename F> void feed(const char *p, std::size_t len, F &&on_key) {
+    std::visit([&](auto &d) { d.feed(p, len, on_key); }, decoder);
+  }
+
+private:
+  terminal_policy_t selected = {};
+  std::variant<key_decoder_t, basic_key_decoder_t<xterm_policy_t>,
+               basic_key_decoder_t<linux_console_policy_t>,
+               basic_key_decoder_t<kitty_policy_t>>
+      decoder = {};
+};
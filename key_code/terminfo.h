@@ -0,0 +1,399 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <termios.h>
+#include <vector>
+
+/**
+ * @struct terminal_caps_t
+ * @brief the terminfo string capabilities used for output. An empty string
+ * means the terminal does not have it. Parameterized ones are expanded with
+ * terminfo_expand.
+ *
+ * onlcr is not from terminfo. It is set when output post processing turns
+ * NL into CR NL, as it does unless raw mode turned off OPOST, in which case
+ * a cud1 of "\n" also returns to the first column. load_terminal_caps
+ * reads it from the terminal's termios when given its fd.
+ */
+struct terminal_caps_t {
+  std::string name = {};
+  std::string cr = {};
+  std::string cup = {};
+  std::string home = {};
+  std::string cud1 = {};
+  std::string cuu1 = {};
+  std::string cuf1 = {};
+  std::string cub1 = {};
+  std::string cud = {};
+  std::string cuu = {};
+  std::string cuf = {};
+  std::string cub = {};
+  std::string hpa = {};
+  std::string vpa = {};
+  std::string el = {};
+  std::string clear = {};
+  std::string sgr0 = {};
+  bool onlcr = {};
+};
+
+/**
+ * @fn ansi_terminal_caps
+ * @brief the capabilities of xterm, used when there is no terminfo entry to
+ * be found.
+ */
+inline terminal_caps_t ansi_terminal_caps() {
+  terminal_caps_t caps = {};
+  caps.name = "ansi";
+  caps.cr = "\r";
+  caps.cup = "\x1b[%i%p1%d;%p2%dH";
+  caps.home = "\x1b[H";
+  caps.cud1 = "\n";
+  caps.cuu1 = "\x1b[A";
+  caps.cuf1 = "\x1b[C";
+  caps.cub1 = "\b";
+  caps.cud = "\x1b[%p1%dB";
+  caps.cuu = "\x1b[%p1%dA";
+  caps.cuf = "\x1b[%p1%dC";
+  caps.cub = "\x1b[%p1%dD";
+  caps.hpa = "\x1b[%i%p1%dG";
+  caps.vpa = "\x1b[%i%p1%dd";
+  caps.el = "\x1b[K";
+  caps.clear = "\x1b[H\x1b[2J";
+  caps.sgr0 = "\x1b[m";
+  return caps;
+}
+
+/**
+ * @fn read_terminfo_file
+ * @brief parses a compiled terminfo entry, see term(5). Only the string
+ * section of the standard capabilities is used, the extended section is
+ * ignored.
+ */
+inline bool read_terminfo_file(const std::string &path, terminal_caps_t &caps) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file)
+    return false;
+  std::vector<unsigned char> data = {};
+  unsigned char chunk[4096] = {};
+  std::size_t n = {};
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    data.insert(data.end(), chunk, chunk + n);
+  fclose(file);
+
+  auto word = [&](std::size_t pos) -> int {
+    if (pos + 2 > data.size())
+      return -1;
+    int v = data[pos] | (data[pos + 1] << 8);
+    return v >= 0x8000 ? v - 0x10000 : v;
+  };
+
+  // 0432 for 16 bit numbers, 01036 for 32 bit numbers.
+  int magic = word(0);
+  if (magic != 0432 && magic != 01036)
+    return false;
+  std::size_t number_size = magic == 0432 ? 2 : 4;
+  int names_size = word(2);
+  int bool_count = word(4);
+  int number_count = word(6);
+  int string_count = word(8);
+  int table_size = word(10);
+  if (names_size < 0 || bool_count < 0 || number_count < 0 ||
+      string_count < 0 || table_size < 0)
+    return false;
+
+  std::size_t pos = 12 + names_size + bool_count;
+  if (pos % 2)
+    pos++;
+  pos += number_count * number_size;
+  std::size_t offsets = pos;
+  std::size_t table = offsets + string_count * 2;
+  if (table + table_size > data.size())
+    return false;
+
+  auto string_cap = [&](int index) -> std::string {
+    if (index >= string_count)
+      return {};
+    int offset = word(offsets + index * 2);
+    if (offset < 0 || offset >= table_size)
+      return {};
+    const char *s = reinterpret_cast<const char *>(&data[table + offset]);
+    return std::string(s, strnlen(s, table_size - offset));
+  };
+
+  // the index of each capability within the string section, see term.h.
+  caps.cr = string_cap(2);
+  caps.clear = string_cap(5);
+  caps.el = string_cap(6);
+  caps.hpa = string_cap(8);
+  caps.cup = string_cap(10);
+  caps.cud1 = string_cap(11);
+  caps.home = string_cap(12);
+  caps.cub1 = string_cap(14);
+  caps.cuf1 = string_cap(17);
+  caps.cuu1 = string_cap(19);
+  caps.sgr0 = string_cap(39);
+  caps.cud = string_cap(107);
+  caps.cub = string_cap(111);
+  caps.cuf = string_cap(112);
+  caps.cuu = string_cap(114);
+  caps.vpa = string_cap(127);
+  return true;
+}
+
+/**
+ * @fn terminal_onlcr
+ * @brief true when output written to fd has NL turned into CR NL, false
+ * as well when fd is not a terminal.
+ */
+inline bool terminal_onlcr(int fd) {
+  struct termios t = {};
+  if (fd < 0 || tcgetattr(fd, &t) != 0)
+    return false;
+  return (t.c_oflag & OPOST) && (t.c_oflag & ONLCR);
+}
+
+/**
+ * @fn load_terminal_caps
+ * @brief finds the terminfo entry of term. This follows the ncurses search
+ * order, $TERMINFO, ${HOME}/.terminfo, /etc/terminfo, /lib/terminfo and
+ * last /usr/share/terminfo, with both the letter and the hex directory
+ * layouts. Without an entry the xterm capabilities are returned. onlcr is
+ * read from fd, the terminal the output goes to, when one is given. Load
+ * the caps after setting the terminal's mode.
+ */
+inline terminal_caps_t load_terminal_caps(const char *term, int fd = -1) {
+  terminal_caps_t caps = ansi_terminal_caps();
+  caps.onlcr = terminal_onlcr(fd);
+  if (!term || !*term || strchr(term, '/'))
+    return caps;
+
+  std::vector<std::string> dirs = {};
+  if (const char *env = getenv("TERMINFO"))
+    dirs.push_back(env);
+  if (const char *home = getenv("HOME"))
+    dirs.push_back(std::string(home) + "/.terminfo");
+  dirs.push_back("/etc/terminfo");
+  dirs.push_back("/lib/terminfo");
+  dirs.push_back("/usr/share/terminfo");
+
+  char hex[3] = {};
+  snprintf(hex, sizeof(hex), "%02x", static_cast<unsigned char>(term[0]));
+
+  for (auto &dir : dirs) {
+    for (auto sub : {std::string(1, term[0]), std::string(hex)}) {
+      terminal_caps_t found = {};
+      if (read_terminfo_file(dir + "/" + sub + "/" + term, found)) {
+        found.name = term;
+        found.onlcr = caps.onlcr;
+        return found;
+      }
+    }
+  }
+  return caps;
+}
+
+/**
+ * @fn terminfo_expand
+ * @brief expands a parameterized capability such as cup into out, which
+ * must hold 64 bytes, returning the length. This is the part of tparm(3)
+ * that cursor movement strings use: %p %i %d %c %{} %'' %+ %- %* %/ %m
+ * the logic and comparison operators, %P %g variables and %? %t %e %;
+ * conditionals. Padding, $<...>, is dropped.
+ */
+inline std::size_t terminfo_expand(const std::string &cap, char *out, int p1,
+                                   int p2 = 0) {
+  const std::size_t out_size = 64;
+  int params[9] = {p1, p2};
+  int vars[52] = {};
+  int stack[16] = {};
+  int depth = {};
+  std::size_t len = {};
+
+  auto push = [&](int v) {
+    if (depth < 16)
+      stack[depth++] = v;
+  };
+  auto pop = [&]() { return depth ? stack[--depth] : 0; };
+  auto put = [&](char c) {
+    if (len < out_size - 1)
+      out[len++] = c;
+  };
+
+  // skips forward to the matching %e (when else_ok) or %; of a condition.
+  auto skip = [&](std::size_t i, bool else_ok) {
+    int level = {};
+    for (; i + 1 < cap.size(); i++) {
+      if (cap[i] != '%')
+        continue;
+      char c = cap[++i];
+      if (c == '?')
+        level++;
+      else if (c == ';' && level-- == 0)
+        return i + 1;
+      else if (c == 'e' && else_ok && level == 0)
+        return i + 1;
+    }
+    return cap.size();
+  };
+
+  std::size_t i = {};
+  while (i < cap.size()) {
+    char c = cap[i++];
+    if (c == '$' && i < cap.size() && cap[i] == '<') {
+      while (i < cap.size() && cap[i] != '>')
+        i++;
+      i++;
+      continue;
+    }
+    if (c != '%' || i >= cap.size()) {
+      put(c);
+      continue;
+    }
+
+    c = cap[i++];
+    switch (c) {
+    case '%':
+      put('%');
+      break;
+    case 'i':
+      params[0]++;
+      params[1]++;
+      break;
+    case 'p':
+      if (i < cap.size() && cap[i] >= '1' && cap[i] <= '9')
+        push(params[cap[i++] - '1']);
+      break;
+    case 'P':
+    case 'g':
+      if (i < cap.size()) {
+        char name = cap[i++];
+        int index = name >= 'a' && name <= 'z'   ? name - 'a'
+                    : name >= 'A' && name <= 'Z' ? 26 + name - 'A'
+                                                 : -1;
+        if (index >= 0) {
+          if (c == 'P')
+            vars[index] = pop();
+          else
+            push(vars[index]);
+        }
+      }
+      break;
+    case '\'':
+      if (i < cap.size())
+        push(static_cast<unsigned char>(cap[i++]));
+      i++;
+      break;
+    case '{': {
+      int v = {};
+      while (i < cap.size() && cap[i] != '}')
+        v = v * 10 + (cap[i++] - '0');
+      i++;
+      push(v);
+    } break;
+    case 'c':
+      put(static_cast<char>(pop()));
+      break;
+    case 'l':
+      pop();
+      push(0);
+      break;
+    case '+':
+    case '-':
+    case '*':
+    case '/':
+    case 'm':
+    case '&':
+    case '|':
+    case '^':
+    case '=':
+    case '>':
+    case '<':
+    case 'A':
+    case 'O': {
+      int b = pop();
+      int a = pop();
+      switch (c) {
+      case '+':
+        push(a + b);
+        break;
+      case '-':
+        push(a - b);
+        break;
+      case '*':
+        push(a * b);
+        break;
+      case '/':
+        push(b ? a / b : 0);
+        break;
+      case 'm':
+        push(b ? a % b : 0);
+        break;
+      case '&':
+        push(a & b);
+        break;
+      case '|':
+        push(a | b);
+        break;
+      case '^':
+        push(a ^ b);
+        break;
+      case '=':
+        push(a == b);
+        break;
+      case '>':
+        push(a > b);
+        break;
+      case '<':
+        push(a < b);
+        break;
+      case 'A':
+        push(a && b);
+        break;
+      case 'O':
+        push(a || b);
+        break;
+      }
+    } break;
+    case '!':
+      push(!pop());
+      break;
+    case '~':
+      push(~pop());
+      break;
+    case '?':
+    case ';':
+      break;
+    case 't':
+      if (!pop())
+        i = skip(i, true);
+      break;
+    case 'e':
+      i = skip(i, false);
+      break;
+    default: {
+      // %[[:]flags][width[.precision]][doxXs]
+      std::string format = "%";
+      i--;
+      if (cap[i] == ':')
+        i++;
+      while (i < cap.size() && strchr("-+# .0123456789", cap[i]))
+        format += cap[i++];
+      if (i >= cap.size())
+        break;
+      char conversion = cap[i++];
+      if (!strchr("doxXs", conversion))
+        break;
+      format += conversion == 's' ? 'd' : conversion;
+      char number[32] = {};
+      int n = snprintf(number, sizeof(number), format.c_str(), pop());
+      for (int k = 0; k < n && k < static_cast<int>(sizeof(number)) - 1; k++)
+        put(number[k]);
+    } break;
+    }
+  }
+  out[len] = {};
+  return len;
+}
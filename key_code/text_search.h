@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <sys/types.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define TEXT_SEARCH_X86_SIMD 1
+#endif
+
+/**
+ * @enum text_search_impl_t
+ * @brief the substring search used by text_find and text_rfind. The
+ * default is chosen once from the cpu features, the others are there so
+ * the benchmark can compare them.
+ */
+enum class text_search_impl_t { scalar, sse2, avx2 };
+
+constexpr std::size_t text_npos = ~std::size_t{};
+
+/**
+ * @fn text_search_detect_impl
+ * @brief the widest search the processor supports.
+ */
+inline text_search_impl_t text_search_detect_impl() {
+#if TEXT_SEARCH_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return text_search_impl_t::avx2;
+  if (__builtin_cpu_supports("sse2"))
+    return text_search_impl_t::sse2;
+#endif
+  return text_search_impl_t::scalar;
+}
+
+inline text_search_impl_t text_search_default_impl() {
+  static const text_search_impl_t impl = text_search_detect_impl();
+  return impl;
+}
+
+/*
+ * @brief the vector searches compare the first and the last byte of the
+ * needle at every position of a block at once, the positions where both
+ * agree are checked in full. A block of positions p .. p + width - 1 reads
+ * the text up to p + width + n - 2, the positions too near the end for a
+ * whole block are left to the scalar loop.
+ */
+#if TEXT_SEARCH_X86_SIMD
+__attribute__((target("sse2"))) inline u_int32_t
+text_candidates_sse2(const char *p, std::size_t n, const char *needle) {
+  __m128i first = _mm_set1_epi8(needle[0]);
+  __m128i last = _mm_set1_epi8(needle[n - 1]);
+  __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + n - 1));
+  __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(a, first),
+                             _mm_cmpeq_epi8(b, last));
+  return static_cast<u_int32_t>(_mm_movemask_epi8(eq));
+}
+
+__attribute__((target("avx2"))) inline u_int32_t
+text_candidates_avx2(const char *p, std::size_t n, const char *needle) {
+  __m256i first = _mm256_set1_epi8(needle[0]);
+  __m256i last = _mm256_set1_epi8(needle[n - 1]);
+  __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  __m256i b =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + n - 1));
+  __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+                                _mm256_cmpeq_epi8(b, last));
+  return static_cast<u_int32_t>(_mm256_movemask_epi8(eq));
+}
+#endif
+
+inline u_int32_t text_candidates(text_search_impl_t impl, const char *p,
+                                 std::size_t n, const char *needle) {
+#if TEXT_SEARCH_X86_SIMD
+  if (impl == text_search_impl_t::avx2)
+    return text_candidates_avx2(p, n, needle);
+  return text_candidates_sse2(p, n, needle);
+#else
+  return 0;
+#endif
+}
+
+inline std::size_t text_search_width(text_search_impl_t impl) {
+  return impl == text_search_impl_t::avx2   ? 32
+         : impl == text_search_impl_t::sse2 ? 16
+                                            : 0;
+}
+
+/**
+ * @fn text_find
+ * @brief the first position at or after from where needle occurs in
+ * text, text_npos when it does not.
+ */
+inline std::size_t
+text_find(const char *text, std::size_t size, const char *needle,
+          std::size_t n, std::size_t from = 0,
+          text_search_impl_t impl = text_search_default_impl()) {
+  if (n == 0 || n > size || from > size - n)
+    return n == 0 && from <= size ? from : text_npos;
+  std::size_t count = size - n + 1;
+  std::size_t width = text_search_width(impl);
+  std::size_t p = from;
+  for (; width && p + width <= count; p += width) {
+    u_int32_t mask = text_candidates(impl, text + p, n, needle);
+    while (mask) {
+      std::size_t at = p + __builtin_ctz(mask);
+      if (memcmp(text + at + 1, needle + 1, n - 1) == 0)
+        return at;
+      mask &= mask - 1;
+    }
+  }
+  for (; p < count; p++)
+    if (text[p] == needle[0] && memcmp(text + p, needle, n) == 0)
+      return p;
+  return text_npos;
+}
+
+/**
+ * @fn text_rfind
+ * @brief the last position before until where needle occurs in text,
+ * text_npos when it does not. The text is searched from the end.
+ */
+inline std::size_t
+text_rfind(const char *text, std::size_t size, const char *needle,
+           std::size_t n, std::size_t until = text_npos,
+           text_search_impl_t impl = text_search_default_impl()) {
+  if (n == 0 || n > size)
+    return text_npos;
+  std::size_t count = size - n + 1;
+  if (until < count)
+    count = until;
+  std::size_t width = text_search_width(impl);
+  std::size_t p = count;
+  for (; width && p >= width; p -= width) {
+    u_int32_t mask = text_candidates(impl, text + p - width, n, needle);
+    while (mask) {
+      int bit = 31 - __builtin_clz(mask);
+      std::size_t at = p - width + bit;
+      if (memcmp(text + at + 1, needle + 1, n - 1) == 0)
+        return at;
+      mask &= ~(1u << bit);
+    }
+  }
+  while (p--)
+    if (text[p] == needle[0] && memcmp(text + p, needle, n) == 0)
+      return p;
+  return text_npos;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <sys/types.h>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @class thread_pool_t
+ * @brief a fixed set of threads that run the tasks of one job at a time.
+ * run() hands out the task indexes to the workers and to the calling
+ * thread, which counts as one of the threads, and returns when every task
+ * is done. Jobs are meant to be short, a frame's worth, so nothing is
+ * allocated per job. The task function must not throw.
+ */
+class thread_pool_t {
+public:
+  /** @brief threads includes the caller, 1 runs everything inline. */
+  explicit thread_pool_t(std::size_t threads) {
+    for (std::size_t i = 1; i < threads; i++)
+      workers.emplace_back([this] { work_loop(); });
+  }
+
+  ~thread_pool_t() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      bstop = true;
+    }
+    start.notify_all();
+    for (auto &w : workers)
+      w.join();
+  }
+
+  thread_pool_t(const thread_pool_t &) = delete;
+  thread_pool_t &operator=(const thread_pool_t &) = delete;
+
+  std::size_t size() const { return workers.size() + 1; }
+
+  /**
+   * @fn run
+   * @brief calls fn(i) for every i below tasks, spread over the threads.
+   */
+  template <typename F> void run(std::size_t tasks, F &&fn) {
+    using fn_t = std::remove_reference_t<F>;
+    if (workers.empty() || tasks < 2) {
+      for (std::size_t i = 0; i < tasks; i++)
+        fn(i);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job.context = const_cast<void *>(static_cast<const void *>(&fn));
+      job.call = [](void *context, std::size_t i) {
+        (*static_cast<fn_t *>(context))(i);
+      };
+      job.tasks = tasks;
+      next.store(0, std::memory_order_relaxed);
+      busy = workers.size();
+      generation++;
+    }
+    start.notify_all();
+    work();
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+  }
+
+private:
+  struct job_t {
+    void *context = {};
+    void (*call)(void *, std::size_t) = {};
+    std::size_t tasks = {};
+  };
+
+  void work() {
+    std::size_t i = {};
+    while ((i = next.fetch_add(1, std::memory_order_relaxed)) < job.tasks)
+      job.call(job.context, i);
+  }
+
+  void work_loop() {
+    u_int64_t seen = {};
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      start.wait(lock, [&] { return bstop || generation != seen; });
+      if (bstop)
+        return;
+      seen = generation;
+      lock.unlock();
+      work();
+      lock.lock();
+      if (--busy == 0)
+        done.notify_one();
+    }
+  }
+
+  std::vector<std::thread> workers = {};
+  std::mutex mutex = {};
+  std::condition_variable start = {};
+  std::condition_variable done = {};
+  job_t job = {};
+  std::atomic<std::size_t> next = {};
+  std::size_t busy = {};
+  u_int64_t generation = {};
+  bool bstop = {};
+};
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <cstddef>
+#include <sys/types.h>
+
+class timer_wheel_t;
+
+/**
+ * @struct wheel_link_t
+ * @brief the links of a timer within a slot of the wheel. Each slot is a
+ * circular list with a link of its own as the head, so a timer leaves its
+ * list without knowing where it is.
+ */
+struct wheel_link_t {
+  wheel_link_t *next = this;
+  wheel_link_t *prev = this;
+
+  bool linked() const { return next != this; }
+
+  void unlink() {
+    prev->next = next;
+    next->prev = prev;
+    next = prev = this;
+  }
+
+  void push_back(wheel_link_t &head) {
+    prev = head.prev;
+    next = &head;
+    head.prev->next = this;
+    head.prev = this;
+  }
+};
+
+/**
+ * @class wheel_timer_t
+ * @brief a deadline, kept by the session or whatever it belongs to and
+ * scheduled on a timer_wheel_t. context and kind tell the expiry callback
+ * what expired. A timer cancels itself when it is destroyed.
+ */
+class wheel_timer_t : private wheel_link_t {
+public:
+  void *context = {};
+  int kind = {};
+
+  wheel_timer_t() = default;
+  wheel_timer_t(void *_context, int _kind) : context(_context), kind(_kind) {}
+  ~wheel_timer_t();
+
+  wheel_timer_t(const wheel_timer_t &) = delete;
+  wheel_timer_t &operator=(const wheel_timer_t &) = delete;
+
+  bool scheduled() const { return linked(); }
+  u_int64_t expires() const { return expires_; }
+
+private:
+  friend class timer_wheel_t;
+
+  timer_wheel_t *wheel = {};
+  u_int64_t expires_ = {};
+  u_int16_t slot = {};
+};
+
+/**
+ * @class timer_wheel_t
+ * @brief the deadlines of one worker, in a hierarchical timing wheel.
+ * Time is counted in ticks, a millisecond in the event loop. Level 0 has a
+ * slot for each of the next 64 ticks, each level above has 64 slots of 64
+ * times the span of the level below. schedule() and cancel() are O(1).
+ * advance() runs the wheel up to now: when level 0 comes round, the next
+ * slot of level 1 is spread over level 0, and so on up, and the timers of
+ * every slot passed are expired as one batch. A timer fires at the tick it
+ * was scheduled for, one further away than the wheel spans waits in the
+ * top level until it comes in range.
+ */
+class timer_wheel_t {
+public:
+  static constexpr int slot_bits = 6;
+  static constexpr int slots = 1 << slot_bits;
+  static constexpr int levels = 4;
+  static constexpr u_int64_t span = u_int64_t{1} << (slot_bits * levels);
+
+  explicit timer_wheel_t(u_int64_t now = 0) : current(now) {}
+
+  ~timer_wheel_t() {
+    for (auto &head : wheel)
+      while (head.linked())
+        cancel(*static_cast<wheel_timer_t *>(head.next));
+  }
+
+  timer_wheel_t(const timer_wheel_t &) = delete;
+  timer_wheel_t &operator=(const timer_wheel_t &) = delete;
+
+  u_int64_t now() const { return current; }
+  std::size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  /**
+   * @fn schedule
+   * @brief sets the timer to expire at tick expires, moving it when it was
+   * scheduled already. A tick that passed already is taken as the next.
+   */
+  void schedule(wheel_timer_t &timer, u_int64_t expires) {
+    cancel(timer);
+    timer.wheel = this;
+    timer.expires_ = expires > current ? expires : current + 1;
+    place(timer);
+    count++;
+  }
+
+  void cancel(wheel_timer_t &timer) {
+    if (!timer.scheduled())
+      return;
+    timer.unlink();
+    int level = timer.slot / slots;
+    if (!wheel[timer.slot].linked())
+      occupied[level] &= ~(u_int64_t{1} << (timer.slot % slots));
+    timer.wheel = {};
+    count--;
+  }
+
+  /**
+   * @fn advance
+   * @brief runs the wheel up to tick now, calling on_expire(wheel_timer_t &)
+   * for every timer due. The timers of a tick are taken off the wheel
+   * before the first is called, so on_expire may schedule any timer again.
+   * Ticks with nothing in the wheel are passed over at once. Returns the
+   * number of timers expired.
+   */
+  template <typename F> std::size_t advance(u_int64_t now, F &&on_expire) {
+    std::size_t fired = {};
+    while (current < now) {
+      if (count == 0) {
+        current = now;
+        break;
+      }
+      if (!occupied[0] && (current + 1) % slots) {
+        // nothing in level 0 until it comes round.
+        u_int64_t skip = slots - current % slots - 1;
+        current += skip < now - current ? skip : now - current;
+        continue;
+      }
+      current++;
+      // level n comes round when every level below it did.
+      for (int level = 1; level < levels; level++) {
+        if ((current >> (slot_bits * (level - 1))) % slots)
+          break;
+        cascade(level, (current >> (slot_bits * level)) % slots);
+      }
+
+      int index = static_cast<int>(current % slots);
+      wheel_link_t &head = wheel[index];
+      if (!head.linked())
+        continue;
+      wheel_link_t batch;
+      batch.next = head.next;
+      batch.prev = head.prev;
+      batch.next->prev = &batch;
+      batch.prev->next = &batch;
+      head.next = head.prev = &head;
+      occupied[0] &= ~(u_int64_t{1} << index);
+      while (batch.linked()) {
+        auto *timer = static_cast<wheel_timer_t *>(batch.next);
+        timer->unlink();
+        timer->wheel = {};
+        count--;
+        fired++;
+        on_expire(*timer);
+      }
+    }
+    return fired;
+  }
+
+  /**
+   * @fn next_tick
+   * @brief a tick at or before the earliest deadline, for the event loop
+   * to sleep until. It is the deadline itself when that is in level 0,
+   * otherwise the tick a slot above is spread over the levels below. ~0
+   * when the wheel is empty.
+   */
+  u_int64_t next_tick() const {
+    u_int64_t next = ~u_int64_t{};
+    for (int level = 0; level < levels; level++) {
+      u_int64_t mask = occupied[level];
+      if (!mask)
+        continue;
+      int shift = slot_bits * level;
+      u_int64_t at = current >> shift;
+      int from = static_cast<int>((at + 1) % slots);
+      u_int64_t rotated = mask >> from | (from ? mask << (slots - from) : 0);
+      u_int64_t tick = (at + __builtin_ctzll(rotated) + 1) << shift;
+      if (tick < next)
+        next = tick;
+    }
+    return next;
+  }
+
+private:
+  /** @brief the slot for timer, relative to the current tick. */
+  void place(wheel_timer_t &timer) {
+    u_int64_t delta = timer.expires_ - current;
+    int level = {};
+    while (level < levels - 1 &&
+           delta >= (u_int64_t{1} << (slot_bits * (level + 1))))
+      level++;
+    u_int64_t at = timer.expires_;
+    if (delta >= span)
+      at = current + span - 1;
+    int index = static_cast<int>((at >> (slot_bits * level)) % slots);
+    timer.slot = static_cast<u_int16_t>(level * slots + index);
+    timer.push_back(wheel[timer.slot]);
+    occupied[level] |= u_int64_t{1} << index;
+  }
+
+  /** @brief moves the timers of a slot to the levels below. */
+  void cascade(int level, u_int64_t index) {
+    wheel_link_t &head = wheel[level * slots + index];
+    if (!head.linked())
+      return;
+    wheel_link_t moving;
+    moving.next = head.next;
+    moving.prev = head.prev;
+    moving.next->prev = &moving;
+    moving.prev->next = &moving;
+    head.next = head.prev = &head;
+    occupied[level] &= ~(u_int64_t{1} << index);
+    while (moving.linked()) {
+      auto *timer = static_cast<wheel_timer_t *>(moving.next);
+      timer->unlink();
+      place(*timer);
+    }
+  }
+
+  wheel_link_t wheel[levels * slots] = {};
+  u_int64_t occupied[levels] = {};
+  u_int64_t current = {};
+  std::size_t count = {};
+};
+
+inline wheel_timer_t::~wheel_timer_t() {
+  if (wheel)
+    wheel->cancel(*this);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <sys/types.h>
+
+/**
+ * @class token_bucket_t
+ * @brief a budget of burst tokens that refills at burst per period_ns,
+ * never past burst. Tokens are taken for what was spent, and a bucket
+ * that ran dry tells how long until it is full again. Refills are counted
+ * in whole tokens, the time of a part token is carried to the next. A
+ * bucket made without a burst is unlimited.
+ */
+class token_bucket_t {
+public:
+  token_bucket_t() = default;
+  token_bucket_t(u_int64_t _burst, u_int64_t _period_ns, u_int64_t now_ns)
+      : burst(_burst), period_ns(std::max<u_int64_t>(_period_ns, 1)),
+        tokens(_burst), last_ns(now_ns) {}
+
+  bool limited() const { return burst != 0; }
+
+  /**
+   * @fn available
+   * @brief the tokens at now_ns, ~0 when unlimited.
+   */
+  u_int64_t available(u_int64_t now_ns) {
+    if (!limited())
+      return ~u_int64_t{};
+    refill(now_ns);
+    return tokens;
+  }
+
+  /** @brief spends n tokens, as many as there are when n is more. */
+  void take(u_int64_t n) {
+    if (limited())
+      tokens -= std::min(n, tokens);
+  }
+
+  /**
+   * @fn full_in_ns
+   * @brief how long after now_ns the bucket is full again, 0 when it is.
+   */
+  u_int64_t full_in_ns(u_int64_t now_ns) {
+    if (!limited() || available(now_ns) == burst)
+      return 0;
+    double ns = static_cast<double>(burst - tokens) * period_ns / burst;
+    u_int64_t since = now_ns - last_ns;
+    u_int64_t need = static_cast<u_int64_t>(ns) + 1;
+    return need > since ? need - since : 0;
+  }
+
+private:
+  void refill(u_int64_t now_ns) {
+    if (now_ns <= last_ns)
+      return;
+    if (tokens == burst) {
+      last_ns = now_ns;
+      return;
+    }
+    double add = static_cast<double>(now_ns - last_ns) * burst / period_ns;
+    if (add >= static_cast<double>(burst - tokens)) {
+      tokens = burst;
+      last_ns = now_ns;
+    } else if (add >= 1) {
+      u_int64_t whole = static_cast<u_int64_t>(add);
+      tokens += whole;
+      last_ns += static_cast<u_int64_t>(static_cast<double>(whole) *
+                                        period_ns / burst);
+    }
+  }
+
+  u_int64_t burst = {};
+  u_int64_t period_ns = 1;
+  u_int64_t tokens = {};
+  u_int64_t last_ns = {};
+};
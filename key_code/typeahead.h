@@ -0,0 +1,86 @@
+#pragma once
+
+#include "latency_histogram.h"
+
+#include <poll.h>
+#include <sys/types.h>
+
+/**
+ * @fn input_pending
+ * @brief true when fd has bytes waiting to be read, found without reading
+ * or waiting.
+ */
+inline bool input_pending(int fd) {
+  struct pollfd p = {fd, POLLIN, 0};
+  return poll(&p, 1, 0) > 0 && (p.revents & POLLIN);
+}
+
+/**
+ * @class typeahead_t
+ * @brief puts off drawing while more input is waiting, as vim does with
+ * its typeahead check. A held cursor key or a replayed macro changes the
+ * screen once per key, but only the last state needs to reach the
+ * terminal. The event loop reports each change with changed(), and after
+ * handling what it read asks ready() whether to draw, telling it whether
+ * more input is pending. Drawing waits for the input to drain, at most
+ * max_stale_ns after the oldest change not yet drawn, so a stream that
+ * never stops still shows progress. Times are steady clock nanoseconds.
+ */
+class typeahead_t {
+public:
+  u_int64_t max_stale_ns = 50000000;
+
+  void changed(u_int64_t now_ns) {
+    if (!changes++)
+      oldest_ns = now_ns;
+  }
+
+  bool dirty() const { return changes != 0; }
+
+  /**
+   * @fn ready
+   * @brief whether to draw now. binput_pending is whether decoded events
+   * or readable bytes are waiting.
+   */
+  bool ready(bool binput_pending, u_int64_t now_ns) {
+    if (!changes)
+      return false;
+    if (!binput_pending)
+      return true;
+    if (now_ns - oldest_ns >= max_stale_ns) {
+      stale_frames++;
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @fn deadline
+   * @brief when a frame is due if input keeps coming, for the wait of the
+   * event loop. ~0 when nothing changed.
+   */
+  u_int64_t deadline() const {
+    return changes ? oldest_ns + max_stale_ns : ~u_int64_t{};
+  }
+
+  /** @brief a frame with every change so far was drawn at now_ns. */
+  void drawn(u_int64_t now_ns) {
+    if (!changes)
+      return;
+    frames++;
+    skipped += changes - 1;
+    to_frame.record(now_ns - oldest_ns);
+    changes = {};
+  }
+
+  /** @brief frames drawn, frames left out and frames the deadline forced. */
+  u_int64_t frames = {};
+  u_int64_t skipped = {};
+  u_int64_t stale_frames = {};
+  /** @brief from the oldest change a frame holds to the frame. */
+  latency_histogram_t to_frame = {};
+
+private:
+  u_int64_t changes = {};
+  u_int64_t oldest_ns = {};
+};
@@ -0,0 +1,499 @@
+#pragma once
+
+#include "key_decoder.h"
+#include "output_writer.h"
+#include "screen.h"
+#include "screen_renderer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @fn put_clipped
+ * @brief writes utf8 text at row r from column c, up to column end.
+ */
+inline void put_clipped(screen_grid_t &screen, int r, int c, int end,
+                        const std::string &text, const style_t &style) {
+  const unsigned char *p =
+      reinterpret_cast<const unsigned char *>(text.c_str());
+  while (*p && c < end && c < screen.columns()) {
+    char32_t ch = *p++;
+    int extra = ch >= 0xf0 ? 3 : ch >= 0xe0 ? 2 : ch >= 0xc0 ? 1 : 0;
+    if (extra)
+      ch &= 0x3f >> extra;
+    for (; extra && (*p & 0xc0) == 0x80; extra--)
+      ch = (ch << 6) | (*p++ & 0x3f);
+    screen.at(r, c).ch = ch;
+    screen.at(r, c).style = style;
+    c++;
+  }
+}
+
+/**
+ * @class widget_t
+ * @brief a node of a retained widget tree. A widget owns its children,
+ * keeps the rectangle layout() gave it and draws within it. When its state
+ * changes it calls invalidate(), which marks it dirty and its ancestors as
+ * having a dirty widget below, so the next update visits only the paths to
+ * dirty widgets. A dirty widget is drawn with everything below it, as its
+ * drawing may cover theirs. Siblings may overlap, the later on top, so a
+ * later sibling is drawn again where an earlier one was drawn over it.
+ * Layout is kept until invalidate_layout().
+ */
+class widget_t {
+public:
+  virtual ~widget_t() {}
+
+  /**
+   * @fn add
+   * @brief makes child the last child, drawn over the ones before.
+   */
+  template <typename W> W *add(std::unique_ptr<W> child) {
+    W *w = child.get();
+    w->parent_ = this;
+    children_.push_back(std::move(child));
+    invalidate_layout();
+    return w;
+  }
+
+  widget_t *parent() const { return parent_; }
+  const std::vector<std::unique_ptr<widget_t>> &children() const {
+    return children_;
+  }
+  const screen_rect_t &rect() const { return rect_; }
+
+  /** @brief whether key events may be routed to the widget. */
+  virtual bool focusable() const { return false; }
+
+  /**
+   * @fn on_key
+   * @brief a key routed to the widget, true when it was handled. Keys the
+   * focused widget leaves go to its parent, then the parent's parent.
+   */
+  virtual bool on_key(const key_event_t &) { return false; }
+
+  /**
+   * @fn caret
+   * @brief where the cursor goes while the widget has focus, false to
+   * leave it.
+   */
+  virtual bool caret(int &, int &) const { return false; }
+
+  /**
+   * @fn invalidate
+   * @brief the widget's state changed, it is drawn on the next update.
+   */
+  void invalidate() {
+    if (bdirty)
+      return;
+    bdirty = true;
+    for (widget_t *w = parent_; w && !w->bdirty_below; w = w->parent_)
+      w->bdirty_below = true;
+  }
+
+  /**
+   * @fn invalidate_layout
+   * @brief the children's rectangles must be worked out again, on the
+   * next update.
+   */
+  void invalidate_layout() {
+    for (widget_t *w = this; w && !w->blayout; w = w->parent_)
+      w->blayout = true;
+    invalidate();
+  }
+
+protected:
+  /**
+   * @fn arrange
+   * @brief gives each child its rectangle within rect(), with place().
+   * The default gives each child the whole of it.
+   */
+  virtual void arrange() {
+    for (auto &c : children_)
+      place(*c, rect_);
+  }
+
+  /**
+   * @fn draw
+   * @brief draws the widget, not its children, within rect().
+   */
+  virtual void draw(screen_grid_t &) {}
+
+  void place(widget_t &child, const screen_rect_t &area) {
+    if (child.rect_ != area) {
+      child.rect_ = area;
+      child.blayout = true;
+      child.invalidate();
+    }
+  }
+
+private:
+  friend class widget_tree_t;
+
+  void layout() {
+    if (!blayout)
+      return;
+    blayout = false;
+    arrange();
+    for (auto &c : children_)
+      c->layout();
+  }
+
+  /**
+   * @brief draws what is dirty at or below the widget, adding the
+   * rectangles drawn to regions. Returns the widgets drawn.
+   */
+  std::size_t update(screen_grid_t &screen,
+                     std::vector<screen_rect_t> &regions, bool bforce) {
+    std::size_t drawn = {};
+    bool bdraw = bforce || bdirty;
+    if (bdraw) {
+      draw(screen);
+      drawn++;
+      if (!bforce)
+        regions.push_back(rect_);
+    }
+    if (bdraw || bdirty_below) {
+      // what the earlier siblings drew this time, from first on.
+      std::size_t first = regions.size();
+      for (auto &c : children_) {
+        bool bover = {};
+        for (std::size_t i = first; !bdraw && !bover && i < regions.size();
+             i++)
+          bover = !regions[i].intersect(c->rect_).empty();
+        if (bover)
+          regions.push_back(c->rect_);
+        drawn += c->update(screen, regions, bdraw || bover);
+      }
+    }
+    bdirty = bdirty_below = false;
+    return drawn;
+  }
+
+  widget_t *parent_ = {};
+  std::vector<std::unique_ptr<widget_t>> children_ = {};
+  screen_rect_t rect_ = {};
+  bool bdirty = true;
+  bool bdirty_below = {};
+  bool blayout = true;
+};
+
+/**
+ * @class split_t
+ * @brief lays its children out in a row or a column. A child given a size
+ * gets that many cells, the others share what is left evenly.
+ */
+class split_t : public widget_t {
+public:
+  explicit split_t(bool _bvertical = true) : bvertical(_bvertical) {}
+
+  template <typename W> W *add(std::unique_ptr<W> child, int size = 0) {
+    sizes.push_back(size);
+    return widget_t::add(std::move(child));
+  }
+
+protected:
+  void arrange() override {
+    const screen_rect_t &r = rect();
+    int total = bvertical ? r.rows : r.columns;
+    int fixed = {};
+    int shared = {};
+    for (int s : sizes) {
+      fixed += s;
+      shared += s == 0;
+    }
+    int left = std::max(total - fixed, 0);
+    int at = bvertical ? r.row : r.col;
+    int n = {};
+    for (std::size_t i = 0; i < children().size(); i++) {
+      int size = sizes[i];
+      if (!size) {
+        size = left * (n + 1) / shared - left * n / shared;
+        n++;
+      }
+      place(*children()[i],
+            bvertical ? screen_rect_t{at, r.col, size, r.columns}
+                      : screen_rect_t{r.row, at, r.rows, size});
+      at += size;
+    }
+  }
+
+private:
+  bool bvertical = true;
+  std::vector<int> sizes = {};
+};
+
+/**
+ * @class panel_t
+ * @brief a box with a title around its children.
+ */
+class panel_t : public widget_t {
+public:
+  explicit panel_t(std::string _title, style_t _style = {})
+      : title(std::move(_title)), style(_style) {}
+
+protected:
+  void arrange() override {
+    const screen_rect_t &r = rect();
+    screen_rect_t inner = {r.row + 1, r.col + 1, std::max(r.rows - 2, 0),
+                           std::max(r.columns - 2, 0)};
+    for (auto &c : children())
+      place(*c, inner);
+  }
+
+  void draw(screen_grid_t &screen) override {
+    const screen_rect_t &r = rect();
+    if (r.rows < 2 || r.columns < 2)
+      return;
+    cell_t edge = {};
+    edge.style = style;
+    screen.fill(r, {});
+    edge.ch = U'─';
+    screen.fill({r.row, r.col, 1, r.columns}, edge);
+    screen.fill({r.row + r.rows - 1, r.col, 1, r.columns}, edge);
+    edge.ch = U'│';
+    screen.fill({r.row + 1, r.col, r.rows - 2, 1}, edge);
+    screen.fill({r.row + 1, r.col + r.columns - 1, r.rows - 2, 1}, edge);
+    int bottom = r.row + r.rows - 1;
+    int right = r.col + r.columns - 1;
+    screen.at(r.row, r.col).ch = U'┌';
+    screen.at(r.row, right).ch = U'┐';
+    screen.at(bottom, r.col).ch = U'└';
+    screen.at(bottom, right).ch = U'┘';
+    put_clipped(screen, r.row, r.col + 2, right - 1, title, style);
+  }
+
+private:
+  std::string title = {};
+  style_t style = {};
+};
+
+/**
+ * @class label_t
+ * @brief a line of text, redrawn when it is set to something else.
+ */
+class label_t : public widget_t {
+public:
+  explicit label_t(std::string _text = {}, style_t _style = {})
+      : text(std::move(_text)), style(_style) {}
+
+  void set(const std::string &_text, const style_t &_style) {
+    if (_text == text && _style == style)
+      return;
+    text = _text;
+    style = _style;
+    invalidate();
+  }
+  void set(const std::string &_text) { set(_text, style); }
+  const std::string &get() const { return text; }
+
+protected:
+  void draw(screen_grid_t &screen) override {
+    const screen_rect_t &r = rect();
+    if (r.empty())
+      return;
+    cell_t blank = {};
+    blank.style = style;
+    screen.fill(r, blank);
+    put_clipped(screen, r.row, r.col, r.col + r.columns, text, style);
+  }
+
+private:
+  std::string text = {};
+  style_t style = {};
+};
+
+/**
+ * @class field_t
+ * @brief a line of text to edit, with focus: characters are inserted at
+ * the caret, LEFT_ARROW, RIGHT_ARROW, HOME and END move it and BACKSPACE
+ * takes the character before it. ASCII only.
+ */
+class field_t : public widget_t {
+public:
+  bool focusable() const override { return true; }
+
+  bool on_key(const key_event_t &e) override {
+    switch (e.vk) {
+    case vkey_t::none:
+      if (static_cast<u_int8_t>(e.c) < 0x20 || e.c == 0x7f)
+        return false;
+      text.insert(at++, 1, e.c);
+      break;
+    case vkey_t::BACKSPACE:
+      if (!at)
+        return true;
+      text.erase(--at, 1);
+      break;
+    case vkey_t::LEFT_ARROW:
+      at -= at > 0;
+      break;
+    case vkey_t::RIGHT_ARROW:
+      at += at < text.size();
+      break;
+    case vkey_t::HOME:
+      at = 0;
+      break;
+    case vkey_t::END:
+      at = text.size();
+      break;
+    default:
+      return false;
+    }
+    invalidate();
+    return true;
+  }
+
+  bool caret(int &row, int &col) const override {
+    const screen_rect_t &r = rect();
+    if (r.empty())
+      return false;
+    row = r.row;
+    col = r.col + std::min<int>(static_cast<int>(at) - first(), r.columns - 1);
+    return true;
+  }
+
+  const std::string &get() const { return text; }
+
+protected:
+  void draw(screen_grid_t &screen) override {
+    const screen_rect_t &r = rect();
+    if (r.empty())
+      return;
+    style_t s = {};
+    s.attrs = style_t::underline;
+    cell_t blank = {};
+    blank.style = s;
+    screen.fill(r, blank);
+    put_clipped(screen, r.row, r.col, r.col + r.columns,
+                text.substr(first()), s);
+  }
+
+private:
+  /** @brief the first character shown, so the caret stays in view. */
+  int first() const {
+    int columns = rect().columns;
+    int a = static_cast<int>(at);
+    return a < columns ? 0 : a - columns + 1;
+  }
+
+  std::string text = {};
+  std::size_t at = {};
+};
+
+/**
+ * @class widget_tree_t
+ * @brief the root of a widget tree on a screen. Keys are routed to the
+ * focused widget and up through its parents, TAB moves the focus to the
+ * next focusable widget. render() lays out what changed, draws the dirty
+ * widgets and hands only their rectangles to the renderer, so an event
+ * costs what it changed, not the size of the screen.
+ */
+class widget_tree_t {
+public:
+  widget_tree_t(std::unique_ptr<widget_t> _root, int rows, int columns)
+      : root(std::move(_root)), screen(rows, columns) {
+    resize(rows, columns);
+  }
+
+  widget_t &top() { return *root; }
+  const screen_grid_t &grid() const { return screen; }
+
+  /**
+   * @fn resize
+   * @brief lays the tree out again and draws all of it.
+   */
+  void resize(int rows, int columns) {
+    screen.resize(rows, columns);
+    root->rect_ = {0, 0, rows, columns};
+    root->blayout = true;
+    root->bdirty = true;
+    bfull = true;
+  }
+
+  widget_t *focus() const { return focused; }
+
+  void set_focus(widget_t *w) { focused = w; }
+
+  /**
+   * @fn focus_next
+   * @brief the focus goes to the focusable widget after the focused one,
+   * in tree order, round to the first.
+   */
+  void focus_next() {
+    std::vector<widget_t *> order = {};
+    collect_focusable(*root, order);
+    if (order.empty())
+      return;
+    auto it = std::find(order.begin(), order.end(), focused);
+    focused = it == order.end() || ++it == order.end() ? order.front() : *it;
+  }
+
+  /**
+   * @fn dispatch
+   * @brief routes a key, true when a widget handled it.
+   */
+  bool dispatch(const key_event_t &e) {
+    for (widget_t *w = focused; w; w = w->parent())
+      if (w->on_key(e))
+        return true;
+    if (e.vk == vkey_t::TAB || (e.vk == vkey_t::none && e.c == '\t')) {
+      focus_next();
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @fn update
+   * @brief lays out and draws what changed into the grid. Returns the
+   * widgets drawn, regions holds the rectangles to render.
+   */
+  std::size_t update(std::vector<screen_rect_t> &regions) {
+    regions.clear();
+    root->layout();
+    std::size_t drawn = root->update(screen, regions, false);
+    if (bfull) {
+      regions.assign(1, {0, 0, screen.rows(), screen.columns()});
+      bfull = false;
+    }
+    return drawn;
+  }
+
+  /**
+   * @fn render
+   * @brief update() and renders the regions drawn, the cursor at the
+   * focused widget's caret. Returns the widgets drawn.
+   */
+  std::size_t render(screen_renderer_t &renderer, output_writer_t &out) {
+    std::size_t drawn = update(regions);
+    int row = -1;
+    int col = -1;
+    if (!focused || !focused->caret(row, col))
+      row = col = -1;
+    if (!regions.empty() || row != caret_row || col != caret_col)
+      renderer.render(screen, out, regions.data(), regions.size(), row, col);
+    caret_row = row;
+    caret_col = col;
+    return drawn;
+  }
+
+private:
+  static void collect_focusable(widget_t &w, std::vector<widget_t *> &out) {
+    if (w.focusable())
+      out.push_back(&w);
+    for (auto &c : w.children())
+      collect_focusable(*c, out);
+  }
+
+  std::unique_ptr<widget_t> root = {};
+  screen_grid_t screen = {};
+  widget_t *focused = {};
+  std::vector<screen_rect_t> regions = {};
+  int caret_row = -1;
+  int caret_col = -1;
+  bool bfull = true;
+};